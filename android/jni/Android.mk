@@ -86,6 +86,9 @@ CRENGINE_SRC_FILES := \
     ../../crengine/src/private/lvfontglyphcache.cpp \
     ../../crengine/src/private/lvfontboldtransform.cpp \
     ../../crengine/src/private/lvfontcache.cpp \
+    ../../crengine/src/private/lvfontscancache.cpp \
+    ../../crengine/src/private/lvfontcoverage.cpp \
+    ../../crengine/src/private/lvdocfontcache.cpp \
     ../../crengine/src/private/lvfontdef.cpp \
     ../../crengine/src/private/lvfreetypeface.cpp \
     ../../crengine/src/private/lvfreetypefontman.cpp \
@@ -20,6 +20,7 @@
 #include "../../crengine/include/crengine.h"
 #include "../../crengine/include/epubfmt.h"
 #include "../../crengine/include/pdbfmt.h"
+#include "../../crengine/include/crconcurrent.h"
 #include "../../crengine/include/lvstream.h"
 
 
@@ -108,24 +109,8 @@ public:
 
 static bool GetEPUBBookProperties(const char *name, LVStreamRef stream, BookProperties * pBookProps)
 {
-    LVContainerRef m_arc = LVOpenArchieve( stream );
-    if ( m_arc.isNull() )
-        return false; // not a ZIP archive
-
-    // check root media type
-    lString16 rootfilePath = EpubGetRootFilePath(m_arc);
-    if ( rootfilePath.empty() )
-    	return false;
-
-    lString16 codeBase;
-    codeBase=LVExtractPath(rootfilePath, false);
-
-    LVStreamRef content_stream = m_arc->OpenStream(rootfilePath.c_str(), LVOM_READ);
-    if ( content_stream.isNull() )
-        return false;
-
-    ldomDocument * doc = LVParseXMLStream( content_stream );
-    if ( !doc )
+    LVDocMetadata metadata;
+    if ( !GetEpubMetadata( stream, metadata ) )
         return false;
 
     time_t t = (time_t)time(0);
@@ -134,32 +119,15 @@ static bool GetEPUBBookProperties(const char *name, LVStreamRef stream, BookProp
         t = fs.st_mtime;
     }
 
-    lString16 author = doc->textFromXPath( lString16("package/metadata/creator")).trim();
-    lString16 title = doc->textFromXPath( lString16("package/metadata/title")).trim();
-    lString16 language = doc->textFromXPath( lString16("package/metadata/language")).trim();
-
-    pBookProps->author = author;
-    pBookProps->title = title;
-    pBookProps->language = language;
-
-    for ( int i=1; i<20; i++ ) {
-        ldomNode * item = doc->nodeFromXPath( lString16("package/metadata/meta[") << fmt::decimal(i) << "]" );
-        if ( !item )
-            break;
-        lString16 name = item->getAttributeValue("name");
-        lString16 content = item->getAttributeValue("content");
-        if (name == "calibre:series")
-        	pBookProps->series = content.trim();
-        else if (name == "calibre:series_index")
-        	pBookProps->seriesNumber = content.trim().atoi();
-    }
-
+    pBookProps->author = metadata.getAuthors( lString16("|"), false );
+    pBookProps->title = metadata.title;
+    pBookProps->language = metadata.language;
+    pBookProps->series = metadata.series;
+    pBookProps->seriesNumber = metadata.seriesNumber >= 0 ? metadata.seriesNumber : 0;
     pBookProps->filesize = (long)stream->GetSize();
     pBookProps->filename = lString16(name);
     pBookProps->filedate = getDateTimeString( t );
 
-    delete doc;
-
     return true;
 }
 
@@ -205,37 +173,15 @@ static bool GetBookProperties(const char *name,  BookProperties * pBookProps)
         t = fs.st_mtime;
     }
 
-    // read document
-#if COMPACT_DOM==1
-    ldomDocument doc(stream, 0);
-#else
-    ldomDocument doc;
-#endif
-    ldomDocumentWriter writer(&doc, true);
-    doc.setNodeTypes( fb2_elem_table );
-    doc.setAttributeTypes( fb2_attr_table );
-    doc.setNameSpaceTypes( fb2_ns_table );
-    LVXMLParser parser( stream, &writer );
-    CRLog::trace( "checking format..." );
-    if ( !parser.CheckFormat() ) {
-        return false;
-    }
-    CRLog::trace( "parsing..." );
-    if ( !parser.Parse() ) {
+    // read <description> only
+    LVDocMetadata metadata;
+    if ( !LVParseFB2Metadata( stream, metadata ) )
         return false;
-    }
-    CRLog::trace( "parsed" );
-    #if 0
-        char ofname[512];
-        sprintf(ofname, "%s.xml", name);
-        CRLog::trace("    writing to file %s", ofname);
-        LVStreamRef out = LVOpenFileStream(ofname, LVOM_WRITE);
-        doc.saveToStream(out, "utf16");
-    #endif
-    lString16 authors = extractDocAuthors( &doc, lString16("|"), false );
-    lString16 title = extractDocTitle( &doc );
-    lString16 language = extractDocLanguage( &doc );
-    lString16 series = extractDocSeries( &doc, &pBookProps->seriesNumber );
+    lString16 authors = metadata.getAuthors( lString16("|"), false );
+    lString16 title = metadata.title;
+    lString16 language = metadata.language;
+    lString16 series = metadata.series;
+    pBookProps->seriesNumber = metadata.seriesNumber >= 0 ? metadata.seriesNumber : 0;
 #if SERIES_IN_AUTHORS==1
     if ( !series.empty() )
         authors << "    " << series;
@@ -272,7 +218,9 @@ JNIEXPORT jboolean JNICALL Java_org_coolreader_crengine_Engine_scanBookPropertie
 
 	BookProperties props;
 	CRLog::debug("Looking for properties of file %s", LCSTR(filename));
+	CRTimerUtil timer;
 	bool res = GetBookProperties(LCSTR(filename),  &props);
+	CRLog::debug("Book properties scanned in %d ms", (int)timer.elapsed());
 	if ( !res )
 		return JNI_FALSE;
 	#define SET_STR_FLD(fldname,src) \
@@ -553,6 +501,10 @@ void cr3androidFatalErrorHandler(int errorCode, const char * errorText )
 /// set fatal error handler
 void crSetFatalErrorHandler( lv_FatalErrorHandler_t * handler );
 
+/// font file scan results are kept here, set with cache directory after fonts are registered,
+/// read when engine is initialized again
+static lString16 fontScanCacheFile;
+
 jboolean initInternal(JNIEnv * penv, jclass obj, jobjectArray fontArray, jint sdk_int) {
 
 	CRJNIEnv::sdk_int = sdk_int;
@@ -570,12 +522,17 @@ jboolean initInternal(JNIEnv * penv, jclass obj, jobjectArray fontArray, jint sd
 	CRLog::setLogLevel( CRLog::LL_TRACE );
 	CRLog::info("CREngine log redirected");
 	CRLog::info("CRENGINE version %s %s", CR_ENGINE_VERSION, CR_ENGINE_BUILD_DATE);
-	
+
+	// worker threads for cache writing, book format conversion and archive reading
+	CRSetupDefaultConcurrency();
+
 	CRLog::info("initializing hyphenation manager");
     HyphMan::initDictionaries(lString16::empty_str); //don't look for dictionaries
 	HyphMan::activateDictionary(lString16(HYPH_DICT_ID_NONE));
 	CRLog::info("creating font manager");
     InitFontManager(lString8::empty_str);
+	if ( !fontScanCacheFile.empty() )
+		fontMan->SetFontScanCacheFile(fontScanCacheFile);
 	CRLog::debug("converting fonts array: %d items", (int)env->GetArrayLength(fontArray));
 	lString16Collection fonts;
 	env.fromJavaStringArray(fontArray, fonts);
@@ -587,6 +544,7 @@ jboolean initInternal(JNIEnv * penv, jclass obj, jobjectArray fontArray, jint sd
 		if ( !fontMan->RegisterFont( fontName ) )
 			CRLog::error("cannot load font %s", fontName.c_str());
 	}
+	fontMan->SaveFontScanCache();
     CRLog::info("%d fonts registered", fontMan->GetFontCount());
 	return fontMan->GetFontCount() ? JNI_TRUE : JNI_FALSE;
 }
@@ -659,6 +617,16 @@ JNIEXPORT jboolean JNICALL Java_org_coolreader_crengine_Engine_setCacheDirectory
 	CRJNIEnv env(penv);
 	bool res = false;
 	COFFEE_TRY_JNI(penv, res = ldomDocCache::init(env.fromJavaString(dir), size ));
+	if ( res ) {
+		fontScanCacheFile = env.fromJavaString(dir);
+		LVAppendPathDelimiter(fontScanCacheFile);
+		fontScanCacheFile << "fontscan.cache";
+		// keep scan results of fonts registered by initInternal()
+		if ( fontMan ) {
+			fontMan->SetFontScanCacheFile(fontScanCacheFile);
+			fontMan->SaveFontScanCache();
+		}
+	}
 	return res ? JNI_TRUE : JNI_FALSE;
 }
 
@@ -201,7 +201,7 @@ bool getDirectoryFonts( lString16Collection & pathList, lString16Collection & ex
 }
 #endif
 
-bool InitCREngine( const char * exename, lString16Collection & fontDirs )
+bool InitCREngine( const char * exename, lString16Collection & fontDirs, lString16 cacheDir )
 {
     CRLog::trace("InitCREngine(%s)", exename);
     for ( int k=0; k<fontDirs.length(); k++ )
@@ -229,6 +229,10 @@ bool InitCREngine( const char * exename, lString16Collection & fontDirs )
     //const char * fontDir8s = fontDir8.c_str();
     //InitFontManager( fontDir8 );
     InitFontManager(lString8::empty_str);
+    if ( !cacheDir.empty() ) {
+        LVAppendPathDelimiter( cacheDir );
+        fontMan->SetFontScanCacheFile( cacheDir + "fontscan.cache" );
+    }
 
     // Load font definitions into font manager
     // fonts are in files font1.lbf, font2.lbf, ... font32.lbf
@@ -287,6 +291,7 @@ bool InitCREngine( const char * exename, lString16Collection & fontDirs )
                 fontMan->RegisterFont( lString8(fn) );
             }
     #endif
+        fontMan->SaveFontScanCache();
     }
 
     // init hyphenation manager
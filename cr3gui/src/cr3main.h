@@ -25,7 +25,8 @@ void ShutdownCREngine();
 bool getDirectoryFonts( lString16Collection & pathList, lString16 ext, lString16Collection & fonts, bool absPath );
 #endif
 
-bool InitCREngine( const char * exename, lString16Collection & fontPathList );
+/// cacheDir, if set, is where font file scan results are kept in between runs
+bool InitCREngine( const char * exename, lString16Collection & fontPathList, lString16 cacheDir = lString16::empty_str );
 
 void InitCREngineLog( const char * cfgfile );
 
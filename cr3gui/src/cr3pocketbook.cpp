@@ -2398,8 +2398,18 @@ int InitDoc(const char *exename, char *fileName)
     lString16Collection fontDirs;
     fontDirs.add(lString16(USERFONTDIR));
     fontDirs.add(lString16(SYSTEMFONTDIR));
+    lString16 cacheDir(STATEPATH"/cr3/.cache");
+    ldomDocCache::init(cacheDir, PB_CR3_CACHE_SIZE);
+    if (!ldomDocCache::enabled()) {
+        cacheDir = USERDATA2"/share/cr3/.cache";
+        ldomDocCache::init(cacheDir, PB_CR3_CACHE_SIZE);
+    }
+    if (!ldomDocCache::enabled()) {
+        cacheDir = USERDATA"/share/cr3/.cache";
+        ldomDocCache::init(cacheDir, PB_CR3_CACHE_SIZE);
+    }
     CRLog::info("INIT...");
-    if (!InitCREngine(exename, fontDirs))
+    if (!InitCREngine(exename, fontDirs, cacheDir))
         return 0;
 
     {
@@ -2420,11 +2430,6 @@ int InitDoc(const char *exename, char *fileName)
             if (!wm->loadSkin(lString16(USERDATA2"/share/cr3/skin")))
                 wm->loadSkin(lString16(USERDATA"/share/cr3/skin"));
 
-        ldomDocCache::init(lString16(STATEPATH"/cr3/.cache"), PB_CR3_CACHE_SIZE);
-        if (!ldomDocCache::enabled())
-            ldomDocCache::init(lString16(USERDATA2"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
-        if (!ldomDocCache::enabled())
-            ldomDocCache::init(lString16(USERDATA"/share/cr3/.cache"), PB_CR3_CACHE_SIZE);
         CRLog::trace("creating main window...");
         main_win = new CRPocketBookDocView(wm, lString16(USERDATA"/share/cr3"));
         CRLog::trace("setting colors...");
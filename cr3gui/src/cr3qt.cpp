@@ -6,6 +6,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <crengine.h>
+#include <crconcurrent.h>
 #include <crgui.h>
 #include <crtrace.h>
 #include <crtest.h>
@@ -97,6 +98,8 @@ class CRQtScreen : public CRGUIScreenBase
 
             _canvas = LVRef<LVDrawBuf>( createCanvas( _width, _height ) );
             _front = LVRef<LVDrawBuf>( createCanvas( _width, _height ) );
+            // widget repaint requests are cheap and coalesced by Qt
+            setMultiRectUpdateEnabled( true );
             printf("Created screen %d x %d, depth = %d\n", _width, _height, _bufDepth );
         }
 };
@@ -331,7 +334,14 @@ int main(int argc, char **argv)
     //fontDirs.add( lString16(L"/usr/share/fonts/truetype/liberation") );
     //fontDirs.add( lString16(L"/usr/share/fonts/truetype/freefont") );
     //fontDirs.add( lString16(L"/root/fonts/truetype") );
-    if ( !InitCREngine( argv[0], fontDirs ) ) {
+    // worker threads for cache writing, book format conversion and archive reading
+    CRSetupDefaultConcurrency();
+    lString16 cacheDir("/media/sd/.cr3/cache");
+    if ( !ldomDocCache::init( cacheDir, 0x100000 * 64 )) {
+        cacheDir = "/tmp/.cr3/cache";
+        ldomDocCache::init( cacheDir, 0x100000 * 64 ); /*64Mb*/
+    }
+    if ( !InitCREngine( argv[0], fontDirs, cacheDir ) ) {
         printf("Cannot init CREngine - exiting\n");
         return 2;
     }
@@ -364,8 +374,6 @@ int main(int argc, char **argv)
 #else
         CRQtWindowManager winman( 600, 800, bitDepth );
 #endif
-    if ( !ldomDocCache::init( lString16("/media/sd/.cr3/cache"), 0x100000 * 64 ))
-        ldomDocCache::init( lString16("/tmp/.cr3/cache"), 0x100000 * 64 ); /*64Mb*/
 
     {
 
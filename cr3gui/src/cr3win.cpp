@@ -395,7 +395,8 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 	lString16Collection fontDirs;
 	//fontDirs.add( fontdir );
     fontDirs.add( exedir + "fonts" );
-	InitCREngine( exe_fn, fontDirs );
+    ldomDocCache::init( exedir + "cache", 0x100000 * 96 ); /*96Mb*/
+	InitCREngine( exe_fn, fontDirs, exedir + "cache" );
     const char * fontnames[] = {
 #if 1
         "arial.ttf",
@@ -446,6 +447,7 @@ int APIENTRY WinMain(HINSTANCE hInstance,
     for ( int fi = 0; fontnames[fi]; fi++ ) {
         fontMan->RegisterFont( fontdir8 + fontnames[fi] );
     }
+    fontMan->SaveFontScanCache();
     //LVCHECKPOINT("WinMain start");
 
     if (!fontMan->GetFontCount())
@@ -479,8 +481,6 @@ int APIENTRY WinMain(HINSTANCE hInstance,
 		loadKeymaps( winman, keymap_locations );
 		
 
-        ldomDocCache::init( exedir + "cache", 0x100000 * 96 ); /*96Mb*/
-
         winman.loadSkin( LVExtractPath(LocalToUnicode(lString8(exe_fn))) + "skin" );
         V3DocViewWin * main_win = new V3DocViewWin( &winman, LVExtractPath(LocalToUnicode(lString8(exe_fn))) );
         main_win->getDocView()->setBackgroundColor(0xFFFFFF);
@@ -1355,7 +1355,12 @@ int main(int argc, char **argv)
     //fontDirs.add( lString16(L"/usr/share/fonts/truetype/liberation") );
     //fontDirs.add( lString16(L"/usr/share/fonts/truetype/freefont") );
     //fontDirs.add( lString16(L"/root/fonts/truetype") );
-    if ( !InitCREngine( argv[0], fontDirs ) ) {
+    lString16 cacheDir("/media/sd/.cr3/cache");
+    if ( !ldomDocCache::init( cacheDir, 0x100000 * 64 )) {
+        cacheDir = "/tmp/.cr3/cache";
+        ldomDocCache::init( cacheDir, 0x100000 * 64 ); /*64Mb*/
+    }
+    if ( !InitCREngine( argv[0], fontDirs, cacheDir ) ) {
         printf("Cannot init CREngine - exiting\n");
         return 2;
     }
@@ -1385,8 +1390,6 @@ int main(int argc, char **argv)
         CRXCBWindowManager winman( 600, 800 );
 
 #endif
-    if ( !ldomDocCache::init( lString16("/media/sd/.cr3/cache"), 0x100000 * 64 ))
-        ldomDocCache::init( lString16("/tmp/.cr3/cache"), 0x100000 * 64 ); /*64Mb*/
     if ( !winman.hasValidConnection() ) {
         CRLog::error("connection has an error! exiting.");
     } else {
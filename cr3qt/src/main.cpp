@@ -9,6 +9,7 @@
 #endif
 #include "../crengine/include/crengine.h"
 #include "../crengine/include/cr3version.h"
+#include "../crengine/include/crconcurrent.h"
 #include "mainwindow.h"
 #if QT_VERSION >= 0x050000
 #include <QtCore/QTranslator>
@@ -40,7 +41,7 @@ Q_IMPORT_PLUGIN(QCocoaIntegrationPlugin);
 
 // prototypes
 void InitCREngineLog( const char * cfgfile );
-bool InitCREngine( const char * exename, lString16Collection & fontDirs );
+bool InitCREngine( const char * exename, lString16Collection & fontDirs, lString16 cacheDir );
 void ShutdownCREngine();
 lString8 readFileToString( const char * fname );
 #if (USE_FREETYPE==1)
@@ -158,7 +159,8 @@ int main(int argc, char *argv[])
 #endif
         // TODO: use fontconfig instead
         //fontDirs.add( cs16("/root/fonts/truetype") );
-        if ( !InitCREngine( argv[0], fontDirs ) ) {
+        //~/.cr3/cache
+        if ( !InitCREngine( argv[0], fontDirs, homecr3 + "cache" ) ) {
             printf("Cannot init CREngine - exiting\n");
             return 2;
         }
@@ -329,9 +331,11 @@ bool getDirectoryFonts( lString16Collection & pathList, lString16Collection & ex
 }
 #endif
 
-bool InitCREngine( const char * exename, lString16Collection & fontDirs )
+bool InitCREngine( const char * exename, lString16Collection & fontDirs, lString16 cacheDir )
 {
 	CRLog::trace("InitCREngine(%s)", exename);
+    // worker threads for cache writing, book format conversion and archive reading
+    CRSetupDefaultConcurrency();
 #ifdef _WIN32
     lString16 appname( exename );
     int lastSlash=-1;
@@ -365,6 +369,10 @@ bool InitCREngine( const char * exename, lString16Collection & fontDirs )
     //const char * fontDir8s = fontDir8.c_str();
     //InitFontManager( fontDir8 );
     InitFontManager(lString8::empty_str);
+    // keep font file scan results in between runs
+    LVCreateDirectory( cacheDir );
+    LVAppendPathDelimiter( cacheDir );
+    fontMan->SetFontScanCacheFile( cacheDir + "fontscan.cache" );
 
 #if defined(_WIN32) && USE_FONTCONFIG!=1
     lChar16 sysdir[MAX_PATH+1];
@@ -443,6 +451,7 @@ bool InitCREngine( const char * exename, lString16Collection & fontDirs )
 	}
     //}
 #endif  // USE_FREETYPE==1
+    fontMan->SaveFontScanCache();
 
     // init hyphenation manager
     //char hyphfn[1024];
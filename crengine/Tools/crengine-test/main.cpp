@@ -0,0 +1,1138 @@
+// Engine regression checks: results of optimized code paths are compared with plain reference code,
+// with input data they were made of, or with results of the same operation done another way.
+// Prints OK or FAILED for each check, exit code is 1 if any check failed.
+// Usage: crengine-test [-f <font file>] <work dir>
+//   -f    also run checks which render documents, using this font
+//   work dir is created if necessary, caches and files written by checks are kept there
+
+#include "lvstring.h"
+#include "lvstream.h"
+#include "lvdocview.h"
+#include "lvfntman.h"
+#include "lvstsheet.h"
+#include "lvxml.h"
+#include "crconcurrent.h"
+#include "pdbfmt.h"
+#include "crtxtenc.h"
+#include "../render_bench/mobiwriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// not exported in crtxtenc.h
+void MakeCharStat(const unsigned char * buf, int buf_size, short stat_table[256], bool skipHtml);
+// not exported in lvtinydom.h
+bool ldomPack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dstsize );
+
+static int failedChecks = 0;
+
+static bool check( const char * name, bool ok )
+{
+    printf("%-60s %s\n", name, ok ? "OK" : "FAILED");
+    if ( !ok )
+        failedChecks++;
+    return ok;
+}
+
+// deterministic pseudo random numbers, so that failures are reproducible
+static lUInt32 randomSeed = 12345;
+
+static int rnd( int n )
+{
+    randomSeed = randomSeed * 1103515245 + 12345;
+    return (int)((randomSeed >> 8) % (lUInt32)n);
+}
+
+// engine's own std::thread based provider, to check code using worker threads
+static CRStdConcurrencyProvider testConcurrencyProvider;
+
+/// sets or clears worker threads provider
+static void useThreads( bool threaded )
+{
+    concurrencyProvider = threaded ? &testConcurrencyProvider : NULL;
+}
+
+static bool sameBuffers( LVDrawBuf & a, LVDrawBuf & b )
+{
+    if ( a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight() || a.GetRowSize() != b.GetRowSize() )
+        return false;
+    for ( int y=0; y<a.GetHeight(); y++ )
+        if ( memcmp( a.GetScanLine( y ), b.GetScanLine( y ), a.GetRowSize() ) )
+            return false;
+    return true;
+}
+
+// binary data is kept in arrays: strings stop at zero bytes
+static void readStream( LVStreamRef stream, LVArray<lUInt8> & data )
+{
+    data.clear();
+    // read in chunks like image decoders do
+    lUInt8 buf[4096];
+    lvsize_t bytesRead = 0;
+    while ( !stream.isNull() && stream->Read( buf, sizeof(buf), &bytesRead ) == LVERR_OK && bytesRead > 0 )
+        data.add( buf, (int)bytesRead );
+}
+
+static void readFile( const lString16 & fileName, LVArray<lUInt8> & data )
+{
+    readStream( LVOpenFileStream( fileName.c_str(), LVOM_READ ), data );
+}
+
+static bool sameBytes( LVArray<lUInt8> & a, const lUInt8 * b, int len )
+{
+    return a.length() == len && (!len || !memcmp( a.get(), b, len ));
+}
+
+// UTF-8 check as it was done byte by byte: last 5 bytes are not checked
+static bool refValidUtf8( const lUInt8 * buf, int size )
+{
+    int i = 0;
+    while ( i < size - 5 ) {
+        lUInt8 ch = buf[i++];
+        int n;
+        if ( (ch & 0x80) == 0 )
+            continue;
+        else if ( (ch & 0xE0) == 0xC0 )
+            n = 1;
+        else if ( (ch & 0xF0) == 0xE0 )
+            n = 2;
+        else if ( (ch & 0xF8) == 0xF0 )
+            n = 3;
+        else
+            return false;
+        for ( int k=0; k<n; k++ )
+            if ( (buf[i++] & 0xC0) != 0x80 )
+                return false;
+    }
+    return true;
+}
+
+static void checkMixedWidthNames()
+{
+    // names with chars above 127 given as 8 bit and wide strings
+    static const char * names[] = { "caf\xe9", "\xff", "x\x80y", "plain", NULL };
+    bool ok = true;
+    for ( int i=0; names[i]; i++ ) {
+        lString16 wide;
+        for ( const char * p = names[i]; *p; p++ )
+            wide << (lChar16)(lUInt8)*p;
+        ok = ok && calcStringHash( names[i] ) == calcStringHash( wide.c_str() )
+                && lStr_cmp( wide.c_str(), names[i] ) == 0 && lStr_cmp( names[i], wide.c_str() ) == 0;
+    }
+    ok = ok && lStr_cmp( L"\xe9", "e" ) > 0 && lStr_cmp( "e", L"\xe9" ) < 0;
+    check( "8 bit and wide names hash and compare the same", ok );
+}
+
+static void checkUtf8Validation()
+{
+    static const char * seqs[] = { "\xd0\x96", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xc3\xa9" };
+    LVArray<lUInt8> data( 512, 0 );
+    int mismatches = 0;
+    int valid = 0;
+    for ( int n=0; n<4000; n++ ) {
+        // misaligned starts, ASCII runs around 8 and 16 byte blocks
+        lUInt8 * buf = data.get() + rnd( 16 );
+        int size = rnd( 200 );
+        for ( int i=0; i<size; ) {
+            if ( rnd( 10 ) ) {
+                buf[i++] = (lUInt8)(32 + rnd( 95 ));
+                continue;
+            }
+            const char * seq = seqs[rnd( 4 )];
+            for ( int k=0; seq[k] && i<size; k++ )
+                buf[i++] = (lUInt8)seq[k];
+        }
+        if ( size && (n & 1) )
+            buf[rnd( size )] = (lUInt8)(0x80 + rnd( 128 ));
+        bool expected = refValidUtf8( buf, size );
+        if ( expected )
+            valid++;
+        if ( isValidUtf8Data( buf, size ) != expected )
+            mismatches++;
+    }
+    check( "UTF-8 validation matches byte by byte check", mismatches == 0 && valid > 0 && valid < 4000 );
+}
+
+// char statistics as they were made byte by byte
+static void refCharStat( const lUInt8 * buf, int size, short stat_table[256], bool skipHtml )
+{
+    int stat[256] = { 0 };
+    int total = 0;
+    bool insideTag = false;
+    for ( int i=0; i<size; i++ ) {
+        lUInt8 ch = buf[i];
+        if ( skipHtml ) {
+            if ( ch == '<' ) {
+                insideTag = true;
+                continue;
+            }
+            if ( ch == '>' ) {
+                insideTag = false;
+                continue;
+            }
+            if ( insideTag )
+                continue;
+        }
+        if ( ch > 127 || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '\'' ) {
+            stat[ch]++;
+            total++;
+        }
+    }
+    if ( total )
+        for ( int i=0; i<256; i++ )
+            stat_table[i] = (short)(stat[i] * (lInt64)0x7000 / total);
+}
+
+static void checkCharStat()
+{
+    LVArray<lUInt8> data( 4096, 0 );
+    int mismatches = 0;
+    for ( int n=0; n<1000; n++ ) {
+        int size = rnd( 4000 );
+        lUInt8 * buf = data.get();
+        for ( int i=0; i<size; i++ ) {
+            int r = rnd( 100 );
+            buf[i] = (lUInt8)(r < 3 ? '<' : r < 6 ? '>' : r < 40 ? 0x80 + rnd( 128 ) : r < 50 ? ' ' : 'a' + rnd( 26 ));
+        }
+        for ( int skip=0; skip<2; skip++ ) {
+            short stat[256];
+            short expected[256];
+            for ( int i=0; i<256; i++ )
+                stat[i] = expected[i] = (short)i;
+            MakeCharStat( buf, size, stat, skip != 0 );
+            refCharStat( buf, size, expected, skip != 0 );
+            if ( memcmp( stat, expected, sizeof(stat) ) )
+                mismatches++;
+        }
+    }
+    check( "char statistics match byte by byte count", mismatches == 0 );
+}
+
+static const char * russianText =
+    "\xd0\x92 \xd0\xbd\xd0\xb0\xd1\x87\xd0\xb0\xd0\xbb\xd0\xb5 \xd0\xb8\xd1\x8e\xd0\xbb\xd1\x8f, \xd0\xb2 "
+    "\xd1\x87\xd1\x80\xd0\xb5\xd0\xb7\xd0\xb2\xd1\x8b\xd1\x87\xd0\xb0\xd0\xb9\xd0\xbd\xd0\xbe \xd0\xb6\xd0\xb0"
+    "\xd1\x80\xd0\xba\xd0\xbe\xd0\xb5 \xd0\xb2\xd1\x80\xd0\xb5\xd0\xbc\xd1\x8f, \xd0\xbf\xd0\xbe\xd0\xb4 "
+    "\xd0\xb2\xd0\xb5\xd1\x87\xd0\xb5\xd1\x80 \xd0\xbe\xd0\xb4\xd0\xb8\xd0\xbd \xd0\xbc\xd0\xbe\xd0\xbb\xd0"
+    "\xbe\xd0\xb4\xd0\xbe\xd0\xb9 \xd1\x87\xd0\xb5\xd0\xbb\xd0\xbe\xd0\xb2\xd0\xb5\xd0\xba \xd0\xb2\xd1\x8b"
+    "\xd1\x88\xd0\xb5\xd0\xbb \xd0\xb8\xd0\xb7 \xd1\x81\xd0\xb2\xd0\xbe\xd0\xb5\xd0\xb9 \xd0\xba\xd0\xb0\xd0"
+    "\xbc\xd0\xbe\xd1\x80\xd0\xba\xd0\xb8, \xd0\xba\xd0\xbe\xd1\x82\xd0\xbe\xd1\x80\xd1\x83\xd1\x8e \xd0\xbd"
+    "\xd0\xb0\xd0\xbd\xd0\xb8\xd0\xbc\xd0\xb0\xd0\xbb \xd0\xbe\xd1\x82 \xd0\xb6\xd0\xb8\xd0\xbb\xd1\x8c\xd1"
+    "\x86\xd0\xbe\xd0\xb2 \xd0\xb2 \xd0\xa1. \xd0\xbf\xd0\xb5\xd1\x80\xd0\xb5\xd1\x83\xd0\xbb\xd0\xba\xd0\xb5,"
+    " \xd0\xbd\xd0\xb0 \xd1\x83\xd0\xbb\xd0\xb8\xd1\x86\xd1\x83 \xd0\xb8 \xd0\xbc\xd0\xb5\xd0\xb4\xd0\xbb\xd0"
+    "\xb5\xd0\xbd\xd0\xbd\xd0\xbe, \xd0\xba\xd0\xb0\xd0\xba \xd0\xb1\xd1\x8b \xd0\xb2 \xd0\xbd\xd0\xb5\xd1\x80"
+    "\xd0\xb5\xd1\x88\xd0\xb8\xd0\xbc\xd0\xbe\xd1\x81\xd1\x82\xd0\xb8, \xd0\xbe\xd1\x82\xd0\xbf\xd1\x80\xd0"
+    "\xb0\xd0\xb2\xd0\xb8\xd0\xbb\xd1\x81\xd1\x8f \xd0\xba \xd0\x9a-\xd0\xbd\xd1\x83 \xd0\xbc\xd0\xbe\xd1\x81"
+    "\xd1\x82\xd1\x83.";
+
+// encodes text to 8 bit charset using its decoding table, only some charsets have encoding tables
+static lString8 encode8Bit( const lString16 & text, const char * charset )
+{
+    const lChar16 * table = GetCharsetByte2UnicodeTable( Utf8ToUnicode( lString8(charset) ).c_str() );
+    lString8 res;
+    for ( int i=0; i<text.length(); i++ ) {
+        lChar16 ch = text[i];
+        int b = ch < 128 ? ch : 0;
+        for ( int k=0; !b && table && k<128; k++ )
+            if ( table[k] == ch )
+                b = 128 + k;
+        res << (char)(b ? b : '?');
+    }
+    return res;
+}
+
+static void checkCharsetDetection()
+{
+    lString16 text = Utf8ToUnicode( lString8( russianText ) );
+    lString16 paragraph;
+    for ( int i=0; i<20; i++ )
+        paragraph << text << (i % 4 == 3 ? "\n" : " ");
+    static const char * charsets[] = { "utf-8", "cp1251", "koi8r", "cp866", NULL };
+    bool ok = true;
+    for ( int i=0; charsets[i]; i++ ) {
+        lString8 data = i ? encode8Bit( paragraph, charsets[i] ) : UnicodeToUtf8( paragraph );
+        for ( int tags=0; tags<2; tags++ ) {
+            if ( tags )
+                data = lString8("<html><body><p>") + data + "</p><p>" + data + "</p></body></html>";
+            const lUInt8 * buf = (const lUInt8 *)data.c_str();
+            char cp_name[32];
+            char lang_name[32];
+            cp_name[0] = lang_name[0] = 0;
+            bool hasTags = hasXmlTags( buf, data.length() );
+            AutodetectCodePage( buf, data.length(), cp_name, lang_name, hasTags );
+            if ( hasTags != (tags != 0) || strcmp( cp_name, charsets[i] ) ) {
+                printf("  %s%s detected as %s %s\n", charsets[i], tags ? " with tags" : "", cp_name, lang_name);
+                ok = false;
+            }
+        }
+    }
+    check( "charset autodetection of russian text", ok );
+}
+
+static lString16 nonSpaceChars( const lString16 & text )
+{
+    lString16 res;
+    for ( int i=0; i<text.length(); i++ )
+        if ( text[i] > ' ' && text[i] != 0xA0 )
+            res << text[i];
+    return res;
+}
+
+/// collects text passed by parser
+class TextCollectCallback : public LVXMLParserCallback
+{
+public:
+    lString16 text;
+    virtual void OnStop() { }
+    virtual ldomNode * OnTagOpen( const lChar16 * nsname, const lChar16 * tagname )
+    {
+        CR_UNUSED2(nsname, tagname);
+        return NULL;
+    }
+    virtual void OnTagBody() { }
+    virtual void OnTagClose( const lChar16 * nsname, const lChar16 * tagname )
+    {
+        CR_UNUSED2(nsname, tagname);
+    }
+    virtual void OnAttribute( const lChar16 * nsname, const lChar16 * attrname, const lChar16 * attrvalue )
+    {
+        CR_UNUSED3(nsname, attrname, attrvalue);
+    }
+    virtual void OnText( const lChar16 * text, int len, lUInt32 flags )
+    {
+        CR_UNUSED(flags);
+        this->text.append( text, len );
+        this->text << " ";
+    }
+    virtual bool OnBlob( lString16 name, const lUInt8 * data, int size )
+    {
+        CR_UNUSED3(name, data, size);
+        return false;
+    }
+};
+
+static void checkTextImport()
+{
+    static const char * eols[] = { "\n", "\r\n", "\r" };
+    // no hyphens and dots: parser joins hyphenated words and may move short lines
+    lString16 words = Utf8ToUnicode( lString8( russianText ) );
+    for ( int i=0; i<words.length(); i++ )
+        if ( words[i] == '-' || words[i] == '.' )
+            words[i] = ' ';
+    for ( int e=0; e<3; e++ ) {
+        for ( int cp=0; cp<2; cp++ ) {
+            // paragraphs with indents, empty lines, short and very long lines
+            lString16 text;
+            for ( int line=0; line<3000; line++ ) {
+                int kind = rnd( 10 );
+                if ( kind == 0 ) {
+                    text << eols[e];
+                    continue;
+                }
+                if ( kind < 4 )
+                    text << (rnd( 2 ) ? "\t" : "    ");
+                int len = kind == 9 ? 3000 + rnd( 5000 ) : 10 + rnd( 70 );
+                int start = rnd( words.length() );
+                for ( int i=0; i<len; i++ ) {
+                    lChar16 ch = words[(start + i) % words.length()];
+                    text << (ch == ' ' && rnd( 8 ) == 0 ? (lChar16)'\t' : ch);
+                }
+                text << eols[e];
+            }
+            lString8 data = cp ? encode8Bit( text, "cp1251" ) : UnicodeToUtf8( text );
+            LVStreamRef stream = LVCreateStringStream( data );
+            TextCollectCallback callback;
+            LVTextParser parser( stream, &callback, false );
+            bool ok = parser.CheckFormat() && parser.Parse() && nonSpaceChars( callback.text ) == nonSpaceChars( text );
+            char name[64];
+            sprintf( name, "text import keeps all chars: %s, %s", cp ? "cp1251" : "utf-8", e == 0 ? "LF" : e == 1 ? "CRLF" : "CR" );
+            check( name, ok );
+        }
+    }
+}
+
+static lString8 encodeBase64( const lUInt8 * data, int len )
+{
+    static const char * digits = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    lString8 res;
+    for ( int i=0; i<len; i+=3 ) {
+        lUInt32 v = data[i] << 16;
+        if ( i + 1 < len )
+            v |= data[i+1] << 8;
+        if ( i + 2 < len )
+            v |= data[i+2];
+        res << digits[(v >> 18) & 63] << digits[(v >> 12) & 63];
+        res << (i + 1 < len ? digits[(v >> 6) & 63] : '=');
+        res << (i + 2 < len ? digits[v & 63] : '=');
+    }
+    return res;
+}
+
+static void checkFb2Metadata()
+{
+    static const char * sequences[] = { "<sequence name=\"S\" number=\"0\"/>", "<sequence name=\"S\" number=\"12\"/>",
+                                        "<sequence name=\"S\"/>", NULL };
+    static const int numbers[] = { 0, 12, -1 };
+    bool ok = true;
+    for ( int i=0; sequences[i]; i++ ) {
+        lString8 fb2( "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                      "<FictionBook xmlns=\"http://www.gribuser.ru/xml/fictionbook/2.0\">\n<description><title-info>"
+                      "<book-title>Test</book-title>" );
+        fb2 << sequences[i] << "</title-info></description>\n<body><section><p>text</p></section></body>\n</FictionBook>\n";
+        LVDocMetadata metadata;
+        ok = ok && LVParseFB2Metadata( LVCreateStringStream( fb2 ), metadata )
+                && metadata.series == "S" && metadata.seriesNumber == numbers[i];
+    }
+    check( "FB2 metadata keeps series number 0 apart from no number", ok );
+}
+
+static void checkFb2Binaries()
+{
+    // binaries of different sizes, base64 text split by different line breaks and spaces
+    const int count = 40;
+    LVPtrVector< LVArray<lUInt8> > binaries;
+    lString8 fb2( "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<FictionBook xmlns=\"http://www.gribuser.ru/xml/fictionbook/2.0\" xmlns:l=\"http://www.w3.org/1999/xlink\">\n"
+                  "<body><section><p>text</p></section></body>\n" );
+    for ( int b=0; b<count; b++ ) {
+        LVArray<lUInt8> * data = new LVArray<lUInt8>();
+        int len = b < 8 ? b : rnd( b < 30 ? 300 : 40000 );
+        for ( int i=0; i<len; i++ )
+            data->add( (lUInt8)rnd( 256 ) );
+        binaries.add( data );
+        lString8 digits = encodeBase64( data->get(), len );
+        int layout = b % 5;
+        lString8 text;
+        for ( int i=0; i<digits.length(); i++ ) {
+            if ( i && layout == 1 && i % 76 == 0 )
+                text << "\n";
+            else if ( i && layout == 2 && i % 64 == 0 )
+                text << "\r\n";
+            else if ( i && layout == 3 && i % 7 == 0 )
+                text << " ";
+            else if ( layout == 4 && rnd( 20 ) == 0 )
+                text << "\t\n  ";
+            text << digits[i];
+        }
+        fb2 << "<binary id=\"b" << lString8::itoa( b ) << "\" content-type=\"image/png\">";
+        fb2 << (layout == 1 ? "\n" : "") << text << (layout == 1 ? "\n" : "") << "</binary>\n";
+    }
+    fb2 << "</FictionBook>\n";
+    LVDocView view;
+    view.Resize( 600, 800 );
+    if ( !check( "FB2 with binaries loaded", view.LoadDocument( LVCreateStringStream( fb2 ), L"binaries.fb2" ) ) )
+        return;
+    int mismatches = 0;
+    LVArray<lUInt8> data;
+    for ( int b=0; b<count; b++ ) {
+        // empty binaries may have no stream
+        readStream( view.getDocument()->getObjectImageStream( lString16("#b") + lString16::itoa( b ) ), data );
+        if ( !sameBytes( data, binaries[b]->get(), binaries[b]->length() ) )
+            mismatches++;
+    }
+    check( "FB2 binaries decoded to original bytes", mismatches == 0 );
+}
+
+static void checkMobi( const lString16 & dir )
+{
+    // words repeated often enough to get dictionary codes, with UTF-8 and control bytes between them
+    static const char * words[] = { "reading ", "the ", "book ", "\xd0\xba\xd0\xbd\xd0\xb8\xd0\xb3\xd0\xb0 ", "chapter\n",
+                                    "a", " ", "\x01\x02", "longerwordforcodes ", ".\n", NULL };
+    lString8 text;
+    while ( text.length() < 300000 )
+        text << words[rnd( 10 )];
+    for ( int huff=0; huff<2; huff++ ) {
+        lString16 fileName = dir + (huff ? "huffcdic.mobi" : "palmdoc.mobi");
+        if ( !check( huff ? "HUFF/CDIC book written" : "PalmDOC book written",
+                     writeMobi( fileName, (const lUInt8 *)text.c_str(), text.length(), huff != 0 ) ) )
+            continue;
+        for ( int threaded=0; threaded<2; threaded++ ) {
+            useThreads( threaded != 0 );
+            doc_format_t format = doc_format_none;
+            LVStreamRef src = LVOpenFileStream( fileName.c_str(), LVOM_READ );
+            LVStreamRef pdb = src.isNull() ? LVStreamRef() : LVOpenPDBStream( src, format );
+            char name[64];
+            sprintf( name, "%s book unpacked to original text%s", huff ? "HUFF/CDIC" : "PalmDOC", threaded ? ", threads" : "" );
+            LVArray<lUInt8> data;
+            readStream( pdb, data );
+            check( name, !pdb.isNull() && sameBytes( data, (const lUInt8 *)text.c_str(), text.length() ) );
+        }
+        useThreads( false );
+    }
+}
+
+static void putLE( LVArray<lUInt8> & buf, lUInt32 value, int bytes )
+{
+    for ( int i=0; i<bytes; i++ )
+        buf.add( (lUInt8)(value >> (i*8)) );
+}
+
+/// ZIP archive of deflated files: raw deflate data is zlib stream without its 2 byte header and 4 byte checksum
+class ZipWriter {
+    LVArray<lUInt8> _data;
+    LVArray<lUInt8> _dir;
+    int _count;
+    void putHeader( LVArray<lUInt8> & buf, const lString8 & name, lUInt32 crc, int packedSize, int size )
+    {
+        putLE( buf, 20, 2 ); // version needed
+        putLE( buf, 0, 2 );  // flags
+        putLE( buf, 8, 2 );  // deflated
+        putLE( buf, 0, 2 );  // time
+        putLE( buf, 0x21, 2 ); // date: 1980-01-01
+        putLE( buf, crc, 4 );
+        putLE( buf, packedSize, 4 );
+        putLE( buf, size, 4 );
+        putLE( buf, name.length(), 2 );
+        putLE( buf, 0, 2 );  // extra field length
+    }
+public:
+    ZipWriter() : _count(0) { }
+    bool add( const char * name, const lString8 & content )
+    {
+        lUInt8 * packed = NULL;
+        lUInt32 packedSize = 0;
+        if ( !ldomPack( (const lUInt8 *)content.c_str(), content.length(), packed, packedSize ) || packedSize < 6 ) {
+            free( packed );
+            return false;
+        }
+        lString8 fn( name );
+        lUInt32 crc = lStr_crc32( 0, content.c_str(), content.length() );
+        int offset = _data.length();
+        putLE( _data, 0x04034b50, 4 );
+        putHeader( _data, fn, crc, packedSize - 6, content.length() );
+        _data.add( (const lUInt8 *)fn.c_str(), fn.length() );
+        _data.add( packed + 2, packedSize - 6 );
+        free( packed );
+        putLE( _dir, 0x02014b50, 4 );
+        putLE( _dir, 20, 2 ); // version made by
+        putHeader( _dir, fn, crc, packedSize - 6, content.length() );
+        putLE( _dir, 0, 2 ); // comment length
+        putLE( _dir, 0, 2 ); // disk number
+        putLE( _dir, 0, 2 ); // internal attributes
+        putLE( _dir, 0, 4 ); // external attributes
+        putLE( _dir, offset, 4 );
+        _dir.add( (const lUInt8 *)fn.c_str(), fn.length() );
+        _count++;
+        return true;
+    }
+    LVStreamRef finish()
+    {
+        LVArray<lUInt8> zip( _data );
+        zip.add( _dir );
+        putLE( zip, 0x06054b50, 4 );
+        putLE( zip, 0, 2 );
+        putLE( zip, 0, 2 );
+        putLE( zip, _count, 2 );
+        putLE( zip, _count, 2 );
+        putLE( zip, _dir.length(), 4 );
+        putLE( zip, _data.length(), 4 );
+        putLE( zip, 0, 2 ); // comment length
+        LVStreamRef stream = LVCreateMemoryStream();
+        lvsize_t bytesWritten = 0;
+        stream->Write( zip.get(), zip.length(), &bytesWritten );
+        stream->SetPos( 0 );
+        return stream;
+    }
+};
+
+/// returns DOCX with headings, numbered list and character style, NULL if it cannot be packed
+static LVStreamRef makeDocx()
+{
+    static const char * w = "xmlns:w=\"http://schemas.openxmlformats.org/wordprocessingml/2006/main\"";
+    lString8 types( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+                    "<Override PartName=\"/word/document.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.document.main+xml\"/>"
+                    "<Override PartName=\"/word/styles.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.styles+xml\"/>"
+                    "<Override PartName=\"/word/numbering.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.wordprocessingml.numbering+xml\"/>"
+                    "</Types>" );
+    lString8 styles = lString8( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<w:styles " ) + w + ">"
+                    "<w:style w:type=\"paragraph\" w:default=\"1\" w:styleId=\"Normal\"><w:name w:val=\"Normal\"/></w:style>"
+                    "<w:style w:type=\"paragraph\" w:styleId=\"Heading1\"><w:name w:val=\"heading 1\"/><w:basedOn w:val=\"Normal\"/>"
+                    "<w:pPr><w:outlineLvl w:val=\"0\"/></w:pPr><w:rPr><w:b/></w:rPr></w:style>"
+                    "<w:style w:type=\"character\" w:styleId=\"Strong\"><w:name w:val=\"Strong\"/><w:rPr><w:b/></w:rPr></w:style>"
+                    "</w:styles>";
+    lString8 numbering = lString8( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<w:numbering " ) + w + ">"
+                    "<w:abstractNum w:abstractNumId=\"0\"><w:lvl w:ilvl=\"0\"><w:start w:val=\"1\"/><w:numFmt w:val=\"decimal\"/>"
+                    "<w:lvlText w:val=\"%1.\"/></w:lvl></w:abstractNum>"
+                    "<w:num w:numId=\"1\"><w:abstractNumId w:val=\"0\"/></w:num></w:numbering>";
+    static const char * words[] = { "reading ", "the ", "book ", "\xd0\xba\xd0\xbd\xd0\xb8\xd0\xb3\xd0\xb0 ", "chapter ",
+                                    "a ", "&amp; ", "longerwordforparagraphs ", ". ", "text " };
+    // bigger than blocks reader thread keeps for parser to rewind to
+    lString8 document = lString8( "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<w:document " ) + w + "><w:body>";
+    for ( int chapter=1; document.length() < 1500000; chapter++ ) {
+        document << "<w:p><w:pPr><w:pStyle w:val=\"Heading1\"/></w:pPr><w:r><w:t>Chapter " << lString8::itoa( chapter ) << "</w:t></w:r></w:p>";
+        for ( int i=0; i<3; i++ )
+            document << "<w:p><w:pPr><w:numPr><w:ilvl w:val=\"0\"/><w:numId w:val=\"1\"/></w:numPr></w:pPr>"
+                        "<w:r><w:t>item " << lString8::itoa( i ) << "</w:t></w:r></w:p>";
+        for ( int p=0; p<20; p++ ) {
+            document << "<w:p><w:r><w:rPr><w:rStyle w:val=\"Strong\"/></w:rPr><w:t>First </w:t></w:r><w:r><w:t xml:space=\"preserve\">";
+            for ( int k=rnd( 40 ); k>=0; k-- )
+                document << words[rnd( 10 )];
+            document << "</w:t></w:r></w:p>";
+        }
+    }
+    document << "</w:body></w:document>";
+    ZipWriter zip;
+    bool ok = zip.add( "[Content_Types].xml", types ) && zip.add( "word/styles.xml", styles )
+            && zip.add( "word/numbering.xml", numbering ) && zip.add( "word/document.xml", document );
+    return ok ? zip.finish() : LVStreamRef();
+}
+
+static void checkDocx()
+{
+    LVStreamRef docx = makeDocx();
+    if ( !check( "DOCX archive written", !docx.isNull() ) )
+        return;
+    // parts inflated on parser thread, then by reader thread while parsed
+    lString8 dom[2];
+    for ( int threaded=0; threaded<2; threaded++ ) {
+        useThreads( threaded != 0 );
+        docx->SetPos( 0 );
+        LVDocView view;
+        view.Resize( 600, 800 );
+        if ( view.LoadDocument( docx, L"book.docx" ) && view.getDocument() ) {
+            LVStreamRef out = LVCreateMemoryStream();
+            view.getDocument()->saveToStream( out, "utf-8" );
+            LVArray<lUInt8> data;
+            out->SetPos( 0 );
+            readStream( out, data );
+            dom[threaded] = lString8( (const char *)data.get(), data.length() );
+        }
+    }
+    useThreads( false );
+    check( "DOCX imported", dom[0].pos( "Chapter 1" ) >= 0 && dom[0].pos( "longerwordforparagraphs" ) >= 0 );
+    check( "DOCX imported with reader thread equals sequential", !dom[0].empty() && dom[1] == dom[0] );
+}
+
+static void fillBlocks( LVDrawBuf & buf )
+{
+    for ( int y=0; y<buf.GetHeight(); y += 8 )
+        for ( int x=0; x<buf.GetWidth(); x += 8 )
+            buf.FillRect( x, y, x + 8, y + 8, ((lUInt32)rnd( 256 ) << 16) | (rnd( 256 ) << 8) | rnd( 256 ) );
+}
+
+static void checkGlyphBlending()
+{
+    // glyphs with solid, empty and antialiased pixels, some clipped by buffer edges
+    const int dx = 257;
+    const int dy = 61;
+    LVArray<lUInt8> bitmaps( 64 * 64 * 64, 0 );
+    LVArray<LVDrawBufGlyph> glyphs;
+    for ( int i=0; i<64; i++ ) {
+        LVDrawBufGlyph g;
+        g.width = 1 + rnd( 40 );
+        g.height = 1 + rnd( 30 );
+        g.x = rnd( dx + 20 ) - 20;
+        g.y = rnd( dy + 10 ) - 10;
+        lUInt8 * bmp = bitmaps.get() + i * 64 * 64;
+        for ( int k=0; k<g.width * g.height; k++ ) {
+            int r = rnd( 4 );
+            bmp[k] = (lUInt8)(r == 0 ? 0 : r == 1 ? 255 : rnd( 256 ));
+        }
+        g.bitmap = bmp;
+        glyphs.add( g );
+    }
+    static const int bpps[] = { 32, 16, 8, 4 };
+    for ( unsigned b=0; b<sizeof(bpps)/sizeof(bpps[0]); b++ ) {
+        LVDrawBuf * rows;
+        LVDrawBuf * columns;
+        if ( bpps[b] >= 16 ) {
+            rows = new LVColorDrawBuf( dx, dy, bpps[b] );
+            columns = new LVColorDrawBuf( dx, dy, bpps[b] );
+        } else {
+            rows = new LVGrayDrawBuf( dx, dy, bpps[b] );
+            columns = new LVGrayDrawBuf( dx, dy, bpps[b] );
+        }
+        lUInt32 seed = randomSeed;
+        fillBlocks( *rows );
+        randomSeed = seed;
+        fillBlocks( *columns );
+        lUInt32 color = 0x305070;
+        rows->SetTextColor( color );
+        columns->SetTextColor( color );
+        rows->DrawGlyphs( glyphs.get(), glyphs.length(), NULL );
+        // glyphs split to one pixel wide columns are blended pixel by pixel
+        LVArray<lUInt8> column( 64, 0 );
+        for ( int i=0; i<glyphs.length(); i++ ) {
+            LVDrawBufGlyph g = glyphs[i];
+            for ( int x=0; x<glyphs[i].width; x++ ) {
+                for ( int y=0; y<g.height; y++ )
+                    column[y] = glyphs[i].bitmap[y * glyphs[i].width + x];
+                g.x = glyphs[i].x + x;
+                g.bitmap = column.get();
+                g.width = 1;
+                columns->DrawGlyphs( &g, 1, NULL );
+            }
+        }
+        char name[64];
+        sprintf( name, "glyph rows blended as single pixels, %d bpp", bpps[b] );
+        check( name, sameBuffers( *rows, *columns ) );
+        delete rows;
+        delete columns;
+    }
+}
+
+static void checkPixelConversion()
+{
+    const int dx = 301;
+    const int dy = 157;
+    LVColorDrawBuf frame( dx, dy, 32 );
+    for ( int y=0; y<dy; y++ ) {
+        lUInt32 * row = (lUInt32 *)frame.GetScanLine( y );
+        for ( int x=0; x<dx; x++ )
+            row[x] = ((lUInt32)rnd( 256 ) << 16) | (rnd( 256 ) << 8) | rnd( 256 );
+    }
+    LVGrayDrawBuf gray( dx, dy, 8 );
+    frame.DrawTo( &gray, 0, 0, 0, NULL );
+    bool ok = true;
+    for ( int y=0; y<dy; y++ )
+        for ( int x=0; x<dx; x++ )
+            ok = ok && gray.GetScanLine( y )[x] == (lUInt8)((lUInt32 *)frame.GetScanLine( y ))[x];
+    check( "32 bpp -> 8 bpp gray takes low byte", ok );
+
+    LVColorDrawBuf color( dx, dy, 32 );
+    gray.DrawTo( &color, 0, 0, 0, NULL );
+    LVGrayDrawBuf back( dx, dy, 8 );
+    color.DrawTo( &back, 0, 0, 0, NULL );
+    check( "8 bpp gray -> 32 bpp -> 8 bpp gray is lossless", sameBuffers( gray, back ) );
+
+    LVColorDrawBuf copy( dx, dy, 32 );
+    frame.DrawTo( &copy, 0, 0, 0, NULL );
+    LVColorDrawBuf copy2( dx, dy, 32 );
+    copy.DrawTo( &copy2, 0, 0, 0, NULL );
+    check( "32 bpp -> 32 bpp twice gives original", sameBuffers( frame, copy2 ) );
+
+    LVColorDrawBuf rgb565( dx, dy, 16 );
+    for ( int y=0; y<dy; y++ ) {
+        lUInt16 * row = (lUInt16 *)rgb565.GetScanLine( y );
+        for ( int x=0; x<dx; x++ )
+            row[x] = (lUInt16)rnd( 65536 );
+    }
+    rgb565.DrawTo( &color, 0, 0, 0, NULL );
+    ok = true;
+    for ( int y=0; y<dy; y++ )
+        for ( int x=0; x<dx; x++ )
+            ok = ok && ((lUInt32 *)color.GetScanLine( y ))[x] == rgb565to888( ((lUInt16 *)rgb565.GetScanLine( y ))[x] );
+    check( "16 bpp -> 32 bpp expands 565 pixels", ok );
+
+    for ( int bpp=8; bpp<=32; bpp+=24 ) {
+        LVDrawBuf * bufs[3];
+        for ( int i=0; i<3; i++ ) {
+            if ( bpp == 8 )
+                bufs[i] = new LVGrayDrawBuf( dx, dy, 8 );
+            else
+                bufs[i] = new LVColorDrawBuf( dx, dy, 32 );
+            frame.DrawTo( bufs[i], 0, 0, 0, NULL );
+        }
+        bufs[0]->Rotate( CR_ROTATE_ANGLE_90 );
+        bool swapped = bufs[0]->GetWidth() == dy && bufs[0]->GetHeight() == dx;
+        bufs[0]->Rotate( CR_ROTATE_ANGLE_90 );
+        bufs[1]->Rotate( CR_ROTATE_ANGLE_180 );
+        char name[64];
+        sprintf( name, "%d bpp rotated by 90 twice equals rotated by 180", bpp );
+        check( name, swapped && sameBuffers( *bufs[0], *bufs[1] ) );
+        bufs[2]->Rotate( CR_ROTATE_ANGLE_90 );
+        bufs[2]->Rotate( CR_ROTATE_ANGLE_270 );
+        bufs[1]->Rotate( CR_ROTATE_ANGLE_180 );
+        sprintf( name, "%d bpp rotated by 90 and back equals original", bpp );
+        check( name, sameBuffers( *bufs[1], *bufs[2] ) );
+        for ( int i=0; i<3; i++ )
+            delete bufs[i];
+    }
+}
+
+static const char * testStyleSheet =
+    "body { text-align: justify; margin: 0; font-family: \"Times New Roman\", serif }\n"
+    "p { text-indent: 1.2em; margin-top: 0; margin-bottom: 0 }\n"
+    "title, subtitle { text-align: center; font-weight: bold; page-break-before: always }\n"
+    "section > title p, .chapter h1 { font-size: 130%; hyphenate: none }\n"
+    "a[type=\"note\"] { vertical-align: super; font-size: 70% }\n"
+    "div.poem stanza v:first-child, table td + td { margin-left: 2em }\n"
+    "customtag, othercustom[customattr=\"x\"] { display: block; color: #336699 }\n"
+    "#note1, emphasis em i { font-style: italic }\n"
+    "@media print { p { color: black } }\n"
+    "epigraph, cite { margin-left: 15%; font-size: 90% }\n";
+
+static lUInt32 styleSheetHash( const lString8 & css )
+{
+    ldomDocument * doc = new ldomDocument();
+    doc->setStyleSheet( css.c_str(), true );
+    lUInt32 hash = doc->getStyleSheet()->getHash();
+    delete doc;
+    return hash;
+}
+
+static void checkStyleSheetCache( const lString16 & dir )
+{
+    lString8 css( testStyleSheet );
+    LVStyleSheetCache::setMaxSize( 0 );
+    lUInt32 parsed = styleSheetHash( css );
+    LVStyleSheetCache::setMaxSize( 0x400000 );
+    LVStyleSheetCache::setCacheDir( dir );
+    LVStyleSheetCache::clear();
+    lUInt32 compiled = styleSheetHash( css );
+    lUInt32 restored = styleSheetHash( css );
+    check( "stylesheet compiled and restored from memory cache", parsed == compiled && parsed == restored );
+    // as after restart: saved stylesheets are read back
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+    LVStyleSheetCache::setCacheDir( dir );
+    check( "stylesheet restored from cache file", styleSheetHash( css ) == parsed );
+    // damaged cache files are not used
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+    LVContainerRef container = LVOpenDirectory( dir.c_str() );
+    int damaged = 0;
+    for ( int i=0; !container.isNull() && i<container->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = container->GetObjectInfo( i );
+        if ( item->IsContainer() )
+            continue;
+        lString16 fileName = dir + item->GetName();
+        LVArray<lUInt8> data;
+        readFile( fileName, data );
+        for ( int k=data.length()/2; k<data.length(); k++ )
+            data[k] ^= 0x5A;
+        LVStreamRef out = LVOpenFileStream( fileName.c_str(), LVOM_WRITE );
+        if ( !out.isNull() && out->Write( data.get(), data.length(), NULL ) == LVERR_OK )
+            damaged++;
+    }
+    LVStyleSheetCache::setCacheDir( dir );
+    check( "stylesheet parsed again when cache file is damaged", damaged > 0 && styleSheetHash( css ) == parsed );
+    LVStyleSheetCache::clear();
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+}
+
+static void checkCacheCatalog( const lString16 & dir )
+{
+    // 200 books with 40K cache files each: budget holds half of them
+    const int books = 200;
+    const lvsize_t maxSize = books / 2 * 40 * 1024;
+    if ( !check( "document cache initialized", ldomDocCache::init( dir, maxSize ) ) )
+        return;
+    ldomDocCache::clear();
+    bool created = true;
+    for ( int b=0; b<books; b++ ) {
+        lString16 path;
+        lString16 name = lString16("book") + lString16::itoa(b) + ".fb2";
+        LVStreamRef stream = ldomDocCache::createNew( name, (lUInt32)b, 0, 400 * 1024, path );
+        if ( stream.isNull() )
+            created = false;
+        stream.Clear();
+        ldomDocCache::updateFileSize( path, 40 * 1024 );
+    }
+    check( "document cache files created", created );
+    ldomDocCache::close();
+    ldomDocCache::init( dir, maxSize );
+    int found = 0;
+    bool newestFound = false;
+    bool oldestFound = false;
+    for ( int b=0; b<books; b++ ) {
+        lString16 path;
+        lString16 name = lString16("book") + lString16::itoa(b) + ".fb2";
+        if ( !ldomDocCache::openExisting( name, (lUInt32)b, 0, path ).isNull() ) {
+            found++;
+            newestFound = newestFound || b == books - 1;
+            oldestFound = oldestFound || b == 0;
+        }
+    }
+    check( "document cache catalog keeps newest files within budget", found > 0 && found <= books / 2 && newestFound && !oldestFound );
+    // other name, size or crc of document don't match cache file
+    lString16 path;
+    check( "document cache lookup checks document crc", ldomDocCache::openExisting( lString16("book199.fb2"), 1, 0, path ).isNull() );
+    // file missing from catalog is left by interrupted save
+    ldomDocCache::close();
+    lString16 strayFile = dir + "stray.cr3";
+    {
+        LVStreamRef stream = LVOpenFileStream( strayFile.c_str(), LVOM_WRITE );
+        if ( !stream.isNull() )
+            stream->Write( "stray", 5, NULL );
+    }
+    bool strayCreated = LVFileExists( strayFile );
+    ldomDocCache::init( dir, maxSize );
+    check( "document cache deletes files missing from catalog", strayCreated && !LVFileExists( strayFile ) );
+    ldomDocCache::clear();
+    ldomDocCache::close();
+}
+
+static void checkFontScanCache( const char * fontFile, const lString16 & dir )
+{
+    lString16 cacheFileName = dir + "fontscan.cache";
+    LVDeleteFile( cacheFileName );
+    lString16Collection faces[3];
+    int fonts[3];
+    for ( int pass=0; pass<3; pass++ ) {
+        ShutdownFontManager();
+        InitFontManager( lString8::empty_str );
+        if ( pass > 0 )
+            fontMan->SetFontScanCacheFile( cacheFileName );
+        fontMan->RegisterFont( lString8(fontFile) );
+        if ( pass > 0 )
+            fontMan->SaveFontScanCache();
+        fontMan->getFaceList( faces[pass] );
+        fonts[pass] = fontMan->GetFontCount();
+    }
+    bool same = fonts[0] > 0 && fonts[1] == fonts[0] && fonts[2] == fonts[0];
+    for ( int pass=1; pass<3; pass++ ) {
+        same = same && faces[pass].length() == faces[0].length();
+        for ( int i=0; same && i<faces[0].length(); i++ )
+            same = faces[pass][i] == faces[0][i];
+    }
+    check( "fonts registered from scan cache are the same", same );
+    // cache file set after fonts are registered keeps their scan results
+    LVDeleteFile( cacheFileName );
+    ShutdownFontManager();
+    InitFontManager( lString8::empty_str );
+    fontMan->RegisterFont( lString8(fontFile) );
+    fontMan->SetFontScanCacheFile( cacheFileName );
+    fontMan->SaveFontScanCache();
+    check( "font scan cache file set after registration is written", LVFileExists( cacheFileName ) );
+}
+
+static lString8 makeFb2Book()
+{
+    static const char * words[] = { "reading", "the", "book", "of", "chapter", "with", "some", "longer", "paragraphs",
+        "and", "hyphenation", "for", "pages", "a", "in", "extraordinarily", "text", NULL };
+    lString8 fb2( "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+                  "<FictionBook xmlns=\"http://www.gribuser.ru/xml/fictionbook/2.0\" xmlns:l=\"http://www.w3.org/1999/xlink\">\n"
+                  "<description><title-info><book-title>Test</book-title></title-info></description>\n<body>\n" );
+    int notes = 0;
+    for ( int s=0; s<30; s++ ) {
+        fb2 << "<section><title><p>Chapter " << lString8::itoa( s + 1 ) << "</p></title>\n";
+        int paragraphs = 5 + rnd( 30 );
+        for ( int p=0; p<paragraphs; p++ ) {
+            fb2 << "<p>";
+            int len = 3 + rnd( rnd( 4 ) ? 80 : 400 );
+            for ( int w=0; w<len; w++ ) {
+                int kind = rnd( 40 );
+                if ( kind == 0 )
+                    fb2 << "<emphasis>" << words[rnd( 17 )] << "</emphasis> ";
+                else if ( kind == 1 && notes < 200 ) {
+                    lString8 note = lString8::itoa( ++notes );
+                    fb2 << "<a l:href=\"#n" << note << "\" type=\"note\">[" << note << "]</a> ";
+                }
+                else
+                    fb2 << words[rnd( 17 )] << " ";
+            }
+            fb2 << "</p>\n";
+            if ( rnd( 10 ) == 0 )
+                fb2 << "<empty-line/>\n";
+        }
+        fb2 << "</section>\n";
+    }
+    fb2 << "</body>\n<body name=\"notes\">\n";
+    for ( int n=1; n<=notes; n++ ) {
+        fb2 << "<section id=\"n" << lString8::itoa( n ) << "\"><title><p>" << lString8::itoa( n ) << "</p></title><p>";
+        int len = 3 + rnd( rnd( 8 ) ? 20 : 300 );
+        for ( int w=0; w<len; w++ )
+            fb2 << words[rnd( 17 )] << " ";
+        fb2 << "</p></section>\n";
+    }
+    fb2 << "</body>\n</FictionBook>\n";
+    return fb2;
+}
+
+static bool loadBook( LVDocView & view, const lString8 & book, int dx, int dy )
+{
+    view.Resize( dx, dy );
+    view.setPageHeaderInfo( 0 ); // no clock in pages
+    if ( !view.LoadDocument( LVCreateStringStream( book ), L"book.fb2" ) )
+        return false;
+    view.checkRender();
+    return view.getPageCount() > 0;
+}
+
+static bool samePages( LVRendPageList * a, LVRendPageList * b )
+{
+    if ( a->length() != b->length() )
+        return false;
+    for ( int i=0; i<a->length(); i++ ) {
+        LVRendPageInfo * p1 = a->get(i);
+        LVRendPageInfo * p2 = b->get(i);
+        if ( p1->start != p2->start || p1->height != p2->height || p1->flags != p2->flags
+             || p1->footnotes.length() != p2->footnotes.length() )
+            return false;
+        for ( int k=0; k<p1->footnotes.length(); k++ )
+            if ( p1->footnotes[k].start != p2->footnotes[k].start || p1->footnotes[k].height != p2->footnotes[k].height )
+                return false;
+    }
+    return true;
+}
+
+// returns crc of each page drawn: first, some in the middle, last
+static LVArray<lUInt32> drawPages( LVDocView & view )
+{
+    LVArray<lUInt32> crcs;
+    LVColorDrawBuf buf( view.GetWidth(), view.GetHeight(), 32 );
+    int pageCount = view.getPageCount();
+    int pages[5] = { 0, 1, pageCount / 4, pageCount / 2, pageCount - 1 };
+    for ( int i=0; i<5; i++ ) {
+        view.Draw( buf, -1, pages[i], false, false );
+        lUInt32 crc = 0;
+        for ( int y=0; y<buf.GetHeight(); y++ )
+            crc = lStr_crc32( crc, buf.GetScanLine( y ), buf.GetRowSize() );
+        crcs.add( crc );
+    }
+    return crcs;
+}
+
+static bool sameCrcs( LVArray<lUInt32> & a, LVArray<lUInt32> & b )
+{
+    if ( a.length() != b.length() )
+        return false;
+    for ( int i=0; i<a.length(); i++ )
+        if ( a[i] != b[i] )
+            return false;
+    return true;
+}
+
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+static void checkPageDrawLists( const lString8 & book )
+{
+    LVDocView view;
+    if ( !check( "book rendered", loadBook( view, book, 600, 800 ) ) )
+        return;
+    int pageCount = view.getPageCount() < 15 ? view.getPageCount() : 15;
+    LVColorDrawBuf direct( 600, 800, 32 );
+    LVColorDrawBuf recorded( 600, 800, 32 );
+    LVColorDrawBuf replayed( 600, 800, 32 );
+    bool ok = true;
+    for ( int p=0; p<pageCount; p++ ) {
+        view.setPageDrawListEnabled( false );
+        view.Draw( direct, -1, p, false, false );
+        view.setPageDrawListEnabled( true );
+        view.Draw( recorded, -1, p, false, false );
+        view.Draw( replayed, -1, p, false, false );
+        ok = ok && sameBuffers( direct, recorded ) && sameBuffers( direct, replayed );
+    }
+    check( "pages drawn from draw lists equal pages drawn directly", ok );
+}
+#endif
+
+static void checkRepagination( const lString8 & book )
+{
+    static const int heights[] = { 760, 800, 700, 900, 640, 800 };
+    LVDocView view;
+    if ( !loadBook( view, book, 600, 800 ) )
+        return;
+    for ( unsigned k=0; k<sizeof(heights)/sizeof(heights[0]); k++ ) {
+        view.Resize( 600, heights[k] );
+        view.checkRender();
+        LVDocView full;
+        loadBook( full, book, 600, heights[k] );
+        char name[64];
+        sprintf( name, "pages after height change to %d equal full render", heights[k] );
+        check( name, samePages( view.getPageList(), full.getPageList() ) );
+    }
+}
+
+static void checkWol( const lString8 & book, const lString16 & dir )
+{
+    LVDocView view;
+    if ( !loadBook( view, book, 600, 800 ) )
+        return;
+    LVArray<lUInt8> files[2];
+    for ( int threaded=0; threaded<2; threaded++ ) {
+        useThreads( threaded != 0 );
+        lString16 fileName = dir + (threaded ? "threads.wol" : "book.wol");
+        if ( view.exportWolFile( fileName.c_str(), true, 3 ) )
+            readFile( fileName, files[threaded] );
+    }
+    useThreads( false );
+    check( "WOL export", !files[0].empty() );
+    check( "WOL export with encoder threads equals sequential", sameBytes( files[1], files[0].get(), files[0].length() ) );
+}
+
+static void checkDocumentCache( const lString8 & book, const lString16 & dir )
+{
+    if ( !ldomDocCache::init( dir, 256 * 1024 * 1024 ) )
+        return;
+    LVArray<lUInt32> expected;
+    {
+        LVDocView view;
+        if ( !loadBook( view, book, 600, 800 ) )
+            return;
+        expected = drawPages( view );
+    }
+    // saved on calling thread, then by writer thread
+    for ( int threaded=0; threaded<2; threaded++ ) {
+        useThreads( threaded != 0 );
+        ldomDocCache::clear();
+        {
+            LVDocView view;
+            loadBook( view, book, 600, 800 );
+            view.updateCache();
+            view.close();
+        }
+        LVDocView view;
+        bool loaded = loadBook( view, book, 600, 800 );
+        int parts = 0;
+        int total = 0;
+        if ( loaded )
+            view.getDocument()->getNodePartStats( parts, total );
+        LVArray<lUInt32> crcs = drawPages( view );
+        char name[64];
+        sprintf( name, "pages of book reopened from cache equal%s", threaded ? ", writer thread" : "" );
+        check( name, loaded && total > 0 && sameCrcs( crcs, expected ) );
+    }
+    useThreads( false );
+    ldomDocCache::clear();
+    ldomDocCache::close();
+}
+
+static lString16 subDir( const lString16 & dir, const char * name )
+{
+    lString16 path = dir + name;
+    LVAppendPathDelimiter( path );
+    LVCreateDirectory( path );
+    return path;
+}
+
+int main(int argc, char* argv[])
+{
+    const char * fontFile = NULL;
+    int i = 1;
+    if ( i+1<argc && !strcmp(argv[i], "-f") ) {
+        fontFile = argv[i+1];
+        i += 2;
+    }
+    if ( i+1 != argc ) {
+        printf("Usage: crengine-test [-f <font file>] <work dir>\n");
+        return 2;
+    }
+    lString16 dir = Utf8ToUnicode( lString8(argv[i]) );
+    LVAppendPathDelimiter( dir );
+    LVCreateDirectory( dir );
+    InitFontManager( lString8::empty_str );
+
+    checkMixedWidthNames();
+    checkUtf8Validation();
+    checkCharStat();
+    checkCharsetDetection();
+    checkTextImport();
+    checkFb2Metadata();
+    checkFb2Binaries();
+    checkMobi( dir );
+    checkDocx();
+    checkGlyphBlending();
+    checkPixelConversion();
+    checkStyleSheetCache( subDir( dir, "css" ) );
+    checkCacheCatalog( subDir( dir, "catalog" ) );
+
+    if ( fontFile ) {
+        checkFontScanCache( fontFile, dir );
+        lString8 book = makeFb2Book();
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+        checkPageDrawLists( book );
+#endif
+        checkRepagination( book );
+        checkWol( book, dir );
+        checkDocumentCache( book, subDir( dir, "cache" ) );
+    } else {
+        printf("no font given, document rendering is not checked\n");
+    }
+    ShutdownFontManager();
+    if ( failedChecks ) {
+        printf("%d checks failed\n", failedChecks);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
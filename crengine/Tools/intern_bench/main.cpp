@@ -0,0 +1,80 @@
+// Element/attribute name and attribute value interning benchmark
+// Usage: intern_bench [<xml or fb2 file> [<repeat count>]]
+//   without file, only synthetic lookups are measured; with file, it's parsed into DOM <repeat count> times
+
+#include "lvstring.h"
+#include "lvstream.h"
+#include "lstridmap.h"
+#include "lvstring16hashedcollection.h"
+#include "lvtinydom.h"
+#include "lvfntman.h"
+#include "crtimerutil.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fb2def.h"
+#define XS_IMPLEMENT_SCHEME 1
+#include "fb2def.h"
+
+static void benchNameIdMap()
+{
+    LDOMNameIdMap map( MAX_ELEMENT_TYPE_ID );
+    lString16Collection names;
+    int count = 0;
+    for ( const elem_def_t * p = fb2_elem_table; p->id; p++, count++ ) {
+        map.AddItem( p->id, lString16(p->name), &p->props );
+        names.add( lString16(p->name) );
+    }
+    const int iterations = 2000000;
+    CRTimerUtil timer;
+    int found = 0;
+    for ( int i=0; i<iterations; i++ )
+        if ( map.idByName( names[i % count].c_str() ) )
+            found++;
+    printf("LDOMNameIdMap: %d names, %d lookups in %d ms (%d found)\n", count, iterations, (int)timer.elapsed(), found);
+}
+
+static void benchAttrValues()
+{
+    lString16HashedCollection values( 256 );
+    lString16Collection src;
+    const int count = 20000;
+    for ( int i=0; i<count; i++ )
+        src.add( lString16("id_") + fmt::decimal(rand()) );
+    const int iterations = 2000000;
+    CRTimerUtil timer;
+    lInt64 sum = 0;
+    for ( int i=0; i<iterations; i++ )
+        sum += values.add( src[i % count].c_str() );
+    printf("lString16HashedCollection: %d values, %d add/lookups in %d ms (%d interned)\n",
+           count, iterations, (int)timer.elapsed(), values.length());
+}
+
+int main(int argc, char* argv[])
+{
+    InitFontManager( lString8::empty_str );
+    benchNameIdMap();
+    benchAttrValues();
+    if ( argc < 2 )
+        return 0;
+    int repeat = argc > 2 ? atoi(argv[2]) : 10;
+    lInt64 total = 0;
+    for ( int i=0; i<repeat; i++ ) {
+        LVStreamRef stream = LVOpenFileStream( argv[1], LVOM_READ );
+        if ( stream.isNull() ) {
+            printf("cannot open %s\n", argv[1]);
+            return 1;
+        }
+        CRTimerUtil timer;
+        ldomDocument * doc = LVParseXMLStream( stream, fb2_elem_table, fb2_attr_table, fb2_ns_table );
+        total += timer.elapsed();
+        if ( !doc ) {
+            printf("cannot parse %s\n", argv[1]);
+            return 1;
+        }
+        delete doc;
+    }
+    printf("%s parsed %d times, %.1f ms per parse\n", argv[1], repeat, (double)total / repeat);
+    return 0;
+}
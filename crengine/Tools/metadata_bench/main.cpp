@@ -0,0 +1,100 @@
+// Header-only metadata extraction benchmark: reports time per book for FB2, FB2.ZIP and EPUB files
+// Usage: metadata_bench [-c] <file or directory>...
+//   -c    extract cover image too
+
+#include "lvstring.h"
+#include "lvstream.h"
+#include "lvxml.h"
+#include "epubfmt.h"
+#include "crlog.h"
+#include "lvfntman.h"
+#include "crtimerutil.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static bool extractCover = false;
+static int booksCount = 0;
+static int failedCount = 0;
+static lInt64 totalTime = 0;
+
+static bool parseBook( LVStreamRef stream, const lString16 & name, LVDocMetadata & metadata )
+{
+    lString16 lname = name;
+    lname.lowercase();
+    if ( lname.endsWith(".epub") )
+        return GetEpubMetadata( stream, metadata, extractCover );
+    if ( lname.endsWith(".fb2.zip") || lname.endsWith(".zip") ) {
+        LVContainerRef arc = LVOpenArchieve( stream );
+        if ( arc.isNull() )
+            return false;
+        for ( int i=0; i<arc->GetObjectCount(); i++ ) {
+            const LVContainerItemInfo * item = arc->GetObjectInfo(i);
+            if ( item && !item->IsContainer() && lString16(item->GetName()).lowercase().endsWith(".fb2") ) {
+                LVStreamRef fb2 = arc->OpenStream( item->GetName(), LVOM_READ );
+                return LVParseFB2Metadata( fb2, metadata, extractCover );
+            }
+        }
+        return false;
+    }
+    return LVParseFB2Metadata( stream, metadata, extractCover );
+}
+
+static void benchFile( const lString16 & path )
+{
+    lString16 lname = path;
+    lname.lowercase();
+    if ( !lname.endsWith(".fb2") && !lname.endsWith(".fb2.zip") && !lname.endsWith(".epub") )
+        return;
+    CRTimerUtil timer;
+    LVStreamRef stream = LVOpenFileStream( path.c_str(), LVOM_READ );
+    LVDocMetadata metadata;
+    bool res = !stream.isNull() && parseBook( stream, path, metadata );
+    lInt64 elapsed = timer.elapsed();
+    totalTime += elapsed;
+    booksCount++;
+    if ( !res ) {
+        failedCount++;
+        printf("%5d ms  FAILED  %s\n", (int)elapsed, LCSTR(path));
+        return;
+    }
+    printf("%5d ms  %s  [%s] \"%s\"%s\n", (int)elapsed, LCSTR(path), LCSTR(metadata.getAuthors()), LCSTR(metadata.title),
+           metadata.cover.isNull() ? "" : " +cover");
+}
+
+static void benchDir( const lString16 & path )
+{
+    LVContainerRef dir = LVOpenDirectory( path );
+    if ( dir.isNull() ) {
+        benchFile( path );
+        return;
+    }
+    for ( int i=0; i<dir->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = dir->GetObjectInfo(i);
+        lString16 itemPath = LVCombinePaths( path, item->GetName() );
+        if ( item->IsContainer() )
+            benchDir( itemPath );
+        else
+            benchFile( itemPath );
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if ( argc < 2 ) {
+        printf("usage: metadata_bench [-c] <file or directory>...\n");
+        return 1;
+    }
+    // EPUB container.xml is still parsed into a small DOM, which needs font manager
+    InitFontManager( lString8::empty_str );
+    for ( int i=1; i<argc; i++ ) {
+        if ( !strcmp(argv[i], "-c") ) {
+            extractCover = true;
+            continue;
+        }
+        benchDir( LocalToUnicode(lString8(argv[i])) );
+    }
+    printf("%d books (%d failed), total %d ms, %.2f ms per book\n", booksCount, failedCount, (int)totalTime,
+           booksCount ? (double)totalTime / booksCount : 0.0);
+    return 0;
+}
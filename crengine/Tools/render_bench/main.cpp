@@ -0,0 +1,1168 @@
+// Document rendering benchmark: reports render time and heap allocations count for several font sizes.
+// Only timings are reported, results of measured code are checked by crengine-test.
+// Usage: render_bench [-f <font file>]... [-h <highlights count>] [-r <redraws count>] [-w <wol file>] [-c <cache dir>] [-m <storage size factor>] <document> [<width> <height>]
+//        render_bench -g
+//        render_bench -p
+//        render_bench -d <cache dir>
+//        render_bench -s <css file> <cache dir>
+//        render_bench -k <corpus dir> [<text file>]
+//        render_bench -t <font dir> <scan cache file>
+//        render_bench -u <font file> <fallback font face>
+//        render_bench -e <cache dir> <epub file>...
+//        render_bench -x <text file>
+//        render_bench -a <text file>...
+//        render_bench -b <font file> <fb2 file>
+//        render_bench -i <font file> <chm file>
+//        render_bench -o <font file> <docx file>
+//        render_bench -v <font file> <document>
+//   -h    select this number of words over the document, then measure drawing of all pages
+//   -r    draw each of first pages this number of times, with and without recorded page drawing
+//   -w    export document to WOL file, sequentially and with encoder threads
+//   -c    save document to cache in this directory, then measure reopening it from cache and turning pages,
+//         with cache file written on calling thread and by writer thread
+//   -m    scale unpacked document storage space by this factor
+//   -g    measure antialiased glyph blending into e-reader sized buffers, no document needed
+//   -p    measure e-ink frame conversion, dithering and rotation, no document needed
+//   -d    measure document cache catalog with thousands of cache files in this directory, no document needed
+//   -s    measure stylesheet parsing for new documents: without cache, from compiled stylesheets in memory
+//         and from ones saved in this directory
+//   -k    measure unpacking of MOBI/PDB books in this directory, first writing PalmDOC and HUFF/CDIC
+//         compressed books made of text file to it when one is given
+//   -t    measure font manager startup registering all fonts under this directory: without font scan cache,
+//         writing it and reading it back
+//   -u    measure drawing and measuring of mixed script text with glyphs missing in font taken from fallback font,
+//         and language support checks, with charmap lookups and with unicode coverage of faces
+//   -e    measure opening books with embedded fonts, all kept open: fonts decoded to memory, decoded and written
+//         to document font cache in this directory, and mapped from it
+//   -x    measure import of plain text file: format detection and paragraphs passed to parser callback
+//   -a    measure charset autodetection of text files
+//   -b    measure loading of FB2 book with images, and reading of all its binaries as image streams and sources
+//   -i    measure opening of CHM book, merging all its topics into document
+//   -o    measure import of DOCX document, with parts inflated on calling thread and by reader thread
+//   -v    measure rendering after page height changes, repaginating lines of last render, and full rendering
+//         at each page height
+
+#include "lvstring.h"
+#include "lvstream.h"
+#include "lvdocview.h"
+#include "crlog.h"
+#include "lvfntman.h"
+#include "crtimerutil.h"
+#include "crconcurrent.h"
+#include "pdbfmt.h"
+#include "crtxtenc.h"
+#include "../../src/private/lvfreetypeface.h"
+#include "../../src/private/lvdocfontcache.h"
+#include "mobiwriter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(__GLIBC__)
+// count heap allocations by wrapping glibc allocator
+extern "C" {
+void * __libc_malloc( size_t size );
+void * __libc_calloc( size_t n, size_t size );
+void * __libc_realloc( void * p, size_t size );
+void __libc_free( void * p );
+}
+
+static volatile lInt64 allocCount = 0;
+
+void * malloc( size_t size ) { allocCount++; return __libc_malloc( size ); }
+void * calloc( size_t n, size_t size ) { allocCount++; return __libc_calloc( n, size ); }
+void * realloc( void * p, size_t size ) { allocCount++; return __libc_realloc( p, size ); }
+void free( void * p ) { __libc_free( p ); }
+#define ALLOC_COUNT_SUPPORTED 1
+#else
+static lInt64 allocCount = 0;
+#define ALLOC_COUNT_SUPPORTED 0
+#endif
+
+static void benchHighlights( LVDocView & view, int highlights )
+{
+    int pageCount = view.getPageCount();
+    LVArray<ldomWord> words;
+    for ( int p=0; p<pageCount; p++ ) {
+        LVRef<ldomXRange> range = view.getPageDocumentRange( p );
+        if ( !range.isNull() )
+            range->getRangeWords( words );
+    }
+    if ( words.empty() )
+        return;
+    ldomXRangeList ranges;
+    int step = words.length() > highlights ? words.length() / highlights : 1;
+    for ( int w=0; w<words.length() && ranges.length()<highlights; w += step ) {
+        ldomXRange * r = new ldomXRange( words[w] );
+        r->setFlags( 1 );
+        ranges.add( r );
+    }
+    CRTimerUtil selectTimer;
+    view.selectRanges( ranges );
+    printf("%d highlights selected in %d ms, %d marked ranges\n", ranges.length(), (int)selectTimer.elapsed(),
+           view.getMarkedRanges()->length());
+    LVColorDrawBuf buf( view.GetWidth(), view.GetHeight(), 32 );
+    lInt64 allocs = allocCount;
+    CRTimerUtil timer;
+    for ( int p=0; p<pageCount; p++ )
+        view.Draw( buf, -1, p, false, false );
+    lInt64 elapsed = timer.elapsed();
+    allocs = allocCount - allocs;
+    printf("%d pages drawn: %d ms", pageCount, (int)elapsed);
+    if ( ALLOC_COUNT_SUPPORTED )
+        printf("  %lld allocations", (long long)allocs);
+    printf("\n");
+}
+
+#if defined(_LINUX)
+#include <pthread.h>
+#include <unistd.h>
+
+// minimal pthread based concurrency provider, to measure code using worker threads
+class BenchMutex : public CRMonitor {
+protected:
+    pthread_mutex_t _mutex;
+    pthread_cond_t _cond;
+public:
+    BenchMutex() { pthread_mutex_init( &_mutex, NULL ); pthread_cond_init( &_cond, NULL ); }
+    virtual ~BenchMutex() { pthread_cond_destroy( &_cond ); pthread_mutex_destroy( &_mutex ); }
+    virtual void acquire() { pthread_mutex_lock( &_mutex ); }
+    virtual void release() { pthread_mutex_unlock( &_mutex ); }
+    virtual void wait() { pthread_cond_wait( &_cond, &_mutex ); }
+    virtual void notify() { pthread_cond_signal( &_cond ); }
+    virtual void notifyAll() { pthread_cond_broadcast( &_cond ); }
+};
+
+class BenchThread : public CRThread {
+    CRRunnable * _task;
+    pthread_t _thread;
+    bool _started;
+    static void * start_routine( void * param ) { ((BenchThread*)param)->_task->run(); return NULL; }
+public:
+    BenchThread( CRRunnable * task ) : _task(task), _started(false) { }
+    virtual ~BenchThread() { join(); }
+    virtual void start() { _started = pthread_create( &_thread, NULL, &start_routine, this ) == 0; }
+    virtual void join() { if ( _started ) { pthread_join( _thread, NULL ); _started = false; } }
+};
+
+class BenchConcurrencyProvider : public CRConcurrencyProvider {
+public:
+    virtual CRMutex * createMutex() { return new BenchMutex(); }
+    virtual CRMonitor * createMonitor() { return new BenchMutex(); }
+    virtual CRThread * createThread( CRRunnable * threadTask ) { return new BenchThread( threadTask ); }
+    virtual void executeGui( CRRunnable * task ) { task->run(); delete task; }
+    virtual void executeGui( CRRunnable * task, int delayMillis ) { CR_UNUSED(delayMillis); if ( task ) executeGui( task ); }
+    virtual void sleepMs( int durationMs ) { usleep( durationMs * 1000 ); }
+};
+#endif
+
+static void benchWol( LVDocView & view, const char * fileName )
+{
+    for ( int threaded=0; threaded<2; threaded++ ) {
+#if defined(_LINUX)
+        static BenchConcurrencyProvider provider;
+        concurrencyProvider = threaded ? &provider : NULL;
+#else
+        if ( threaded )
+            break;
+#endif
+        int pageCount = view.getPageCount();
+        CRTimerUtil timer;
+        if ( !view.exportWolFile( fileName, true, 3 ) ) {
+            printf("Cannot export %s\n", fileName);
+            return;
+        }
+        lInt64 elapsed = timer.elapsed();
+        LVStreamRef stream = LVOpenFileStream( fileName, LVOM_READ );
+        printf("WOL export%s: %d pages in %d ms, %d pages/s, %d bytes\n", threaded ? ", encoder threads" : "",
+               pageCount, (int)elapsed, elapsed > 0 ? (int)(pageCount * 1000 / elapsed) : pageCount,
+               stream.isNull() ? 0 : (int)stream->GetSize());
+    }
+    concurrencyProvider = NULL;
+}
+
+static void benchCache( const char * fileName, const char * cacheDir, int dx, int dy )
+{
+    if ( !ldomDocCache::init( Utf8ToUnicode( lString8(cacheDir) ), 256 * 1024 * 1024 ) ) {
+        printf("Cannot init document cache in %s\n", cacheDir);
+        return;
+    }
+    // save and reopen, then the same with cache file written by writer thread
+    for ( int pass=0; pass<4; pass++ ) {
+        bool save = (pass & 1) == 0;
+        bool threaded = pass >= 2;
+        if ( threaded ) {
+#if defined(_LINUX)
+            static BenchConcurrencyProvider provider;
+            concurrencyProvider = &provider;
+            if ( save )
+                ldomDocCache::clear();
+#else
+            break;
+#endif
+        }
+        LVDocView view;
+        view.Resize( dx, dy );
+        CRTimerUtil timer;
+        if ( !view.LoadDocument( fileName ) ) {
+            printf("Cannot open document %s\n", fileName);
+            break;
+        }
+        view.checkRender();
+        lInt64 openTime = timer.elapsed();
+        lInt64 saveTime = 0;
+        if ( save ) {
+            timer.restart();
+            view.updateCache();
+            saveTime = timer.elapsed();
+        }
+        int loaded = 0;
+        int total = 0;
+        view.getDocument()->getNodePartStats( loaded, total );
+        // draw pages from start and middle of document: only node parts these pages refer to should be loaded
+        LVColorDrawBuf buf( dx, dy, 32 );
+        int pageCount = view.getPageCount();
+        int pages[3] = { 0, pageCount / 4, pageCount / 2 };
+        timer.restart();
+        for ( int p=0; p<3; p++ )
+            view.Draw( buf, -1, pages[p], false, false );
+        lInt64 drawTime = timer.elapsed();
+        int drawLoaded = 0;
+        view.getDocument()->getNodePartStats( drawLoaded, total );
+        printf("%s%s: %5d ms  %d/%d node parts loaded, 3 pages drawn %d ms  %d/%d node parts loaded\n",
+               save ? "open  " : "reopen", threaded ? " (writer thread)" : "", (int)openTime, loaded, total, (int)drawTime, drawLoaded, total);
+        if ( save ) {
+            // closing waits for writer thread to finish saving
+            timer.restart();
+            view.close();
+            printf("save: updateCache %d ms, close %d ms\n", (int)saveTime, (int)timer.elapsed());
+            continue;
+        }
+        // turn pages forward from the middle, then show how storages were used
+        int turns = 0;
+        timer.restart();
+        for ( int p=pages[2]+1; p<pageCount && turns<300; p++, turns++ )
+            view.Draw( buf, -1, p, false, false );
+        printf("%d page turns: %d ms\n", turns, (int)timer.elapsed());
+        lString8 stats = UnicodeToUtf8( view.getDocument()->getStatistics() );
+        lString8Collection lines( stats, cs8("\n") );
+        for ( int k=0; k<lines.length(); k++ )
+            if ( lines[k].pos( "storage:" ) >= 0 )
+                printf("  %s\n", lines[k].c_str());
+    }
+    concurrencyProvider = NULL;
+    ldomDocCache::close();
+}
+
+static void benchCacheCatalog( const char * cacheDir )
+{
+    const int books = 3000;
+    const lvsize_t maxSize = 64 * 1024 * 1024;
+    lString16 dir = Utf8ToUnicode( lString8(cacheDir) );
+    if ( !ldomDocCache::init( dir, maxSize ) ) {
+        printf("Cannot init document cache in %s\n", cacheDir);
+        return;
+    }
+    ldomDocCache::clear();
+    // 3000 books with 40K cache files each: budget holds about half of them
+    CRTimerUtil timer;
+    for ( int b=0; b<books; b++ ) {
+        lString16 path;
+        lString16 name = lString16("book") + lString16::itoa(b) + ".fb2";
+        LVStreamRef stream = ldomDocCache::createNew( name, (lUInt32)b, 0, 400 * 1024, path );
+        if ( stream.isNull() ) {
+            printf("Cannot create cache file for %s\n", LCSTR(name));
+            return;
+        }
+        stream.Clear();
+        ldomDocCache::updateFileSize( path, 40 * 1024 );
+    }
+    printf("%d cache files created: %d ms\n", books, (int)timer.elapsed());
+    ldomDocCache::close();
+    timer.restart();
+    ldomDocCache::init( dir, maxSize );
+    printf("cache init: %d ms\n", (int)timer.elapsed());
+    timer.restart();
+    int found = 0;
+    for ( int b=0; b<books; b++ ) {
+        lString16 path;
+        lString16 name = lString16("book") + lString16::itoa(b) + ".fb2";
+        if ( !ldomDocCache::openExisting( name, (lUInt32)b, 0, path ).isNull() )
+            found++;
+    }
+    printf("%d cache files looked up: %d ms, %d found\n", books, (int)timer.elapsed(), found);
+    ldomDocCache::clear();
+    ldomDocCache::close();
+}
+
+static lUInt32 parseStyleSheet( const lString8 & css, int passes, lInt64 & elapsed )
+{
+    lUInt32 hash = 0;
+    elapsed = 0;
+    for ( int p=0; p<passes; p++ ) {
+        ldomDocument * doc = new ldomDocument();
+        CRTimerUtil timer;
+        doc->setStyleSheet( css.c_str(), true );
+        elapsed += timer.elapsed();
+        hash = doc->getStyleSheet()->getHash();
+        delete doc;
+    }
+    return hash;
+}
+
+static void benchStyleSheet( const char * cssFile, const char * cacheDir )
+{
+    const int passes = 200;
+    lString8 css;
+    if ( !LVLoadStylesheetFile( Utf8ToUnicode( lString8(cssFile) ), css ) ) {
+        printf("Cannot read stylesheet %s\n", cssFile);
+        return;
+    }
+    lString16 dir = Utf8ToUnicode( lString8(cacheDir) );
+    lInt64 elapsed;
+    LVStyleSheetCache::setMaxSize( 0 );
+    lUInt32 hash = parseStyleSheet( css, passes, elapsed );
+    printf("%d documents, %d bytes of CSS parsed: %d ms  hash %08x\n", passes, css.length(), (int)elapsed, hash);
+    LVStyleSheetCache::setMaxSize( 0x400000 );
+    LVStyleSheetCache::setCacheDir( dir );
+    LVStyleSheetCache::clear();
+    parseStyleSheet( css, 1, elapsed );
+    printf("first document, stylesheet compiled and cached: %d ms\n", (int)elapsed);
+    hash = parseStyleSheet( css, passes, elapsed );
+    printf("%d documents, stylesheet restored from memory: %d ms  hash %08x\n", passes, (int)elapsed, hash);
+    // as after restart: read back saved compiled stylesheets
+    CRTimerUtil timer;
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+    LVStyleSheetCache::setCacheDir( dir );
+    printf("compiled stylesheets saved and read back: %d ms\n", (int)timer.elapsed());
+    hash = parseStyleSheet( css, 1, elapsed );
+    printf("first document, stylesheet restored from cache file: %d ms  hash %08x\n", (int)elapsed, hash);
+    LVStyleSheetCache::clear();
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+}
+
+static void benchMobi( const char * corpusDir, const char * textFile )
+{
+    lString16 dir = Utf8ToUnicode( lString8(corpusDir) );
+    LVAppendPathDelimiter( dir );
+    if ( textFile ) {
+        LVStreamRef in = LVOpenFileStream( textFile, LVOM_READ );
+        if ( in.isNull() ) {
+            printf("Cannot read %s\n", textFile);
+            return;
+        }
+        LVArray<lUInt8> text;
+        text.addSpace( (int)in->GetSize() );
+        in->Read( text.get(), text.length(), NULL );
+        LVCreateDirectory( dir );
+        if ( !writeMobi( dir + "palmdoc.mobi", text.get(), text.length(), false )
+             || !writeMobi( dir + "huffcdic.mobi", text.get(), text.length(), true ) ) {
+            printf("Cannot write books to %s\n", corpusDir);
+            return;
+        }
+    }
+    LVContainerRef container = LVOpenDirectory( dir.c_str() );
+    if ( container.isNull() ) {
+        printf("Cannot open directory %s\n", corpusDir);
+        return;
+    }
+    // unpack each book: all records are unpacked when opened, then again when read
+    for ( int pass=0; pass<2; pass++ ) {
+#if defined(_LINUX)
+        static BenchConcurrencyProvider provider;
+        concurrencyProvider = pass ? &provider : NULL;
+#else
+        if ( pass )
+            break;
+#endif
+        lInt64 totalSize = 0;
+        lInt64 totalTime = 0;
+        for ( int i=0; i<container->GetObjectCount(); i++ ) {
+            const LVContainerItemInfo * item = container->GetObjectInfo( i );
+            lString16 name = item->GetName();
+            if ( item->IsContainer() || !(name.endsWith(".mobi") || name.endsWith(".prc") || name.endsWith(".azw") || name.endsWith(".pdb")) )
+                continue;
+            LVStreamRef src = LVOpenFileStream( (dir + name).c_str(), LVOM_READ );
+            CRTimerUtil timer;
+            doc_format_t format = doc_format_none;
+            LVStreamRef pdb = src.isNull() ? LVStreamRef() : LVOpenPDBStream( src, format );
+            if ( pdb.isNull() ) {
+                printf("%s: cannot open\n", LCSTR(name));
+                continue;
+            }
+            lInt64 openTime = timer.elapsed();
+            timer.restart();
+            lUInt8 buf[16384];
+            lvsize_t size = 0;
+            for ( ;; ) {
+                lvsize_t bytesRead = 0;
+                if ( pdb->Read( buf, sizeof(buf), &bytesRead ) != LVERR_OK || !bytesRead )
+                    break;
+                size += bytesRead;
+            }
+            lInt64 readTime = timer.elapsed();
+            printf("%s%s: %d KB text, open %d ms, read %d ms, %.1f MB/s\n", LCSTR(name), pass ? " (threads)" : "",
+                   (int)(size / 1024), (int)openTime, (int)readTime,
+                   (double)size * 2 / 1048576 / ((openTime + readTime) ? (openTime + readTime) / 1000.0 : 0.001));
+            totalSize += size * 2;
+            totalTime += openTime + readTime;
+        }
+        if ( totalTime )
+            printf("total%s: %.1f MB unpacked, %.1f MB/s\n", pass ? " (threads)" : "",
+                   (double)totalSize / 1048576, (double)totalSize / 1048576 / (totalTime / 1000.0));
+    }
+    concurrencyProvider = NULL;
+}
+
+static void collectFontFiles( lString16 dir, lString16Collection & files )
+{
+    LVAppendPathDelimiter( dir );
+    LVContainerRef container = LVOpenDirectory( dir.c_str() );
+    if ( container.isNull() )
+        return;
+    for ( int i=0; i<container->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = container->GetObjectInfo( i );
+        lString16 name = item->GetName();
+        if ( item->IsContainer() ) {
+            collectFontFiles( dir + name, files );
+            continue;
+        }
+        lString16 lname = name;
+        lname.lowercase();
+        if ( lname.endsWith(".ttf") || lname.endsWith(".otf") || lname.endsWith(".ttc") || lname.endsWith(".pfb") )
+            files.add( dir + name );
+    }
+}
+
+static void benchFontScan( const char * fontDir, const char * cacheFile )
+{
+    lString16Collection files;
+    collectFontFiles( Utf8ToUnicode( lString8(fontDir) ), files );
+    lString16 cacheFileName = Utf8ToUnicode( lString8(cacheFile) );
+    LVDeleteFile( cacheFileName );
+    const char * passNames[3] = { "without scan cache", "scan cache written", "from scan cache file" };
+    for ( int pass=0; pass<3; pass++ ) {
+        ShutdownFontManager();
+        CRTimerUtil timer;
+        InitFontManager( lString8::empty_str );
+        if ( pass > 0 )
+            fontMan->SetFontScanCacheFile( cacheFileName );
+        int registered = 0;
+        for ( int i=0; i<files.length(); i++ )
+            if ( fontMan->RegisterFont( UnicodeToUtf8( files[i] ) ) )
+                registered++;
+        if ( pass > 0 )
+            fontMan->SaveFontScanCache();
+        lInt64 elapsed = timer.elapsed();
+        lString16Collection faces;
+        fontMan->getFaceList( faces );
+        lUInt32 hash = 0;
+        for ( int i=0; i<faces.length(); i++ )
+            hash = hash * 31 + faces[i].getHash();
+        timer.restart();
+        LVFontRef font = faces.length() ? fontMan->GetFont( 24, 400, false, css_ff_sans_serif, UnicodeToUtf8( faces[0] ), -1 ) : LVFontRef();
+        printf("%-22s %d files, %d registered, %d fonts: %d ms, first font opened in %d ms  hash %08x\n", passNames[pass],
+               files.length(), registered, fontMan->GetFontCount(), (int)elapsed, (int)timer.elapsed(), hash);
+    }
+    LVDeleteFile( cacheFileName );
+}
+
+#if (USE_FREETYPE == 1)
+static lString8 registerFontFace( const char * fontFile )
+{
+    lString16Collection before;
+    fontMan->getFaceList( before );
+    if ( !fontMan->RegisterFont( lString8(fontFile) ) )
+        return lString8::empty_str;
+    lString16Collection after;
+    fontMan->getFaceList( after );
+    for ( int i=0; i<after.length(); i++ )
+        if ( !before.contains( after[i] ) )
+            return UnicodeToUtf8( after[i] );
+    return lString8::empty_str;
+}
+
+static void benchFallback( const char * fontFile, const char * fallbackFontFace )
+{
+    InitFontManager( lString8::empty_str );
+    lString8 face = registerFontFace( fontFile );
+    lString8 fallbackFace( fallbackFontFace );
+    if ( face.empty() ) {
+        printf("Cannot register font %s\n", fontFile);
+        return;
+    }
+    if ( !fontMan->SetFallbackFontFace( fallbackFace ) ) {
+        printf("Fallback font face %s is not found\n", fallbackFontFace);
+        return;
+    }
+    fontMan->SetKerning( true );
+    LVFontRef fontRef = fontMan->GetFont( 24, 400, false, css_ff_sans_serif, face, -1 );
+    LVFreeTypeFace * font = (LVFreeTypeFace *)fontRef.get();
+    LVFreeTypeFace * fallback = (LVFreeTypeFace *)font->getFallbackFont();
+    if ( !fallback ) {
+        printf("No fallback font for %s\n", face.c_str());
+        return;
+    }
+    // words in scripts of main font, of fallback font only, and of none of them
+    const lChar16 * words[] = { L"Reading", L"\x0427\x0442\x0435\x043d\x0438\x0435", L"\x0391\x03bd\x03ac\x03b3\x03bd\x03c9\x03c3\x03b7",
+        L"\x05e7\x05e8\x05d9\x05d0\x05d4", L"\x2190\x2192\x21d2\x2200\x2203", L"\x8aad\x66f8", L"\x3088\x3080", NULL };
+    lString16 line;
+    for ( int i=0; line.length() < 80; i++ ) {
+        line << words[i % 7] << L" ";
+    }
+    LVFontCoverageRef coverage = font->readCoverage();
+    LVFontCoverageRef fallbackCoverage = fallback->readCoverage();
+    const char * langs[] = { "en", "ru", "el", "he", "zh-cn", "ja", NULL };
+    const int passes = 2000;
+    LVColorDrawBuf buf( 1400, 40, 32 );
+    lUInt16 widths[256];
+    lUInt8 flags[256];
+    for ( int pass=0; pass<2; pass++ ) {
+        font->setCoverage( pass ? coverage : LVFontCoverageRef() );
+        fallback->setCoverage( pass ? fallbackCoverage : LVFontCoverageRef() );
+        // fill glyph and width caches
+        buf.Clear( 0xFFFFFF );
+        fontRef->DrawTextString( &buf, 0, 0, line.c_str(), line.length(), '?' );
+        CRTimerUtil timer;
+        for ( int p=0; p<passes; p++ ) {
+            buf.Clear( 0xFFFFFF );
+            fontRef->DrawTextString( &buf, 0, 0, line.c_str(), line.length(), '?' );
+        }
+        lInt64 drawTime = timer.elapsed();
+        timer.restart();
+        int fit = 0;
+        for ( int p=0; p<passes; p++ )
+            fit += fontRef->measureText( line.c_str(), line.length(), widths, flags, 10000, '?', 0, false );
+        lInt64 measureTime = timer.elapsed();
+        timer.restart();
+        int supported = 0;
+        for ( int p=0; p<passes / 20; p++ )
+            for ( int i=0; langs[i]; i++ )
+                supported += fontRef->checkFontLangCompat( lString8(langs[i]) ) ? 1 : 0;
+        lInt64 langTime = timer.elapsed();
+        printf("%-20s %d lines of %d chars: draw %d ms, measure %d ms (%d chars fit, width %d), %d language checks %d ms (%d supported)\n",
+               pass ? "unicode coverage" : "charmap lookups", passes, line.length(), (int)drawTime, (int)measureTime, fit, widths[line.length() - 1],
+               passes / 20 * 6, (int)langTime, supported);
+    }
+    if ( !coverage.isNull() && !fallbackCoverage.isNull() )
+        printf("coverage: %s %d ranges, %s %d ranges\n", face.c_str(), coverage->rangeCount(), fallbackFace.c_str(), fallbackCoverage->rangeCount());
+}
+#endif
+
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+/// returns heap memory in use in KB, 0 if unknown
+static int heapInUseKb()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return (int)((info.uordblks + info.hblkhd) / 1024);
+#else
+    return 0;
+#endif
+}
+
+static void benchEmbeddedFonts( const char * cacheDir, int count, char ** books )
+{
+    InitFontManager( lString8::empty_str );
+    LVDocumentFontCacheImpl * fonts = LVDocumentFontCacheImpl::instance();
+    const char * names[3] = { "decoded to memory", "written to cache dir", "mapped from cache dir" };
+    // first pass warms up allocator and glyph caches, and is not reported
+    for ( int pass=-1; pass<3; pass++ ) {
+        if ( pass == 1 ) {
+            // only fonts are kept in cache dir: documents are parsed in all passes
+            LVDocumentFontCache::setCacheDir( Utf8ToUnicode( lString8(cacheDir) ) );
+            LVDocumentFontCache::clear();
+        }
+        // fonts of documents closed in previous pass are freed before measuring
+        fontMan->gc();
+        fonts->release();
+        fonts->hits = fonts->mapped = fonts->decoded = 0;
+        int heap = heapInUseKb();
+        LVPtrVector<LVDocView> views;
+        CRTimerUtil timer;
+        for ( int i=0; i<count; i++ ) {
+            LVDocView * view = new LVDocView();
+            views.add( view );
+            view->Resize( 600, 800 );
+            if ( !view->LoadDocument( books[i] ) ) {
+                printf("Cannot open document %s\n", books[i]);
+                return;
+            }
+            view->checkRender();
+            LVColorDrawBuf buf( 600, 800, 32 );
+            view->Draw( buf, -1, 0, false, false );
+        }
+        lInt64 elapsed = timer.elapsed();
+        if ( pass >= 0 )
+            printf("%-22s %d books: %5d ms, heap +%5d KB, fonts: %d decoded, %d mapped, %d shared\n",
+                   names[pass], count, (int)elapsed, heapInUseKb() - heap, fonts->decoded, fonts->mapped, fonts->hits);
+        views.clear();
+    }
+    LVDocumentFontCache::setCacheDir( lString16::empty_str );
+}
+
+/// counts tags and text passed by parser, instead of building document
+class TextImportCallback : public LVXMLParserCallback
+{
+public:
+    int tags;
+    lInt64 chars;
+    TextImportCallback() : tags(0), chars(0) { }
+    virtual void OnStop() { }
+    virtual ldomNode * OnTagOpen( const lChar16 * nsname, const lChar16 * tagname )
+    {
+        CR_UNUSED2(nsname, tagname);
+        tags++;
+        return NULL;
+    }
+    virtual void OnTagBody() { }
+    virtual void OnTagClose( const lChar16 * nsname, const lChar16 * tagname )
+    {
+        CR_UNUSED2(nsname, tagname);
+    }
+    virtual void OnAttribute( const lChar16 * nsname, const lChar16 * attrname, const lChar16 * attrvalue )
+    {
+        CR_UNUSED3(nsname, attrname, attrvalue);
+    }
+    virtual void OnText( const lChar16 * text, int len, lUInt32 flags )
+    {
+        CR_UNUSED2(text, flags);
+        chars += len;
+    }
+    virtual bool OnBlob( lString16 name, const lUInt8 * data, int size )
+    {
+        CR_UNUSED3(name, data, size);
+        return false;
+    }
+};
+
+static void benchTextImport( const char * fileName )
+{
+    LVStreamRef stream = LVOpenFileStream( fileName, LVOM_READ );
+    if ( stream.isNull() ) {
+        printf("Cannot open %s\n", fileName);
+        return;
+    }
+    int sizeMb = (int)(stream->GetSize() >> 20);
+    for ( int pass=0; pass<3; pass++ ) {
+        TextImportCallback callback;
+        LVTextParser parser( stream, &callback, false );
+        lInt64 allocs = allocCount;
+        CRTimerUtil timer;
+        if ( !parser.CheckFormat() ) {
+            printf("Not a text file: %s\n", fileName);
+            return;
+        }
+        parser.Parse();
+        lInt64 elapsed = timer.elapsed();
+        printf("import %d MB: %5d ms (%d MB/s), %d allocations, %d tags, %d chars\n",
+               sizeMb, (int)elapsed, elapsed ? (int)(sizeMb * 1000 / elapsed) : 0,
+               (int)(allocCount - allocs), callback.tags, (int)callback.chars);
+    }
+}
+
+static void collectBinaryIds( ldomNode * node, lString16Collection & ids )
+{
+    if ( !node->isElement() )
+        return;
+    if ( node->isNodeName("binary") ) {
+        lString16 id = node->getAttributeValue("id");
+        if ( !id.empty() )
+            ids.add( id );
+        return;
+    }
+    for ( int i=0; i<(int)node->getChildCount(); i++ )
+        collectBinaryIds( node->getChildNode(i), ids );
+}
+
+#define BENCH_IMAGE_PASSES 3
+
+static void benchBinaries( const char * fileName )
+{
+    // first load warms up allocator, and is not reported
+    for ( int pass=0; pass<2; pass++ ) {
+        int heap = heapInUseKb();
+        LVDocView view;
+        view.Resize( 600, 800 );
+        view.setPageHeaderInfo( 0 );
+        CRTimerUtil timer;
+        if ( !view.LoadDocument( fileName ) ) {
+            printf("Cannot open document %s\n", fileName);
+            return;
+        }
+        lInt64 loadTime = timer.elapsed();
+        if ( pass == 0 )
+            continue;
+        printf("load: %5d ms, heap +%d KB\n", (int)loadTime, heapInUseKb() - heap);
+        ldomDocument * doc = view.getDocument();
+        lString16Collection ids;
+        collectBinaryIds( doc->getRootNode(), ids );
+        lInt64 bytes = 0;
+        timer.restart();
+        for ( int k=0; k<BENCH_IMAGE_PASSES; k++ ) {
+            for ( int i=0; i<ids.length(); i++ ) {
+                LVStreamRef stream = doc->getObjectImageStream( cs16("#") + ids[i] );
+                if ( stream.isNull() )
+                    continue;
+                // read in chunks like image decoders do
+                lUInt8 buf[4096];
+                lvsize_t bytesRead = 0;
+                while ( stream->Read( buf, sizeof(buf), &bytesRead ) == LVERR_OK && bytesRead > 0 )
+                    bytes += bytesRead;
+            }
+        }
+        lInt64 streamTime = timer.elapsed();
+        timer.restart();
+        int decoded = 0;
+        for ( int k=0; k<BENCH_IMAGE_PASSES; k++ ) {
+            for ( int i=0; i<ids.length(); i++ ) {
+                LVImageSourceRef img = doc->getObjectImageSource( cs16("#") + ids[i] );
+                if ( !img.isNull() && img->GetWidth() > 0 )
+                    decoded++;
+            }
+        }
+        lInt64 imageTime = timer.elapsed();
+        printf("%d binaries read %d times: streams %5d ms (%d KB), image sources %5d ms (%d decoded)\n",
+               ids.length(), BENCH_IMAGE_PASSES, (int)streamTime, (int)(bytes / 1024), (int)imageTime, decoded);
+        timer.restart();
+        LVImageSourceRef cover = view.getCoverPageImage();
+        printf("cover: %d ms, %dx%d\n", (int)timer.elapsed(), cover.isNull() ? 0 : cover->GetWidth(), cover.isNull() ? 0 : cover->GetHeight());
+    }
+}
+
+static void benchChmImport( const char * fileName )
+{
+    for ( int pass=0; pass<3; pass++ ) {
+        LVDocView view;
+        view.Resize( 600, 800 );
+        CRTimerUtil timer;
+        if ( !view.LoadDocument( fileName ) ) {
+            printf("Cannot open document %s\n", fileName);
+            return;
+        }
+        lInt64 elapsed = timer.elapsed();
+        ldomNode * body = view.getDocument()->getRootNode()->findChildElement( LXML_NS_ANY, view.getDocument()->getElementNameIndex(L"body"), -1 );
+        int fragments = body ? body->getChildCount() : 0;
+        lString16 text = view.getDocument()->getRootNode()->getText();
+        printf("open: %5d ms, %d fragments, %d chars\n", (int)elapsed, fragments, text.length());
+    }
+}
+
+static void benchDocxImport( const char * fileName )
+{
+    for ( int pass=0; pass<4; pass++ ) {
+        bool threaded = (pass & 1) != 0;
+#if defined(_LINUX)
+        static BenchConcurrencyProvider provider;
+        concurrencyProvider = threaded ? &provider : NULL;
+#else
+        if ( threaded )
+            continue;
+#endif
+        LVDocView view;
+        view.Resize( 600, 800 );
+        CRTimerUtil timer;
+        if ( !view.LoadDocument( fileName ) ) {
+            printf("Cannot open document %s\n", fileName);
+            break;
+        }
+        lInt64 elapsed = timer.elapsed();
+        // size of whole DOM, inline formatting tags included
+        LVStreamRef stream = LVCreateMemoryStream( NULL, 0, false, LVOM_WRITE );
+        view.getDocument()->saveToStream( stream, "utf-8" );
+        printf("open%s: %5d ms, %d KB of XML\n", threaded ? " (reader thread)" : "", (int)elapsed,
+               (int)(stream->GetSize() / 1024));
+    }
+    concurrencyProvider = NULL;
+}
+
+static void benchRepaginate( const char * fileName )
+{
+    static const int heights[] = { 760, 800, 700, 900, 640, 800 };
+    LVDocView view;
+    view.Resize( 600, 800 );
+    if ( !view.LoadDocument( fileName ) ) {
+        printf("Cannot open document %s\n", fileName);
+        return;
+    }
+    view.checkRender();
+    for ( unsigned k=0; k<sizeof(heights)/sizeof(heights[0]); k++ ) {
+        view.Resize( 600, heights[k] );
+        CRTimerUtil timer;
+        view.checkRender();
+        lInt64 elapsed = timer.elapsed();
+        // same page height in a view rendered from scratch
+        LVDocView full;
+        full.Resize( 600, heights[k] );
+        full.LoadDocument( fileName );
+        CRTimerUtil fullTimer;
+        full.checkRender();
+        lInt64 fullElapsed = fullTimer.elapsed();
+        printf("height %3d: %5d ms (full render %5d ms)  %4d pages\n", heights[k], (int)elapsed,
+               (int)fullElapsed, view.getPageCount());
+    }
+}
+
+// same as buffer size used by text parsers for encoding detection
+#define BENCH_AUTODETECT_BUF_SIZE 0x20000
+#define BENCH_AUTODETECT_REPEATS 20
+
+static void benchCharsetDetection( int count, char ** files )
+{
+    lInt64 totalTime = 0;
+    int totalKb = 0;
+    for ( int i=0; i<count; i++ ) {
+        LVStreamRef stream = LVOpenFileStream( files[i], LVOM_READ );
+        if ( stream.isNull() ) {
+            printf("Cannot open %s\n", files[i]);
+            continue;
+        }
+        int size = (int)stream->GetSize();
+        if ( size > BENCH_AUTODETECT_BUF_SIZE )
+            size = BENCH_AUTODETECT_BUF_SIZE;
+        LVArray<lUInt8> buf( size, 0 );
+        stream->Read( buf.get(), size, NULL );
+        char cp_name[32];
+        char lang_name[32];
+        cp_name[0] = lang_name[0] = 0;
+        CRTimerUtil timer;
+        for ( int k=0; k<BENCH_AUTODETECT_REPEATS; k++ ) {
+            bool hasTags = hasXmlTags( buf.get(), size );
+            AutodetectCodePage( buf.get(), size, cp_name, lang_name, hasTags );
+        }
+        totalTime += timer.elapsed();
+        totalKb += size / 1024;
+    }
+    printf("%d files, %d KB detected %d times: %d ms, %d us per file\n", count, totalKb, BENCH_AUTODETECT_REPEATS,
+           (int)totalTime, count ? (int)(totalTime * 1000 / count / BENCH_AUTODETECT_REPEATS) : 0);
+}
+
+static void benchRedraw( LVDocView & view, int redraws )
+{
+    int pageCount = view.getPageCount();
+    if ( pageCount > 20 )
+        pageCount = 20;
+    LVColorDrawBuf buf( view.GetWidth(), view.GetHeight(), 32 );
+    for ( int enabled=0; enabled<2; enabled++ ) {
+        view.setPageDrawListEnabled( enabled != 0 );
+        lInt64 elapsed = 0;
+        for ( int p=0; p<pageCount; p++ ) {
+            CRTimerUtil timer;
+            for ( int r=0; r<redraws; r++ )
+                view.Draw( buf, -1, p, false, false );
+            elapsed += timer.elapsed();
+        }
+        printf("%d pages drawn %d times, draw lists %s: %d ms\n", pageCount, redraws,
+               enabled ? "on" : "off", (int)elapsed);
+    }
+}
+#endif
+
+static void benchGlyphs()
+{
+    // synthetic antialiased glyphs: solid core, soft edges, empty margins
+    const int gw = 18;
+    const int gh = 24;
+    const int glyphKinds = 16;
+    LVArray<lUInt8> bitmaps( gw * gh * glyphKinds, 0 );
+    for ( int k=0; k<glyphKinds; k++ ) {
+        lUInt8 * bmp = bitmaps.get() + k * gw * gh;
+        for ( int y=0; y<gh; y++ ) {
+            for ( int x=0; x<gw; x++ ) {
+                int dx = x*2 - gw + (k & 3);
+                int dy = y*2 - gh + (k >> 2);
+                int d = dx*dx + dy*dy;
+                int r = (gw - 4 - (k & 7)) * (gw - 4 - (k & 7));
+                int v = d < r / 2 ? 255 : (d < r ? (r - d) * 255 * 2 / r : 0);
+                if ( (x + k) % 5 == 0 && v == 255 )
+                    v = 0; // counters
+                bmp[y * gw + x] = (lUInt8)(v > 255 ? 255 : v);
+            }
+        }
+    }
+    static const int sizes[][2] = { { 1072, 1448 }, { 1404, 1872 } };
+    static const int bpps[] = { 32, 16, 8, 4 };
+    for ( unsigned s=0; s<sizeof(sizes)/sizeof(sizes[0]); s++ ) {
+        int dx = sizes[s][0];
+        int dy = sizes[s][1];
+        LVArray<LVDrawBufGlyph> glyphs;
+        for ( int y=2; y+gh<dy; y += gh + 6 ) {
+            for ( int x=1+(y&7); x+gw<dx; x += gw - 7 ) {
+                LVDrawBufGlyph g;
+                g.x = x;
+                g.y = y;
+                g.bitmap = bitmaps.get() + ((x + y) % glyphKinds) * gw * gh;
+                g.width = gw;
+                g.height = gh;
+                glyphs.add( g );
+            }
+        }
+        const int passes = 50;
+        for ( unsigned b=0; b<sizeof(bpps)/sizeof(bpps[0]); b++ ) {
+            LVDrawBuf * buf;
+            if ( bpps[b] >= 16 )
+                buf = new LVColorDrawBuf( dx, dy, bpps[b] );
+            else
+                buf = new LVGrayDrawBuf( dx, dy, bpps[b] );
+            lUInt32 color = 0x203040;
+            CRTimerUtil timer;
+            for ( int p=0; p<passes; p++ ) {
+                buf->FillRect( 0, 0, dx, dy, 0xFFFFFF );
+                buf->SetTextColor( color );
+                buf->DrawGlyphs( glyphs.get(), glyphs.length(), NULL );
+            }
+            lInt64 elapsed = timer.elapsed();
+            if ( elapsed < 1 )
+                elapsed = 1;
+            printf("%dx%d %2d bpp: %d glyphs x %d in %5d ms, %7.2f Mglyph/s\n", dx, dy, bpps[b],
+                   glyphs.length(), passes, (int)elapsed, glyphs.length() * (double)passes / elapsed / 1000.0);
+            delete buf;
+        }
+    }
+}
+
+static void reportPixels( const char * name, LVDrawBuf & buf, int passes, lInt64 elapsed )
+{
+    if ( elapsed < 1 )
+        elapsed = 1;
+    printf("%-24s %5d ms, %8.1f MP/s\n", name, (int)elapsed,
+           (double)buf.GetWidth() * buf.GetHeight() * passes / elapsed / 1000.0);
+}
+
+static void benchPixels()
+{
+    // 1404x1872 panel frame: gradient background with text-like stripes
+    const int dx = 1404;
+    const int dy = 1872;
+    const int passes = 20;
+    LVColorDrawBuf frame( dx, dy, 32 );
+    for ( int y=0; y<dy; y++ ) {
+        lUInt32 * row = (lUInt32 *)frame.GetScanLine( y );
+        for ( int x=0; x<dx; x++ ) {
+            lUInt32 g = (lUInt32)(x * 255 / dx);
+            if ( (y % 40) < 24 && ((x * 7 + y * 3) % 23) < 9 )
+                g = (g * 3 + y) & 0x3F;
+            row[x] = (g << 16) | (((g + y) & 0xFF) << 8) | ((g * 2 + x) & 0xFF);
+        }
+    }
+    LVGrayDrawBuf gray8( dx, dy, 8 );
+    CRTimerUtil timer;
+    for ( int p=0; p<passes; p++ )
+        frame.DrawTo( &gray8, 0, 0, 0, NULL );
+    reportPixels( "32 bpp -> 8 bpp gray", gray8, passes, timer.elapsed() );
+
+    LVColorDrawBuf copy( dx, dy, 32 );
+    timer.restart();
+    for ( int p=0; p<passes; p++ )
+        frame.DrawTo( &copy, 0, 0, 0, NULL );
+    reportPixels( "32 bpp -> 32 bpp", copy, passes, timer.elapsed() );
+
+    timer.restart();
+    for ( int p=0; p<passes; p++ )
+        gray8.DrawTo( &copy, 0, 0, 0, NULL );
+    reportPixels( "8 bpp gray -> 32 bpp", copy, passes, timer.elapsed() );
+
+    static const int ditherBpps[] = { 4, 2, 1 };
+    for ( unsigned b=0; b<sizeof(ditherBpps)/sizeof(ditherBpps[0]); b++ ) {
+        LVGrayDrawBuf packed( dx, dy, ditherBpps[b] );
+        timer.restart();
+        for ( int p=0; p<passes; p++ )
+            gray8.DrawTo( &packed, 0, 0, 0, NULL );
+        char name[32];
+        sprintf( name, "8 bpp -> %d bpp dithered", ditherBpps[b] );
+        reportPixels( name, packed, passes, timer.elapsed() );
+    }
+
+    timer.restart();
+    for ( int p=0; p<passes; p++ )
+        gray8.Rotate( p & 1 ? CR_ROTATE_ANGLE_270 : CR_ROTATE_ANGLE_90 );
+    reportPixels( "8 bpp rotate 90", gray8, passes, timer.elapsed() );
+
+    timer.restart();
+    for ( int p=0; p<passes; p++ )
+        copy.Rotate( p & 1 ? CR_ROTATE_ANGLE_270 : CR_ROTATE_ANGLE_90 );
+    reportPixels( "32 bpp rotate 90", copy, passes, timer.elapsed() );
+
+    LVPtrVector<LVGrayDrawBuf> bitmaps;
+    for ( int p=0; p<passes; p++ ) {
+        LVGrayDrawBuf * buf = new LVGrayDrawBuf( dx, dy, 2 );
+        frame.DrawTo( buf, 0, 0, 0, NULL );
+        bitmaps.add( buf );
+    }
+    timer.restart();
+    for ( int p=0; p<passes; p++ )
+        bitmaps[p]->ConvertToBitmap( true );
+    reportPixels( "2 bpp -> 1 bpp dithered", *bitmaps[0], passes, timer.elapsed() );
+}
+
+int main(int argc, char* argv[])
+{
+    if ( argc == 2 && !strcmp(argv[1], "-g") ) {
+        benchGlyphs();
+        return 0;
+    }
+    if ( argc == 2 && !strcmp(argv[1], "-p") ) {
+        benchPixels();
+        return 0;
+    }
+    if ( argc == 3 && !strcmp(argv[1], "-d") ) {
+        benchCacheCatalog( argv[2] );
+        return 0;
+    }
+    if ( (argc == 3 || argc == 4) && !strcmp(argv[1], "-k") ) {
+        benchMobi( argv[2], argc == 4 ? argv[3] : NULL );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-t") ) {
+        benchFontScan( argv[2], argv[3] );
+        return 0;
+    }
+#if (USE_FREETYPE == 1)
+    if ( argc == 4 && !strcmp(argv[1], "-u") ) {
+        benchFallback( argv[2], argv[3] );
+        return 0;
+    }
+#endif
+    if ( argc >= 4 && !strcmp(argv[1], "-e") ) {
+        benchEmbeddedFonts( argv[2], argc - 3, argv + 3 );
+        return 0;
+    }
+    if ( argc == 3 && !strcmp(argv[1], "-x") ) {
+        benchTextImport( argv[2] );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-b") ) {
+        InitFontManager( lString8::empty_str );
+        fontMan->RegisterFont( lString8(argv[2]) );
+        benchBinaries( argv[3] );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-i") ) {
+        InitFontManager( lString8::empty_str );
+        fontMan->RegisterFont( lString8(argv[2]) );
+        benchChmImport( argv[3] );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-o") ) {
+        InitFontManager( lString8::empty_str );
+        fontMan->RegisterFont( lString8(argv[2]) );
+        benchDocxImport( argv[3] );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-v") ) {
+        InitFontManager( lString8::empty_str );
+        fontMan->RegisterFont( lString8(argv[2]) );
+        benchRepaginate( argv[3] );
+        return 0;
+    }
+    if ( argc >= 3 && !strcmp(argv[1], "-a") ) {
+        benchCharsetDetection( argc - 2, argv + 2 );
+        return 0;
+    }
+    if ( argc == 4 && !strcmp(argv[1], "-s") ) {
+        InitFontManager( lString8::empty_str );
+        benchStyleSheet( argv[2], argv[3] );
+        return 0;
+    }
+    InitFontManager( lString8::empty_str );
+    int i = 1;
+    for ( ; i+1<argc && !strcmp(argv[i], "-f"); i += 2 ) {
+        if ( !fontMan->RegisterFont( lString8(argv[i+1]) ) )
+            printf("Cannot register font %s\n", argv[i+1]);
+    }
+    int highlights = 0;
+    if ( i+1<argc && !strcmp(argv[i], "-h") ) {
+        highlights = atoi(argv[i+1]);
+        i += 2;
+    }
+    int redraws = 0;
+    if ( i+1<argc && !strcmp(argv[i], "-r") ) {
+        redraws = atoi(argv[i+1]);
+        i += 2;
+    }
+    const char * wolFileName = NULL;
+    if ( i+1<argc && !strcmp(argv[i], "-w") ) {
+        wolFileName = argv[i+1];
+        i += 2;
+    }
+    const char * cacheDir = NULL;
+    if ( i+1<argc && !strcmp(argv[i], "-c") ) {
+        cacheDir = argv[i+1];
+        i += 2;
+    }
+    if ( i+1<argc && !strcmp(argv[i], "-m") ) {
+        setStorageMaxUncompressedSizeFactor( (float)atof(argv[i+1]) );
+        i += 2;
+    }
+    if ( i >= argc ) {
+        printf("Usage: render_bench [-f <font file>]... [-h <highlights count>] [-r <redraws count>] [-w <wol file>] [-c <cache dir>] [-m <storage size factor>] <document> [<width> <height>]\n");
+        printf("       render_bench -g\n");
+        printf("       render_bench -p\n");
+        printf("       render_bench -d <cache dir>\n");
+        printf("       render_bench -s <css file> <cache dir>\n");
+        printf("       render_bench -k <corpus dir> [<text file>]\n");
+        printf("       render_bench -t <font dir> <scan cache file>\n");
+        printf("       render_bench -u <font file> <fallback font face>\n");
+        printf("       render_bench -e <cache dir> <epub file>...\n");
+        printf("       render_bench -x <text file>\n");
+        printf("       render_bench -a <text file>...\n");
+        printf("       render_bench -b <font file> <fb2 file>\n");
+        printf("       render_bench -i <font file> <chm file>\n");
+        printf("       render_bench -o <font file> <docx file>\n");
+        printf("       render_bench -v <font file> <document>\n");
+        return 1;
+    }
+    if ( !fontMan->GetFontCount() ) {
+        printf("No fonts registered, use -f <font file>\n");
+        return 1;
+    }
+    const char * fileName = argv[i];
+    int dx = i+2 < argc ? atoi(argv[i+1]) : 600;
+    int dy = i+2 < argc ? atoi(argv[i+2]) : 800;
+
+    if ( cacheDir ) {
+        benchCache( fileName, cacheDir, dx, dy );
+        return 0;
+    }
+
+    LVDocView view;
+    view.Resize( dx, dy );
+    if ( !view.LoadDocument( fileName ) ) {
+        printf("Cannot open document %s\n", fileName);
+        return 2;
+    }
+    static const int fontSizes[] = { 18, 22, 26, 30, 24 };
+    lInt64 totalTime = 0;
+    lInt64 totalAllocs = 0;
+    for ( unsigned k=0; k<sizeof(fontSizes)/sizeof(fontSizes[0]); k++ ) {
+        view.setFontSize( fontSizes[k] );
+        lInt64 allocs = allocCount;
+        CRTimerUtil timer;
+        view.checkRender();
+        lInt64 elapsed = timer.elapsed();
+        allocs = allocCount - allocs;
+        totalTime += elapsed;
+        totalAllocs += allocs;
+        printf("font size %2d: %5d ms  %4d pages", fontSizes[k], (int)elapsed, view.getPageCount());
+        if ( ALLOC_COUNT_SUPPORTED )
+            printf("  %8lld allocations", (long long)allocs);
+        printf("\n");
+    }
+    printf("total: %d ms", (int)totalTime);
+    if ( ALLOC_COUNT_SUPPORTED )
+        printf("  %lld allocations", (long long)totalAllocs);
+    printf("\n");
+    if ( highlights > 0 )
+        benchHighlights( view, highlights );
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+    if ( redraws > 0 )
+        benchRedraw( view, redraws );
+#endif
+    if ( wolFileName )
+        benchWol( view, wolFileName );
+    return 0;
+}
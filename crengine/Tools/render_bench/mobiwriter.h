@@ -0,0 +1,288 @@
+// MOBI book writer for benchmarks and tests: PalmDOC and HUFF/CDIC compressed text records
+#ifndef MOBIWRITER_H_INCLUDED
+#define MOBIWRITER_H_INCLUDED
+
+#include "lvstring.h"
+#include "lvstream.h"
+#include "lvhashtable.h"
+#include "lvptrvec.h"
+
+static void putBE( LVArray<lUInt8> & buf, lUInt32 value, int bytes )
+{
+    for ( int i=bytes-1; i>=0; i-- )
+        buf.add( (lUInt8)(value >> (i*8)) );
+}
+
+static void setBE( LVArray<lUInt8> & buf, int pos, lUInt32 value, int bytes )
+{
+    for ( int i=bytes-1; i>=0; i-- )
+        buf[pos + bytes - 1 - i] = (lUInt8)(value >> (i*8));
+}
+
+// PalmDOC LZ77 compression of one text record
+static void palmDocPack( const lUInt8 * src, int len, LVArray<lUInt8> & dst )
+{
+    int last[4096];
+    for ( int i=0; i<4096; i++ )
+        last[i] = -1;
+    int i = 0;
+    while ( i < len ) {
+        int best = 0;
+        int dist = 0;
+        if ( i + 3 <= len ) {
+            int h = ((src[i] << 7) ^ (src[i+1] << 3) ^ src[i+2]) & 4095;
+            int p = last[h];
+            last[h] = i;
+            if ( p >= 0 && i - p <= 2047 ) {
+                int n = 0;
+                while ( n < 10 && i + n < len && src[p + n] == src[i + n] )
+                    n++;
+                if ( n >= 3 ) {
+                    best = n;
+                    dist = i - p;
+                }
+            }
+        }
+        if ( best ) {
+            int z = (dist << 3) | (best - 3);
+            dst.add( (lUInt8)(0x80 | (z >> 8)) );
+            dst.add( (lUInt8)(z & 255) );
+            i += best;
+        } else if ( src[i] == ' ' && i + 1 < len && src[i+1] >= 0x40 && src[i+1] < 0x80 ) {
+            dst.add( (lUInt8)(src[i+1] ^ 0x80) );
+            i += 2;
+        } else if ( src[i] >= 0x80 || (src[i] >= 1 && src[i] <= 8) ) {
+            int n = 1;
+            while ( n < 8 && i + n < len && (src[i+n] >= 0x80 || (src[i+n] >= 1 && src[i+n] <= 8)) )
+                n++;
+            dst.add( (lUInt8)n );
+            dst.add( src + i, n );
+            i += n;
+        } else {
+            dst.add( src[i++] );
+        }
+    }
+}
+
+// HUFF/CDIC coder with 192 8 bit codes and 16384 16 bit codes: 256 single bytes and frequent words,
+// long words are stored in dictionary huffman coded themselves
+class MobiHuffCoder {
+    LVHashTable<lString8, int> _codes; // word -> code
+    LVArray<lUInt8> _phrases; // dictionary entries in CDIC record form: 2 bytes of length and flag, data
+    LVArray<int> _phraseStarts;
+    int _count8;
+    int _count16;
+    static int wordLength( const lUInt8 * p, int len )
+    {
+        int n = 0;
+        while ( n < len && n < 30 && ((p[n] >= 'a' && p[n] <= 'z') || (p[n] >= 'A' && p[n] <= 'Z')) )
+            n++;
+        if ( n && n < len && p[n] == ' ' )
+            n++;
+        return n;
+    }
+    // single bytes have first 256 16 bit codes
+    static int byteCode( lUInt8 ch ) { return 192 + ch; }
+    void putCode( LVArray<lUInt8> & dst, int code )
+    {
+        if ( code < 192 )
+            dst.add( (lUInt8)code );
+        else
+            putBE( dst, 0xC000 + code - 192, 2 );
+    }
+    // dictionary index for code
+    static int entryIndex( int code ) { return code < 192 ? 0x40BF - code : 0xFFFF - (0xC000 + code - 192); }
+    void addPhrase( int code, const lUInt8 * p, int len )
+    {
+        int index = entryIndex( code );
+        while ( _phraseStarts.length() <= index )
+            _phraseStarts.add( -1 );
+        _phraseStarts[index] = _phrases.length();
+        if ( len >= 8 ) {
+            // compressed phrase: single byte codes
+            LVArray<lUInt8> packed;
+            for ( int i=0; i<len; i++ )
+                putCode( packed, byteCode( p[i] ) );
+            putBE( _phrases, packed.length(), 2 );
+            _phrases.add( packed );
+        } else {
+            putBE( _phrases, 0x8000 | len, 2 );
+            _phrases.add( p, len );
+        }
+    }
+public:
+    MobiHuffCoder( const lUInt8 * text, int len ) : _codes(32768), _count8(0), _count16(0)
+    {
+        LVHashTable<lString8, int> counts(32768);
+        for ( int i=0; i<len; ) {
+            int n = wordLength( text + i, len - i );
+            if ( n < 3 ) {
+                i += n ? n : 1;
+                continue;
+            }
+            lString8 word( (const char *)text + i, n );
+            int count = 0;
+            counts.get( word, count );
+            counts.set( word, count + 1 );
+            i += n;
+        }
+        for ( int b=0; b<256; b++ ) {
+            lUInt8 ch = (lUInt8)b;
+            _count16++;
+            addPhrase( byteCode( ch ), &ch, 1 );
+        }
+        for ( int i=0; i<len && _count16 < 16384; ) {
+            int n = wordLength( text + i, len - i );
+            if ( n < 3 ) {
+                i += n ? n : 1;
+                continue;
+            }
+            lString8 word( (const char *)text + i, n );
+            int count = 0;
+            counts.get( word, count );
+            int code = 0;
+            if ( count >= 3 && !_codes.get( word, code ) ) {
+                code = _count8 < 192 && count >= 50 ? _count8++ : 192 + _count16++;
+                _codes.set( word, code );
+                addPhrase( code, text + i, n );
+            }
+            i += n;
+        }
+    }
+    int phraseCount() { return _phraseStarts.length(); }
+    // encodes text, returns number of bytes used
+    int encode( const lUInt8 * text, int len, int maxSize, LVArray<lUInt8> & dst )
+    {
+        int i = 0;
+        while ( i < len && i < maxSize ) {
+            int n = wordLength( text + i, len - i );
+            int code = 0;
+            if ( n >= 3 && _codes.get( lString8( (const char *)text + i, n ), code ) ) {
+                putCode( dst, code );
+                i += n;
+            } else {
+                putCode( dst, byteCode( text[i] ) );
+                i++;
+            }
+        }
+        return i;
+    }
+    void writeHuff( LVArray<lUInt8> & dst )
+    {
+        dst.add( (const lUInt8 *)"HUFF", 4 );
+        putBE( dst, 24, 4 );
+        putBE( dst, 24, 4 ); // dict1 offset
+        putBE( dst, 24 + 256 * 4, 4 ); // mincode/maxcode offset
+        putBE( dst, 0, 4 );
+        putBE( dst, 0, 4 );
+        for ( int c=0; c<256; c++ ) {
+            if ( c < 192 )
+                putBE( dst, (0x40BF << 8) | 0x80 | 8, 4 );
+            else
+                putBE( dst, (0xFFFF << 8) | 16, 4 ); // not terminal: code length and max code from table
+        }
+        for ( int codelen=1; codelen<=32; codelen++ ) {
+            putBE( dst, codelen == 16 ? 0xC000 : 0, 4 );
+            putBE( dst, codelen == 16 ? 0xFFFF : 0, 4 );
+        }
+    }
+    // returns number of entries written
+    int writeCdic( LVArray<lUInt8> & dst, int start, int bits )
+    {
+        int n = phraseCount() - start;
+        if ( n > (1 << bits) )
+            n = 1 << bits;
+        dst.add( (const lUInt8 *)"CDIC", 4 );
+        putBE( dst, 16, 4 );
+        putBE( dst, phraseCount(), 4 );
+        putBE( dst, bits, 4 );
+        LVArray<lUInt8> data;
+        for ( int i=0; i<n; i++ ) {
+            putBE( dst, n * 2 + data.length(), 2 );
+            int p = _phraseStarts[start + i];
+            if ( p < 0 ) {
+                putBE( data, 0x8000, 2 ); // unused entry
+                continue;
+            }
+            int size = ((_phrases[p] << 8) | _phrases[p+1]) & 0x7fff;
+            data.add( _phrases.get() + p, size + 2 );
+        }
+        dst.add( data );
+        return n;
+    }
+};
+
+// writes MOBI book with text split into 4096 byte records, PalmDOC or HUFF/CDIC compressed
+static bool writeMobi( const lString16 & fileName, const lUInt8 * text, int len, bool huff )
+{
+    LVPtrVector< LVArray<lUInt8> > records;
+    records.add( new LVArray<lUInt8>() ); // MOBI header
+    MobiHuffCoder * coder = huff ? new MobiHuffCoder( text, len ) : NULL;
+    for ( int pos=0; pos<len; ) {
+        LVArray<lUInt8> * rec = new LVArray<lUInt8>();
+        if ( coder ) {
+            pos += coder->encode( text + pos, len - pos, 4096, *rec );
+        } else {
+            int n = len - pos < 4096 ? len - pos : 4096;
+            palmDocPack( text + pos, n, *rec );
+            pos += n;
+        }
+        records.add( rec );
+    }
+    int textRecords = records.length() - 1;
+    int huffRecords = 0;
+    if ( coder ) {
+        LVArray<lUInt8> * rec = new LVArray<lUInt8>();
+        coder->writeHuff( *rec );
+        records.add( rec );
+        huffRecords++;
+        for ( int start=0; start<coder->phraseCount(); huffRecords++ ) {
+            rec = new LVArray<lUInt8>();
+            start += coder->writeCdic( *rec, start, 12 );
+            records.add( rec );
+        }
+        delete coder;
+    }
+    LVArray<lUInt8> & hdr = *records[0];
+    hdr.addSpace( 256 );
+    for ( int i=0; i<256; i++ )
+        hdr[i] = (i >= 40 && i < 80) ? 0xFF : 0;
+    setBE( hdr, 0, huff ? 17480 : 2, 2 );
+    setBE( hdr, 4, len, 4 );
+    setBE( hdr, 8, textRecords, 2 );
+    setBE( hdr, 10, 4096, 2 );
+    hdr[16] = 'M'; hdr[17] = 'O'; hdr[18] = 'B'; hdr[19] = 'I';
+    setBE( hdr, 20, 0xE8, 4 ); // header length
+    setBE( hdr, 24, 2, 4 ); // Mobipocket book
+    setBE( hdr, 28, 65001, 4 ); // UTF-8
+    setBE( hdr, 36, 6, 4 );
+    setBE( hdr, 80, textRecords + 1, 4 ); // first non-book record
+    setBE( hdr, 108, records.length(), 4 ); // no images
+    setBE( hdr, 112, huff ? textRecords + 1 : 0, 4 );
+    setBE( hdr, 116, huffRecords, 4 );
+
+    lUInt32 offset = 78 + records.length() * 8 + 2;
+    lUInt32 fileSize = offset;
+    for ( int i=0; i<records.length(); i++ )
+        fileSize += records[i]->length();
+    LVArray<lUInt8> file;
+    file.reserve( fileSize );
+    file.addSpace( 78 );
+    for ( int i=0; i<78; i++ )
+        file[i] = 0;
+    memcpy( file.get(), "bench", 5 );
+    memcpy( file.get() + 60, "BOOKMOBI", 8 );
+    setBE( file, 76, records.length(), 2 );
+    for ( int i=0; i<records.length(); i++ ) {
+        putBE( file, offset, 4 );
+        putBE( file, i * 2, 4 );
+        offset += records[i]->length();
+    }
+    putBE( file, 0, 2 );
+    for ( int i=0; i<records.length(); i++ )
+        file.add( *records[i] );
+    LVStreamRef out = LVOpenFileStream( fileName.c_str(), LVOM_WRITE );
+    return !out.isNull() && out->Write( file.get(), file.length(), NULL ) == LVERR_OK;
+}
+
+#endif // MOBIWRITER_H_INCLUDED
@@ -32,6 +32,24 @@ public:
 
 extern CRConcurrencyProvider * concurrencyProvider;
 
+/// provider made of C++11 std::thread, std::mutex and std::condition_variable
+/**
+    For frontends which have no provider of their own. Engine has no GUI event loop,
+    so executeGui() runs task on calling thread, and delayed tasks are run immediately.
+*/
+class CRStdConcurrencyProvider : public CRConcurrencyProvider {
+public:
+    virtual CRMutex * createMutex();
+    virtual CRMonitor * createMonitor();
+    virtual CRThread * createThread(CRRunnable * threadTask);
+    virtual void executeGui(CRRunnable * task);
+    virtual void executeGui(CRRunnable * task, int delayMillis);
+    virtual void sleepMs(int durationMs);
+};
+
+/// sets CRStdConcurrencyProvider as concurrencyProvider unless frontend has already set one
+void CRSetupDefaultConcurrency();
+
 
 class CRThreadExecutor : public CRRunnable, public CRExecutor {
     volatile bool _stopped;
@@ -751,8 +751,14 @@ class CRGUIScreenBase : public CRGUIScreen
         LVRef<LVDrawBuf> _front;
         int _fullUpdateInterval;
         int _fullUpdateCounter;
+        bool _fullUpdateChecked;
+        bool _fullUpdateRequested;
+        int _updateMergeCost;
+        bool _multiRectUpdate;
         /// override in ancessor to transfer image to device
         virtual void update( const lvRect & rc, bool full ) = 0;
+        /// compares canvas with front buffer tile by tile inside update rect, copies changed tiles to front buffer and returns merged changed rectangles
+        virtual void findChangedRects( LVArray<lvRect> & rects );
     public:
         /// fast update feature parameter setting
         virtual void setFullUpdateInterval( int pagesBeforeFullupdate=1 )
@@ -763,17 +769,27 @@ class CRGUIScreenBase : public CRGUIScreen
         }
         virtual bool checkFullUpdateCounter()
         {
+            // flush() sending several rectangles counts only the first one
+            if ( _fullUpdateChecked )
+                return false;
             if ( _fullUpdateInterval<=0 )
                 return false; // always partial update
-            if ( _fullUpdateInterval==1 )
+            if ( _fullUpdateInterval==1 ) {
+                _fullUpdateRequested = true;
                 return true;  // always full update
+            }
             _fullUpdateCounter--;
             if ( _fullUpdateCounter<=0 ) {
                 _fullUpdateCounter = _fullUpdateInterval;
+                _fullUpdateRequested = true;
                 return true; // full update
             }
             return false; // partial update
         }
+        /// sets cost of one more partial update in pixels: changed rectangles are merged while it wastes less area (default is 1/32 of screen)
+        virtual void setUpdateMergeCost( int pixels ) { _updateMergeCost = pixels; }
+        /// allows calling update() for each changed rectangle; otherwise their bounding box is sent in one update() per flush
+        virtual void setMultiRectUpdateEnabled( bool enabled ) { _multiRectUpdate = enabled; }
 
         /// creates compatible canvas of specified size
         virtual LVDrawBuf * createCanvas( int dx, int dy )
@@ -821,6 +837,10 @@ class CRGUIScreenBase : public CRGUIScreen
         : _width( width ), _height( height ), _canvas(NULL), _front(NULL)
         , _fullUpdateInterval(1)
         , _fullUpdateCounter(1)
+        , _fullUpdateChecked(false)
+        , _fullUpdateRequested(false)
+        , _updateMergeCost(-1)
+        , _multiRectUpdate(false)
         {
             if ( width && height ) {
                 _canvas = LVRef<LVDrawBuf>( createCanvas( width, height ) );
@@ -9,6 +9,9 @@ bool DetectEpubFormat( LVStreamRef stream );
 bool ImportEpubDocument( LVStreamRef stream, ldomDocument * doc, LVDocViewCallback * progressCallback, CacheLoadingCallback * formatCallback, bool metadataOnly = false );
 lString16 EpubGetRootFilePath( LVContainerRef m_arc );
 LVStreamRef GetEpubCoverpage(LVContainerRef arc);
+/// reads OPF <metadata> only, without building DOM; manifest is scanned only when extractCover is true
+bool GetEpubMetadata( LVContainerRef arc, LVDocMetadata & metadata, bool extractCover=false );
+bool GetEpubMetadata( LVStreamRef stream, LVDocMetadata & metadata, bool extractCover=false );
 
 
 #endif // EPUBFMT_H
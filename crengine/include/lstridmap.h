@@ -33,6 +33,8 @@ public:
     lUInt16    id;
     /// value
     lString16 value;
+    /// precomputed calcStringHash() of value
+    lUInt32    hash;
 	/// constructor
     LDOMNameIdMapItem(lUInt16 _id, const lString16 & _value, const css_elem_def_props_t * _data);
     /// copy constructor
@@ -54,13 +56,16 @@ class LDOMNameIdMap
 {
 private:
     LDOMNameIdMapItem * * m_by_id;
-    LDOMNameIdMapItem * * m_by_name;
+    LDOMNameIdMapItem * * m_by_name; // items in order of addition (owns items)
+    LDOMNameIdMapItem * * m_hash;    // open addressing hash table, by name
     lUInt16 m_count; // non-empty count
     lUInt16 m_size;  // max number of ids
-    bool    m_sorted;
+    lUInt32 m_hashSize; // power of 2
     bool    m_changed;
 
-    void    Sort();
+    void    reHash( lUInt32 newSize );
+    void    addHashItem( LDOMNameIdMapItem * item );
+    template <typename T> const LDOMNameIdMapItem * findHashItem( const T * name ) const;
 public:
     /// Main constructor
     LDOMNameIdMap( lUInt16 maxId );
@@ -84,17 +89,18 @@ public:
        return m_by_id[id];
     }
 
-    const LDOMNameIdMapItem * findItem( const lChar16 * name );
-    const LDOMNameIdMapItem * findItem( const lChar8 * name );
-    const LDOMNameIdMapItem * findItem( const lString16 & name ) { return findItem(name.c_str()); }
+    /// lookup by name does not modify map, so it's safe to do from several threads while no items are being added
+    const LDOMNameIdMapItem * findItem( const lChar16 * name ) const;
+    const LDOMNameIdMapItem * findItem( const lChar8 * name ) const;
+    const LDOMNameIdMapItem * findItem( const lString16 & name ) const { return findItem(name.c_str()); }
 
-    inline lUInt16 idByName( const lChar16 * name )
+    inline lUInt16 idByName( const lChar16 * name ) const
     {
         const LDOMNameIdMapItem * item = findItem(name);
         return item?item->id:0;
     }
 
-    inline lUInt16 idByName( const lChar8 * name )
+    inline lUInt16 idByName( const lChar8 * name ) const
     {
         const LDOMNameIdMapItem * item = findItem(name);
         return item?item->id:0;
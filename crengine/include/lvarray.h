@@ -76,6 +76,13 @@ public:
         }
         return *this;
     }
+    /// exchanges contents with another array without copying
+    void swap( LVArray & v )
+    {
+        T * a = _array; _array = v._array; v._array = a;
+        int n = _size; _size = v._size; v._size = n;
+        n = _count; _count = v._count; v._count = n;
+    }
     /// retrieves pointer to C array
     T * get() { return _array; }
     /// retrieves item from specified position
@@ -46,6 +46,15 @@ typedef enum {
 #endif
 #endif//#ifndef CR_ENABLE_PAGE_IMAGE_CACHE
 
+#ifndef CR_ENABLE_PAGE_DRAW_LIST
+#if USE_WIN32_FONTS==1
+// win32 fonts draw directly into LVColorDrawBuf, cannot be recorded
+#define CR_ENABLE_PAGE_DRAW_LIST 0
+#else
+#define CR_ENABLE_PAGE_DRAW_LIST 1
+#endif
+#endif//#ifndef CR_ENABLE_PAGE_DRAW_LIST
+
 #if CR_ENABLE_PAGE_IMAGE_CACHE==1
 /// Page imege holder which allows to unlock mutex after destruction
 class LVDocImageHolder
@@ -234,6 +243,25 @@ enum {
 
 typedef LVArray<int> LVBookMarkPercentInfo;
 
+/// selection and bookmark ranges intersecting a page, cached until they change
+class LVPageMarkedRanges {
+public:
+    int start;
+    int height;
+    ldomMarkedRangeList marks;
+    ldomMarkedRangeList bookmarks;
+    LVPageMarkedRanges( int pageStart, int pageHeight ) : start(pageStart), height(pageHeight) { }
+};
+
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+/// recorded drawing of page text, images and footnotes, replayed while page, its marks and drawing parameters are unchanged
+class LVPageDrawList {
+public:
+    LVArray<lInt32> key;
+    LVDrawList list;
+};
+#endif
+
 #define DEF_COLOR_BUFFER_BPP 32
 
 /**
@@ -303,6 +331,23 @@ protected:
 
     ldomMarkedRangeList m_markRanges;
     ldomMarkedRangeList m_bmkRanges;
+    LVPtrVector<LVPageMarkedRanges> m_pageMarkRanges;
+    LVHashTable<lString16, ldomXPointer> m_bmkXPointers;
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+    LVPtrVector<LVPageDrawList> m_pageDrawLists;
+    bool m_pageDrawListEnabled;
+    /// incremented by clearImageCache(): lists recorded before don't match
+    lInt32 m_pageDrawGeneration;
+    /// fills key of page body drawing: page, its marks, document change counters and drawing parameters
+    void getPageDrawListKey( LVArray<lInt32> & key, LVDrawBuf * drawbuf, LVRendPageInfo & page, lvRect * pageRect, LVPageMarkedRanges * pageMarks );
+#endif
+    /// draws page text, images and footnotes
+    void drawPageBody( LVDrawBuf * drawbuf, LVRendPageInfo & page, lvRect * pageRect, lvRect & clip, LVPageMarkedRanges * pageMarks );
+
+    /// returns m_markRanges and m_bmkRanges items intersecting page or its footnotes
+    LVPageMarkedRanges * getPageMarkedRanges( LVRendPageInfo & page );
+    /// returns bookmark position xpointer, resolving path only once per document
+    ldomXPointer getBookmarkXPointer( const lString16 & path );
 
 private:
     lString16 m_filename;
@@ -582,6 +627,12 @@ public:
     void requestReload();
     /// invalidate image cache, request redraw
     void clearImageCache();
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+    /// drop recorded page drawing (document is changed or rendered again)
+    void clearPageDrawLists() { m_pageDrawLists.clear(); }
+    /// enable or disable recording and replaying of page drawing
+    void setPageDrawListEnabled( bool enabled ) { m_pageDrawListEnabled = enabled; clearPageDrawLists(); }
+#endif
 #if CR_ENABLE_PAGE_IMAGE_CACHE==1
     /// get page image (0=current, -1=prev, 1=next)
     LVDocImageRef getPageImage( int delta );
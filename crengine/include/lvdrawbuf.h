@@ -27,6 +27,7 @@ extern "C" {
 
 #include "lvtypes.h"
 #include "lvimg.h"
+#include "lvhashtable.h"
 
 enum cr_rotate_angle_t {
     CR_ROTATE_ANGLE_0 = 0,
@@ -38,6 +39,15 @@ enum cr_rotate_angle_t {
 class LVFont;
 class GLDrawBuf; // workaround for no-rtti builds
 
+/// glyph bitmap (1 byte per pixel) placed at x, y, for LVDrawBuf::DrawGlyphs()
+struct LVDrawBufGlyph {
+    int x;
+    int y;
+    const lUInt8 * bitmap;
+    int width;
+    int height;
+};
+
 /// Abstract drawing buffer
 class LVDrawBuf : public CacheableObject
 {
@@ -176,6 +186,12 @@ public:
     virtual void Resize( int dx, int dy ) = 0;
     /// draws bitmap (1 byte per pixel) using specified palette
     virtual void Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette ) = 0;
+    /// draws run of glyph bitmaps with the same palette; bitmaps must stay valid during the call
+    virtual void DrawGlyphs( const LVDrawBufGlyph * glyphs, int count, lUInt32 * palette )
+    {
+        for ( int i=0; i<count; i++ )
+            Draw( glyphs[i].x, glyphs[i].y, glyphs[i].bitmap, glyphs[i].width, glyphs[i].height, palette );
+    }
     /// draws image
     virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither=true ) = 0;
     /// draws part of source image, possible rescaled
@@ -559,7 +575,112 @@ public:
 #endif
 };
 
+/// retained list of drawing operations: recorded once by LVDrawListRecorder, replayed to any draw buffer
+class LVDrawList
+{
+    friend class LVDrawListRecorder;
+public:
+    enum Op {
+        OP_FILL_RECT,
+        OP_FILL_RECT_PATTERN,
+        OP_GRADIENT_RECT,
+        OP_INVERT_RECT,
+        OP_DRAW_LINE,
+        OP_DRAW_BITMAP,
+        OP_DRAW_IMAGE,
+        OP_DRAW_IMAGE_PART,
+        OP_DRAW_IMAGE_ROTATED,
+        OP_SET_CLIP_RECT,
+        OP_RESET_CLIP_RECT,
+        OP_SET_TEXT_COLOR,
+        OP_SET_BACKGROUND_COLOR,
+        OP_SET_HIDE_PARTIAL_GLYPHS,
+        OP_SET_INVERT_IMAGES,
+        OP_SET_DITHER_IMAGES,
+        OP_SET_SMOOTH_SCALING_IMAGES,
+        OP_SET_ALPHA
+    };
+private:
+    struct Item {
+        lInt32 op;
+        lInt32 v[10];
+    };
+    LVArray<Item> _items;
+    LVArray<lUInt8> _bitmaps;
+    LVArray<LVImageSourceRef> _images;
+    bool _valid;
+public:
+    /// replays recorded operations to buffer
+    void replay( LVDrawBuf * buf );
+    /// returns false if some drawing could not be recorded, so list cannot be replayed
+    bool isValid() const { return _valid; }
+    /// returns count of recorded operations
+    int length() const { return _items.length(); }
+    /// returns approximate memory used by list, bytes
+    int getMemorySize() const { return _items.length() * sizeof(Item) + _bitmaps.length() + _images.length() * sizeof(LVImageSourceRef); }
+    void clear() { _items.clear(); _bitmaps.clear(); _images.clear(); _valid = true; }
+    LVDrawList() : _valid(true) { }
+};
 
-
+/// draw buffer proxy: passes drawing to target buffer and records it to LVDrawList
+class LVDrawListRecorder : public LVDrawBuf
+{
+    LVDrawBuf * _target;
+    LVDrawList * _list;
+    LVHashTable<lUInt32, int> _bitmapOffsets;
+    LVDrawList::Item & add( int op );
+    void addImage( int op, LVImageSourceRef img, int x, int y, int width, int height );
+    void invalidate() { _list->_valid = false; }
+public:
+    virtual void Rotate( cr_rotate_angle_t angle ) { invalidate(); _target->Rotate( angle ); }
+    virtual lUInt32 GetWhiteColor() { return _target->GetWhiteColor(); }
+    virtual lUInt32 GetBlackColor() { return _target->GetBlackColor(); }
+    virtual lUInt32 GetBackgroundColor() { return _target->GetBackgroundColor(); }
+    virtual void SetBackgroundColor( lUInt32 cl );
+    virtual lUInt32 GetTextColor() { return _target->GetTextColor(); }
+    virtual void SetTextColor( lUInt32 cl );
+    virtual void GetClipRect( lvRect * clipRect ) { _target->GetClipRect( clipRect ); }
+    virtual void SetClipRect( const lvRect * clipRect );
+    virtual void setHidePartialGlyphs( bool hide );
+    virtual void setInvertImages( bool invert );
+    virtual void setDitherImages( bool dither );
+    virtual void setSmoothScalingImages( bool smooth );
+    virtual void Invert() { invalidate(); _target->Invert(); }
+    virtual int GetWidth() { return _target->GetWidth(); }
+    virtual int GetHeight() { return _target->GetHeight(); }
+    virtual int GetBitsPerPixel() { return _target->GetBitsPerPixel(); }
+    virtual int GetRowSize() { return _target->GetRowSize(); }
+    virtual void Clear( lUInt32 color ) { invalidate(); _target->Clear( color ); }
+    virtual lUInt32 GetPixel( int x, int y ) { return _target->GetPixel( x, y ); }
+    virtual lUInt32 GetAvgColor( lvRect & rc16 ) { return _target->GetAvgColor( rc16 ); }
+    virtual lUInt32 GetInterpolatedColor( int x16, int y16 ) { return _target->GetInterpolatedColor( x16, y16 ); }
+    virtual void GradientRect( int x0, int y0, int x1, int y1, lUInt32 color1, lUInt32 color2, lUInt32 color3, lUInt32 color4 );
+    virtual void FillRect( int x0, int y0, int x1, int y1, lUInt32 color );
+    virtual void FillRectPattern( int x0, int y0, int x1, int y1, lUInt32 color0, lUInt32 color1, lUInt8 * pattern );
+    virtual void InvertRect( int x0, int y0, int x1, int y1 );
+    virtual void Resize( int dx, int dy ) { invalidate(); _target->Resize( dx, dy ); }
+    virtual void Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette );
+    virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither=true );
+    virtual void Draw( LVImageSourceRef img, int x, int y, int width, int height, int srcx, int srcy, int srcwidth, int srcheight, bool dither=true );
+    virtual void DrawRotated( LVImageSourceRef img, int x, int y, int width, int height, int rotationAngle );
+    virtual void DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32 * palette ) { _target->DrawTo( buf, x, y, options, palette ); }
+    virtual void DrawOnTop( LVDrawBuf * buf, int x, int y ) { _target->DrawOnTop( buf, x, y ); }
+    virtual void DrawRescaled( LVDrawBuf * src, int x, int y, int dx, int dy, int options ) { invalidate(); _target->DrawRescaled( src, x, y, dx, dy, options ); }
+    virtual void DrawFragment( LVDrawBuf * src, int srcx, int srcy, int srcdx, int srcdy, int x, int y, int dx, int dy, int options ) {
+        invalidate();
+        _target->DrawFragment( src, srcx, srcy, srcdx, srcdy, x, y, dx, dy, options );
+    }
+    virtual void DrawLine( int x0, int y0, int x1, int y1, lUInt32 color0, int length1, int length2, int direction );
+#if !defined(__SYMBIAN32__) && defined(_WIN32) && !defined(QT_GL)
+    virtual void DrawTo( HDC dc, int x, int y, int options, lUInt32 * palette ) { _target->DrawTo( dc, x, y, options, palette ); }
 #endif
+    /// direct pixel access cannot be recorded
+    virtual lUInt8 * GetScanLine( int y ) { invalidate(); return _target->GetScanLine( y ); }
+    virtual int getAlpha() { return _target->getAlpha(); }
+    virtual void setAlpha( int alpha );
+    virtual lUInt32 applyAlpha( lUInt32 cl ) { return _target->applyAlpha( cl ); }
+    LVDrawListRecorder( LVDrawBuf * target, LVDrawList * list ) : _target( target ), _list( list ), _bitmapOffsets( 256 ) { }
+    virtual ~LVDrawListRecorder() { }
+};
 
+#endif
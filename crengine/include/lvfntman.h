@@ -21,6 +21,15 @@
 #include "lvstring16collection.h"
 #include "lvfont.h"
 
+/// decoded embedded document fonts, shared between documents
+class LVDocumentFontCache {
+public:
+    /// set directory to keep decoded document fonts in, empty to keep them in memory only
+    static void setCacheDir( lString16 dir );
+    /// remove decoded document fonts which are not used, from memory and cache directory
+    static void clear();
+};
+
 /// font manager interface class
 class LVFontManager {
 protected:
@@ -60,6 +69,10 @@ public:
 
     /// unregisters all document fonts
     virtual void UnregisterDocumentFonts(int /*documentId*/) {}
+    /// sets file to keep font file scan results in between runs, so that unchanged font files are not opened on registration
+    virtual void SetFontScanCacheFile(lString16 /*fileName*/) {}
+    /// writes font file scan results to cache file, if there are new ones
+    virtual void SaveFontScanCache() {}
 
     /// initializes font manager
     virtual bool Init(lString8 path) = 0;
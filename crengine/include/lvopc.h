@@ -21,6 +21,8 @@ public:
     LVStreamRef open();
     lString16 getRelatedPartName(const lChar16 * const relationType, const lString16 id = lString16());
     OpcPartRef getRelatedPart(const lChar16 * const relationType, const lString16 id = lString16());
+    /// reads relations now instead of on first lookup
+    void loadRelations();
 protected:
     OpcPart(OpcPackage* package, lString16 name):
        m_relations(16), m_package(package), m_name(name), m_relationsValid(false)
@@ -415,6 +415,9 @@ public:
     /// add source line
     void AddLine( int starty, int endy, int flags );
 
+    /// split lines into pages, keeping lines to split them again later
+    void split( LVRendPageList * pageList, int pageHeight );
+
     void Finalize();
 };
 
@@ -900,6 +900,8 @@ bool LVDirectoryExists( const lString16 & pathName );
 bool LVDirectoryExists( const lString8 & pathName );
 /// returns true if directory exists and your app can write to directory
 bool LVDirectoryIsWritable(const lString16 & pathName);
+/// gets size and last modification time of file, returns false if there is no such file
+bool LVGetFileInfo( const lString8 & pathName, lUInt64 & size, lUInt64 & modTime );
 
 
 /// factory to handle filesystem access for paths started with ASSET_PATH_PREFIX (@ sign)
@@ -788,6 +788,8 @@ const lString16 & cs16(const lChar16 * str);
 
 /// calculates hash for wide c-string
 lUInt32 calcStringHash( const lChar16 * s );
+/// calculates hash for 8-bit string; equal to hash of same string converted to wide chars
+lUInt32 calcStringHash( const lChar8 * s );
 
 /// returns true if two wide strings are equal
 inline bool operator == (const lString16& s1, const lString16& s2 )
@@ -21,14 +21,15 @@ class SerialBuf;
 class lString16HashedCollection : public lString16Collection
 {
 private:
-    int hashSize;
+    int hashSize; // power of 2
+    /// open addressing hash table item: precomputed hash avoids most string compares and rehashing of strings
     struct HashPair {
         int index;
-        HashPair * next;
-        void clear() { index=-1; next=NULL; }
+        lUInt32 hash;
+        void clear() { index=-1; hash=0; }
     };
     HashPair * hash;
-    void addHashItem( int hashIndex, int storageIndex );
+    void addHashItem( lUInt32 h, int storageIndex );
     void clearHash();
     void reHash( int newSize );
 public:
@@ -42,7 +43,8 @@ public:
     lString16HashedCollection( lUInt32 hashSize );
     ~lString16HashedCollection();
     int add( const lChar16 * s );
-    int find( const lChar16 * s );
+    /// find does not modify collection, so it's safe to call from several threads while no strings are being added
+    int find( const lChar16 * s ) const;
 };
 
 #endif  // __LV_STRING16HASHEDCOLLECTION_H_INCLUDED__
@@ -49,6 +49,8 @@
 
 class lxmlDocBase;
 class ldomNode;
+class SerialBuf;
+class LVCssNameIds;
 
 /** \brief CSS property declaration
     
@@ -77,12 +79,17 @@ class ldomNode;
 class LVCssDeclaration {
 private:
     int * _data;
+    int _size; // number of items in _data
 public:
     void apply( css_style_rec_t * style );
     bool empty() { return _data==NULL; }
     bool parse( const char * & decl, bool higher_importance=false, lxmlDocBase * doc=NULL, lString16 codeBase=lString16::empty_str );
     lUInt32 getHash();
-    LVCssDeclaration() : _data(NULL) { }
+    /// write compiled declaration
+    void serialize( SerialBuf & buf );
+    /// read compiled declaration
+    bool deserialize( SerialBuf & buf );
+    LVCssDeclaration() : _data(NULL), _size(0) { }
     ~LVCssDeclaration() { if (_data) delete[] _data; }
 };
 
@@ -181,6 +188,10 @@ public:
     bool isFullChecking() { return _type == cssrt_ancessor || _type == cssrt_predsibling; }
     lUInt32 getHash();
     lUInt32 getWeight();
+    /// write rule, adding element and attribute ids it refers to to names
+    void serialize( SerialBuf & buf, LVCssNameIds & names );
+    /// read rule
+    bool deserialize( SerialBuf & buf, lxmlDocBase * doc );
 };
 
 /** \brief simple CSS selector
@@ -219,6 +230,10 @@ public:
     LVCssSelector * getNext() { return _next; }
     void setNext(LVCssSelector * next) { _next = next; }
     lUInt32 getHash();
+    /// write selector and its rules (neither declaration nor next selector)
+    void serialize( SerialBuf & buf, LVCssNameIds & names );
+    /// read selector and its rules
+    bool deserialize( SerialBuf & buf, lxmlDocBase * doc );
 };
 
 
@@ -250,6 +265,12 @@ class LVStyleSheet {
     }
 
     void set(LVPtrVector<LVCssSelector> & v );
+    /// insert selector to chain for its element, keeping specificity order
+    void insert( LVCssSelector * item );
+    /// parse stylesheet, writing compiled rules to buf if it's not NULL
+    bool compile( const char * str, bool higher_importance, lString16 codeBase, SerialBuf * buf, LVCssNameIds * names );
+    /// add rules from compiled stylesheet
+    bool restore( SerialBuf & buf );
 public:
 
 
@@ -285,6 +306,24 @@ public:
     lUInt32 getHash();
 };
 
+/** \brief cache of compiled stylesheets
+
+    LVStyleSheet::parse() looks up CSS text here before parsing it: compiled
+    rules are kept keyed by text hash and parsing options, in memory and,
+    when cache directory is set, in file cr3css.cache in it.
+*/
+class LVStyleSheetCache {
+public:
+    /// set directory to keep compiled stylesheets in, empty to keep them in memory only
+    static void setCacheDir( lString16 dir );
+    /// set max size of compiled stylesheets kept, 0 disables cache
+    static void setMaxSize( int size );
+    /// write compiled stylesheets to cache directory, if there are new ones
+    static void save();
+    /// remove all compiled stylesheets, from memory and cache directory
+    static void clear();
+};
+
 /// parse color value like #334455, #345 or red
 bool parse_color_value( const char * & str, css_length_t & value );
 
@@ -219,6 +219,8 @@ struct text_highlight_options_t {
     }
 };
 
+struct lvtext_arena_t;
+
 /** \brief Text formatter container
 */
 typedef struct
@@ -229,6 +231,7 @@ typedef struct
    lInt32                frmlinecount;  /**< formatted lines count*/
    embedded_float_t   ** floats;        /**< embedded floats */
    lInt32                floatcount;    /**< embedded floats count*/
+   lvtext_arena_t      * arena;         /**< storage for formatted lines, words and floats */
    lUInt32               height;        /**< height of text fragment */
    lUInt16               width;         /**< width of text fragment */
    lUInt16               page_height;   /**< max page height */
@@ -36,6 +36,7 @@
 #include "lvstsheet.h"
 #include "lvpagesplitter.h"
 #include "lvptrvec.h"
+#include "lvautoptr.h"
 #include "lvhashtable.h"
 #include "lvimg.h"
 #include "props.h"
@@ -45,6 +46,8 @@
 
 // Allows for requesting older DOM building code (including bugs NOT fixed)
 extern const int gDOMVersionCurrent;
+/// version of cache file format: data cached by engine is dropped when it changes
+extern const char * const gCacheFileFormatVersion;
 extern int gDOMVersionRequested;
 
 
@@ -248,6 +251,8 @@ struct ldomNodeStyleInfo
 class ldomBlobItem;
 #define BLOB_NAME_PREFIX L"@blob#"
 #define MOBI_IMAGE_NAME_PREFIX L"mobi_image_"
+/// FB2 binaries are decoded while parsing, and kept as blobs named with this prefix and binary id
+#define FB2_BINARY_NAME_PREFIX BLOB_NAME_PREFIX L"binary#"
 class ldomBlobCache
 {
     CacheFile * _cacheFile;
@@ -266,6 +271,7 @@ public:
 class ldomDataStorageManager
 {
     friend class ldomTextStorageChunk;
+    friend class tinyNodeCollection;
 protected:
     tinyNodeCollection * _owner;
     LVPtrVector<ldomTextStorageChunk> _chunks;
@@ -274,10 +280,22 @@ protected:
     CacheFile * _cache;
     int _uncompressedSize;
     int _maxUncompressedSize;
+    int _baseUncompressedSize; /// initial max uncompressed size, storages of document share sum of these
     int _chunkSize;
     char _type;       /// type, to show in log
     bool _maxSizeReachedWarned;
+    lUInt32 _hits;       /// chunk accesses with data already unpacked
+    lUInt32 _misses;     /// chunk accesses which had to read data from cache file
+    lUInt32 _unpacks;    /// chunks read from cache file, including prefetched ones
+    lUInt32 _prefetches; /// chunks read ahead of sequential access
+    lUInt32 _recentAccesses; /// accesses since last sharing of space between storages
+    lUInt32 _recentMisses;   /// misses since last sharing of space between storages
+    int _lastMissChunk;  /// index of last missed chunk, to detect sequential reading
     ldomTextStorageChunk * getChunk( lUInt32 address );
+    /// moves chunk to head of recently used list
+    void touchChunk( ldomTextStorageChunk * chunk );
+    /// reads next chunk from cache file in advance, if it fits without compacting
+    bool prefetchChunk( int index );
 public:
     /// type
     lUInt16 cacheType();
@@ -290,6 +308,11 @@ public:
     /// checks buffer sizes, compacts most unused chunks
     void compact( int reservedSpace );
     int getUncompressedSize() { return _uncompressedSize; }
+    int getMaxUncompressedSize() { return _maxUncompressedSize; }
+    /// returns space needed to keep all chunks unpacked
+    int getDataSize();
+    /// returns chunk access counters, to show in document statistics
+    lString16 getStatistics();
 #if BUILD_LITE!=1
     /// allocates new text node, return its address inside storage
     lUInt32 allocText( lUInt32 dataIndex, lUInt32 parentIndex, const lString8 & text );
@@ -443,7 +466,18 @@ private:
     LVIndexedRefCache<font_ref_t> _fonts;
     int _tinyElementCount;
     int _itemCount;
+    int _lazyElemCount; // element nodes count in cache file, parts are read on first access
+    int _lazyTextCount; // text nodes count in cache file, parts are read on first access
+    int _lazyNodeStyles; // for parts read later: 0 - loaded styles not checked yet, 1 - use loaded styles, 2 - reset styles
     int _docIndex;
+    lUInt32 _contentChangeCount; // incremented on each change of nodes, attributes or text
+
+    /// reads node part from cache file on first access, returns NULL if there is no such part
+    ldomNode * loadNodePart( bool elem, int partIndex );
+    /// returns element nodes part, reading it from cache file if necessary
+    inline ldomNode * getElemPart( int partIndex ) { ldomNode * part = _elemList[partIndex]; return part ? part : loadNodePart( true, partIndex ); }
+    /// returns text nodes part, reading it from cache file if necessary
+    inline ldomNode * getTextPart( int partIndex ) { ldomNode * part = _textList[partIndex]; return part ? part : loadNodePart( false, partIndex ); }
 
 protected:
 #if BUILD_LITE!=1
@@ -493,11 +527,14 @@ protected:
     bool saveStylesData();
     bool loadStylesData();
     bool updateLoadedStyles( bool enabled );
+    /// sets fonts for loaded styles of elements in one node part
+    bool updateLoadedStyles( ldomNode * buf, int sz, bool enabled );
     lUInt32 calcStyleHash();
+    /// hash of style table and fonts of styles: when unchanged, saved node style hash is still valid
+    lUInt32 calcStylesTableHash();
     bool saveNodeData();
     bool saveNodeData( lUInt16 type, ldomNode ** list, int nodecount );
     bool loadNodeData();
-    bool loadNodeData( lUInt16 type, ldomNode ** list, int nodecount );
 
 
     bool openCacheFile();
@@ -516,7 +553,12 @@ protected:
 
     tinyNodeCollection( tinyNodeCollection & v );
 
+    /// call on each change of nodes, attributes or text
+    inline void contentChanged() { _contentChangeCount++; }
+
 public:
+    /// returns counter of DOM changes, to check that content drawn earlier is unchanged
+    inline lUInt32 getContentChangeCount() const { return _contentChangeCount; }
 
 #if BUILD_LITE!=1
     bool setSpaceWidthScalePercent(int spaceWidthScalePercent) {
@@ -557,6 +599,12 @@ public:
 
     bool swapToCacheIfNecessary();
 
+    /// returns number of node parts in memory and total number of node parts
+    void getNodePartStats( int & loaded, int & total );
+
+    /// lends unpacked space not used by some data storages to the ones which miss chunks, by their recent access counts
+    void shareStorageSpace();
+
 
     bool createCacheFile();
 #endif
@@ -1110,6 +1158,13 @@ public:
     */
     lUInt16 getAttrNameIndex( const lChar8 * name );
 
+    /// Get attribute id by name
+    /**
+        \param name is string value of attribute
+        \return id of attribute, 0 if not found
+    */
+    lUInt16 findAttrNameIndex( const lChar16 * name );
+
     /// helper: returns attribute value
     inline const lString16 & getAttrValue( lUInt32 index ) const
     {
@@ -1138,6 +1193,12 @@ public:
         return _elementNameTable.nameById( id );
     }
 
+    /// returns id to be allocated for next unknown element name
+    inline lUInt16 getNextUnknownElementId() { return _nextUnknownElementId; }
+
+    /// returns id to be allocated for next unknown attribute name
+    inline lUInt16 getNextUnknownAttrId() { return _nextUnknownAttrId; }
+
     /// Get element id by name
     /**
         \param name is string value of element name
@@ -1159,6 +1220,13 @@ public:
     */
     lUInt16 findElementNameIndex( const lChar8 * name );
 
+    /// Get element id by name
+    /**
+        \param name is string value of element name
+        \return id of element, 0 if not found
+    */
+    lUInt16 findElementNameIndex( const lChar16 * name );
+
     /// Get element type properties structure by id
     /**
         \param id is element id
@@ -1249,11 +1317,15 @@ protected:
         lUInt32 render_style_hash;
         lUInt32 stylesheet_hash;
         lUInt32 node_displaystyle_hash;
+        lUInt32 node_style_hash; // _nodeStyleHash at render time
+        lUInt32 node_displaystyle_hash_rendered; // _nodeDisplayStyleHash at render time
+        lUInt32 styles_table_hash; // calcStylesTableHash() at render time
         bool serialize( SerialBuf & buf );
         bool deserialize( SerialBuf & buf );
         DocFileHeader()
             : render_dx(0), render_dy(0), render_docflags(0), render_style_hash(0), stylesheet_hash(0),
-                node_displaystyle_hash(NODE_DISPLAY_STYLE_HASH_UNITIALIZED)
+                node_displaystyle_hash(NODE_DISPLAY_STYLE_HASH_UNITIALIZED), node_style_hash(0),
+                node_displaystyle_hash_rendered(NODE_DISPLAY_STYLE_HASH_UNITIALIZED), styles_table_hash(0)
         {
         }
     };
@@ -2206,6 +2278,14 @@ private:
     bool _just_rendered_from_cache;
     bool _toc_from_cache_valid;
     ldomXRangeList _selections;
+    // lines of last full render, to split them again when only page height changes
+    LVAutoPtr<LVRendPageContext> _renderedLines;
+    int _renderedY0;
+    bool _renderedShowCover;
+    lUInt32 _renderedOptionsHash;
+    // page heights for which last full render would lay out document the same way
+    int _renderMinPageHeight;
+    int _renderMaxPageHeight;
 #endif
 
     lString16 _docStylesheetFileName;
@@ -2283,6 +2363,10 @@ public:
     void updateRenderContext();
     /// check document formatting parameters before render - whether we need to reformat; returns false if render is necessary
     bool checkRenderContext();
+    /// returns hash of formatting options which are not part of style hash
+    lUInt32 calcRenderOptionsHash();
+    /// returns true if only page height is changed since last render, and pages can be split again without reformatting
+    bool canRepaginate( bool showCover, int y0 );
 #endif
 
 #if BUILD_LITE!=1
@@ -2322,6 +2406,14 @@ public:
     int getFullHeight();
     /// returns page height setting
     int getPageHeight() { return _page_height; }
+    /// notes that layout being rendered is the same only for page heights from minHeight to maxHeight
+    void limitRenderPageHeight( int minHeight, int maxHeight=0x7FFFFFFF )
+    {
+        if ( _renderMinPageHeight < minHeight )
+            _renderMinPageHeight = minHeight;
+        if ( _renderMaxPageHeight > maxHeight )
+            _renderMaxPageHeight = maxHeight;
+    }
 #endif
     /// saves document contents as XML to stream with specified encoding
     bool saveToStream( LVStreamRef stream, const char * codepage, bool treeLayout=false );
@@ -2437,6 +2529,15 @@ protected:
     bool _inHeadStyle;
     lString16 _headStyleText;
     lString16Collection _stylesheetLinks;
+#if BUILD_LITE!=1
+    bool _inBinary;             /// inside FB2 <binary>: text is decoded to blob instead of being added to DOM
+    bool _binaryEnded;          /// base64 padding found, rest of binary text is ignored
+    int _binaryIteration;       /// base64 digits in _binaryValue
+    lUInt32 _binaryValue;
+    LVArray<lUInt8> _binaryData;
+    void decodeBinaryText( const lChar16 * text, int len );
+    void addBinaryBlob();
+#endif
     virtual void ElementCloseHandler( ldomNode * node ) { node->persist(); }
 public:
     /// returns flags
@@ -2661,6 +2762,8 @@ public:
     static bool close();
     /// delete all cache files
     static bool clear();
+    /// update size of closed cache file, evicting other files if needed
+    static void updateFileSize( lString16 cachePath, lvsize_t size );
     /// returns true if cache is enabled (successfully initialized)
     static bool enabled();
 };
@@ -18,6 +18,7 @@
 #include <time.h>
 #include "lvstring.h"
 #include "lvstream.h"
+#include "lvstring16collection.h"
 #include "crtxtenc.h"
 #include "dtddef.h"
 
@@ -274,6 +275,8 @@ public:
     bool AutodetectEncoding( bool utfOnly=false );
     /// reads next text line, tells file position and size of line, sets EOL flag
     lString16 ReadLine( int maxLineSize, lUInt32 & flags );
+    /// reads next text line into res, reusing its buffer, sets EOL flag
+    void ReadLine( lString16 & res, int maxLineSize, lUInt32 & flags );
     //lString16 ReadLine( int maxLineSize, lvpos_t & fpos, lvsize_t & fsize, lUInt32 & flags );
     /// returns name of character encoding
     lString16 GetEncodingName() { return m_encoding_name; }
@@ -442,4 +445,38 @@ lString16 LVReadTextFile( lString16 filename );
 
 LVStreamRef GetFB2Coverpage(LVStreamRef stream);
 
+/// book metadata, as collected by header-only parsers (no DOM is built)
+class LVDocMetadata
+{
+    lString16Collection _authorFirstNames;
+    lString16Collection _authorMiddleNames;
+    lString16Collection _authorLastNames;
+public:
+    lString16 title;
+    lString16 language;
+    lString16 series;
+    /// number in series, -1 when not set
+    int seriesNumber;
+    /// FB2 genres or EPUB subjects
+    lString16Collection genres;
+    lString16 annotation;
+    /// FB2 binary id or EPUB manifest item id of cover image
+    lString16 coverId;
+    /// cover image data, filled only when requested
+    LVStreamRef cover;
+
+    LVDocMetadata() : seriesNumber(-1) { }
+    void clear();
+    /// adds author; any of name parts may be empty
+    void addAuthor( const lString16 & firstName, const lString16 & middleName, const lString16 & lastName );
+    int getAuthorCount() const { return _authorLastNames.length(); }
+    /// returns author name formatted as "First M. Last" or "First Middle Last"
+    lString16 getAuthor( int index, bool shortMiddleName=true ) const;
+    /// returns all authors joined with delimiter (", " if empty)
+    lString16 getAuthors( lString16 delimiter=lString16::empty_str, bool shortMiddleName=true ) const;
+};
+
+/// reads FB2 <description> only, stopping at </description>; <binary> payloads are skipped unless extractCover is true
+bool LVParseFB2Metadata( LVStreamRef stream, LVDocMetadata & metadata, bool extractCover=false );
+
 #endif // __LVXML_H_INCLUDED__
@@ -4,8 +4,8 @@
 #include "../include/crsetup.h"
 #include "../include/lvtinydom.h"
 
-// creates PDB decoder stream for stream
-//LVStreamRef LVOpenPDBStream( LVStreamRef srcstream, int &format );
+// creates PDB decoder stream for stream, unpacking all text records to check them
+LVStreamRef LVOpenPDBStream( LVStreamRef srcstream, doc_format_t & contentFormat );
 
 bool DetectPDBFormat( LVStreamRef stream, doc_format_t & contentFormat );
 bool ImportPDBDocument( LVStreamRef & stream, ldomDocument * doc, LVDocViewCallback * progressCallback, CacheLoadingCallback * formatCallback, doc_format_t & contentFormat );
@@ -9,6 +9,7 @@
 #define __WOLUTIL_H_INCLUDED__
 
 #include "../include/crengine.h"
+#include "../include/crconcurrent.h"
 
 
 
@@ -139,6 +140,48 @@ public:
     );
     void addCoverImage( LVGrayDrawBuf & image );
     void addImage( LVGrayDrawBuf & image );
+    /// writes page image already compressed by encodeImage()
+    void addEncodedImage( int width, int height, int num_bits, const lUInt8 * compressed, int compressed_len );
+    /// LZSS-compresses page image data, adding trailing dummy byte
+    static void encodeImage( const lUInt8 * bitmap, int size, LVArray<lUInt8> & compressed );
+};
+
+class WOLPageEncoderTask;
+
+/// compresses WOL page images on worker threads, passing them to WOLWriter in page order
+class WOLPageQueue {
+    friend class WOLPageEncoderTask;
+    struct Page {
+        int width;
+        int height;
+        int num_bits;
+        LVArray<lUInt8> bitmap;
+        LVArray<lUInt8> compressed;
+        bool started;
+        bool done;
+    };
+    WOLWriter & _writer;
+    int _maxPending;
+    bool _stopped;
+    CRMonitorRef _monitor;
+    LVPtrVector<CRThread> _threads;
+    LVPtrVector<WOLPageEncoderTask> _tasks;
+    LVPtrVector<Page> _pages; // reorder buffer: first item is the next page to write
+    int _pageCount;
+    /// worker: compresses pages until queue is stopped
+    void encodePages();
+    /// writes compressed pages from head of queue; waits until pending count is below limit
+    void writePages( int maxPending );
+public:
+    /// uses up to threads workers when concurrencyProvider is set, otherwise compresses pages on calling thread
+    WOLPageQueue( WOLWriter & writer, int threads, int maxPending );
+    ~WOLPageQueue();
+    /// queues copy of page image, blocks while too many pages are pending
+    void addImage( LVGrayDrawBuf & image );
+    /// waits for all queued pages and writes them
+    void flush();
+    /// returns number of pages passed to addImage()
+    int getPageCount() { return _pageCount; }
 };
 
 typedef struct {
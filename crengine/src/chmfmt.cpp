@@ -8,6 +8,11 @@
 
 #define DUMP_CHM_DOC 0
 
+/// max size of decompressed LZX blocks kept by each opened CHM file
+#define CHM_BLOCK_CACHE_SIZE (4*1024*1024)
+/// max total size of topics read to memory ahead of parsing on import
+#define CHM_PREFETCH_SIZE (4*1024*1024)
+
 struct crChmExternalFileStream : public chmExternalFileStream {
     /** returns file size, in bytes, if opened successfully */
     //LONGUINT64 (open)( chmExternalFileStream * instance );
@@ -149,6 +154,12 @@ public:
         return LVERR_OK;
     }
 
+    /// returns position of object data in its section
+    lUInt64 getStart()
+    {
+        return (lUInt64)m_ui.start;
+    }
+
 
     virtual lverror_t Write( const void * /*buf*/, lvsize_t /*count*/, lvsize_t * /*nBytesWritten*/ )
     {
@@ -170,6 +181,20 @@ public:
 
 };
 
+/// object read ahead, see LVCHMContainer::readObjects()
+struct CHMObjectReadItem {
+    int index;
+    lUInt64 start;
+    LVStreamRef stream;
+};
+
+static int compareObjectStart( const CHMObjectReadItem ** item1, const CHMObjectReadItem ** item2 )
+{
+    if ( (*item1)->start != (*item2)->start )
+        return (*item1)->start < (*item2)->start ? -1 : 1;
+    return 0;
+}
+
 class LVCHMContainer : public LVNamedContainer
 {
 protected:
@@ -227,6 +252,38 @@ public:
             chm_close( _file );
     }
 
+    /// reads objects starting from first one to memory, until their total size reaches maxSize,
+    /// in order of their placement in archive, so that LZX blocks shared by neighbours are decompressed once;
+    /// streams of objects which cannot be read are NULL; returns number of objects processed
+    int readObjects( const lString16Collection & names, int first, int maxSize, LVArray<LVStreamRef> & streams )
+    {
+        LVPtrVector<CHMObjectReadItem> items;
+        int totalSize = 0;
+        int count = 0;
+        for ( int i=first; i<names.length() && (count==0 || totalSize<maxSize); i++, count++ ) {
+            LVStreamRef stream = OpenStream( names[i].c_str(), LVOM_READ );
+            if ( stream.isNull() )
+                continue;
+            CHMObjectReadItem * item = new CHMObjectReadItem();
+            item->index = i - first;
+            item->start = ((LVCHMStream*)stream.get())->getStart();
+            item->stream = stream;
+            items.add( item );
+            totalSize += (int)stream->GetSize();
+        }
+        items.sort( compareObjectStart );
+        streams.clear();
+        for ( int i=0; i<count; i++ )
+            streams.add( LVStreamRef() );
+        for ( int i=0; i<items.length(); i++ ) {
+            CHMObjectReadItem * item = items[i];
+            streams[item->index] = LVCreateMemoryStream( item->stream );
+            if ( !streams[item->index].isNull() )
+                streams[item->index]->SetName( item->stream->GetName() );
+        }
+        return count;
+    }
+
     void addFileItem( const char * filename, LONGUINT64 len )
     {
         LVCommonContainerItemInfo * item = new LVCommonContainerItemInfo();
@@ -251,6 +308,7 @@ public:
         _file = chm_open( &_stream );
         if ( !_file )
             return false;
+        chm_set_param( _file, CHM_PARAM_MAX_CACHE_SIZE, CHM_BLOCK_CACHE_SIZE );
         chm_enumerate( _file,
                   CHM_ENUMERATE_ALL,
                   CHM_ENUMERATOR_CALLBACK,
@@ -962,6 +1020,7 @@ static int filename_comparator(lString16 & _s1, lString16 & _s2) {
 
 class CHMTOCReader {
     LVContainerRef _cont;
+    LVCHMContainer * _chm;
     ldomDocumentFragmentWriter * _appender;
     ldomDocument * _doc;
     LVTocItem * _toc;
@@ -971,7 +1030,7 @@ class CHMTOCReader {
     bool _fakeToc;
 public:
     CHMTOCReader( LVContainerRef cont, ldomDocument * doc, ldomDocumentFragmentWriter * appender )
-        : _cont(cont), _appender(appender), _doc(doc), _fileList(1024)
+        : _cont(cont), _chm((LVCHMContainer*)cont.get()), _appender(appender), _doc(doc), _fileList(1024)
     {
         _toc = _doc->getToc();
     }
@@ -1141,6 +1200,9 @@ public:
         time_t lastProgressTime = (time_t)time(0);
         int lastProgressPercent = -1;
         int cnt = _fileList.length();
+        // topics are parsed in TOC order, but read in batches in order of placement in archive
+        LVArray<LVStreamRef> prefetched;
+        int prefetchedStart = 0;
         for ( int i=0; i<cnt; i++ ) {
             if ( progressCallback ) {
                 int percent = i * 100 / cnt;
@@ -1153,7 +1215,14 @@ public:
             }
             lString16 fname = _fileList[i];
             CRLog::trace("Import file %s", LCSTR(fname));
-            LVStreamRef stream = _cont->OpenStream(fname.c_str(), LVOM_READ);
+            if ( i >= prefetchedStart + prefetched.length() ) {
+                prefetchedStart = i;
+                _chm->readObjects( _fileList, i, CHM_PREFETCH_SIZE, prefetched );
+            }
+            LVStreamRef stream = prefetched[i - prefetchedStart];
+            prefetched[i - prefetchedStart].Clear();
+            if ( stream.isNull() )
+                stream = _cont->OpenStream(fname.c_str(), LVOM_READ);
             if ( stream.isNull() )
                 continue;
             _appender->setCodeBase(fname);
@@ -4,6 +4,11 @@
 #include "lvstring.h"
 #include "crlog.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
 CRMutex * _refMutex = NULL;
 CRMutex * _fontMutex = NULL;
 CRMutex * _fontManMutex = NULL;
@@ -32,6 +37,69 @@ void CRSetupEngineConcurrency() {
 
 CRConcurrencyProvider * concurrencyProvider = NULL;
 
+class CRStdMonitor : public CRMonitor {
+    std::mutex _mutex;
+    std::condition_variable _cond;
+public:
+    virtual void acquire() { _mutex.lock(); }
+    virtual void release() { _mutex.unlock(); }
+    virtual void wait() {
+        // mutex is already acquired by caller, and stays acquired after wait
+        std::unique_lock<std::mutex> lock(_mutex, std::adopt_lock);
+        _cond.wait(lock);
+        lock.release();
+    }
+    virtual void notify() { _cond.notify_one(); }
+    virtual void notifyAll() { _cond.notify_all(); }
+};
+
+class CRStdThread : public CRThread {
+    CRRunnable * _task;
+    std::thread _thread;
+public:
+    CRStdThread(CRRunnable * task) : _task(task) { }
+    virtual ~CRStdThread() { join(); }
+    virtual void start() { _thread = std::thread(&CRRunnable::run, _task); }
+    virtual void join() {
+        if (_thread.joinable())
+            _thread.join();
+    }
+};
+
+CRMutex * CRStdConcurrencyProvider::createMutex() {
+    return new CRStdMonitor();
+}
+
+CRMonitor * CRStdConcurrencyProvider::createMonitor() {
+    return new CRStdMonitor();
+}
+
+CRThread * CRStdConcurrencyProvider::createThread(CRRunnable * threadTask) {
+    return new CRStdThread(threadTask);
+}
+
+void CRStdConcurrencyProvider::executeGui(CRRunnable * task) {
+    task->run();
+    delete task;
+}
+
+void CRStdConcurrencyProvider::executeGui(CRRunnable * task, int delayMillis) {
+    CR_UNUSED(delayMillis);
+    if (task)
+        executeGui(task);
+}
+
+void CRStdConcurrencyProvider::sleepMs(int durationMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+}
+
+static CRStdConcurrencyProvider stdConcurrencyProvider;
+
+void CRSetupDefaultConcurrency() {
+    if (!concurrencyProvider)
+        concurrencyProvider = &stdConcurrencyProvider;
+}
+
 CRThreadExecutor::CRThreadExecutor() : _stopped(false) {
     _monitor = concurrencyProvider->createMonitor();
     _thread = concurrencyProvider->createThread(this);
@@ -479,38 +479,164 @@ void CRGUIWindowManager::showProgress( lString16 filename, int progressPercent )
     _lastProgressPercent = progressPercent;
 }
 
+// partial update diffing: tile size in pixels and rows
+#define UPDATE_TILE_PIXELS 64
+#define UPDATE_TILE_ROWS 16
+// changed tiles in the same band separated by no more than this count of tiles are updated together
+#define UPDATE_TILE_GAP 1
+// changed rectangles are merged to this count even if it wastes area
+#define UPDATE_MAX_RECTS 8
+// too fragmented change is updated as single bounding box
+#define UPDATE_MAX_MERGE_RECTS 64
+
+static int rectArea( const lvRect & rc )
+{
+    return rc.width() * rc.height();
+}
+
+/// merges rectangles while merging wastes less than mergeCost pixels, or while there are more than UPDATE_MAX_RECTS
+static void mergeUpdateRects( LVArray<lvRect> & rects, int mergeCost )
+{
+    if ( rects.length() > UPDATE_MAX_MERGE_RECTS ) {
+        lvRect rc;
+        for ( int i=0; i<rects.length(); i++ )
+            rc.extend( rects[i] );
+        rects.clear();
+        rects.add( rc );
+        return;
+    }
+    while ( rects.length() > 1 ) {
+        int bestI = -1;
+        int bestJ = -1;
+        int bestWaste = 0;
+        for ( int i=0; i<rects.length(); i++ ) {
+            for ( int j=i+1; j<rects.length(); j++ ) {
+                lvRect rc( rects[i] );
+                rc.extend( rects[j] );
+                int waste = rectArea( rc ) - rectArea( rects[i] ) - rectArea( rects[j] );
+                if ( bestI<0 || waste<bestWaste ) {
+                    bestI = i;
+                    bestJ = j;
+                    bestWaste = waste;
+                }
+            }
+        }
+        if ( bestWaste > mergeCost && rects.length() <= UPDATE_MAX_RECTS )
+            break;
+        rects[bestI].extend( rects[bestJ] );
+        rects.erase( bestJ, 1 );
+    }
+}
+
+void CRGUIScreenBase::findChangedRects( LVArray<lvRect> & rects )
+{
+    int bpp = _canvas->GetBitsPerPixel();
+    int pixelBits = bpp <= 2 ? bpp : (bpp <= 8 ? 8 : bpp);
+    int tileBytes = UPDATE_TILE_PIXELS * pixelBits / 8;
+    int rowSize = _canvas->GetRowSize();
+    int tilesX = (rowSize + tileBytes - 1) / tileBytes;
+    int top = _updateRect.top > 0 ? _updateRect.top : 0;
+    int bottom = _updateRect.bottom < _height ? _updateRect.bottom : _height;
+    LVArray<lUInt8> dirty( tilesX, 0 );
+    for ( int y0 = top; y0 < bottom; y0 += UPDATE_TILE_ROWS ) {
+        int y1 = y0 + UPDATE_TILE_ROWS < bottom ? y0 + UPDATE_TILE_ROWS : bottom;
+        bool bandChanged = false;
+        for ( int y = y0; y < y1; y++ ) {
+            lUInt8 * line1 = _canvas->GetScanLine( y );
+            lUInt8 * line2 = _front->GetScanLine( y );
+            if ( !memcmp( line1, line2, rowSize ) )
+                continue;
+            for ( int tx = 0; tx < tilesX; tx++ ) {
+                int offset = tx * tileBytes;
+                int bytes = offset + tileBytes <= rowSize ? tileBytes : rowSize - offset;
+                if ( memcmp( line1 + offset, line2 + offset, bytes ) ) {
+                    memcpy( line2 + offset, line1 + offset, bytes );
+                    dirty[tx] = 1;
+                    bandChanged = true;
+                }
+            }
+        }
+        if ( !bandChanged )
+            continue;
+        for ( int tx = 0; tx < tilesX; ) {
+            if ( !dirty[tx] ) {
+                tx++;
+                continue;
+            }
+            // run of changed tiles, including short gaps
+            int start = tx;
+            int end = tx + 1;
+            for ( int t = end; t < tilesX && t <= end + UPDATE_TILE_GAP; t++ ) {
+                if ( dirty[t] )
+                    end = t + 1;
+            }
+            for ( int t = start; t < end; t++ )
+                dirty[t] = 0;
+            tx = end;
+            lvRect rc( start * UPDATE_TILE_PIXELS, y0, end * UPDATE_TILE_PIXELS, y1 );
+            if ( rc.right > _width )
+                rc.right = _width;
+            // continue rectangle of previous band with the same columns
+            bool merged = false;
+            for ( int i = rects.length() - 1; i >= 0; i-- ) {
+                if ( rects[i].bottom == y0 && rects[i].left == rc.left && rects[i].right == rc.right ) {
+                    rects[i].bottom = y1;
+                    merged = true;
+                    break;
+                }
+            }
+            if ( !merged )
+                rects.add( rc );
+        }
+    }
+    // screen size may be set after construction
+    mergeUpdateRects( rects, _updateMergeCost >= 0 ? _updateMergeCost : _width * _height / 32 );
+}
+
 void CRGUIScreenBase::flush( bool full )
 {
+    _fullUpdateRequested = false;
     if ( _updateRect.isEmpty() && !full && !getTurboUpdateEnabled() ) {
         CRLog::trace("CRGUIScreenBase::flush() - update rectangle is empty");
         return;
     }
     if ( !_front.isNull() && !_updateRect.isEmpty() && !full ) {
-        // calculate really changed area
-        lvRect rc;
-        lvRect lineRect(_updateRect);
-        int sz = _canvas->GetRowSize();
-        for ( int y = _updateRect.top; y < _updateRect.bottom; y++ ) {
-            if ( y>=0 && y<_height ) {
-                void * line1 = _canvas->GetScanLine( y );
-                void * line2 = _front->GetScanLine( y );
-                if (memcmp( line1, line2, sz ) != 0) {
-                    // line content is different
-                    lineRect.top = y;
-                    lineRect.bottom = y+1;
-                    rc.extend( lineRect );
-                    // copy line to front buffer
-                    memcpy( line2, line1, sz );
-                }
-            }
-        }
-        if ( rc.isEmpty() ) {
+        // calculate really changed areas
+        LVArray<lvRect> rects;
+        findChangedRects( rects );
+        if ( rects.empty() ) {
             // no actual changes
             _updateRect.clear();
             return;
         }
-        _updateRect.top = rc.top;
-        _updateRect.bottom = rc.bottom;
+        int pixels = 0;
+        lvRect bounds;
+        for ( int i=0; i<rects.length(); i++ ) {
+            pixels += rectArea( rects[i] );
+            bounds.extend( rects[i] );
+        }
+        // previously, changed lines of update rect were sent
+        lvRect lines( _updateRect );
+        lines.top = bounds.top;
+        lines.bottom = bounds.bottom;
+        lines.intersect( getRect() );
+        if ( !_multiRectUpdate ) {
+            // device refresh per update() call may be expensive (e.g. e-ink): send one update
+            CRLog::debug("CRGUIScreenBase::flush() - %d pixels updated instead of %d", rectArea( bounds ),
+                         rectArea( lines ));
+            update( bounds, false );
+            _updateRect.clear();
+            return;
+        }
+        CRLog::debug("CRGUIScreenBase::flush() - %d rects, %d pixels updated instead of %d", rects.length(), pixels,
+                     rectArea( lines ));
+        for ( int i=0; i<rects.length() && !_fullUpdateRequested; i++ ) {
+            update( rects[i], false );
+            _fullUpdateChecked = true;
+        }
+        _fullUpdateChecked = false;
+        _updateRect.clear();
+        return;
     }
     //if ( !full && !checkFullUpdateCounter() )
     //    full = false;
@@ -18,6 +18,10 @@
 #include <string.h>
 #include <stdio.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const lChar16 __cp737[128] = {
   /* 0x80 */
   0x0391, 0x0392, 0x0393, 0x0394, 0x0395, 0x0396, 0x0397, 0x0398,
@@ -1640,43 +1644,52 @@ int sort_dblstats_by_ch( const void * p1, const void * p2 )
 class CDoubleCharStat2
 {
 private:
-    lUInt16 * * stats;
+    lUInt16 * stats; // 256 x 256 pair counters
+    bool rows[256]; // true if there are pairs starting with char
     int total;
-    int items;
 public:
-    CDoubleCharStat2() : stats(NULL), total(0), items(0)
+    CDoubleCharStat2() : total(0)
     {
+        stats = new lUInt16[256 * 256]();
+        memset( rows, 0, sizeof(rows) );
     }
-    void Add( unsigned char c1, unsigned char c2 )
+    inline void Add( unsigned char c1, unsigned char c2 )
     {
-        if ( !stats ) {
-            stats = new lUInt16* [256]();
-        }
-        if (c1==' ' && c2==' ')
-            return;
-        total++;
-        if ( stats[c1]==NULL ) {
-            stats[c1] = new lUInt16[256]();
-        }
-        if ( stats[c1][c2]++ == 0)
-            items++;
+        // pair of spaces is counted without branching, and dropped in GetData
+        int pair = (c1 << 8) | c2;
+        total += (pair != ((' ' << 8) | ' '));
+        stats[pair]++;
+        rows[c1] = true;
     }
     void GetData( dbl_char_stat_t * pData, int len )
     {
         int count = 0;
+        int items = 0;
+        if ( stats ) {
+            stats[(' ' << 8) | ' '] = 0;
+            for ( int i=0; i<256; i++ ) {
+                if ( !rows[i] )
+                    continue;
+                const lUInt16 * row = stats + (i << 8);
+                for ( int j=0; j<256; j++ )
+                    if ( row[j] )
+                        items++;
+            }
+        }
         dbl_char_stat_long_t * pdata = new dbl_char_stat_long_t[items];
         if ( total ) {
             for ( int i=0; i<256; i++ ) {
-                if ( stats[i] ) {
-                    for ( int j=0; j<256; j++ ) {
-                        if ( stats[i][j]> 0 ) {
-                            pdata[count].ch1 = i;
-                            pdata[count].ch2 = j;
-                            int n = stats[i][j];
-                            n = (int)(n * (lInt64)0x7000 / total);
-                            pdata[count].count = n;
-                            count++;
-                        }
+                if ( !rows[i] )
+                    continue;
+                const lUInt16 * row = stats + (i << 8);
+                for ( int j=0; j<256; j++ ) {
+                    if ( row[j]> 0 ) {
+                        pdata[count].ch1 = i;
+                        pdata[count].ch2 = j;
+                        int n = row[j];
+                        n = (int)(n * (lInt64)0x7000 / total);
+                        pdata[count].count = n;
+                        count++;
                     }
                 }
             }
@@ -1705,9 +1718,6 @@ public:
    void Close()
    {
        if ( stats ) {
-           for ( int i=0; i<256; i++ )
-               if ( stats[i] )
-                   delete[] stats[i];
            delete[] stats;
            stats = NULL;
        }
@@ -1727,6 +1737,22 @@ bool isValidUtf8Data( const unsigned char * buf, int buf_size )
     while ( buf < end_buf ) {
         lUInt8 ch = *buf++;
         if ( (ch & 0x80) == 0 ) {
+#if defined(__SSE2__)
+            // skip ASCII text 16 bytes at once
+            while ( buf + 16 <= end_buf ) {
+                if ( _mm_movemask_epi8( _mm_loadu_si128( (const __m128i*)buf ) ) )
+                    break;
+                buf += 16;
+            }
+#endif
+            // skip ASCII text 8 bytes at once
+            lUInt64 word;
+            while ( buf + 8 <= end_buf ) {
+                memcpy( &word, buf, 8 );
+                if ( word & 0x8080808080808080ULL )
+                    break;
+                buf += 8;
+            }
         } else if ( (ch & 0xC0) == 0x80 ) {
             CRLog::trace("unexpected char %02x at position %x, str=%s", ch, (buf-1-start), lString8((const char *)(buf-1), 32).c_str());
             return false;
@@ -1760,14 +1786,24 @@ bool isValidUtf8Data( const unsigned char * buf, int buf_size )
     return true;
 }
 
+// chars counted in statistics: letters and apostrophe
+static inline bool isStatChar( unsigned char ch )
+{
+   return ch>127 || (ch>='a' && ch<='z') || (ch>='A' && ch<='Z') || ch=='\'';
+}
+
 void MakeDblCharStat(const unsigned char * buf, int buf_size, dbl_char_stat_t * stat, int stat_len, bool skipHtml)
 {
    CDoubleCharStat2 maker;
+   // chars not counted are replaced with space
+   unsigned char stat_char[256];
+   for ( int i=0; i<256; i++ )
+      stat_char[i] = isStatChar( (unsigned char)i ) ? (unsigned char)i : ' ';
    unsigned char ch1=' ';
    unsigned char ch2=' ';
    bool insideTag = false;
    for ( int i=1; i<buf_size; i++) {
-      lChar8 ch = buf[i];
+      unsigned char ch = buf[i];
       if (skipHtml) {
           if (ch == '<') {
               insideTag = true;
@@ -1776,42 +1812,80 @@ void MakeDblCharStat(const unsigned char * buf, int buf_size, dbl_char_stat_t *
               insideTag = false;
               ch = ' ';
           }
+          if (insideTag)
+              continue;
       }
-      if (insideTag)
-          continue;
       ch1 = ch2;
-      ch2 = ch;
-      if ( ch2<128 && ch2!='\'' && !( (ch2>='a' && ch2<='z') || (ch2>='A' && ch2<='Z')) )
-         ch2 = ' ';
+      ch2 = stat_char[ch];
       //if (i>0)
       maker.Add( ch1, ch2 );
    }
    maker.GetData( stat, stat_len );
 }
 
+// count all bytes to 4 tables, so that repeated bytes don't wait for increment of the same counter
+static void addByteStat( int stat4[4][256], const unsigned char * buf, int buf_size )
+{
+   int i = 0;
+   for ( ; i+4<=buf_size; i+=4) {
+      stat4[0][buf[i]]++;
+      stat4[1][buf[i+1]]++;
+      stat4[2][buf[i+2]]++;
+      stat4[3][buf[i+3]]++;
+   }
+   for ( ; i<buf_size; i++)
+      stat4[0][buf[i]]++;
+}
+
+// returns position of first '<' or '>' at or after pos, or buf_size
+static int findTagBracket( const unsigned char * buf, int pos, int buf_size )
+{
+#if defined(__SSE2__)
+   const __m128i lt = _mm_set1_epi8( '<' );
+   const __m128i gt = _mm_set1_epi8( '>' );
+   for ( ; pos+16<=buf_size; pos+=16 ) {
+      __m128i v = _mm_loadu_si128( (const __m128i*)(buf + pos) );
+      if ( _mm_movemask_epi8( _mm_or_si128( _mm_cmpeq_epi8( v, lt ), _mm_cmpeq_epi8( v, gt ) ) ) )
+         break;
+   }
+#endif
+   for ( ; pos<buf_size; pos++ )
+      if ( buf[pos] == '<' || buf[pos] == '>' )
+         break;
+   return pos;
+}
+
 void MakeCharStat(const unsigned char * buf, int buf_size, short stat_table[256], bool skipHtml)
 {
    int stat[256] = { 0 };
    int total=0;
-   unsigned char ch;
-   bool insideTag = false;
-   for (int i=0; i<buf_size; i++) {
-      ch = buf[i];
-      if (skipHtml) {
-          if (ch == '<') {
-              insideTag = true;
-              continue;
-          }
-          if (ch == '>') {
-              insideTag = false;
-              continue;
-          }
-          if (insideTag)
-              continue;
+   // count all bytes outside of tags, then keep counted chars only
+   int stat4[4][256];
+   memset( stat4, 0, sizeof(stat4) );
+   if (skipHtml) {
+      bool insideTag = false;
+      for (int i=0; i<buf_size; ) {
+         if (insideTag) {
+            const unsigned char * tagEnd = (const unsigned char *)memchr( buf + i, '>', buf_size - i );
+            if ( !tagEnd )
+               break;
+            i = (int)(tagEnd - buf) + 1;
+            insideTag = false;
+            continue;
+         }
+         int bracket = findTagBracket( buf, i, buf_size );
+         addByteStat( stat4, buf + i, bracket - i );
+         if ( bracket < buf_size && buf[bracket] == '<' )
+            insideTag = true;
+         i = bracket + 1;
       }
-      if ( ch>127 || (ch>='a' && ch<='z') || (ch>='A' && ch<='Z') || ch=='\'') {
-         stat[ch]++;
-         total++;
+   } else {
+      addByteStat( stat4, buf, buf_size );
+   }
+   for (int i=0; i<256; i++) {
+      if ( isStatChar( (unsigned char)i ) ) {
+         stat[i] = stat4[0][i] + stat4[1][i] + stat4[2][i] + stat4[3][i];
+         total += stat[i];
       }
    }
    if (total) {
@@ -1823,31 +1897,33 @@ void MakeCharStat(const unsigned char * buf, int buf_size, short stat_table[256]
 
 double CompareCharStats( const short * stat1, const short * stat2, double &k1, double &k2 )
 {
-   double sum = 0;
-   double psum = 0;
-   double psum2 = 0;
+   // products are summed as integers and scaled once
+   lInt64 sum = 0;
+   lInt64 psum = 0;
+   lInt64 psum2 = 0;
    for (int i=0; i<256; i++) {
-	  psum += ( (double)stat1[i] * stat2[i] / 0x7000 / 0x7000);
-	  if (i>=128)
-		psum2 += ( (double)stat1[i] * stat2[i] / 0x7000 / 0x7000);
+      int product = stat1[i] * stat2[i];
+      psum += product;
+      if (i>=128)
+         psum2 += product;
       int delta = stat1[i] - stat2[i];
       if (delta<0)
          delta = -delta;
       sum += delta;
    }
-   sum /= 0x7000;
-   k1 = psum;
-   k2 = psum2;
-   return sum / 256;
+   k1 = (double)psum / 0x7000 / 0x7000;
+   k2 = (double)psum2 / 0x7000 / 0x7000;
+   return (double)sum / 0x7000 / 256;
 }
 
 double CompareDblCharStats( const dbl_char_stat_t * stat1, const dbl_char_stat_t * stat2, int stat_len, double &k1, double &k2 )
 {
-   double sum = 0;
+   // products are summed as integers and scaled once
+   lInt64 sum = 0;
    int len1 = stat_len;
    int len2 = stat_len;
-   double psum = 0;
-   double psum2 = 0;
+   lInt64 psum = 0;
+   lInt64 psum2 = 0;
    while (len1 && len2) {
       //
       if (stat1->ch1==stat2->ch1 && stat1->ch2==stat2->ch2) {
@@ -1857,9 +1933,10 @@ double CompareDblCharStats( const dbl_char_stat_t * stat1, const dbl_char_stat_t
              if (delta<0)
                 delta = -delta;
              sum += delta;
-             psum += ( (double)stat1->count * stat2->count / 0x7000 / 0x7000);
+             int product = stat1->count * stat2->count;
+             psum += product;
              if (stat1->ch1>=128 || stat1->ch2>=128)
-                psum2 += ( (double)stat1->count * stat2->count / 0x7000 / 0x7000);
+                psum2 += product;
           }
           // move both
           stat1++;
@@ -1881,10 +1958,9 @@ double CompareDblCharStats( const dbl_char_stat_t * stat1, const dbl_char_stat_t
          len2--;
       }
    }
-   sum /= 0x7000;
-   k1 = psum;
-   k2 = psum2;
-   return sum / stat_len;
+   k1 = (double)psum / 0x7000 / 0x7000;
+   k2 = (double)psum2 / 0x7000 / 0x7000;
+   return (double)sum / 0x7000 / stat_len;
 }
 
 
@@ -1899,6 +1975,46 @@ typedef struct {
 // EXTERNAL DEFINE
 extern cp_stat_t cp_stat_table[];
 
+/// set of chars 128..255 present in char or char pair statistics
+struct cp_high_chars_t {
+    lUInt32 bits[4];
+    void init( const short * ch_stat, const dbl_char_stat_t * dbl_ch_stat, int stat_len )
+    {
+        bits[0] = bits[1] = bits[2] = bits[3] = 0;
+        for ( int i=128; i<256; i++ )
+            if ( ch_stat[i] )
+                add( i );
+        for ( int i=0; i<stat_len; i++ ) {
+            if ( dbl_ch_stat[i].count ) {
+                add( dbl_ch_stat[i].ch1 );
+                add( dbl_ch_stat[i].ch2 );
+            }
+        }
+    }
+    void add( int ch )
+    {
+        if ( ch>=128 )
+            bits[(ch - 128) >> 5] |= 1U << ((ch - 128) & 31);
+    }
+    bool intersects( const cp_high_chars_t & v ) const
+    {
+        return ( (bits[0] & v.bits[0]) | (bits[1] & v.bits[1]) | (bits[2] & v.bits[2]) | (bits[3] & v.bits[3]) ) != 0;
+    }
+};
+
+#define MAX_CP_STAT_TABLES 256
+static cp_high_chars_t cp_stat_high_chars[MAX_CP_STAT_TABLES];
+static bool cp_stat_high_chars_initialized = false;
+
+static void initCodePageHighChars()
+{
+    if ( cp_stat_high_chars_initialized )
+        return;
+    for (int i=0; cp_stat_table[i].ch_stat && i<MAX_CP_STAT_TABLES; i++)
+        cp_stat_high_chars[i].init( cp_stat_table[i].ch_stat, cp_stat_table[i].dbl_ch_stat, DBL_CHAR_STAT_SIZE );
+    cp_stat_high_chars_initialized = true;
+}
+
 int AutodetectCodePageUtf( const unsigned char * buf, int buf_size, char * cp_name, char * lang_name )
 {
     // checking byte order signatures
@@ -1951,7 +2067,14 @@ int strincmp(const unsigned char * buf, const char * pattern, int len)
 int strnstr(const unsigned char * buf, int buf_len, const char * pattern)
 {
     int plen = (int)strlen(pattern);
+    // positions are compared only when first char matches in any case
+    int first = (unsigned char)pattern[0];
+    int firstUpper = (first >= 'a' && first <= 'z') ? first - ('a' - 'A') : first;
+    int firstLower = (first >= 'A' && first <= 'Z') ? first + ('a' - 'A') : first;
     for (int i=0; i<=buf_len - plen; i++) {
+        int ch = buf[i];
+        if (ch != firstLower && ch != firstUpper && ch && first)
+            continue;
         if (!strincmp(buf + i, pattern, plen)) {
             return i;
         }
@@ -2021,9 +2144,15 @@ int AutodetectCodePage(const unsigned char * buf, int buf_size, char * cp_name,
    dbl_char_stat_t dbl_char_stat[DBL_CHAR_STAT_SIZE];
    MakeCharStat(buf, buf_size, char_stat, skipHtml);
    MakeDblCharStat(buf, buf_size, dbl_char_stat, DBL_CHAR_STAT_SIZE, skipHtml);
+   initCodePageHighChars();
+   cp_high_chars_t high_chars;
+   high_chars.init( char_stat, dbl_char_stat, DBL_CHAR_STAT_SIZE );
    int bestn = 0;
    double bestq = 0; //1000000;
    for (int i=0; cp_stat_table[i].ch_stat; i++) {
+       // score is made of products of chars 128..255 frequencies: zero when there are no such chars in common
+       if ( i<MAX_CP_STAT_TABLES && !high_chars.intersects( cp_stat_high_chars[i] ) )
+           continue;
 	   double q12, q11;
 	   double q22, q21;
 	   double q1 = CompareCharStats( cp_stat_table[i].ch_stat, char_stat, q11, q12 );
@@ -3,6 +3,7 @@
 #include "../include/fb2def.h"
 #include "../include/lvopc.h"
 #include "../include/crlog.h"
+#include "../include/crconcurrent.h"
 
 #define DOCX_TAG_NAME(itm) docx_el_##itm##_name
 #define DOCX_TAG_ID(itm) docx_el_##itm
@@ -42,6 +43,52 @@ enum {
 #define DOCX_TAG(itm) static const lChar16 * const DOCX_TAG_NAME(itm) = L ## #itm;
     #include "docxdtd.inc"
 
+#define DOCX_NUM_FMT(itm)
+#define DOCX_TAG(itm) DOCX_TAG_NAME(itm),
+static const lChar16 * const docx_tag_names[] = {
+    NULL,
+    #include "docxdtd.inc"
+};
+
+/// size of tag name hash, power of 2 several times bigger than number of tags
+#define DOCX_TAG_HASH_SIZE 512
+
+/// interned tag names: tag id is found by one hash lookup instead of comparing name with each table item
+class docx_TagIds
+{
+    lUInt16 m_hash[DOCX_TAG_HASH_SIZE]; // tag id, 0 for empty slot
+    static lUInt32 hashName(const lChar16 * name)
+    {
+        lUInt32 h = 0;
+        while ( *name )
+            h = h * 31 + *name++;
+        return h;
+    }
+public:
+    docx_TagIds()
+    {
+        memset(m_hash, 0, sizeof(m_hash));
+        for ( int id = 1; id < docx_el_MAX_ID; id++ ) {
+            lUInt32 index = hashName(docx_tag_names[id]) & (DOCX_TAG_HASH_SIZE - 1);
+            while ( m_hash[index] )
+                index = (index + 1) & (DOCX_TAG_HASH_SIZE - 1);
+            m_hash[index] = (lUInt16)id;
+        }
+    }
+    /// returns tag id, docx_el_NULL for unknown tag
+    int get(const lChar16 * name) const
+    {
+        lUInt32 index = hashName(name) & (DOCX_TAG_HASH_SIZE - 1);
+        for ( ; m_hash[index]; index = (index + 1) & (DOCX_TAG_HASH_SIZE - 1) ) {
+            if ( !lStr_cmp(docx_tag_names[m_hash[index]], name) )
+                return m_hash[index];
+        }
+        return docx_el_NULL;
+    }
+};
+
+static const docx_TagIds docx_tagIds;
+
 const struct item_def_t styles_elements[] = {
     DOCX_TAG_CHILD(styles),
     DOCX_TAG_CHILD(style),
@@ -655,6 +702,10 @@ public:
     LVStreamRef openContentPart(const lChar16 * const contentType);
     LVStreamRef openRelatedPart(const lChar16 * const relationshipType);
     void closeRelatedPart();
+    void loadRelations() {
+        if ( !m_docPart.isNull() )
+            m_docPart->loadRelations();
+    }
     void openList(int level, int numid, ldomDocumentWriter *writer);
     void closeList(int level, ldomDocumentWriter *writer);
     inline docx_rPr * get_rPrDefault() { return &m_rPrDefault; }
@@ -765,6 +816,7 @@ protected:
 protected:
     static bool parse_OnOff_attribute(const lChar16 * attrValue);
     static int parse_name(const struct item_def_t *tags, const lChar16 * nameValue);
+    static int parse_tag(const struct item_def_t *tags, const lChar16 * tagName);
     static void parse_int(const lChar16 * attrValue, css_length_t & result);
     void generateLink(const lChar16 * target, const lChar16 * type, const lChar16 *text);
     void setChildrenInfo(const struct item_def_t *tags);
@@ -955,16 +1007,21 @@ private:
     docx_hyperlinkHandler m_hyperlinkHandler;
     int m_runCount;
     lString16 m_styleTags;
+    int m_styleTagMask; // bits of tags in m_styleTags
     bool m_inTitle;
 private:
     int styleTagPos(lChar16 ch)
     {
+        if ( !(m_styleTagMask & getStyleTagBit(ch)) )
+            return -1;
         for (int i=0; i < m_styleTags.length(); i++)
             if (m_styleTags[i] == ch)
                 return i;
         return -1;
     }
     const lChar16 * getStyleTagName( lChar16 ch );
+    static int getStyleTagBit( lChar16 ch );
+    static int getStyleTagMask(docx_rPr* runProps);
     void closeStyleTag( lChar16 ch);
     void openStyleTag( lChar16 ch);
 public:
@@ -973,13 +1030,14 @@ public:
         m_pPrHandler(reader, writer, context),
         m_rHandler(reader, writer, context, this),
         m_titleHandler(p_documentHandler),
-        m_hyperlinkHandler(reader, writer, context, this), m_inTitle(false)
+        m_hyperlinkHandler(reader, writer, context, this), m_styleTagMask(0), m_inTitle(false)
     {
     }
     ldomNode * handleTagOpen(int tagId);
     void handleAttribute(const lChar16 * attrname, const lChar16 * attrvalue);
     void handleTagClose( const lChar16 * nsname, const lChar16 * tagname );
     void reset();
+    void setStyleTags(docx_rPr* runProps);
     void openStyleTags(docx_rPr* runProps);
     void closeStyleTags(docx_rPr* runProps);
     void closeStyleTags();
@@ -1403,6 +1461,18 @@ int docx_ElementHandler::parse_name(const struct item_def_t *tags, const lChar16
     return -1;
 }
 
+int docx_ElementHandler::parse_tag(const struct item_def_t *tags, const lChar16 * tagName)
+{
+    int id = docx_tagIds.get(tagName);
+    if ( id != docx_el_NULL ) {
+        for (int i=0; tags[i].name; i++) {
+            if ( tags[i].id == id )
+                return id;
+        }
+    }
+    return -1;
+}
+
 void docx_ElementHandler::parse_int(const lChar16 * attrValue, css_length_t & result)
 {
     lString16 value = attrValue;
@@ -1453,7 +1523,7 @@ ldomNode * docx_ElementHandler::handleTagOpen(int tagId)
 
 ldomNode * docx_ElementHandler::handleTagOpen(const lChar16 * nsname, const lChar16 * tagname)
 {
-    int tag = parse_name(m_children, tagname);
+    int tag = parse_tag(m_children, tagname);
 
     CR_UNUSED(nsname);
     if( -1 == tag) {
@@ -1595,8 +1665,7 @@ ldomNode *docx_rHandler::handleTagOpen(int tagId)
             if( m_importContext->m_pStyle )
                 m_rPr.combineWith(m_importContext->m_pStyle->get_rPr(m_importContext));
             m_rPr.combineWith(m_importContext->get_rPrDefault());
-            m_pHandler->closeStyleTags(&m_rPr);
-            m_pHandler->openStyleTags(&m_rPr);
+            m_pHandler->setStyleTags(&m_rPr);
             m_content = true;
         }
         m_state = tagId;
@@ -1889,12 +1958,43 @@ const lChar16 *docx_pHandler::getStyleTagName(lChar16 ch)
     }
 }
 
+int docx_pHandler::getStyleTagBit(lChar16 ch)
+{
+    switch ( ch ) {
+    case 'b':
+        return 1;
+    case 'i':
+        return 2;
+    case 'u':
+        return 4;
+    case 's':
+        return 8;
+    case 't':
+        return 16;
+    case 'd':
+        return 32;
+    default:
+        return 0;
+    }
+}
+
+int docx_pHandler::getStyleTagMask(docx_rPr *runProps)
+{
+    return (runProps->isBold() ? getStyleTagBit('b') : 0) |
+        (runProps->isItalic() ? getStyleTagBit('i') : 0) |
+        (runProps->isUnderline() ? getStyleTagBit('u') : 0) |
+        (runProps->isStrikeThrough() ? getStyleTagBit('s') : 0) |
+        (runProps->isSubScript() ? getStyleTagBit('d') : 0) |
+        (runProps->isSuperScript() ? getStyleTagBit('t') : 0);
+}
+
 void docx_pHandler::closeStyleTag(lChar16 ch)
 {
     int pos = styleTagPos( ch );
     if (pos >= 0) {
         for (int i = m_styleTags.length() - 1; i >= pos; i--) {
             const lChar16 * tag = getStyleTagName(m_styleTags[i]);
+            m_styleTagMask &= ~getStyleTagBit(m_styleTags[i]);
             m_styleTags.erase(m_styleTags.length() - 1, 1);
             if ( tag ) {
                 m_writer->OnTagClose(L"", tag);
@@ -1911,6 +2011,7 @@ void docx_pHandler::openStyleTag(lChar16 ch)
         if ( tag ) {
             m_writer->OnTagOpenNoAttr(L"", tag);
             m_styleTags.append( 1,  ch );
+            m_styleTagMask |= getStyleTagBit(ch);
         }
     }
 }
@@ -2012,6 +2113,15 @@ void docx_pHandler::reset()
     m_runCount = 0;
 }
 
+void docx_pHandler::setStyleTags(docx_rPr *runProps)
+{
+    // most runs repeat formatting of previous one: nothing to close and open then
+    if ( getStyleTagMask(runProps) == m_styleTagMask )
+        return;
+    closeStyleTags(runProps);
+    openStyleTags(runProps);
+}
+
 void docx_pHandler::openStyleTags(docx_rPr *runProps)
 {
     if(runProps->isBold())
@@ -2050,6 +2160,7 @@ void docx_pHandler::closeStyleTags()
     for(int i = m_styleTags.length() - 1; i >= 0; i--)
         closeStyleTag(m_styleTags[i]);
     m_styleTags.clear();
+    m_styleTagMask = 0;
 }
 
 ldomNode * docx_documentHandler::handleTagOpen(int tagId)
@@ -2214,9 +2325,210 @@ void docx_stylesHandler::reset()
     m_state = docx_el_NULL;
 }
 
-bool parseStyles(docxImportContext *importContext)
+/// size of blocks parts are inflated to by docxPartReader
+#define DOCX_PART_BLOCK_SIZE 0x10000
+/// blocks at part start are kept to let parser rewind after encoding detection
+#define DOCX_PART_HEAD_SIZE 0x40000
+/// max size of data inflated ahead of parser
+#define DOCX_PART_READ_AHEAD 0x400000
+
+class docxPartReader;
+
+/// part stream inflated by docxPartReader thread, blocks passed by parser are dropped
+class docxPartStream : public LVNamedStream
+{
+    friend class docxPartReader;
+    docxPartReader * m_reader;
+    int m_index; // in parse order
+    LVStreamRef m_source; // read on reader thread only
+    lvsize_t m_size;
+    lvpos_t m_pos;
+    LVPtrVector<LVArray<lUInt8> > m_blocks; // NULL for dropped ones
+    lvsize_t m_inflated; // size of data in m_blocks, including dropped blocks
+    lvpos_t m_consumed; // start of block parser reads
+    bool m_done;
+    bool m_error;
+public:
+    docxPartStream(docxPartReader * reader, int index, LVStreamRef source);
+    virtual lvopen_mode_t GetMode() { return LVOM_READ; }
+    virtual lverror_t Seek(lvoffset_t offset, lvseek_origin_t origin, lvpos_t * pNewPos);
+    virtual lverror_t Read(void * buf, lvsize_t count, lvsize_t * nBytesRead);
+    virtual lverror_t Write(const void *, lvsize_t, lvsize_t *) { return LVERR_NOTIMPL; }
+    virtual lverror_t SetSize(lvsize_t) { return LVERR_NOTIMPL; }
+    virtual lvsize_t GetSize() { return m_size; }
+    virtual bool Eof() { return m_pos >= m_size; }
+};
+
+/// inflates parts on reader thread, in the order they are parsed, so that
+/// decompression overlaps parsing of current part and of the ones before it
+class docxPartReader : public CRRunnable
+{
+    friend class docxPartStream;
+    CRMonitorRef m_monitor;
+    CRThreadRef m_thread;
+    LVArray<LVStreamRef> m_parts;
+    int m_current; // part parser reads, ones before it are not inflated anymore
+    bool m_stopped;
+public:
+    docxPartReader() : m_current(0), m_stopped(false)
+    {
+        if ( concurrencyProvider )
+            m_monitor = concurrencyProvider->createMonitor();
+    }
+    ~docxPartReader()
+    {
+        stop();
+    }
+    /// returns stream of part inflated on reader thread, source stream if threads are not available
+    LVStreamRef add(LVStreamRef source)
+    {
+        if ( source.isNull() || !m_monitor || !m_thread.isNull() )
+            return source;
+        LVStreamRef stream(new docxPartStream(this, m_parts.length(), source));
+        m_parts.add(stream);
+        return stream;
+    }
+    /// starts thread; archive must not be read by caller until stop()
+    void start()
+    {
+        if ( !m_parts.length() || !m_thread.isNull() )
+            return;
+        m_thread = concurrencyProvider->createThread(this);
+        m_thread->start();
+    }
+    /// stops thread, when parts are parsed or parsing failed
+    void stop()
+    {
+        if ( m_thread.isNull() )
+            return;
+        {
+            CRGuard guard(m_monitor);
+            CR_UNUSED(guard);
+            m_stopped = true;
+            m_monitor->notifyAll();
+        }
+        m_thread->join();
+        m_thread.clear();
+        for ( int i = 0; i < m_parts.length(); i++ )
+            ((docxPartStream *)m_parts[i].get())->m_done = true;
+    }
+    virtual void run();
+};
+
+docxPartStream::docxPartStream(docxPartReader *reader, int index, LVStreamRef source)
+    : m_reader(reader), m_index(index), m_source(source), m_size(source->GetSize()), m_pos(0),
+      m_inflated(0), m_consumed(0), m_done(false), m_error(false)
+{
+    SetName(source->GetName());
+}
+
+lverror_t docxPartStream::Seek(lvoffset_t offset, lvseek_origin_t origin, lvpos_t *pNewPos)
+{
+    lvpos_t pos;
+    switch ( origin ) {
+    case LVSEEK_SET:
+        pos = offset;
+        break;
+    case LVSEEK_CUR:
+        pos = m_pos + offset;
+        break;
+    case LVSEEK_END:
+        pos = m_size + offset;
+        break;
+    default:
+        return LVERR_FAIL;
+    }
+    if ( pos > m_size )
+        return LVERR_FAIL;
+    m_pos = pos;
+    if ( pNewPos )
+        *pNewPos = m_pos;
+    return LVERR_OK;
+}
+
+lverror_t docxPartStream::Read(void *buf, lvsize_t count, lvsize_t *nBytesRead)
+{
+    lvsize_t bytesRead = 0;
+    lverror_t res = LVERR_OK;
+    while ( bytesRead < count && m_pos < m_size ) {
+        int index = (int)(m_pos / DOCX_PART_BLOCK_SIZE);
+        LVArray<lUInt8> * block = NULL;
+        {
+            CRGuard guard(m_reader->m_monitor);
+            CR_UNUSED(guard);
+            if ( m_consumed != (lvpos_t)index * DOCX_PART_BLOCK_SIZE || m_reader->m_current != m_index ) {
+                // previous part may be left unread when its parsing fails
+                m_consumed = (lvpos_t)index * DOCX_PART_BLOCK_SIZE;
+                m_reader->m_current = m_index;
+                m_reader->m_monitor->notifyAll();
+            }
+            while ( index >= m_blocks.length() && !m_done )
+                m_reader->m_monitor->wait();
+            if ( index < m_blocks.length() )
+                block = m_blocks[index];
+        }
+        if ( !block ) {
+            res = LVERR_FAIL; // inflate error, or seek back behind head
+            break;
+        }
+        int offset = (int)(m_pos - (lvpos_t)index * DOCX_PART_BLOCK_SIZE);
+        int n = block->length() - offset;
+        if ( (lvsize_t)n > count - bytesRead )
+            n = (int)(count - bytesRead);
+        memcpy((lUInt8*)buf + bytesRead, block->get() + offset, n);
+        bytesRead += n;
+        m_pos += n;
+        if ( offset + n == block->length() && (lvpos_t)(index + 1) * DOCX_PART_BLOCK_SIZE > DOCX_PART_HEAD_SIZE ) {
+            CRGuard guard(m_reader->m_monitor);
+            CR_UNUSED(guard);
+            m_blocks.set(index, NULL);
+        }
+    }
+    if ( nBytesRead )
+        *nBytesRead = bytesRead;
+    return res;
+}
+
+void docxPartReader::run()
+{
+    for ( int i = 0; i < m_parts.length(); i++ ) {
+        docxPartStream * part = (docxPartStream *)m_parts[i].get();
+        while ( !part->m_done ) {
+            {
+                CRGuard guard(m_monitor);
+                CR_UNUSED(guard);
+                while ( !m_stopped && m_current <= i && part->m_inflated >= part->m_consumed + DOCX_PART_READ_AHEAD )
+                    m_monitor->wait();
+                if ( m_stopped )
+                    return;
+                if ( m_current > i ) {
+                    part->m_done = true;
+                    break;
+                }
+            }
+            lvsize_t size = part->m_size - part->m_inflated;
+            if ( size > DOCX_PART_BLOCK_SIZE )
+                size = DOCX_PART_BLOCK_SIZE;
+            LVArray<lUInt8> * block = new LVArray<lUInt8>((int)size, 0);
+            lvsize_t bytesRead = 0;
+            bool ok = part->m_source->Read(block->get(), size, &bytesRead) == LVERR_OK && bytesRead == size;
+            CRGuard guard(m_monitor);
+            CR_UNUSED(guard);
+            if ( ok ) {
+                part->m_blocks.add(block);
+                part->m_inflated += size;
+            } else {
+                delete block;
+                part->m_error = true;
+            }
+            part->m_done = !ok || part->m_inflated >= part->m_size;
+            m_monitor->notifyAll();
+        }
+    }
+}
+
+bool parseStyles(docxImportContext *importContext, LVStreamRef m_stream)
 {
-    LVStreamRef m_stream = importContext->openContentPart(docx_StylesContentType);
     if ( m_stream.isNull() )
         return false;
 
@@ -2231,9 +2543,8 @@ bool parseStyles(docxImportContext *importContext)
     return true;
 }
 
-bool parseNumbering(docxImportContext *importContext)
+bool parseNumbering(docxImportContext *importContext, LVStreamRef m_stream)
 {
-    LVStreamRef m_stream = importContext->openContentPart(docx_NumberingContentType);
     if ( m_stream.isNull() )
         return false;
 
@@ -2298,14 +2609,26 @@ bool ImportDocXDocument( LVStreamRef stream, ldomDocument * doc, LVDocViewCallba
     }
 #endif
 
-    parseNumbering(&importContext);
-
-    if ( !parseStyles(&importContext) )
+    // parts are opened first, then inflated by reader thread while parsed
+    docxPartReader partReader;
+    LVStreamRef numberingStream = partReader.add(importContext.openContentPart(docx_NumberingContentType));
+    LVStreamRef stylesStream = partReader.add(importContext.openContentPart(docx_StylesContentType));
+    if ( stylesStream.isNull() )
         return false;
-
     LVStreamRef m_stream = importContext.openContentPart(docx_DocumentContentType);
     if ( m_stream.isNull() )
         return false;
+    m_stream = partReader.add(m_stream);
+    // document links and images are looked up while parsing: relations are read before archive is given to reader thread
+    importContext.loadRelations();
+    partReader.start();
+
+    parseNumbering(&importContext, numberingStream);
+    numberingStream.Clear();
+
+    if ( !parseStyles(&importContext, stylesStream) )
+        return false;
+    stylesStream.Clear();
 
     ldomDocumentWriter writer(doc);
     docXMLreader docReader(&writer);
@@ -2350,6 +2673,7 @@ bool ImportDocXDocument( LVStreamRef stream, ldomDocument * doc, LVDocViewCallba
 
     if ( !parser.Parse() )
         return false;
+    partReader.stop();
 
     if(importContext.m_footNoteCount > 0) {
         parseFootnotes(writer, importContext, docx_el_footnotes);
@@ -1,5 +1,8 @@
 #include "../include/epubfmt.h"
 #include "../include/crlog.h"
+#if (USE_ZLIB==1)
+#include <zlib.h>
+#endif
 
 
 class EpubItem {
@@ -176,6 +179,30 @@ public:
         return res;
     }
 
+    /// CRC of demangled data, from CRC of archive item which is known without unpacking it
+    virtual lverror_t getcrc32( lUInt32 & dst ) {
+        if (_key.length() != 16)
+            return _base->getcrc32(dst);
+#if (USE_ZLIB==1)
+        lUInt32 crc = 0;
+        if (_base->getcrc32(crc) != LVERR_OK)
+            return LVERR_FAIL;
+        // crc(data ^ mask) == crc(data) ^ crc(mask) ^ crc(zeros), and mask is zero after first 1024 bytes
+        lvsize_t size = _base->GetSize();
+        int maskSize = size < 1024 ? (int)size : 1024;
+        lUInt8 mask[1024];
+        lUInt8 zeros[1024];
+        memset(zeros, 0, sizeof(zeros));
+        for (int i = 0; i < maskSize; i++)
+            mask[i] = _key[i & 15];
+        lUInt32 delta = (lUInt32)(crc32(0, mask, maskSize) ^ crc32(0, zeros, maskSize));
+        dst = crc ^ (lUInt32)crc32_combine(delta, 0, (z_off_t)(size - maskSize));
+        return LVERR_OK;
+#else
+        return LVStream::getcrc32(dst);
+#endif
+    }
+
 };
 
 class EncryptedItem {
@@ -476,6 +503,154 @@ LVStreamRef GetEpubCoverpage(LVContainerRef arc)
     return coverPageImageStream;
 }
 
+/// OPF header-only parser callback: reads <metadata>, and <manifest> only when looking for cover item
+class EpubMetadataParserCallback : public LVXMLParserCallback
+{
+protected:
+    LVDocMetadata & _metadata;
+    bool _extractCover;
+    bool _insideMetadata;
+    bool _metadataDone;
+    bool _collectText;
+    lString16 _currTag;
+    lString16 _text;
+    lString16 _attrName;
+    lString16 _attrContent;
+    lString16 _attrId;
+    lString16 _attrHref;
+public:
+    lString16 coverHref;
+    EpubMetadataParserCallback( LVDocMetadata & metadata, bool extractCover )
+        : _metadata(metadata), _extractCover(extractCover), _insideMetadata(false), _metadataDone(false), _collectText(false)
+    {
+    }
+    virtual void OnStop() { }
+    virtual bool OnBlob(lString16 /*name*/, const lUInt8 * /*data*/, int /*size*/) { return true; }
+    virtual ldomNode * OnTagOpen( const lChar16 * /*nsname*/, const lChar16 * tagname )
+    {
+        _currTag = tagname;
+        _attrName.clear();
+        _attrContent.clear();
+        _attrId.clear();
+        _attrHref.clear();
+        if ( !_insideMetadata ) {
+            if ( lStr_cmp(tagname, "metadata")==0 )
+                _insideMetadata = true;
+            return NULL;
+        }
+        if ( _currTag == "title" || _currTag == "creator" || _currTag == "language"
+             || _currTag == "subject" || _currTag == "description" ) {
+            _collectText = true;
+            _text.clear();
+        }
+        return NULL;
+    }
+    virtual void OnTagBody()
+    {
+        if ( _metadataDone ) {
+            if ( _currTag == "item" && !_attrId.empty() && _attrId == _metadata.coverId ) {
+                coverHref = DecodeHTMLUrlString(_attrHref);
+                _parser->Stop();
+            }
+        } else if ( _insideMetadata && _currTag == "meta" && !_attrName.empty() ) {
+            PreProcessXmlString(_attrContent, 0);
+            if ( _attrName == "cover" )
+                _metadata.coverId = _attrContent;
+            else if ( _attrName == "calibre:series" )
+                _metadata.series = _attrContent.trim();
+            else if ( _attrName == "calibre:series_index" && !_attrContent.trim().empty() )
+                _metadata.seriesNumber = _attrContent.atoi();
+        }
+    }
+    virtual void OnTagClose( const lChar16 * /*nsname*/, const lChar16 * tagname )
+    {
+        if ( _metadataDone ) {
+            if ( lStr_cmp(tagname, "manifest")==0 )
+                _parser->Stop();
+            return;
+        }
+        if ( !_insideMetadata )
+            return;
+        if ( lStr_cmp(tagname, "metadata")==0 ) {
+            _insideMetadata = false;
+            _metadataDone = true;
+            if ( !_extractCover || _metadata.coverId.empty() )
+                _parser->Stop();
+            return;
+        }
+        if ( !_collectText )
+            return;
+        _collectText = false;
+        _text.trim();
+        if ( lStr_cmp(tagname, "title")==0 ) {
+            if ( _metadata.title.empty() )
+                _metadata.title = _text;
+        } else if ( lStr_cmp(tagname, "creator")==0 ) {
+            if ( !_text.empty() )
+                _metadata.addAuthor( lString16::empty_str, lString16::empty_str, _text );
+        } else if ( lStr_cmp(tagname, "language")==0 ) {
+            if ( _metadata.language.empty() )
+                _metadata.language = _text;
+        } else if ( lStr_cmp(tagname, "subject")==0 ) {
+            if ( !_text.empty() )
+                _metadata.genres.add( _text );
+        } else if ( lStr_cmp(tagname, "description")==0 ) {
+            _metadata.annotation = _text;
+        }
+    }
+    virtual void OnAttribute( const lChar16 * /*nsname*/, const lChar16 * attrname, const lChar16 * attrvalue )
+    {
+        if ( lStr_cmp(attrname, "name")==0 )
+            _attrName = attrvalue;
+        else if ( lStr_cmp(attrname, "content")==0 )
+            _attrContent = attrvalue;
+        else if ( lStr_cmp(attrname, "id")==0 )
+            _attrId = attrvalue;
+        else if ( lStr_cmp(attrname, "href")==0 )
+            _attrHref = attrvalue;
+    }
+    virtual void OnText( const lChar16 * text, int len, lUInt32 /*flags*/ )
+    {
+        if ( _collectText )
+            _text.append( text, len );
+    }
+    virtual ~EpubMetadataParserCallback() { }
+};
+
+bool GetEpubMetadata( LVContainerRef arc, LVDocMetadata & metadata, bool extractCover )
+{
+    metadata.clear();
+    if ( arc.isNull() )
+        return false;
+    lString16 rootfilePath = EpubGetRootFilePath(arc);
+    if ( rootfilePath.empty() )
+        return false;
+    LVStreamRef content_stream = arc->OpenStream(rootfilePath.c_str(), LVOM_READ);
+    if ( content_stream.isNull() )
+        return false;
+    EpubMetadataParserCallback callback( metadata, extractCover );
+    LVXMLParser parser( content_stream, &callback );
+    if ( !parser.CheckFormat() )
+        return false;
+    parser.Parse();
+    if ( extractCover && !callback.coverHref.empty() ) {
+        EncryptedDataContainer * decryptor = new EncryptedDataContainer(arc);
+        decryptor->open();
+        LVContainerRef m_arc = LVContainerRef(decryptor);
+        lString16 coverFileName = LVCombinePaths(LVExtractPath(rootfilePath, false), callback.coverHref);
+        metadata.cover = m_arc->OpenStream(coverFileName.c_str(), LVOM_READ);
+    }
+    return true;
+}
+
+bool GetEpubMetadata( LVStreamRef stream, LVDocMetadata & metadata, bool extractCover )
+{
+    LVContainerRef arc = LVOpenArchieve( stream );
+    if ( arc.isNull() )
+        return false; // not a ZIP archive
+    return GetEpubMetadata( arc, metadata, extractCover );
+}
+
 
 class EmbeddedFontStyleParser {
     LVEmbeddedFontList & _fontList;
@@ -18,7 +18,7 @@
 #include <string.h>
 
 LDOMNameIdMapItem::LDOMNameIdMapItem(lUInt16 _id, const lString16 & _value, const css_elem_def_props_t * _data)
-    : id(_id), value(_value)
+    : id(_id), value(_value), hash(calcStringHash(_value.c_str()))
 {
 	if ( _data ) {
         data = new css_elem_def_props_t();
@@ -28,7 +28,7 @@ LDOMNameIdMapItem::LDOMNameIdMapItem(lUInt16 _id, const lString16 & _value, cons
 }
 
 LDOMNameIdMapItem::LDOMNameIdMapItem(LDOMNameIdMapItem & item)
-    : id(item.id), value(item.value)
+    : id(item.id), value(item.value), hash(item.hash)
 {
 	if ( item.data ) {
 		data = new css_elem_def_props_t();
@@ -100,8 +100,6 @@ void LDOMNameIdMap::serialize( SerialBuf & buf )
 {
     if ( buf.error() )
         return;
-    if (!m_sorted)
-        Sort();
     int start = buf.pos();
 	buf.putMagic( id_map_magic );
     buf << m_count;
@@ -140,11 +138,8 @@ bool LDOMNameIdMap::deserialize( SerialBuf & buf )
         }
         AddItem( item );
     }
-    m_sorted = false;
     buf.checkCRC( buf.pos() - start );
     m_changed = false;
-    if (!m_sorted)
-        Sort();
     return !buf.error();
 }
 
@@ -155,7 +150,8 @@ LDOMNameIdMap::LDOMNameIdMap(lUInt16 maxId)
     m_count = 0;
     m_by_id   = new LDOMNameIdMapItem * [m_size]();
     m_by_name = new LDOMNameIdMapItem * [m_size]();
-    m_sorted = true;
+    m_hash = NULL;
+    m_hashSize = 0;
     m_changed = false;
 }
 
@@ -165,22 +161,16 @@ LDOMNameIdMap::LDOMNameIdMap( LDOMNameIdMap & map )
     m_changed = false;
     m_size = map.m_size;
     m_count = map.m_count;
-    m_by_id   = new LDOMNameIdMapItem * [m_size];
-    int i;
-    for ( i=0; i<m_size; i++ ) {
-        if ( map.m_by_id[i] )
-            m_by_id[i] = new LDOMNameIdMapItem( *map.m_by_id[i] );
-        else
-            m_by_id[i] = NULL;
-    }
-    m_by_name = new LDOMNameIdMapItem * [m_size];
-    for ( i=0; i<m_size; i++ ) {
-        if ( map.m_by_name[i] )
-            m_by_name[i] = new LDOMNameIdMapItem( *map.m_by_name[i] );
-        else
-            m_by_name[i] = NULL;
+    m_by_id   = new LDOMNameIdMapItem * [m_size]();
+    m_by_name = new LDOMNameIdMapItem * [m_size]();
+    for ( int i=0; i<m_count; i++ ) {
+        LDOMNameIdMapItem * item = new LDOMNameIdMapItem( *map.m_by_name[i] );
+        m_by_name[i] = item;
+        m_by_id[item->id] = item;
     }
-    m_sorted = map.m_sorted;
+    m_hash = NULL;
+    m_hashSize = 0;
+    reHash( map.m_hashSize );
 }
 
 LDOMNameIdMap::~LDOMNameIdMap()
@@ -188,68 +178,53 @@ LDOMNameIdMap::~LDOMNameIdMap()
     Clear();
     delete[] m_by_name;
     delete[] m_by_id;
+    delete[] m_hash;
 }
 
-static int compare_items( const void * item1, const void * item2 )
+void LDOMNameIdMap::addHashItem( LDOMNameIdMapItem * item )
 {
-    return (*((LDOMNameIdMapItem **)item1))->value.compare( (*((LDOMNameIdMapItem **)item2))->value );
+    lUInt32 mask = m_hashSize - 1;
+    lUInt32 n = item->hash & mask;
+    while ( m_hash[n] )
+        n = (n + 1) & mask;
+    m_hash[n] = item;
 }
 
-void LDOMNameIdMap::Sort()
+void LDOMNameIdMap::reHash( lUInt32 newSize )
 {
-    if (m_count>1)
-        qsort( m_by_name, m_count, sizeof(LDOMNameIdMapItem*), compare_items );
-    m_sorted = true;
+    delete[] m_hash;
+    m_hash = NULL;
+    m_hashSize = newSize;
+    if ( !m_hashSize )
+        return;
+    m_hash = new LDOMNameIdMapItem * [m_hashSize]();
+    for ( int i=0; i<m_count; i++ )
+        addHashItem( m_by_name[i] );
 }
 
-const LDOMNameIdMapItem * LDOMNameIdMap::findItem( const lChar16 * name )
+template <typename T>
+const LDOMNameIdMapItem * LDOMNameIdMap::findHashItem( const T * name ) const
 {
     if (m_count==0 || !name || !*name)
         return NULL;
-    if (!m_sorted)
-        Sort();
-    lUInt16 a, b, c;
-    int r;
-    a = 0;
-    b = m_count;
-    for (;;) {
-        c = (a + b)>>1;
-        r = lStr_cmp( name, m_by_name[c]->value.c_str() );
-        if (r == 0)
-            return m_by_name[c]; // found
-        if (b==a+1)
-            return NULL; // not found
-        if (r>0) {
-            a = c;
-        } else {
-            b = c;
-        }
+    lUInt32 h = calcStringHash( name );
+    lUInt32 mask = m_hashSize - 1;
+    for ( lUInt32 n = h & mask; m_hash[n]; n = (n + 1) & mask ) {
+        const LDOMNameIdMapItem * item = m_hash[n];
+        if ( item->hash == h && !lStr_cmp( name, item->value.c_str() ) )
+            return item;
     }
+    return NULL;
 }
 
-const LDOMNameIdMapItem * LDOMNameIdMap::findItem( const lChar8 * name )
+const LDOMNameIdMapItem * LDOMNameIdMap::findItem( const lChar16 * name ) const
 {
-    if (m_count==0 || !name || !*name)
-        return NULL;
-    if (!m_sorted)
-        Sort();
-    lUInt16 a, b, c;
-    int r;
-    a = 0;
-    b = m_count;
-    for (;;) {
-        c = (a + b)>>1;
-        r = lStr_cmp( name, m_by_name[c]->value.c_str() );
-        if (r == 0)
-            return m_by_name[c]; // found
-        if (b==a+1)
-            return NULL; // not found
-        if (r>0) {
-            a = c;
-        } else {
-            b = c;
-        }
-    }
+    return findHashItem( name );
+}
+
+const LDOMNameIdMapItem * LDOMNameIdMap::findItem( const lChar8 * name ) const
+{
+    return findHashItem( name );
 }
 
 void LDOMNameIdMap::AddItem( LDOMNameIdMapItem * item )
@@ -280,7 +255,11 @@ void LDOMNameIdMap::AddItem( LDOMNameIdMapItem * item )
     }
     m_by_id[item->id] = item;
     m_by_name[m_count++] = item;
-    m_sorted = false;
+    // keep hash table load factor below 1/2
+    if ( (lUInt32)m_count * 2 > m_hashSize )
+        reHash( m_hashSize ? m_hashSize * 2 : 64 );
+    else
+        addHashItem( item );
     if (!m_changed) {
         m_changed = true;
         //CRLog::trace("new ID for %s is %d", LCSTR(item->value), item->id);
@@ -305,6 +284,8 @@ void LDOMNameIdMap::Clear()
     }
     memset( m_by_id, 0, sizeof(LDOMNameIdMapItem *)*m_size);
     m_count = 0;
+    if ( m_hash )
+        memset( m_hash, 0, sizeof(LDOMNameIdMapItem *)*m_hashSize );
 }
 
 void LDOMNameIdMap::dumpUnknownItems( FILE * f, int start_id )
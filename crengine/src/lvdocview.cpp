@@ -158,6 +158,7 @@ LVDocView::LVDocView(int bitsPerPixel, bool noDefaultDocument) :
             m_backgroundTiled(true),
             m_stylesheetNeedsUpdate(true),
             m_highlightBookmarks(1),
+            m_bmkXPointers(64),
 			m_pageMargins(DEFAULT_PAGE_MARGIN,
 					DEFAULT_PAGE_MARGIN / 2 /*+ INFO_FONT_SIZE + 4 */,
 					DEFAULT_PAGE_MARGIN, DEFAULT_PAGE_MARGIN / 2),
@@ -186,6 +187,10 @@ LVDocView::LVDocView(int bitsPerPixel, bool noDefaultDocument) :
 #endif
 #endif
 	m_statusColor = 0xFF000000;
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+	m_pageDrawListEnabled = true;
+	m_pageDrawGeneration = 0;
+#endif
 	m_defaultFontFace = lString8(DEFAULT_FONT_NAME);
 	m_statusFontFace = lString8(DEFAULT_STATUS_FONT_NAME);
 	m_props = LVCreatePropsContainer();
@@ -549,6 +554,7 @@ void LVDocView::Clear() {
 		if (m_doc)
 			delete m_doc;
 		m_doc = NULL;
+		m_bmkXPointers.clear();
 		m_doc_props->clear();
 		if (!m_stream.isNull())
 			m_stream.Clear();
@@ -565,6 +571,9 @@ void LVDocView::Clear() {
 		m_cursorPos.clear();
 		m_filename.clear();
 		m_section_bounds_valid = false;
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+		clearPageDrawLists();
+#endif
 	}
 	clearImageCache();
 	_navigationHistory.clear();
@@ -578,6 +587,9 @@ void LVDocView::Clear() {
 void LVDocView::clearImageCache() {
 #if CR_ENABLE_PAGE_IMAGE_CACHE==1
 	m_imageCache.clear();
+#endif
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+	m_pageDrawGeneration++;
 #endif
     m_section_bounds_valid = false;
 	if (m_callback != NULL)
@@ -591,6 +603,9 @@ void LVDocView::requestRender() {
 		return;
 	m_is_rendered = false;
 	clearImageCache();
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+	clearPageDrawLists();
+#endif
 	if (m_doc)
 		m_doc->clearRendBlockCache();
 }
@@ -1173,6 +1188,11 @@ bool LVDocView::exportWolFile(LVStream * stream, bool flgGray, int levels) {
 		drawCoverTo(&cover, coverRc);
 		wol.addCoverImage(cover);
 
+		// pages are rendered here, LZSS compression goes to worker threads
+		#define WOL_EXPORT_ENCODER_THREADS 3
+		#define WOL_EXPORT_MAX_PENDING_PAGES 8
+		WOLPageQueue queue(wol, WOL_EXPORT_ENCODER_THREADS, WOL_EXPORT_MAX_PENDING_PAGES);
+		CRTimerUtil timer;
 		int lastPercent = 0;
 		for (int i = showCover ? 1 : 0; i < pages.length(); i
 				+= getVisiblePageCount()) {
@@ -1187,7 +1207,6 @@ bool LVDocView::exportWolFile(LVStream * stream, bool flgGray, int levels) {
 			//drawbuf.SetBackgroundColor(0xFFFFFF);
 			//drawbuf.SetTextColor(0x000000);
 			drawbuf.Clear(m_backgroundColor);
-			drawPageTo(&drawbuf, *pages[i], NULL, pages.length(), 0);
 			_pos = pages[i]->start;
 			_page = i;
 			Draw(drawbuf, -1, _page, true);
@@ -1197,8 +1216,12 @@ bool LVDocView::exportWolFile(LVStream * stream, bool flgGray, int levels) {
 			} else {
 				//drawbuf.Invert();
 			}
-			wol.addImage(drawbuf);
+			queue.addImage(drawbuf);
 		}
+		queue.flush();
+		int elapsed = (int)timer.elapsed();
+		CRLog::info("WOL export: %d pages in %d ms, %d pages/s", queue.getPageCount(), elapsed,
+				elapsed > 0 ? (int)(queue.getPageCount() * 1000LL / elapsed) : queue.getPageCount());
 
 		// add TOC
 		ldomNode * body = m_doc->nodeFromXPath(lString16(
@@ -1887,12 +1910,166 @@ void LVDocView::drawPageHeader(LVDrawBuf * drawbuf, const lvRect & headerRc,
 	drawbuf->SetTextColor(getTextColor());
 }
 
+static bool markIntersects( ldomMarkedRange * mark, int top, int bottom )
+{
+    return mark->start.y < bottom && mark->end.y >= top;
+}
+
+static void addPageMarks( ldomMarkedRangeList & dst, const ldomMarkedRangeList & src, LVRendPageInfo & page )
+{
+    for ( int i=0; i<src.length(); i++ ) {
+        ldomMarkedRange * mark = src[i];
+        bool found = markIntersects( mark, page.start, page.start + page.height );
+        for ( int fn=0; !found && fn<page.footnotes.length(); fn++ )
+            found = markIntersects( mark, page.footnotes[fn].start, page.footnotes[fn].start + page.footnotes[fn].height );
+        if ( found )
+            dst.add( new ldomMarkedRange( *mark ) );
+    }
+}
+
+/// returns m_markRanges and m_bmkRanges items intersecting page or its footnotes
+LVPageMarkedRanges * LVDocView::getPageMarkedRanges( LVRendPageInfo & page )
+{
+    for ( int i=0; i<m_pageMarkRanges.length(); i++ ) {
+        LVPageMarkedRanges * item = m_pageMarkRanges[i];
+        if ( item->start == page.start && item->height == page.height )
+            return item;
+    }
+    #define MAX_PAGE_MARKED_RANGES_CACHE_SIZE 8
+    if ( m_pageMarkRanges.length() >= MAX_PAGE_MARKED_RANGES_CACHE_SIZE )
+        m_pageMarkRanges.erase( 0, 1 );
+    LVPageMarkedRanges * item = new LVPageMarkedRanges( page.start, page.height );
+    addPageMarks( item->marks, m_markRanges, page );
+    addPageMarks( item->bookmarks, m_bmkRanges, page );
+    m_pageMarkRanges.add( item );
+    return item;
+}
+
+/// returns bookmark position xpointer, resolving path only once per document
+ldomXPointer LVDocView::getBookmarkXPointer( const lString16 & path )
+{
+    ldomXPointer p;
+    if ( !m_bmkXPointers.get( path, p ) ) {
+        p = m_doc->createXPointer( path );
+        m_bmkXPointers.set( path, p );
+    }
+    return p;
+}
+
+/// draws page text, images and footnotes
+void LVDocView::drawPageBody(LVDrawBuf * drawbuf, LVRendPageInfo & page,
+		lvRect * pageRect, lvRect & clip, LVPageMarkedRanges * pageMarks) {
+	int start = page.start;
+	int height = page.height;
+	//CRLog::trace("Entering DrawDocument()");
+	if (page.height)
+		DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
+				+ m_pageMargins.left, clip.top, pageRect->width()
+				- m_pageMargins.left - m_pageMargins.right, height, 0,
+				-start, m_dy, &pageMarks->marks, &pageMarks->bookmarks);
+	//CRLog::trace("Done DrawDocument() for main text");
+	// draw footnotes
+#define FOOTNOTE_MARGIN_REM 1 // as in lvpagesplitter.cpp
+	int footnote_margin = FOOTNOTE_MARGIN_REM * gRootFontSize;
+	int fny = clip.top + (page.height ? page.height + footnote_margin
+			: footnote_margin);
+	// Try to push footnotes to the bottom of page if possible
+	int footnotes_height = 0;
+	for (int fn = 0; fn < page.footnotes.length(); fn++) {
+		footnotes_height += page.footnotes[fn].height;
+	}
+	if (footnotes_height > 0) {
+		int h_avail = m_dy - getPageHeaderHeight()
+				   - m_pageMargins.top - m_pageMargins.bottom
+				   - height - footnote_margin;
+		fny += h_avail - footnotes_height; // put empty space before first footnote
+	}
+	int fy = fny;
+	bool footnoteDrawed = false;
+	for (int fn = 0; fn < page.footnotes.length(); fn++) {
+		int fstart = page.footnotes[fn].start;
+		int fheight = page.footnotes[fn].height;
+		clip.top = fy;
+		clip.bottom = fy + fheight;
+		// Also avoid left and right clipping of page margins with footnotes
+		// clip.left = pageRect->left + m_pageMargins.left;
+		// clip.right = pageRect->right - m_pageMargins.right;
+		clip.left = pageRect->left;
+		clip.right = pageRect->right;
+		drawbuf->SetClipRect(&clip);
+		DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
+				+ m_pageMargins.left, fy, pageRect->width()
+				- m_pageMargins.left - m_pageMargins.right, fheight, 0,
+				-fstart, m_dy, &pageMarks->marks);
+		footnoteDrawed = true;
+		fy += fheight;
+	}
+	if (footnoteDrawed) { // && page.height
+		// Draw a small horizontal line as a separator inside
+		// the margin between text and footnotes
+		fny -= footnote_margin * 1/3;
+		drawbuf->SetClipRect(NULL);
+                lUInt32 cl = drawbuf->GetTextColor();
+                cl = (cl & 0xFFFFFF) | (0x55000000);
+		// The line separator was using the full page width:
+		//   int x1 = pageRect->right - m_pageMargins.right;
+		// but 1/7 of page width looks like what we can see in some books
+		int sep_width = (pageRect->right - pageRect->left) / 7;
+		int x0, x1;
+		if ( page.flags & RN_PAGE_FOOTNOTES_MOSTLY_RTL ) { // draw separator on the right
+			x1 = pageRect->right - m_pageMargins.right;
+			x0 = x1 - sep_width;
+		}
+		else {
+			x0 = pageRect->left + m_pageMargins.left;
+			x1 = x0 + sep_width;
+		}
+		drawbuf->FillRect(x0, fny, x1, fny+1, cl);
+	}
+}
+
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+static bool isSamePageDrawListKey(const LVArray<lInt32> & key1, const LVArray<lInt32> & key2) {
+	if (key1.length() != key2.length())
+		return false;
+	for (int i = 0; i < key1.length(); i++)
+		if (key1[i] != key2[i])
+			return false;
+	return true;
+}
+
+/// fills key of page body drawing: page, its marks, document change counters and drawing parameters
+void LVDocView::getPageDrawListKey(LVArray<lInt32> & key, LVDrawBuf * drawbuf,
+		LVRendPageInfo & page, lvRect * pageRect, LVPageMarkedRanges * pageMarks) {
+	lInt32 params[] = {
+		m_pageDrawGeneration, (lInt32)m_doc->getContentChangeCount(),
+		page.start, page.height, page.flags, page.footnotes.length(),
+		pageRect->left, pageRect->top, pageRect->right, pageRect->bottom,
+		m_pageMargins.left, m_pageMargins.top, m_pageMargins.right, m_pageMargins.bottom,
+		getPageHeaderHeight(), m_dy, gRootFontSize,
+		drawbuf->GetWidth(), drawbuf->GetHeight(), drawbuf->GetBitsPerPixel(),
+		(lInt32)drawbuf->GetTextColor(), (lInt32)drawbuf->GetBackgroundColor(), drawbuf->getAlpha(),
+		(lInt32)(fontMan->GetGamma() * 1000), fontMan->GetAntialiasMode(), (lInt32)fontMan->GetHintingMode()
+	};
+	key.add(params, sizeof(params) / sizeof(params[0]));
+	// marks are compared by content: lists are rebuilt on each selection change
+	for (int k = 0; k < 2; k++) {
+		ldomMarkedRangeList & ranges = k ? pageMarks->bookmarks : pageMarks->marks;
+		key.add(ranges.length());
+		for (int i = 0; i < ranges.length(); i++) {
+			ldomMarkedRange * range = ranges[i];
+			lInt32 mark[] = { range->start.x, range->start.y, range->end.x, range->end.y, (lInt32)range->flags };
+			key.add(mark, 5);
+		}
+	}
+}
+#endif
+
 void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 		lvRect * pageRect, int pageCount, int basePage) {
-	int start = page.start;
 	int height = page.height;
 	int headerHeight = getPageHeaderHeight();
-	//CRLog::trace("drawPageTo(%d,%d)", start, height);
+	//CRLog::trace("drawPageTo(%d,%d)", page.start, height);
 	lvRect fullRect(0, 0, drawbuf->GetWidth(), drawbuf->GetHeight());
 	if (!pageRect)
 		pageRect = &fullRect;
@@ -1955,73 +2132,41 @@ void LVDocView::drawPageTo(LVDrawBuf * drawbuf, LVRendPageInfo & page,
 			drawCoverTo(drawbuf, rc);
 		} else {
 			// draw main page text
-            if ( m_markRanges.length() )
-                CRLog::trace("Entering DrawDocument() : %d ranges", m_markRanges.length());
-			//CRLog::trace("Entering DrawDocument()");
-			if (page.height)
-				DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
-						+ m_pageMargins.left, clip.top, pageRect->width()
-						- m_pageMargins.left - m_pageMargins.right, height, 0,
-                                                -start + offset, m_dy, &m_markRanges, &m_bmkRanges);
-			//CRLog::trace("Done DrawDocument() for main text");
-			// draw footnotes
-#define FOOTNOTE_MARGIN_REM 1 // as in lvpagesplitter.cpp
-			int footnote_margin = FOOTNOTE_MARGIN_REM * gRootFontSize;
-			int fny = clip.top + (page.height ? page.height + footnote_margin
-					: footnote_margin);
-			// Try to push footnotes to the bottom of page if possible
-			int footnotes_height = 0;
-			for (int fn = 0; fn < page.footnotes.length(); fn++) {
-				footnotes_height += page.footnotes[fn].height;
-			}
-			if (footnotes_height > 0) {
-				int h_avail = m_dy - getPageHeaderHeight()
-						   - m_pageMargins.top - m_pageMargins.bottom
-						   - height - footnote_margin;
-				fny += h_avail - footnotes_height; // put empty space before first footnote
-			}
-			int fy = fny;
-			bool footnoteDrawed = false;
-			for (int fn = 0; fn < page.footnotes.length(); fn++) {
-				int fstart = page.footnotes[fn].start;
-				int fheight = page.footnotes[fn].height;
-				clip.top = fy + offset;
-				clip.bottom = fy + offset + fheight;
-				// Also avoid left and right clipping of page margins with footnotes
-				// clip.left = pageRect->left + m_pageMargins.left;
-				// clip.right = pageRect->right - m_pageMargins.right;
-				clip.left = pageRect->left;
-				clip.right = pageRect->right;
-				drawbuf->SetClipRect(&clip);
-				DrawDocument(*drawbuf, m_doc->getRootNode(), pageRect->left
-						+ m_pageMargins.left, fy + offset, pageRect->width()
-						- m_pageMargins.left - m_pageMargins.right, fheight, 0,
-						-fstart + offset, m_dy, &m_markRanges);
-				footnoteDrawed = true;
-				fy += fheight;
-			}
-			if (footnoteDrawed) { // && page.height
-				// Draw a small horizontal line as a separator inside
-				// the margin between text and footnotes
-				fny -= footnote_margin * 1/3;
-				drawbuf->SetClipRect(NULL);
-                lUInt32 cl = drawbuf->GetTextColor();
-                cl = (cl & 0xFFFFFF) | (0x55000000);
-				// The line separator was using the full page width:
-				//   int x1 = pageRect->right - m_pageMargins.right;
-				// but 1/7 of page width looks like what we can see in some books
-				int sep_width = (pageRect->right - pageRect->left) / 7;
-				int x0, x1;
-				if ( page.flags & RN_PAGE_FOOTNOTES_MOSTLY_RTL ) { // draw separator on the right
-					x1 = pageRect->right - m_pageMargins.right;
-					x0 = x1 - sep_width;
+			LVPageMarkedRanges * pageMarks = getPageMarkedRanges(page);
+            if ( pageMarks->marks.length() )
+                CRLog::trace("Entering DrawDocument() : %d ranges", pageMarks->marks.length());
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+			if (m_pageDrawListEnabled) {
+				LVArray<lInt32> key;
+				getPageDrawListKey(key, drawbuf, page, pageRect, pageMarks);
+				LVPageDrawList * item = NULL;
+				for (int i = 0; i < m_pageDrawLists.length(); i++) {
+					if (isSamePageDrawListKey(m_pageDrawLists[i]->key, key)) {
+						item = m_pageDrawLists.remove(i);
+						break;
+					}
 				}
-				else {
-					x0 = pageRect->left + m_pageMargins.left;
-					x1 = x0 + sep_width;
+				if (item) {
+					// nothing has changed since page was drawn last time
+					item->list.replay(drawbuf);
+				} else {
+					item = new LVPageDrawList();
+					item->key = key;
+					LVDrawListRecorder recorder(drawbuf, &item->list);
+					drawPageBody(&recorder, page, pageRect, clip, pageMarks);
 				}
-				drawbuf->FillRect(x0, fny, x1, fny+1, cl);
-			}
+				#define MAX_PAGE_DRAW_LIST_CACHE_SIZE 4
+				#define MAX_PAGE_DRAW_LIST_MEMORY_SIZE 0x200000
+				if (item->list.isValid() && item->list.getMemorySize() <= MAX_PAGE_DRAW_LIST_MEMORY_SIZE) {
+					if (m_pageDrawLists.length() >= MAX_PAGE_DRAW_LIST_CACHE_SIZE)
+						m_pageDrawLists.erase(0, 1);
+					m_pageDrawLists.add(item);
+				} else {
+					delete item;
+				}
+			} else
+#endif
+			drawPageBody(drawbuf, page, pageRect, clip, pageMarks);
 		}
 	}
 	drawbuf->SetClipRect(NULL);
@@ -2780,6 +2925,9 @@ void LVDocView::Render(int dx, int dy, LVRendPageList * pages) {
 		}
 #endif
 		fontMan->gc();
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+		clearPageDrawLists();
+#endif
 		m_is_rendered = true;
 		//CRLog::debug("Making TOC...");
 		//makeToc();
@@ -3219,6 +3367,7 @@ void LVDocView::updateSelections() {
 	ldomXRangeList ranges(m_doc->getSelections(), true);
     CRLog::trace("updateSelections() : selection count = %d", m_doc->getSelections().length());
 	ranges.getRanges(m_markRanges);
+	m_pageMarkRanges.clear();
 	if (m_markRanges.length() > 0) {
 //		crtrace trace;
 //		trace << "LVDocView::updateSelections() - " << "selections: "
@@ -3248,13 +3397,13 @@ void LVDocView::updateBookMarksRanges()
             CRBookmark * bmk = bookmarks[i];
             int t = bmk->getType();
             if (t != bmkt_lastpos) {
-                ldomXPointer p = m_doc->createXPointer(bmk->getStartPos());
+                ldomXPointer p = getBookmarkXPointer(bmk->getStartPos());
                 if (p.isNull())
                     continue;
                 lvPoint pt = p.toPoint();
                 if (pt.y < 0)
                     continue;
-                ldomXPointer ep = (t == bmkt_pos) ? p : m_doc->createXPointer(bmk->getEndPos());
+                ldomXPointer ep = (t == bmkt_pos) ? p : getBookmarkXPointer(bmk->getEndPos());
                 if (ep.isNull())
                     continue;
                 lvPoint ept = ep.toPoint();
@@ -3277,6 +3426,7 @@ void LVDocView::updateBookMarksRanges()
         }
     }
     ranges.getRanges(m_bmkRanges);
+    m_pageMarkRanges.clear();
 #if 0
 
     m_bookmarksPercents.clear();
@@ -4575,6 +4725,11 @@ void LVDocView::createEmptyDocument() {
 	m_cursorPos.clear();
 	m_markRanges.clear();
         m_bmkRanges.clear();
+	m_pageMarkRanges.clear();
+#if CR_ENABLE_PAGE_DRAW_LIST==1
+	clearPageDrawLists();
+#endif
+	m_bmkXPointers.clear();
 	_posBookmark.clear();
 	m_section_bounds.clear();
 	m_section_bounds_valid = false;
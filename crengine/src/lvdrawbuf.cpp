@@ -18,6 +18,10 @@
 #include "../include/lvdrawbuf.h"
 #include "../include/crlog.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define GUARD_BYTE 0xa5
 #define CHECK_GUARD_BYTE \
 	{ \
@@ -136,6 +140,331 @@ static void ApplyAlphaGray8( lUInt8 &dst, lUInt8 src, lUInt8 alpha )
 }
 */
 
+// Glyph blending row kernels, used by Draw() for antialiased glyph bitmaps
+// (1 byte of coverage per pixel). Blocks of fully transparent or fully opaque
+// pixels are handled a word at a time; with SSE2, other blocks are blended
+// several pixels at once, with exactly the same rounding as the scalar code.
+
+#define GLYPH_BYTES4(b) ((lUInt32)(b) * 0x01010101U)
+
+static inline void blendGlyphPixel32( lUInt32 & dst, lUInt8 src, lUInt32 color )
+{
+    lUInt32 opaque = (src>>1)&0x7F;
+    if ( opaque>=0x78 )
+        dst = color;
+    else if ( opaque>0 ) {
+        lUInt32 alpha = 0x7F-opaque;
+        lUInt32 cl1 = ((alpha*(dst&0xFF00FF) + opaque*(color&0xFF00FF))>>7) & 0xFF00FF;
+        lUInt32 cl2 = ((alpha*(dst&0x00FF00) + opaque*(color&0x00FF00))>>7) & 0x00FF00;
+        dst = cl1 | cl2;
+    }
+}
+
+/// blends glyph row into 32bpp row
+static void blendGlyphRow32( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 color )
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cl = _mm_set1_epi32( (int)color );
+    const __m128i cl16 = _mm_unpacklo_epi8( cl, zero );
+    const __m128i max7f = _mm_set1_epi16( 0x7F );
+    const __m128i rgbMask = _mm_set1_epi32( 0x00FFFFFF );
+    const __m128i opaqueMin = _mm_set1_epi32( 0xEF );
+#endif
+    for ( ; i + 4 <= count; i += 4 ) {
+        lUInt32 s4;
+        memcpy( &s4, src + i, 4 );
+        if ( !(s4 & GLYPH_BYTES4(0xFE)) )
+            continue; // opaque==0 for all 4 pixels
+        if ( (s4 & GLYPH_BYTES4(0xF0)) == GLYPH_BYTES4(0xF0) ) {
+            dst[i] = dst[i+1] = dst[i+2] = dst[i+3] = color;
+            continue;
+        }
+#if defined(__SSE2__)
+        __m128i s = _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int)s4 ), zero );
+        __m128i op = _mm_srli_epi16( s, 1 );
+        op = _mm_unpacklo_epi16( op, op );
+        __m128i opLo = _mm_unpacklo_epi32( op, op ); // pixels 0,1: opaque for each channel
+        __m128i opHi = _mm_unpackhi_epi32( op, op ); // pixels 2,3
+        __m128i d = _mm_loadu_si128( (const __m128i*)(dst + i) );
+        __m128i dLo = _mm_unpacklo_epi8( d, zero );
+        __m128i dHi = _mm_unpackhi_epi8( d, zero );
+        dLo = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_sub_epi16( max7f, opLo ), dLo ),
+                                             _mm_mullo_epi16( opLo, cl16 ) ), 7 );
+        dHi = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( _mm_sub_epi16( max7f, opHi ), dHi ),
+                                             _mm_mullo_epi16( opHi, cl16 ) ), 7 );
+        __m128i res = _mm_and_si128( _mm_packus_epi16( dLo, dHi ), rgbMask );
+        __m128i s32 = _mm_unpacklo_epi16( s, zero );
+        __m128i isFull = _mm_cmpgt_epi32( s32, opaqueMin );
+        __m128i isEmpty = _mm_cmpeq_epi32( _mm_srli_epi32( s32, 1 ), zero );
+        res = _mm_or_si128( _mm_and_si128( isFull, cl ), _mm_andnot_si128( isFull, res ) );
+        res = _mm_or_si128( _mm_and_si128( isEmpty, d ), _mm_andnot_si128( isEmpty, res ) );
+        _mm_storeu_si128( (__m128i*)(dst + i), res );
+#else
+        for ( int k=i; k<i+4; k++ )
+            blendGlyphPixel32( dst[k], src[k], color );
+#endif
+    }
+    for ( ; i < count; i++ )
+        blendGlyphPixel32( dst[i], src[i], color );
+}
+
+static inline void blendGlyphPixel16( lUInt16 & dst, lUInt8 src, lUInt16 color )
+{
+    lUInt32 opaque = (src>>4)&0x0F;
+    if ( opaque>=0xF )
+        dst = color;
+    else if ( opaque>0 ) {
+        lUInt32 alpha = 0xF-opaque;
+        lUInt16 cl1 = (lUInt16)(((alpha*(dst&0xF81F) + opaque*(color&0xF81F))>>4) & 0xF81F);
+        lUInt16 cl2 = (lUInt16)(((alpha*(dst&0x07E0) + opaque*(color&0x07E0))>>4) & 0x07E0);
+        dst = cl1 | cl2;
+    }
+}
+
+/// blends glyph row into 16bpp (565) row
+static void blendGlyphRow16( lUInt16 * dst, const lUInt8 * src, int count, lUInt16 color )
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cl = _mm_set1_epi16( (short)color );
+    const __m128i cr = _mm_set1_epi16( color >> 11 );
+    const __m128i cg = _mm_set1_epi16( (color >> 5) & 0x3F );
+    const __m128i cb = _mm_set1_epi16( color & 0x1F );
+    const __m128i mask5 = _mm_set1_epi16( 0x1F );
+    const __m128i mask6 = _mm_set1_epi16( 0x3F );
+    const __m128i max15 = _mm_set1_epi16( 0xF );
+#endif
+    for ( ; i + 8 <= count; i += 8 ) {
+        lUInt32 s4[2];
+        memcpy( s4, src + i, 8 );
+        if ( !((s4[0] | s4[1]) & GLYPH_BYTES4(0xF0)) )
+            continue; // opaque==0 for all 8 pixels
+        if ( (s4[0] & s4[1] & GLYPH_BYTES4(0xF0)) == GLYPH_BYTES4(0xF0) ) {
+            for ( int k=i; k<i+8; k++ )
+                dst[k] = color;
+            continue;
+        }
+#if defined(__SSE2__)
+        __m128i op = _mm_srli_epi16( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(src + i) ), zero ), 4 );
+        __m128i alpha = _mm_sub_epi16( max15, op );
+        __m128i d = _mm_loadu_si128( (const __m128i*)(dst + i) );
+        __m128i r = _mm_srli_epi16( d, 11 );
+        __m128i g = _mm_and_si128( _mm_srli_epi16( d, 5 ), mask6 );
+        __m128i b = _mm_and_si128( d, mask5 );
+        r = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( alpha, r ), _mm_mullo_epi16( op, cr ) ), 4 );
+        g = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( alpha, g ), _mm_mullo_epi16( op, cg ) ), 4 );
+        b = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( alpha, b ), _mm_mullo_epi16( op, cb ) ), 4 );
+        __m128i res = _mm_or_si128( _mm_slli_epi16( r, 11 ), _mm_or_si128( _mm_slli_epi16( g, 5 ), b ) );
+        __m128i isFull = _mm_cmpeq_epi16( op, max15 );
+        __m128i isEmpty = _mm_cmpeq_epi16( op, zero );
+        res = _mm_or_si128( _mm_and_si128( isFull, cl ), _mm_andnot_si128( isFull, res ) );
+        res = _mm_or_si128( _mm_and_si128( isEmpty, d ), _mm_andnot_si128( isEmpty, res ) );
+        _mm_storeu_si128( (__m128i*)(dst + i), res );
+#else
+        for ( int k=i; k<i+8; k++ )
+            blendGlyphPixel16( dst[k], src[k], color );
+#endif
+    }
+    for ( ; i < count; i++ )
+        blendGlyphPixel16( dst[i], src[i], color );
+}
+
+static inline void blendGlyphPixelGray( lUInt8 & dst, lUInt8 src, lUInt8 color, int mask, int bpp )
+{
+    if ( src ) {
+        if ( src>=mask )
+            dst = color;
+        else
+            ApplyAlphaGray( dst, color, src ^ 0xFF, bpp );
+    }
+}
+
+/// blends glyph row into 3, 4 or 8 bpp gray row (1 byte per pixel)
+static void blendGlyphRowGray( lUInt8 * dst, const lUInt8 * src, int count, lUInt8 color, int bpp )
+{
+    int mask = ((1<<bpp)-1)<<(8-bpp);
+    lUInt32 mask4 = GLYPH_BYTES4(mask);
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i cl = _mm_set1_epi16( color );
+    const __m128i clMasked = _mm_set1_epi16( color & mask );
+    const __m128i mask16 = _mm_set1_epi16( mask );
+    const __m128i max255 = _mm_set1_epi16( 0xFF );
+#endif
+    for ( ; i + 8 <= count; i += 8 ) {
+        lUInt32 s4[2];
+        memcpy( s4, src + i, 8 );
+        if ( !(s4[0] | s4[1]) )
+            continue;
+        if ( (s4[0] & s4[1] & mask4) == mask4 ) {
+            memset( dst + i, color, 8 );
+            continue;
+        }
+#if defined(__SSE2__)
+        __m128i s = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(src + i) ), zero );
+        __m128i d = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(dst + i) ), zero );
+        __m128i res = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16( d, _mm_xor_si128( s, max255 ) ),
+                                                     _mm_mullo_epi16( clMasked, s ) ), 8 );
+        res = _mm_and_si128( res, mask16 );
+        __m128i isFull = _mm_cmpeq_epi16( _mm_and_si128( s, mask16 ), mask16 );
+        __m128i isEmpty = _mm_cmpeq_epi16( s, zero );
+        res = _mm_or_si128( _mm_and_si128( isFull, cl ), _mm_andnot_si128( isFull, res ) );
+        res = _mm_or_si128( _mm_and_si128( isEmpty, d ), _mm_andnot_si128( isEmpty, res ) );
+        _mm_storel_epi64( (__m128i*)(dst + i), _mm_packus_epi16( res, res ) );
+#else
+        for ( int k=i; k<i+8; k++ )
+            blendGlyphPixelGray( dst[k], src[k], color, mask, bpp );
+#endif
+    }
+    for ( ; i < count; i++ )
+        blendGlyphPixelGray( dst[i], src[i], color, mask, bpp );
+}
+
+// Pixel format conversion row kernels, used by DrawTo(), Rotate() and
+// ConvertToBitmap() when whole frames are converted for e-ink output.
+// They give exactly the same results as the per pixel code they replace.
+
+/// narrows columns [0, width) drawn at x to clip rect, returns false if none are visible
+static bool clipRowSpan( const lvRect & clip, int x, int width, int & x0, int & x1 )
+{
+    x0 = clip.left > x ? clip.left - x : 0;
+    x1 = clip.right - x < width ? clip.right - x : width;
+    return x0 < x1;
+}
+
+/// copies low byte of each 32bpp pixel into 8 bpp row
+static void convertRow32ToGray8( lUInt8 * dst, const lUInt32 * src, int count )
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i lowByte = _mm_set1_epi32( 0xFF );
+    for ( ; i + 16 <= count; i += 16 ) {
+        __m128i a = _mm_and_si128( _mm_loadu_si128( (const __m128i*)(src + i) ), lowByte );
+        __m128i b = _mm_and_si128( _mm_loadu_si128( (const __m128i*)(src + i + 4) ), lowByte );
+        __m128i c = _mm_and_si128( _mm_loadu_si128( (const __m128i*)(src + i + 8) ), lowByte );
+        __m128i d = _mm_and_si128( _mm_loadu_si128( (const __m128i*)(src + i + 12) ), lowByte );
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi16( _mm_packs_epi32( a, b ), _mm_packs_epi32( c, d ) ) );
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = (lUInt8)src[i];
+}
+
+/// copies 32bpp row, applying RevRGBA()
+static void convertRow32ToRev( lUInt32 * dst, const lUInt32 * src, int count )
+{
+#ifdef CR_RENDER_32BPP_RGB_PXFMT
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i keep = _mm_set1_epi32( (int)0xFF00FF00 );
+    const __m128i red = _mm_set1_epi32( 0x00FF0000 );
+    const __m128i blue = _mm_set1_epi32( 0x000000FF );
+    for ( ; i + 4 <= count; i += 4 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        __m128i res = _mm_or_si128( _mm_and_si128( v, keep ),
+                                    _mm_or_si128( _mm_and_si128( _mm_slli_epi32( v, 16 ), red ),
+                                                  _mm_and_si128( _mm_srli_epi32( v, 16 ), blue ) ) );
+        _mm_storeu_si128( (__m128i*)(dst + i), res );
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = RevRGBA( src[i] );
+#else
+    memcpy( dst, src, count * sizeof(lUInt32) );
+#endif
+}
+
+#if defined(__SSE2__)
+static inline __m128i rgb565to888x4( __m128i v )
+{
+    return _mm_or_si128( _mm_slli_epi32( _mm_and_si128( v, _mm_set1_epi32( 0xF800 ) ), 8 ),
+                         _mm_or_si128( _mm_slli_epi32( _mm_and_si128( v, _mm_set1_epi32( 0x07E0 ) ), 5 ),
+                                       _mm_slli_epi32( _mm_and_si128( v, _mm_set1_epi32( 0x001F ) ), 3 ) ) );
+}
+#endif
+
+/// expands 16bpp (565) row to 32bpp
+static void convertRow565To888( lUInt32 * dst, const lUInt16 * src, int count )
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_si128( (__m128i*)(dst + i), rgb565to888x4( _mm_unpacklo_epi16( v, zero ) ) );
+        _mm_storeu_si128( (__m128i*)(dst + i + 4), rgb565to888x4( _mm_unpackhi_epi16( v, zero ) ) );
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = rgb565to888( src[i] );
+}
+
+static inline lUInt32 grayByteTo32( lUInt32 cl, int bpp )
+{
+    if ( bpp == 3 ) {
+        cl &= 0xE0;
+        cl = cl | (cl>>3) | (cl>>6);
+    } else if ( bpp == 4 ) {
+        cl &= 0xF0;
+        cl = cl | (cl>>4);
+    }
+    return cl | (cl << 8) | (cl << 16);
+}
+
+/// expands 3, 4 or 8 bpp gray row (1 byte per pixel) to 32bpp
+static void convertGrayRowTo32( lUInt32 * dst, const lUInt8 * src, int count, int bpp )
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi16( bpp == 3 ? 0xE0 : (bpp == 4 ? 0xF0 : 0xFF) );
+    for ( ; i + 8 <= count; i += 8 ) {
+        __m128i v = _mm_and_si128( _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(src + i) ), zero ), mask );
+        if ( bpp == 3 )
+            v = _mm_or_si128( v, _mm_or_si128( _mm_srli_epi16( v, 3 ), _mm_srli_epi16( v, 6 ) ) );
+        else if ( bpp == 4 )
+            v = _mm_or_si128( v, _mm_srli_epi16( v, 4 ) );
+        __m128i lo = _mm_unpacklo_epi16( v, zero );
+        __m128i hi = _mm_unpackhi_epi16( v, zero );
+        lo = _mm_or_si128( lo, _mm_or_si128( _mm_slli_epi32( lo, 8 ), _mm_slli_epi32( lo, 16 ) ) );
+        hi = _mm_or_si128( hi, _mm_or_si128( _mm_slli_epi32( hi, 8 ), _mm_slli_epi32( hi, 16 ) ) );
+        _mm_storeu_si128( (__m128i*)(dst + i), lo );
+        _mm_storeu_si128( (__m128i*)(dst + i + 4), hi );
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = grayByteTo32( src[i], bpp );
+}
+
+/// rotates dx*dy pixels by 90 degrees into dy*dx buffer, tile by tile to keep both sides in cache
+template <typename T>
+static void rotatePixels90( T * dst, const T * src, int dx, int dy, bool cw )
+{
+    const int tile = 64;
+    for ( int y0=0; y0<dy; y0+=tile ) {
+        int y1 = y0 + tile < dy ? y0 + tile : dy;
+        for ( int x0=0; x0<dx; x0+=tile ) {
+            int x1 = x0 + tile < dx ? x0 + tile : dx;
+            for ( int y=y0; y<y1; y++ ) {
+                const T * s = src + dx*y;
+                if ( cw ) {
+                    T * d = dst + (dy - 1 - y);
+                    for ( int x=x0; x<x1; x++ )
+                        d[ dy*x ] = s[ x ];
+                } else {
+                    T * d = dst + dy*(dx - 1) + y;
+                    for ( int x=x0; x<x1; x++ )
+                        d[ -dy*x ] = s[ x ];
+                }
+            }
+        }
+    }
+}
+
 //static const short dither_2bpp_4x4[] = {
 //    5, 13,  8,  16,
 //    9,  1,  12,  4,
@@ -215,6 +544,57 @@ lUInt32 Dither1BitColor( lUInt32 color, lUInt32 x, lUInt32 y )
     return (cl >> 7) & 1;
 }
 
+/// fills 64 tables, one per cell of 8x8 ordered dither matrix, quantizing 8 bit gray to 2^bits levels
+/// (same maths as dither_o8x8()); results keep significant bits high like 3 and 4 bpp buffers do
+static void initGrayDitherTables( lUInt8 (*tables)[256], int bits )
+{
+    lUInt32 maxLevel = (1 << bits) - 1;
+    for ( int cell=0; cell<64; cell++ ) {
+        lUInt32 threshold = dither_2bpp_8x8[cell] + 1;
+        for ( lUInt32 v=0; v<256; v++ ) {
+            lUInt32 t;
+            DIV255( v * ((maxLevel << 6) + 1U), t );
+            lUInt32 l = t >> 6;
+            t -= l << 6;
+            lUInt32 q = l + (t >= threshold);
+            tables[cell][v] = (lUInt8)((q > maxLevel ? maxLevel : q) << (8 - bits));
+        }
+    }
+}
+
+static inline void putPackedPixel( lUInt8 * dst, int x, int bits, lUInt8 value )
+{
+    int perByte = 8 / bits;
+    int shift = (x % perByte) * bits;
+    lUInt8 mask = (lUInt8)((0xFF << (8 - bits)) & 0xFF) >> shift;
+    lUInt8 & b = dst[ x / perByte ];
+    b = (lUInt8)((b & ~mask) | (value >> shift));
+}
+
+/// dithers 8 bpp gray row into 3/4 bpp (byte per pixel) or packed 1/2 bpp row, starting at column x
+static void ditherGrayRow( lUInt8 * dst, const lUInt8 * src, int count, int x, int y, int bits, lUInt8 (*tables)[256] )
+{
+    lUInt8 (*rowTables)[256] = tables + ((y & 7) << 3);
+    if ( bits > 2 ) {
+        dst += x;
+        for ( int i=0; i<count; i++ )
+            dst[i] = rowTables[(x + i) & 7][src[i]];
+        return;
+    }
+    int perByte = 8 / bits;
+    int i = 0;
+    for ( ; i < count && ((x + i) % perByte); i++ )
+        putPackedPixel( dst, x + i, bits, rowTables[(x + i) & 7][src[i]] );
+    for ( ; i + perByte <= count; i += perByte ) {
+        lUInt8 b = 0;
+        for ( int k=0; k<perByte; k++ )
+            b |= rowTables[(x + i + k) & 7][src[i + k]] >> (k * bits);
+        dst[ (x + i) / perByte ] = b;
+    }
+    for ( ; i < count; i++ )
+        putPackedPixel( dst, x + i, bits, rowTables[(x + i) & 7][src[i]] );
+}
+
 static lUInt8 revByteBits1( lUInt8 b )
 {
     return ( (b&1)<<7 )
@@ -266,29 +646,31 @@ void LVGrayDrawBuf::Rotate( cr_rotate_angle_t angle )
     }
     int newrowsize = _bpp<=2 ? (_dy * _bpp + 7) / 8 : _dy;
     sz = (newrowsize * _dx);
-    lUInt8 * dst = (lUInt8 *)calloc(sz, sizeof(*dst));
-    for ( int y=0; y<_dy; y++ ) {
-        lUInt8 * src = _data + _rowsize*y;
-        int dstx, dsty;
-        for ( int x=0; x<_dx; x++ ) {
-            if ( angle==CR_ROTATE_ANGLE_90 ) {
-                dstx = _dy-1-y;
-                dsty = x;
-            } else {
-                dstx = y;
-                dsty = _dx-1-x;
-            }
-            if ( _bpp==DRAW_BUF_1_BPP ) {
-                lUInt8 px = (src[ x >> 3 ] << (x&7)) & 0x80;
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx >> 3 ] |= (px >> (dstx&7));
-            } else if (_bpp==DRAW_BUF_2_BPP ) {
-                lUInt8 px = (src[ x >> 2 ] << ((x&3)<<1)) & 0xC0;
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx >> 2 ] |= (px >> ((dstx&3)<<1));
-            } else { // DRAW_BUF_3_BPP, DRAW_BUF_4_BPP, DRAW_BUF_8_BPP
-                lUInt8 * dstrow = dst + newrowsize * dsty;
-                dstrow[ dstx ] = src[ x ];
+    lUInt8 * dst = (lUInt8 *)calloc(sz + 1, sizeof(*dst));
+    dst[sz] = GUARD_BYTE;
+    if ( _bpp > DRAW_BUF_2_BPP ) { // DRAW_BUF_3_BPP, DRAW_BUF_4_BPP, DRAW_BUF_8_BPP
+        rotatePixels90( dst, _data, _dx, _dy, angle==CR_ROTATE_ANGLE_90 );
+    } else {
+        for ( int y=0; y<_dy; y++ ) {
+            lUInt8 * src = _data + _rowsize*y;
+            int dstx, dsty;
+            for ( int x=0; x<_dx; x++ ) {
+                if ( angle==CR_ROTATE_ANGLE_90 ) {
+                    dstx = _dy-1-y;
+                    dsty = x;
+                } else {
+                    dstx = y;
+                    dsty = _dx-1-x;
+                }
+                if ( _bpp==DRAW_BUF_1_BPP ) {
+                    lUInt8 px = (src[ x >> 3 ] << (x&7)) & 0x80;
+                    lUInt8 * dstrow = dst + newrowsize * dsty;
+                    dstrow[ dstx >> 3 ] |= (px >> (dstx&7));
+                } else {
+                    lUInt8 px = (src[ x >> 2 ] << ((x&3)<<1)) & 0xC0;
+                    lUInt8 * dstrow = dst + newrowsize * dsty;
+                    dstrow[ dstx >> 2 ] |= (px >> ((dstx&3)<<1));
+                }
             }
         }
     }
@@ -324,23 +706,7 @@ void LVColorDrawBuf::Rotate( cr_rotate_angle_t angle )
     #else
         bool cw = angle==CR_ROTATE_ANGLE_90;
     #endif
-        for ( int y=0; y<_dy; y++ ) {
-            lUInt16 * src = (lUInt16*)_data + _dx*y;
-            int nx, ny;
-            if ( cw ) {
-                nx = _dy - 1 - y;
-            } else {
-                nx = y;
-            }
-            for ( int x=0; x<_dx; x++ ) {
-                if ( cw ) {
-                    ny = x;
-                } else {
-                    ny = _dx - 1 - x;
-                }
-                dst[ _dy*ny + nx ] = src[ x ];
-            }
-        }
+        rotatePixels90( dst, (lUInt16*)_data, _dx, _dy, cw );
     #if !defined(__SYMBIAN32__) && defined(_WIN32) && !defined(QT_GL)
         memcpy( _data, dst, sz );
         free( dst );
@@ -371,23 +737,7 @@ void LVColorDrawBuf::Rotate( cr_rotate_angle_t angle )
     #else
         bool cw = angle==CR_ROTATE_ANGLE_90;
     #endif
-        for ( int y=0; y<_dy; y++ ) {
-            lUInt32 * src = (lUInt32*)_data + _dx*y;
-            int nx, ny;
-            if ( cw ) {
-                nx = _dy - 1 - y;
-            } else {
-                nx = y;
-            }
-            for ( int x=0; x<_dx; x++ ) {
-                if ( cw ) {
-                    ny = x;
-                } else {
-                    ny = _dx - 1 - x;
-                }
-                dst[ _dy*ny + nx ] = src[ x ];
-            }
-        }
+        rotatePixels90( dst, (lUInt32*)_data, _dx, _dy, cw );
     #if !defined(__SYMBIAN32__) && defined(_WIN32) && !defined(QT_GL)
         memcpy( _data, dst, sz );
         free( dst );
@@ -1326,20 +1676,7 @@ void LVGrayDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int he
                 }
             }
         } else { // 3,4,8
-            int mask = ((1<<_bpp)-1)<<(8-_bpp);
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt8 b = (*src++);
-                if ( b ) {
-                    if ( b>=mask )
-                        *dst = color;
-                    else {
-                        int alpha = b ^ 0xFF;
-                        ApplyAlphaGray( *dst, color, alpha, _bpp );
-                    }
-                }
-                dst++;
-            }
+            blendGlyphRowGray( dst, src, width, color, _bpp );
         }
         /* new dest line */
         bitmap += bmp_width;
@@ -1390,16 +1727,56 @@ void LVGrayDrawBuf::ConvertToBitmap(bool flgDither)
     if (_bpp==1)
         return;
     // TODO: implement for byte per pixel mode
-    int sz = GetRowSize();
-    lUInt8 * bitmap = (lUInt8*) calloc(sz, sizeof(*bitmap));
-    if (flgDither)
+    int bitmapRowSize = (_dx+7)/8;
+    int sz = bitmapRowSize * _dy;
+    lUInt8 * bitmap = (lUInt8*) calloc(sz + 1, sizeof(*bitmap));
+    bitmap[sz] = GUARD_BYTE;
+    static const lUInt8 cmap[4][4] = {
+        { 0, 0, 0, 0},
+        { 0, 0, 1, 0},
+        { 0, 1, 0, 1},
+        { 1, 1, 1, 1},
+    };
+    if (_bpp==2)
+    {
+        // one source byte holds 4 pixels: convert it to 4 bits of bitmap with a table per row parity
+        lUInt8 nibbles[2][256];
+        for (int b=0; b<256; b++) {
+            for (int parity=0; parity<2; parity++) {
+                lUInt8 nibble = 0;
+                for (int k=0; k<4; k++) {
+                    int cl;
+                    if (flgDither) {
+                        cl = (b >> (6-k*2))&3;
+                        cl = cmap[cl][ (k&1) + (parity<<1) ];
+                        cl = cmap[cl][ (k&1) + (parity<<1) ];
+                    } else {
+                        cl = (b >> (7-k*2))&1;
+                    }
+                    if (cl)
+                        nibble |= 0x08>>k;
+                }
+                nibbles[parity][b] = nibble;
+            }
+        }
+        lUInt8 lastMask = (_dx&7) ? (lUInt8)(0xFF << (8-(_dx&7))) : 0xFF;
+        for (int y=0; y<_dy; y++)
+        {
+            const lUInt8 * table = nibbles[flgDither ? (y&1) : 0];
+            lUInt8 * src = GetScanLine(y);
+            lUInt8 * dst = bitmap + bitmapRowSize*y;
+            int srcBytes = (_dx+3)/4;
+            for (int i=0; i<bitmapRowSize; i++) {
+                lUInt8 hi = table[src[i*2]];
+                lUInt8 lo = i*2+1 < srcBytes ? table[src[i*2+1]] : 0;
+                dst[i] = (lUInt8)((hi << 4) | lo);
+            }
+            if (bitmapRowSize)
+                dst[bitmapRowSize-1] &= lastMask;
+        }
+    }
+    else if (flgDither)
     {
-        static const lUInt8 cmap[4][4] = {
-            { 0, 0, 0, 0},
-            { 0, 0, 1, 0},
-            { 0, 1, 0, 1},
-            { 1, 1, 1, 1},
-        };
         for (int y=0; y<_dy; y++)
         {
             lUInt8 * src = GetScanLine(y);
@@ -1836,10 +2213,8 @@ void LVColorDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int h
     int initial_height = height;
     int bx = 0;
     int by = 0;
-    int xx;
     int bmp_width = width;
     lUInt32 bmpcl = palette?palette[0]:GetTextColor();
-    const lUInt8 * src;
 
     if (x<_clip.left)
     {
@@ -1878,38 +2253,19 @@ void LVColorDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int h
     if (height<=0)
         return;
 
-    xx = width;
-
     bitmap += bx + by*bmp_width;
 
     if ( _bpp==16 ) {
 
         lUInt16 bmpcl16 = rgb888to565(bmpcl);
 
-        lUInt16 * dst;
         lUInt16 * dstline;
 
 
         for (;height;height--)
         {
-            src = bitmap;
             dstline = ((lUInt16*)GetScanLine(y++)) + x;
-            dst = dstline;
-
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt32 opaque = ((*(src++))>>4)&0x0F;
-                if ( opaque>=0xF )
-                    *dst = bmpcl16;
-                else if ( opaque>0 ) {
-                    lUInt32 alpha = 0xF-opaque;
-                    lUInt16 cl1 = (lUInt16)(((alpha*((*dst)&0xF81F) + opaque*(bmpcl16&0xF81F))>>4) & 0xF81F);
-                    lUInt16 cl2 = (lUInt16)(((alpha*((*dst)&0x07E0) + opaque*(bmpcl16&0x07E0))>>4) & 0x07E0);
-                    *dst = cl1 | cl2;
-                }
-                /* next pixel */
-                dst++;
-            }
+            blendGlyphRow16( dstline, bitmap, width, bmpcl16 );
             /* new dest line */
             bitmap += bmp_width;
         }
@@ -1919,30 +2275,13 @@ void LVColorDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int h
 
         lUInt32 bmpcl32 = RevRGBA(bmpcl);
 
-        lUInt32 * dst;
         lUInt32 * dstline;
 
 
         for (;height;height--)
         {
-            src = bitmap;
             dstline = ((lUInt32*)GetScanLine(y++)) + x;
-            dst = dstline;
-
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt32 opaque = ((*(src++))>>1)&0x7F;
-                if ( opaque>=0x78 )
-                    *dst = bmpcl32;
-                else if ( opaque>0 ) {
-                    lUInt32 alpha = 0x7F-opaque;
-                    lUInt32 cl1 = ((alpha*((*dst)&0xFF00FF) + opaque*(bmpcl32&0xFF00FF))>>7) & 0xFF00FF;
-                    lUInt32 cl2 = ((alpha*((*dst)&0x00FF00) + opaque*(bmpcl32&0x00FF00))>>7) & 0x00FF00;
-                    *dst = cl1 | cl2;
-                }
-                /* next pixel */
-                dst++;
-            }
+            blendGlyphRow32( dstline, bitmap, width, bmpcl32 );
             /* new dest line */
             bitmap += bmp_width;
         }
@@ -2072,23 +2411,9 @@ void LVGrayDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
 	            else
 	            {
 	            	// byte per pixel
-	                for (int xx=0; xx<_dx; xx++)
-	                {
-	                    if ( x+xx >= clip.left && x+xx < clip.right )
-	                    {
-	                        lUInt32 cl = *src;
-	                        if (bpp == 3) {
-	                        	cl &= 0xE0;
-	                        	cl = cl | (cl>>3) | (cl>>6);
-	                        } else if (bpp == 4) {
-	                        	cl &= 0xF0;
-	                        	cl = cl | (cl>>4);
-	                        }
-	                        *dst = cl | (cl << 8) | (cl << 16);
-	                    }
-	                    dst++;
-	                    src++;
-	                }
+	                int x0, x1;
+	                if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+	                    convertGrayRowTo32( dst + x0, src + x0, x1 - x0, bpp );
 	            }
 	        }
 	    }
@@ -2164,6 +2489,22 @@ void LVGrayDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
 	    }
 	    return;
 	}
+	if (bpp == 8 && buf->GetBitsPerPixel() < 8) {
+		// 8bpp to e-ink 1..4 bpp, with ordered dithering
+		int bits = buf->GetBitsPerPixel();
+		int x0, x1;
+		if ( !clipRowSpan( clip, x, _dx, x0, x1 ) )
+			return;
+		lUInt8 (*tables)[256] = (lUInt8 (*)[256])malloc( 64 * 256 );
+		initGrayDitherTables( tables, bits );
+		for (int yy=0; yy<_dy; yy++)
+		{
+			if (y+yy >= clip.top && y+yy < clip.bottom)
+				ditherGrayRow( buf->GetScanLine(y+yy), GetScanLine(yy) + x0, x1 - x0, x + x0, y + yy, bits, tables );
+		}
+		free( tables );
+		return;
+	}
 	if (buf->GetBitsPerPixel() != bpp)
 		return; // not supported yet
     for (int yy=0; yy<_dy; yy++)
@@ -2225,16 +2566,9 @@ void LVGrayDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
             }
             else
             {
-                lUInt8 * dst = buf->GetScanLine(y+yy) + x;
-                for (int xx=0; xx<_dx; xx++)
-                {
-                    if ( x+xx >= clip.left && x+xx < clip.right )
-                    {
-                        *dst = *src;
-                    }
-                    dst++;
-                    src++;
-                }
+                int x0, x1;
+                if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+                    memcpy( buf->GetScanLine(y+yy) + x + x0, src + x0, x1 - x0 );
             }
         }
     }
@@ -2529,23 +2863,13 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
                         src++;
                     }
                 } else if (bpp == 16) {
-                    lUInt16 * dst = ((lUInt16 *)buf->GetScanLine(y + yy)) + x;
-                    for (int xx=0; xx < _dx; xx++) {
-                        if (x + xx >= clip.left && x + xx < clip.right) {
-                            *dst = *src;
-                        }
-                        dst++;
-                        src++;
-                    }
+                    int x0, x1;
+                    if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+                        memcpy( ((lUInt16 *)buf->GetScanLine(y + yy)) + x + x0, src + x0, (x1 - x0) * sizeof(lUInt16) );
                 } else if (bpp == 32) {
-                    lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y + yy)) + x;
-                    for (int xx=0; xx<_dx; xx++) {
-                        if ( x+xx >= clip.left && x+xx < clip.right ) {
-                            *dst = rgb565to888( *src );
-                        }
-                        dst++;
-                        src++;
-                    }
+                    int x0, x1;
+                    if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+                        convertRow565To888( ((lUInt32 *)buf->GetScanLine(y + yy)) + x + x0, src + x0, x1 - x0 );
                 }
             } else {
                 lUInt32 * src = (lUInt32 *)GetScanLine(yy);
@@ -2584,24 +2908,13 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
                         src++;
                     }
                 } else if (bpp<=8) {
-                    lUInt8 * dst = buf->GetScanLine(y + yy) + x;
-                    for (int xx=0; xx<_dx; xx++) {
-                        if (x + xx >= clip.left && x + xx < clip.right) {
-                            //lUInt8 mask = ~((lUInt8)0xC0>>shift);
-                            *dst = (lUInt8)*src;
-                        }
-                        dst++;
-                        src++;
-                    }
+                    int x0, x1;
+                    if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+                        convertRow32ToGray8( buf->GetScanLine(y + yy) + x + x0, src + x0, x1 - x0 );
                 } else if (bpp == 32) {
-                    lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y + yy)) + x;
-                    for (int xx = 0; xx < _dx; xx++) {
-                        if (x+xx >= clip.left && x + xx < clip.right) {
-                            *dst = RevRGBA(*src);
-                        }
-                        dst++;
-                        src++;
-                    }
+                    int x0, x1;
+                    if ( clipRowSpan( clip, x, _dx, x0, x1 ) )
+                        convertRow32ToRev( ((lUInt32 *)buf->GetScanLine(y + yy)) + x + x0, src + x0, x1 - x0 );
                 }
             }
         }
@@ -3017,3 +3330,285 @@ void LVColorDrawBuf::ConvertToBitmap(bool flgDither)
     CR_UNUSED(flgDither);
 }
 
+
+//=======================================================
+// Retained drawing list
+//=======================================================
+
+void LVDrawList::replay( LVDrawBuf * buf )
+{
+    for ( int i=0; i<_items.length(); i++ ) {
+        const Item & item = _items[i];
+        const lInt32 * v = item.v;
+        switch ( item.op ) {
+        case OP_FILL_RECT:
+            buf->FillRect( v[0], v[1], v[2], v[3], (lUInt32)v[4] );
+            break;
+        case OP_FILL_RECT_PATTERN:
+            buf->FillRectPattern( v[0], v[1], v[2], v[3], (lUInt32)v[4], (lUInt32)v[5], (lUInt8 *)_bitmaps.get() + v[6] );
+            break;
+        case OP_GRADIENT_RECT:
+            buf->GradientRect( v[0], v[1], v[2], v[3], (lUInt32)v[4], (lUInt32)v[5], (lUInt32)v[6], (lUInt32)v[7] );
+            break;
+        case OP_INVERT_RECT:
+            buf->InvertRect( v[0], v[1], v[2], v[3] );
+            break;
+        case OP_DRAW_LINE:
+            buf->DrawLine( v[0], v[1], v[2], v[3], (lUInt32)v[4], v[5], v[6], v[7] );
+            break;
+        case OP_DRAW_BITMAP:
+            {
+                // pass runs of glyphs with the same palette to DrawGlyphs() at once
+                LVDrawBufGlyph glyphs[64];
+                int count = 0;
+                lUInt32 palette = (lUInt32)v[5];
+                bool hasPalette = v[6] != 0;
+                for ( ; i<_items.length() && count<64; i++ ) {
+                    const Item & glyph = _items[i];
+                    if ( glyph.op != OP_DRAW_BITMAP || (glyph.v[6] != 0) != hasPalette
+                            || (hasPalette && (lUInt32)glyph.v[5] != palette) )
+                        break;
+                    glyphs[count].x = glyph.v[0];
+                    glyphs[count].y = glyph.v[1];
+                    glyphs[count].bitmap = _bitmaps.get() + glyph.v[4];
+                    glyphs[count].width = glyph.v[2];
+                    glyphs[count].height = glyph.v[3];
+                    count++;
+                }
+                i--;
+                buf->DrawGlyphs( glyphs, count, hasPalette ? &palette : NULL );
+            }
+            break;
+        case OP_DRAW_IMAGE:
+            buf->Draw( _images[v[4]], v[0], v[1], v[2], v[3], v[5] != 0 );
+            break;
+        case OP_DRAW_IMAGE_PART:
+            buf->Draw( _images[v[4]], v[0], v[1], v[2], v[3], v[6], v[7], v[8], v[9], v[5] != 0 );
+            break;
+        case OP_DRAW_IMAGE_ROTATED:
+            buf->DrawRotated( _images[v[4]], v[0], v[1], v[2], v[3], v[5] );
+            break;
+        case OP_SET_CLIP_RECT:
+            {
+                lvRect rc( v[0], v[1], v[2], v[3] );
+                buf->SetClipRect( &rc );
+            }
+            break;
+        case OP_RESET_CLIP_RECT:
+            buf->SetClipRect( NULL );
+            break;
+        case OP_SET_TEXT_COLOR:
+            buf->SetTextColor( (lUInt32)v[0] );
+            break;
+        case OP_SET_BACKGROUND_COLOR:
+            buf->SetBackgroundColor( (lUInt32)v[0] );
+            break;
+        case OP_SET_HIDE_PARTIAL_GLYPHS:
+            buf->setHidePartialGlyphs( v[0] != 0 );
+            break;
+        case OP_SET_INVERT_IMAGES:
+            buf->setInvertImages( v[0] != 0 );
+            break;
+        case OP_SET_DITHER_IMAGES:
+            buf->setDitherImages( v[0] != 0 );
+            break;
+        case OP_SET_SMOOTH_SCALING_IMAGES:
+            buf->setSmoothScalingImages( v[0] != 0 );
+            break;
+        case OP_SET_ALPHA:
+            buf->setAlpha( v[0] );
+            break;
+        }
+    }
+}
+
+LVDrawList::Item & LVDrawListRecorder::add( int op )
+{
+    LVDrawList::Item item;
+    item.op = op;
+    memset( item.v, 0, sizeof(item.v) );
+    _list->_items.add( item );
+    return _list->_items[_list->_items.length() - 1];
+}
+
+void LVDrawListRecorder::addImage( int op, LVImageSourceRef img, int x, int y, int width, int height )
+{
+    LVDrawList::Item & item = add( op );
+    item.v[0] = x;
+    item.v[1] = y;
+    item.v[2] = width;
+    item.v[3] = height;
+    item.v[4] = _list->_images.length();
+    _list->_images.add( img );
+}
+
+void LVDrawListRecorder::SetBackgroundColor( lUInt32 cl )
+{
+    _target->SetBackgroundColor( cl );
+    add( LVDrawList::OP_SET_BACKGROUND_COLOR ).v[0] = (lInt32)cl;
+}
+
+void LVDrawListRecorder::SetTextColor( lUInt32 cl )
+{
+    _target->SetTextColor( cl );
+    add( LVDrawList::OP_SET_TEXT_COLOR ).v[0] = (lInt32)cl;
+}
+
+void LVDrawListRecorder::SetClipRect( const lvRect * clipRect )
+{
+    _target->SetClipRect( clipRect );
+    if ( !clipRect ) {
+        add( LVDrawList::OP_RESET_CLIP_RECT );
+        return;
+    }
+    LVDrawList::Item & item = add( LVDrawList::OP_SET_CLIP_RECT );
+    item.v[0] = clipRect->left;
+    item.v[1] = clipRect->top;
+    item.v[2] = clipRect->right;
+    item.v[3] = clipRect->bottom;
+}
+
+void LVDrawListRecorder::setHidePartialGlyphs( bool hide )
+{
+    _target->setHidePartialGlyphs( hide );
+    add( LVDrawList::OP_SET_HIDE_PARTIAL_GLYPHS ).v[0] = hide ? 1 : 0;
+}
+
+void LVDrawListRecorder::setInvertImages( bool invert )
+{
+    _target->setInvertImages( invert );
+    add( LVDrawList::OP_SET_INVERT_IMAGES ).v[0] = invert ? 1 : 0;
+}
+
+void LVDrawListRecorder::setDitherImages( bool dither )
+{
+    _target->setDitherImages( dither );
+    add( LVDrawList::OP_SET_DITHER_IMAGES ).v[0] = dither ? 1 : 0;
+}
+
+void LVDrawListRecorder::setSmoothScalingImages( bool smooth )
+{
+    _target->setSmoothScalingImages( smooth );
+    add( LVDrawList::OP_SET_SMOOTH_SCALING_IMAGES ).v[0] = smooth ? 1 : 0;
+}
+
+void LVDrawListRecorder::setAlpha( int alpha )
+{
+    _target->setAlpha( alpha );
+    add( LVDrawList::OP_SET_ALPHA ).v[0] = alpha;
+}
+
+void LVDrawListRecorder::GradientRect( int x0, int y0, int x1, int y1, lUInt32 color1, lUInt32 color2, lUInt32 color3, lUInt32 color4 )
+{
+    _target->GradientRect( x0, y0, x1, y1, color1, color2, color3, color4 );
+    LVDrawList::Item & item = add( LVDrawList::OP_GRADIENT_RECT );
+    item.v[0] = x0;
+    item.v[1] = y0;
+    item.v[2] = x1;
+    item.v[3] = y1;
+    item.v[4] = (lInt32)color1;
+    item.v[5] = (lInt32)color2;
+    item.v[6] = (lInt32)color3;
+    item.v[7] = (lInt32)color4;
+}
+
+void LVDrawListRecorder::FillRect( int x0, int y0, int x1, int y1, lUInt32 color )
+{
+    _target->FillRect( x0, y0, x1, y1, color );
+    LVDrawList::Item & item = add( LVDrawList::OP_FILL_RECT );
+    item.v[0] = x0;
+    item.v[1] = y0;
+    item.v[2] = x1;
+    item.v[3] = y1;
+    item.v[4] = (lInt32)color;
+}
+
+void LVDrawListRecorder::FillRectPattern( int x0, int y0, int x1, int y1, lUInt32 color0, lUInt32 color1, lUInt8 * pattern )
+{
+    _target->FillRectPattern( x0, y0, x1, y1, color0, color1, pattern );
+    LVDrawList::Item & item = add( LVDrawList::OP_FILL_RECT_PATTERN );
+    item.v[0] = x0;
+    item.v[1] = y0;
+    item.v[2] = x1;
+    item.v[3] = y1;
+    item.v[4] = (lInt32)color0;
+    item.v[5] = (lInt32)color1;
+    // pattern is 4 rows of 8 pixels
+    item.v[6] = _list->_bitmaps.length();
+    _list->_bitmaps.add( pattern, 4 );
+}
+
+void LVDrawListRecorder::InvertRect( int x0, int y0, int x1, int y1 )
+{
+    _target->InvertRect( x0, y0, x1, y1 );
+    LVDrawList::Item & item = add( LVDrawList::OP_INVERT_RECT );
+    item.v[0] = x0;
+    item.v[1] = y0;
+    item.v[2] = x1;
+    item.v[3] = y1;
+}
+
+void LVDrawListRecorder::Draw( int x, int y, const lUInt8 * bitmap, int width, int height, lUInt32 * palette )
+{
+    _target->Draw( x, y, bitmap, width, height, palette );
+    // glyph bitmaps belong to font glyph cache and may be freed: keep a copy, shared by equal glyphs
+    int size = width * height;
+    lUInt32 hash = (lUInt32)width * 31 + (lUInt32)height;
+    for ( int i=0; i<size; i++ )
+        hash = hash * 31 + bitmap[i];
+    int offset = -1;
+    if ( !_bitmapOffsets.get( hash, offset ) || offset + size > _list->_bitmaps.length()
+            || memcmp( _list->_bitmaps.get() + offset, bitmap, size ) ) {
+        offset = _list->_bitmaps.length();
+        _list->_bitmaps.add( bitmap, size );
+        _bitmapOffsets.set( hash, offset );
+    }
+    LVDrawList::Item & item = add( LVDrawList::OP_DRAW_BITMAP );
+    item.v[0] = x;
+    item.v[1] = y;
+    item.v[2] = width;
+    item.v[3] = height;
+    item.v[4] = offset;
+    item.v[5] = palette ? (lInt32)palette[0] : 0;
+    item.v[6] = palette ? 1 : 0;
+}
+
+void LVDrawListRecorder::Draw( LVImageSourceRef img, int x, int y, int width, int height, bool dither )
+{
+    _target->Draw( img, x, y, width, height, dither );
+    addImage( LVDrawList::OP_DRAW_IMAGE, img, x, y, width, height );
+    _list->_items[_list->_items.length() - 1].v[5] = dither ? 1 : 0;
+}
+
+void LVDrawListRecorder::Draw( LVImageSourceRef img, int x, int y, int width, int height, int srcx, int srcy, int srcwidth, int srcheight, bool dither )
+{
+    _target->Draw( img, x, y, width, height, srcx, srcy, srcwidth, srcheight, dither );
+    addImage( LVDrawList::OP_DRAW_IMAGE_PART, img, x, y, width, height );
+    lInt32 * v = _list->_items[_list->_items.length() - 1].v;
+    v[5] = dither ? 1 : 0;
+    v[6] = srcx;
+    v[7] = srcy;
+    v[8] = srcwidth;
+    v[9] = srcheight;
+}
+
+void LVDrawListRecorder::DrawRotated( LVImageSourceRef img, int x, int y, int width, int height, int rotationAngle )
+{
+    _target->DrawRotated( img, x, y, width, height, rotationAngle );
+    addImage( LVDrawList::OP_DRAW_IMAGE_ROTATED, img, x, y, width, height );
+    _list->_items[_list->_items.length() - 1].v[5] = rotationAngle;
+}
+
+void LVDrawListRecorder::DrawLine( int x0, int y0, int x1, int y1, lUInt32 color0, int length1, int length2, int direction )
+{
+    _target->DrawLine( x0, y0, x1, y1, color0, length1, length2, direction );
+    LVDrawList::Item & item = add( LVDrawList::OP_DRAW_LINE );
+    item.v[0] = x0;
+    item.v[1] = y0;
+    item.v[2] = x1;
+    item.v[3] = y1;
+    item.v[4] = (lInt32)color0;
+    item.v[5] = length1;
+    item.v[6] = length2;
+    item.v[7] = direction;
+}
@@ -14,12 +14,17 @@ LVStreamRef OpcPart::open()
     return m_package->open(m_name);
 }
 
-lString16 OpcPart::getRelatedPartName(const lChar16 * const relationType, const lString16 id)
+void OpcPart::loadRelations()
 {
     if( !m_relationsValid ) {
         readRelations();
         m_relationsValid = true;
     }
+}
+
+lString16 OpcPart::getRelatedPartName(const lChar16 * const relationType, const lString16 id)
+{
+    loadRelations();
     LVHashTable<lString16, lString16> *relationsTable = m_relations.get(relationType);
     if( relationsTable ) {
         if( id.empty() ) {
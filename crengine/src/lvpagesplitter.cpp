@@ -770,6 +770,16 @@ void LVRendPageContext::split()
     s.Finalize();
 }
 
+void LVRendPageContext::split( LVRendPageList * pageList, int pageHeight )
+{
+    // splitting only reads lines (footnote link flags are reset the same way
+    // each time), so it can be done again for another page height
+    page_list = pageList;
+    page_h = pageHeight;
+    callback = NULL;
+    split();
+}
+
 void LVRendPageContext::Finalize()
 {
     split();
@@ -4002,6 +4002,7 @@ private:
                     // todo: currently not used, should be saved in RenderRectAccessor
                     // and used by lvtextfm.cpp for typography
     LVRendPageContext & context;
+    ldomDocument * doc; // to note when page height is used
     LVPtrVector<BlockShift>  _shifts;
     LVPtrVector<BlockFloat>  _floats;
     int  rend_flags;
@@ -4037,10 +4038,11 @@ private:
     int  vm_back_usable_as_margin; // previously moved vertical space where next margin could be accounted in
 
 public:
-    FlowState( LVRendPageContext & ctx, int width, int rendflags, int dir=REND_DIRECTION_UNSET, ldomNode * langnode=NULL ):
+    FlowState( LVRendPageContext & ctx, ldomDocument * document, int width, int rendflags, int dir=REND_DIRECTION_UNSET, ldomNode * langnode=NULL ):
         direction(dir),
         lang_node(langnode),
         context(ctx),
+        doc(document),
         rend_flags(rendflags),
         level(0),
         o_width(width),
@@ -4114,6 +4116,15 @@ public:
     int getPageHeight() {
         return page_height;
     }
+    /// returns height clamped to page height, noting for which page heights the result is the same
+    int limitToPageHeight( int h ) {
+        if ( h > page_height ) {
+            doc->limitRenderPageHeight( page_height, page_height );
+            return page_height;
+        }
+        doc->limitRenderPageHeight( h );
+        return h;
+    }
     LVRendPageContext * getPageContext() {
         return &context;
     }
@@ -4560,9 +4571,7 @@ public:
         // in scroll mode could still show "page 1 of 2" while we scroll this margin
         // height that spans many many screen heights).
         // To avoid any confusion, limit any margin to be the page height
-        if ( margin > page_height )
-            margin = page_height;
-        return margin;
+        return limitToPageHeight( margin );
     }
     void pushVerticalMargin( int next_split_before_flag=RN_SPLIT_AUTO ) {
         if ( vm_disabled )
@@ -6377,8 +6386,8 @@ void renderBlockElementEnhanced( FlowState * flow, ldomNode * enode, int x, int
                     current_h = flow->getCurrentRelativeY() + padding_bottom;
                     int pad_h = style_h - current_h;
                     if (pad_h > 0) {
-                        if (pad_h > flow->getPageHeight()) // don't pad more than one page height
-                            pad_h = flow->getPageHeight();
+                        // don't pad more than one page height
+                        pad_h = flow->limitToPageHeight( pad_h );
                         // Add this space to the page splitting context
                         // Allow page splitting inside this useless excessive style height
                         flow->addContentSpace(pad_h, 1, false, false, false);
@@ -6581,8 +6590,7 @@ void renderBlockElementEnhanced( FlowState * flow, ldomNode * enode, int x, int
                     int pad_h = style_h - (final_h + padding_top + padding_bottom);
                     if (pad_h > 0) {
                         // don't pad more than one page height
-                        if (pad_h > flow->getPageHeight())
-                            pad_h = flow->getPageHeight();
+                        pad_h = flow->limitToPageHeight( pad_h );
                         pad_style_h = pad_h; // to be context.AddLine() below
                     }
                 }
@@ -6769,7 +6777,7 @@ int renderBlockElement( LVRendPageContext & context, ldomNode * enode, int x, in
         // (We are called when rendering the root node, and when rendering each float
         // met along walking the root node hierarchy - and when meeting a new float
         // in a float, etc...)
-        FlowState flow( context, width, rend_flags, direction );
+        FlowState flow( context, enode->getDocument(), width, rend_flags, direction );
         if (baseline != NULL) {
             flow.setRequestedBaselineType(*baseline);
         }
@@ -7776,9 +7784,10 @@ void DrawDocument( LVDrawBuf & drawbuf, ldomNode * enode, int x0, int y0, int dx
                 {
                     lvRect rc;
                     enode->getAbsRect( rc, true );
+                    ldomMarkedRangeList nbookmarksList( bookmarks, rc );
                     ldomMarkedRangeList *nbookmarks = NULL;
-                    if ( bookmarks && bookmarks->length()) { // internal crengine bookmarked text highlights
-                        nbookmarks = new ldomMarkedRangeList( bookmarks, rc );
+                    if ( nbookmarksList.length() ) { // internal crengine bookmarked text highlights
+                        nbookmarks = &nbookmarksList;
                     }
                     if ( marks && marks->length() ) { // "native highlighting" of a selection in progress
                         // Keep marks that are part of the top and bottom overflows
@@ -7794,8 +7803,6 @@ void DrawDocument( LVDrawBuf & drawbuf, ldomNode * enode, int x0, int y0, int dx
                         // Draw regular text, no marks
                         txform->Draw( &drawbuf, doc_x+x0 + padding_left, doc_y+y0 + padding_top, marks, nbookmarks );
                     }
-                    if (nbookmarks)
-                        delete nbookmarks;
                 }
                 #if (DEBUG_TREE_DRAW!=0)
                     drawbuf.FillRect( doc_x+x0, doc_y+y0, doc_x+x0+fmt.getWidth(), doc_y+y0+1, color );
@@ -3909,6 +3909,27 @@ bool LVFileExists( const lString16 & pathName )
 #endif
 }
 
+/// gets size and last modification time of file, returns false if there is no such file
+bool LVGetFileInfo( const lString8 & pathName, lUInt64 & size, lUInt64 & modTime )
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if ( !GetFileAttributesExW( Utf8ToUnicode(pathName).c_str(), GetFileExInfoStandard, &data ) )
+        return false;
+    if ( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        return false;
+    size = ((lUInt64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    modTime = ((lUInt64)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat st;
+    if ( stat( pathName.c_str(), &st ) || !S_ISREG(st.st_mode) )
+        return false;
+    size = (lUInt64)st.st_size;
+    modTime = (lUInt64)st.st_mtime;
+#endif
+    return true;
+}
+
 /// returns true if directory exists and your app can write to directory
 bool LVDirectoryIsWritable(const lString16 & pathName) {
     lString16 fn = pathName;
@@ -549,14 +549,15 @@ int lStr_cmp(const lChar16 * dst, const lChar8 * src)
         return -1;
     else if (!src)
         return 1;
-    while ( *dst == (lChar16)*src)
+    // 8 bit chars are unsigned here, as in calcStringHash()
+    while ( *dst == (lChar16)(lUInt8)*src)
     {
         if (! *dst )
             return 0;
         ++dst;
         ++src;
     }
-    if ( *dst > (lChar16)*src )
+    if ( *dst > (lChar16)(lUInt8)*src )
         return 1;
     else
         return -1;
@@ -570,14 +571,15 @@ int lStr_cmp(const lChar8 * dst, const lChar16 * src)
         return -1;
     else if (!src)
         return 1;
-    while ( (lChar16)*dst == *src)
+    // 8 bit chars are unsigned here, as in calcStringHash()
+    while ( (lChar16)(lUInt8)*dst == *src)
     {
         if (! *dst )
             return 0;
         ++dst;
         ++src;
     }
-    if ( (lChar16)*dst > *src )
+    if ( (lChar16)(lUInt8)*dst > *src )
         return 1;
     else
         return -1;
@@ -1281,6 +1283,16 @@ lUInt32 calcStringHash( const lChar16 * s )
     return a;
 }
 
+lUInt32 calcStringHash( const lChar8 * s )
+{
+    lUInt32 a = 2166136261u;
+    while (*s)
+    {
+        a = a * 16777619 ^ (lUInt8)(*s++);
+    }
+    return a;
+}
+
 /// calculates CRC32 for buffer contents
 lUInt32 lStr_crc32( lUInt32 prevValue, const void * buf, int size )
 {
@@ -38,6 +38,7 @@ bool lString16HashedCollection::deserialize( SerialBuf & buf )
     if ( buf.error() )
         return false;
     clear();
+    clearHash();
     int start = buf.pos();
     buf.putMagic( str_hash_magic );
     lInt32 count = 0;
@@ -58,50 +59,34 @@ lString16HashedCollection::lString16HashedCollection( lString16HashedCollection
 , hashSize( v.hashSize )
 , hash( NULL )
 {
-    hash = (HashPair *)malloc( sizeof(HashPair) * hashSize );
-    for ( int i=0; i<hashSize; i++ ) {
-        hash[i].clear();
-        hash[i].index = v.hash[i].index;
-        HashPair * next = v.hash[i].next;
-        while ( next ) {
-            addHashItem( i, next->index );
-            next = next->next;
-        }
+    if ( v.hash ) {
+        hash = (HashPair *)malloc( sizeof(HashPair) * hashSize );
+        memcpy( hash, v.hash, sizeof(HashPair) * hashSize );
     }
 }
 
-void lString16HashedCollection::addHashItem( int hashIndex, int storageIndex )
+void lString16HashedCollection::addHashItem( lUInt32 h, int storageIndex )
 {
-    if ( hash[ hashIndex ].index == -1 ) {
-        hash[hashIndex].index = storageIndex;
-    } else {
-        HashPair * np = (HashPair *)malloc(sizeof(HashPair));
-        np->index = storageIndex;
-        np->next = hash[hashIndex].next;
-        hash[hashIndex].next = np;
-    }
+    lUInt32 mask = hashSize - 1;
+    lUInt32 n = h & mask;
+    while ( hash[n].index != -1 )
+        n = (n + 1) & mask;
+    hash[n].index = storageIndex;
+    hash[n].hash = h;
 }
 
 void lString16HashedCollection::clearHash()
 {
-    if ( hash ) {
-        for ( int i=0; i<hashSize; i++) {
-            HashPair * p = hash[i].next;
-            while ( p ) {
-                HashPair * tmp = p->next;
-                free( p );
-                p = tmp;
-            }
-        }
+    if ( hash )
         free( hash );
-    }
     hash = NULL;
 }
 
 lString16HashedCollection::lString16HashedCollection( lUInt32 hash_size )
-: hashSize(hash_size), hash(NULL)
+: hashSize(16), hash(NULL)
 {
-
+    while ( hashSize < (int)hash_size )
+        hashSize <<= 1;
     hash = (HashPair *)malloc( sizeof(HashPair) * hashSize );
     for ( int i=0; i<hashSize; i++ )
         hash[i].clear();
@@ -112,69 +97,57 @@ lString16HashedCollection::~lString16HashedCollection()
     clearHash();
 }
 
-int lString16HashedCollection::find( const lChar16 * s )
+int lString16HashedCollection::find( const lChar16 * s ) const
 {
     if ( !hash || !length() )
         return -1;
     lUInt32 h = calcStringHash( s );
-    lUInt32 n = h % hashSize;
-    if ( hash[n].index!=-1 )
-    {
-        const lString16 & str = at( hash[n].index );
-        if ( str == s )
+    lUInt32 mask = hashSize - 1;
+    for ( lUInt32 n = h & mask; hash[n].index != -1; n = (n + 1) & mask ) {
+        if ( hash[n].hash == h && (*this)[ hash[n].index ] == s )
             return hash[n].index;
-        HashPair * p = hash[n].next;
-        for ( ;p ;p = p->next ) {
-            const lString16 & str = at( p->index );
-            if ( str==s )
-                return p->index;
-        }
     }
     return -1;
 }
 
 void lString16HashedCollection::reHash( int newSize )
 {
-    if (hashSize == newSize)
-        return;
-    clearHash();
+    HashPair * oldHash = hash;
+    int oldSize = hashSize;
+    hash = (HashPair *)malloc( sizeof(HashPair) * newSize );
     hashSize = newSize;
-    if (hashSize > 0) {
-        hash = (HashPair *)malloc( sizeof(HashPair) * hashSize );
-        for ( int i=0; i<hashSize; i++ )
-            hash[i].clear();
-    }
-    for ( int i=0; i<length(); i++ ) {
-        lUInt32 h = calcStringHash( at(i).c_str() );
-        lUInt32 n = h % hashSize;
-        addHashItem( n, i );
+    for ( int i=0; i<hashSize; i++ )
+        hash[i].clear();
+    if ( oldHash ) {
+        // reuse precomputed hashes
+        for ( int i=0; i<oldSize; i++ )
+            if ( oldHash[i].index != -1 )
+                addHashItem( oldHash[i].hash, oldHash[i].index );
+        free( oldHash );
+    } else {
+        for ( int i=0; i<length(); i++ )
+            addHashItem( calcStringHash( at(i).c_str() ), i );
     }
 }
 
 int lString16HashedCollection::add( const lChar16 * s )
 {
-    if ( !hash || hashSize < length()*2 ) {
-        int sz = 16;
-        while ( sz<length() )
+    // keep load factor below 1/2
+    if ( !hash || hashSize < (length() + 1) * 2 ) {
+        int sz = hash ? hashSize : 16;
+        while ( sz < (length() + 1) * 2 )
             sz <<= 1;
-        sz <<= 1;
         reHash( sz );
     }
     lUInt32 h = calcStringHash( s );
-    lUInt32 n = h % hashSize;
-    if ( hash[n].index!=-1 )
-    {
-        const lString16 & str = at( hash[n].index );
-        if ( str == s )
+    lUInt32 mask = hashSize - 1;
+    lUInt32 n = h & mask;
+    for ( ; hash[n].index != -1; n = (n + 1) & mask ) {
+        if ( hash[n].hash == h && at( hash[n].index ) == s )
             return hash[n].index;
-        HashPair * p = hash[n].next;
-        for ( ;p ;p = p->next ) {
-            const lString16 & str = at( p->index );
-            if ( str==s )
-                return p->index;
-        }
     }
-    lUInt32 i = lString16Collection::add( lString16(s) );
-    addHashItem( n, i );
+    int i = lString16Collection::add( lString16(s) );
+    hash[n].index = i;
+    hash[n].hash = h;
     return i;
 }
@@ -18,6 +18,7 @@
 #include "../include/fb2def.h"
 #include "../include/lvstream.h"
 #include "../include/lvrend.h"   // for -cr-only-if:
+#include "../include/crlog.h"
 
 // define to dump all tokens
 //#define DUMP_CSS_PARSING
@@ -1981,6 +1982,7 @@ bool LVCssDeclaration::parse( const char * &decl, bool higher_importance, lxmlDo
         buf<<(lUInt32) cssd_stop; // add end marker
         int sz = buf.pos()/4;
         _data = new int[sz];
+        _size = sz;
         // Could that cause problem with different endianess?
         buf.copyTo( (lUInt8*)_data, buf.pos() );
         // Alternative:
@@ -3285,7 +3287,243 @@ lUInt32 LVStyleSheet::getHash()
     return hash;
 }
 
-bool LVStyleSheet::parse( const char * str, bool higher_importance, lString16 codeBase )
+/// write compiled declaration
+void LVCssDeclaration::serialize( SerialBuf & buf )
+{
+    buf << (lUInt32)_size;
+    // native byte order, as copied by parse()
+    SerialBuf data( (const lUInt8*)_data, _size * sizeof(int) );
+    data.setPos( _size * sizeof(int) );
+    buf << data;
+}
+
+/// read compiled declaration
+bool LVCssDeclaration::deserialize( SerialBuf & buf )
+{
+    lUInt32 sz = 0;
+    buf >> sz;
+    if ( buf.error() || sz > buf.space() / sizeof(int) )
+        return false;
+    if ( !sz )
+        return true;
+    _data = new int[sz];
+    _size = sz;
+    memcpy( _data, buf.buf() + buf.pos(), _size * sizeof(int) );
+    buf.setPos( buf.pos() + _size * sizeof(int) );
+    return _data[_size-1] == cssd_stop;
+}
+
+/// element and attribute ids compiled rules refer to, with their names
+class LVCssNameIds {
+    LVArray<lUInt16> _elements;
+    LVArray<lUInt16> _attrs;
+    lString16Collection _elementNames; // filled by read()
+    lString16Collection _attrNames;
+
+    static void add( LVArray<lUInt16> & ids, lUInt16 id )
+    {
+        // keep ids sorted: new names get ids in the order they are met
+        int i = 0;
+        while ( i < ids.length() && ids[i] < id )
+            i++;
+        if ( i < ids.length() && ids[i] == id )
+            return;
+        ids.insert( i, id );
+    }
+public:
+    void addElement( lUInt16 id ) { if ( id ) add( _elements, id ); }
+    void addAttr( lUInt16 id ) { add( _attrs, id ); }
+
+    void serialize( SerialBuf & buf, lxmlDocBase * doc )
+    {
+        buf << (lUInt32)_elements.length();
+        for ( int i=0; i<_elements.length(); i++ )
+            buf << _elements[i] << doc->getElementName( _elements[i] );
+        buf << (lUInt32)_attrs.length();
+        for ( int i=0; i<_attrs.length(); i++ )
+            buf << _attrs[i] << doc->getAttrName( _attrs[i] );
+    }
+
+    static bool read( SerialBuf & buf, LVArray<lUInt16> & ids, lString16Collection & names )
+    {
+        lUInt32 count = 0;
+        buf >> count;
+        for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+            lUInt16 id = 0;
+            lString16 name;
+            buf >> id >> name;
+            ids.add( id );
+            names.add( name );
+        }
+        return !buf.error();
+    }
+
+    /// checks that document has the same ids for names, or allocates the same ids to names it doesn't know yet
+    static bool check( LVArray<lUInt16> & ids, lString16Collection & names, lxmlDocBase * doc, bool attrs )
+    {
+        lUInt16 nextId = attrs ? doc->getNextUnknownAttrId() : doc->getNextUnknownElementId();
+        for ( int i=0; i<ids.length(); i++ ) {
+            lUInt16 id = attrs ? doc->findAttrNameIndex( names[i].c_str() ) : doc->findElementNameIndex( names[i].c_str() );
+            // ids are sorted: unknown names would get ids in this order
+            if ( !id )
+                id = nextId++;
+            if ( id != ids[i] )
+                return false;
+        }
+        return true;
+    }
+
+    /// reads names written by serialize(), returns false if document has other ids for them; document is not changed
+    bool read( SerialBuf & buf, lxmlDocBase * doc )
+    {
+        return read( buf, _elements, _elementNames ) && read( buf, _attrs, _attrNames )
+            && check( _elements, _elementNames, doc, false ) && check( _attrs, _attrNames, doc, true );
+    }
+
+    /// adds names read by read() which document doesn't know yet
+    void allocate( lxmlDocBase * doc )
+    {
+        for ( int i=0; i<_elementNames.length(); i++ )
+            doc->getElementNameIndex( _elementNames[i].c_str() );
+        for ( int i=0; i<_attrNames.length(); i++ )
+            doc->getAttrNameIndex( _attrNames[i].c_str() );
+    }
+};
+
+// attribute selectors refer to attribute by document specific id
+static bool isAttrNameRule( LVCssSelectorRuleType type )
+{
+    return type >= cssrt_attrset && type <= cssrt_attrcontains_i;
+}
+
+/// write rule, adding element and attribute ids it refers to to names
+void LVCssSelectorRule::serialize( SerialBuf & buf, LVCssNameIds & names )
+{
+    buf << (lUInt8)_type << _id << _attrid << _value;
+    names.addElement( _id );
+    if ( isAttrNameRule( _type ) )
+        names.addAttr( _attrid );
+}
+
+/// read rule
+bool LVCssSelectorRule::deserialize( SerialBuf & buf, lxmlDocBase * doc )
+{
+    buf >> _id >> _attrid >> _value;
+    if ( _type == cssrt_pseudoclass && _attrid >= csspc_last_child ) {
+        // same as when parsed: a re-render will be needed
+        doc->setNodeStylesInvalidIfLoading();
+    }
+    return !buf.error();
+}
+
+/// write selector and its rules (neither declaration nor next selector)
+void LVCssSelector::serialize( SerialBuf & buf, LVCssNameIds & names )
+{
+    lUInt32 count = 0;
+    for ( LVCssSelectorRule * p = _rules; p; p = p->getNext() )
+        count++;
+    buf << _id << (lInt32)_specificity << count;
+    names.addElement( _id );
+    for ( LVCssSelectorRule * p = _rules; p; p = p->getNext() )
+        p->serialize( buf, names );
+}
+
+/// read selector and its rules
+bool LVCssSelector::deserialize( SerialBuf & buf, lxmlDocBase * doc )
+{
+    lInt32 specificity = 0;
+    lUInt32 count = 0;
+    buf >> _id >> specificity >> count;
+    if ( buf.error() )
+        return false;
+    _specificity = specificity;
+    LVCssSelectorRule * last = NULL;
+    for ( lUInt32 i=0; i<count; i++ ) {
+        lUInt8 type = 0;
+        buf >> type;
+        if ( buf.error() || type > cssrt_pseudoclass )
+            return false;
+        LVCssSelectorRule * rule = new LVCssSelectorRule( (LVCssSelectorRuleType)type );
+        // keep rules order
+        if ( last )
+            last->setNext( rule );
+        else
+            _rules = rule;
+        last = rule;
+        if ( !rule->deserialize( buf, doc ) )
+            return false;
+    }
+    return true;
+}
+
+/// insert selector to chain for its element, keeping specificity order
+void LVStyleSheet::insert( LVCssSelector * item )
+{
+    lUInt16 id = item->getElementNameId();
+    if (_selectors.length()<=id)
+        _selectors.set(id, NULL);
+    // insert with specificity sorting
+    if ( _selectors[id] == NULL 
+        || _selectors[id]->getSpecificity() > item->getSpecificity() )
+    {
+        // insert as first item
+        item->setNext( _selectors[id] );
+        _selectors[id] = item;
+    }
+    else
+    {
+        // insert as internal item
+        for (LVCssSelector * p = _selectors[id]; p; p = p->getNext() )
+        {
+            if ( p->getNext() == NULL
+                || p->getNext()->getSpecificity() > item->getSpecificity() )
+            {
+                item->setNext( p->getNext() );
+                p->setNext( item );
+                break;
+            }
+        }
+    }
+}
+
+/// add rules from compiled stylesheet
+bool LVStyleSheet::restore( SerialBuf & buf )
+{
+    // compiled stylesheet has ids of names it refers to, followed by list of rules:
+    // declaration followed by its selectors, in the order they were placed to sheet when parsed
+    LVCssNameIds names;
+    if ( !names.read( buf, _doc ) )
+        return false;
+    LVPtrVector<LVCssSelector, false> items;
+    bool err = false;
+    while ( !err && buf.pos() < buf.size() ) {
+        LVCssDeclRef decl( new LVCssDeclaration );
+        lUInt32 count = 0;
+        if ( !decl->deserialize( buf ) )
+            err = true;
+        buf >> count;
+        for ( lUInt32 i=0; i<count && !err && !buf.error(); i++ ) {
+            LVCssSelector * selector = new LVCssSelector;
+            items.add( selector );
+            if ( !selector->deserialize( buf, _doc ) )
+                err = true;
+            selector->setDeclaration( decl );
+        }
+        if ( buf.error() )
+            err = true;
+    }
+    if ( err ) {
+        for ( int i=0; i<items.length(); i++ )
+            delete items[i];
+        return false;
+    }
+    names.allocate( _doc );
+    for ( int i=0; i<items.length(); i++ )
+        insert( items[i] );
+    return true;
+}
+
+bool LVStyleSheet::compile( const char * str, bool higher_importance, lString16 codeBase, SerialBuf * buf, LVCssNameIds * names )
 {
     LVCssSelector * selector = NULL;
     LVCssSelector * prev_selector;
@@ -3296,6 +3534,7 @@ bool LVStyleSheet::parse( const char * str, bool higher_importance, lString16 co
         // new rule
         prev_selector = NULL;
         bool err = false;
+        LVCssDeclRef decl;
         for (;*str;)
         {
             // parse selector(s)
@@ -3316,7 +3555,7 @@ bool LVStyleSheet::parse( const char * str, bool higher_importance, lString16 co
                 }
             }
             // parse declaration
-            LVCssDeclRef decl( new LVCssDeclaration );
+            decl = LVCssDeclRef( new LVCssDeclaration );
             if ( !decl->parse( str, higher_importance, _doc, codeBase ) )
             {
                 err = true;
@@ -3341,43 +3580,324 @@ bool LVStyleSheet::parse( const char * str, bool higher_importance, lString16 co
         }
         else
         {
+            if ( buf ) {
+                // record rule in the order its selectors are placed
+                decl->serialize( *buf );
+                lUInt32 count = 0;
+                for (LVCssSelector * p = selector; p; p = p->getNext() )
+                    count++;
+                *buf << count;
+                for (LVCssSelector * p = selector; p; p = p->getNext() )
+                    p->serialize( *buf, *names );
+            }
             // Ok:
             // place rules to sheet
             for (LVCssSelector * p = selector; p;  )
             {
                 LVCssSelector * item = p;
                 p=p->getNext();
-                lUInt16 id = item->getElementNameId();
-                if (_selectors.length()<=id)
-                    _selectors.set(id, NULL);
-                // insert with specificity sorting
-                if ( _selectors[id] == NULL 
-                    || _selectors[id]->getSpecificity() > item->getSpecificity() )
-                {
-                    // insert as first item
-                    item->setNext( _selectors[id] );
-                    _selectors[id] = item;
-                }
-                else
-                {
-                    // insert as internal item
-                    for (LVCssSelector * p = _selectors[id]; p; p = p->getNext() )
-                    {
-                        if ( p->getNext() == NULL
-                            || p->getNext()->getSpecificity() > item->getSpecificity() )
-                        {
-                            item->setNext( p->getNext() );
-                            p->setNext( item );
-                            break;
-                        }
-                    }
-                }
+                insert( item );
             }
         }
     }
     return _selectors.length() > 0;
 }
 
+#define STYLESHEET_CACHE_MAGIC "CR3CSS02"
+#define STYLESHEET_CACHE_FILE "cr3css.cache"
+#define STYLESHEET_CACHE_DEFAULT_MAX_SIZE 0x200000
+
+/// changes when codes written to compiled stylesheets are added or removed
+static lUInt32 styleSheetCodesStamp()
+{
+    lUInt32 stamp = cssd_stop;
+    stamp = stamp * 31 + cssrt_pseudoclass;
+    stamp = stamp * 31 + csspc_empty;
+    stamp = stamp * 31 + css_val_screen_px;
+    stamp = stamp * 31 + css_d_none;
+    return stamp;
+}
+
+/// compiled stylesheet with text hash and options it was parsed with
+struct LVStyleSheetCacheItem {
+    lUInt32 textCRC;
+    lUInt32 textLength;
+    lUInt32 codeBaseHash;
+    lUInt32 flags;
+    lUInt32 domVersion;
+    lUInt32 renderingFlags;
+    lUInt32 lastUse;
+    lUInt8 * data;
+    int size;
+    LVStyleSheetCacheItem() : lastUse(0), data(NULL), size(0) { }
+    ~LVStyleSheetCacheItem() { if ( data ) free( data ); }
+    bool sameKey( const LVStyleSheetCacheItem & v ) const
+    {
+        return textCRC == v.textCRC && textLength == v.textLength && codeBaseHash == v.codeBaseHash
+            && flags == v.flags && domVersion == v.domVersion && renderingFlags == v.renderingFlags;
+    }
+};
+
+class LVStyleSheetCacheImpl {
+    LVPtrVector<LVStyleSheetCacheItem> _items;
+    int _size;
+    int _maxSize;
+    lUInt32 _useCounter;
+    lString16 _dir;
+    bool _changed; // there are items not saved yet
+
+    static int compareLastUse( const LVStyleSheetCacheItem ** item1, const LVStyleSheetCacheItem ** item2 )
+    {
+        if ( (*item1)->lastUse != (*item2)->lastUse )
+            return (*item1)->lastUse < (*item2)->lastUse ? -1 : 1;
+        return 0;
+    }
+
+    /// remove least recently used items until cache size fits max size
+    void evict()
+    {
+        if ( _size <= _maxSize )
+            return;
+        _items.sort( compareLastUse );
+        while ( _items.length() && _size > _maxSize ) {
+            LVStyleSheetCacheItem * item = _items.remove( 0 );
+            _size -= item->size;
+            delete item;
+            _changed = true;
+        }
+    }
+
+    void add( LVStyleSheetCacheItem * item )
+    {
+        _items.add( item );
+        _size += item->size;
+        if ( item->lastUse > _useCounter )
+            _useCounter = item->lastUse;
+    }
+
+    void load()
+    {
+        LVStreamRef stream = LVOpenFileStream( (_dir + STYLESHEET_CACHE_FILE).c_str(), LVOM_READ );
+        if ( stream.isNull() )
+            return;
+        LVStreamBufferRef sb = stream->GetReadBuffer( 0, stream->GetSize() );
+        if ( sb.isNull() )
+            return;
+        SerialBuf buf( sb->getReadOnly(), sb->getSize() );
+        if ( !buf.checkMagic( STYLESHEET_CACHE_MAGIC ) ) {
+            CRLog::error("wrong stylesheet cache file format");
+            return;
+        }
+        int start = buf.pos();
+        // compiled rules are meaningful for the engine version which wrote them only
+        lString8 version;
+        lUInt32 stamp = 0;
+        buf >> version >> stamp;
+        if ( buf.error() || version != gCacheFileFormatVersion || stamp != styleSheetCodesStamp() ) {
+            CRLog::info("stylesheet cache file is written by other engine version, dropped");
+            return;
+        }
+        lUInt32 count = 0;
+        buf >> count;
+        LVPtrVector<LVStyleSheetCacheItem> items;
+        for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+            LVStyleSheetCacheItem * item = new LVStyleSheetCacheItem();
+            items.add( item );
+            lUInt32 size = 0;
+            buf >> item->textCRC >> item->textLength >> item->codeBaseHash >> item->flags
+                >> item->domVersion >> item->renderingFlags >> item->lastUse >> size;
+            if ( buf.error() || (int)size > buf.space() ) {
+                buf.seterror();
+                break;
+            }
+            item->data = (lUInt8*)malloc( size );
+            item->size = size;
+            memcpy( item->data, buf.buf() + buf.pos(), size );
+            buf.setPos( buf.pos() + size );
+        }
+        if ( buf.error() || !buf.checkCRC( buf.pos() - start ) ) {
+            CRLog::error("stylesheet cache file is corrupted");
+            return;
+        }
+        while ( items.length() )
+            add( items.remove( 0 ) );
+        CRLog::info("%d compiled stylesheets read from cache, %d bytes", _items.length(), _size);
+    }
+public:
+    int hits;
+    int misses;
+
+    LVStyleSheetCacheImpl()
+        : _size(0), _maxSize(STYLESHEET_CACHE_DEFAULT_MAX_SIZE), _useCounter(0), _changed(false)
+        , hits(0), misses(0)
+    { }
+
+    bool enabled() { return _maxSize > 0; }
+
+    LVStyleSheetCacheItem * find( const LVStyleSheetCacheItem & key )
+    {
+        for ( int i=0; i<_items.length(); i++ ) {
+            if ( _items[i]->sameKey( key ) ) {
+                _items[i]->lastUse = ++_useCounter;
+                hits++;
+                return _items[i];
+            }
+        }
+        misses++;
+        return NULL;
+    }
+
+    void remove( LVStyleSheetCacheItem * item )
+    {
+        for ( int i=0; i<_items.length(); i++ ) {
+            if ( _items[i] == item ) {
+                _items.remove( i );
+                _size -= item->size;
+                delete item;
+                _changed = true;
+                return;
+            }
+        }
+    }
+
+    void put( const LVStyleSheetCacheItem & key, SerialBuf & buf )
+    {
+        if ( buf.error() || buf.pos() > _maxSize )
+            return;
+        LVStyleSheetCacheItem * item = new LVStyleSheetCacheItem( key );
+        item->lastUse = ++_useCounter;
+        item->size = buf.pos();
+        item->data = (lUInt8*)malloc( item->size );
+        memcpy( item->data, buf.buf(), item->size );
+        add( item );
+        _changed = true;
+        evict();
+    }
+
+    void save()
+    {
+        if ( !_changed || _dir.empty() )
+            return;
+        SerialBuf buf( _size + 1024, true );
+        buf.putMagic( STYLESHEET_CACHE_MAGIC );
+        int start = buf.pos();
+        buf << lString8( gCacheFileFormatVersion ) << styleSheetCodesStamp();
+        buf << (lUInt32)_items.length();
+        for ( int i=0; i<_items.length(); i++ ) {
+            LVStyleSheetCacheItem * item = _items[i];
+            buf << item->textCRC << item->textLength << item->codeBaseHash << item->flags
+                << item->domVersion << item->renderingFlags << item->lastUse << (lUInt32)item->size;
+            SerialBuf data( item->data, item->size );
+            data.setPos( item->size );
+            buf << data;
+        }
+        buf.putCRC( buf.pos() - start );
+        if ( buf.error() )
+            return;
+        LVStreamRef stream = LVOpenFileStream( (_dir + STYLESHEET_CACHE_FILE).c_str(), LVOM_WRITE );
+        if ( stream.isNull() || stream->Write( buf.buf(), buf.pos(), NULL ) != LVERR_OK ) {
+            CRLog::error("Cannot write stylesheet cache file");
+            return;
+        }
+        _changed = false;
+        CRLog::debug("%d compiled stylesheets saved to cache, %d bytes (%d hits, %d misses)", _items.length(), _size, hits, misses);
+    }
+
+    void clear()
+    {
+        _items.clear();
+        _size = 0;
+        _changed = false;
+        if ( !_dir.empty() )
+            LVDeleteFile( _dir + STYLESHEET_CACHE_FILE );
+    }
+
+    void setCacheDir( lString16 dir )
+    {
+        save();
+        _items.clear();
+        _size = 0;
+        _changed = false;
+        _dir = dir;
+        if ( _dir.empty() )
+            return;
+        LVAppendPathDelimiter( _dir );
+        load();
+        evict();
+    }
+
+    void setMaxSize( int size )
+    {
+        _maxSize = size;
+        evict();
+    }
+};
+
+static LVStyleSheetCacheImpl _styleSheetCache;
+
+/// set directory to keep compiled stylesheets in, empty to keep them in memory only
+void LVStyleSheetCache::setCacheDir( lString16 dir )
+{
+    _styleSheetCache.setCacheDir( dir );
+}
+
+/// set max size of compiled stylesheets kept, 0 disables cache
+void LVStyleSheetCache::setMaxSize( int size )
+{
+    _styleSheetCache.setMaxSize( size );
+}
+
+/// write compiled stylesheets to cache directory, if there are new ones
+void LVStyleSheetCache::save()
+{
+    _styleSheetCache.save();
+}
+
+/// remove all compiled stylesheets, from memory and cache directory
+void LVStyleSheetCache::clear()
+{
+    _styleSheetCache.clear();
+}
+
+bool LVStyleSheet::parse( const char * str, bool higher_importance, lString16 codeBase )
+{
+    if ( !_doc || !_styleSheetCache.enabled() || !str || !*str )
+        return compile( str, higher_importance, codeBase, NULL, NULL );
+    // compiled rules depend on text and on everything parsing checks besides it
+    LVStyleSheetCacheItem key;
+    key.textLength = (lUInt32)strlen( str );
+    key.textCRC = lStr_crc32( 0, str, key.textLength );
+    key.codeBaseHash = codeBase.getHash();
+    key.flags = ( higher_importance ? 1 : 0 )
+        | ( _doc->getProps()->getIntDef(DOC_PROP_FILE_FORMAT_ID, doc_format_none) == doc_format_epub ? 2 : 0 );
+    key.domVersion = (lUInt32)gDOMVersionRequested;
+    key.renderingFlags = (lUInt32)gRenderBlockRenderingFlags;
+    LVStyleSheetCacheItem * item = _styleSheetCache.find( key );
+    if ( item ) {
+        SerialBuf buf( item->data, item->size );
+        if ( restore( buf ) )
+            return _selectors.length() > 0;
+        // expected when document has other ids for names the rules refer to: replaced below
+        CRLog::debug("Cannot restore compiled stylesheet, parsing it");
+        _styleSheetCache.remove( item );
+    }
+    lUInt16 elementStart = _doc->getNextUnknownElementId();
+    lUInt16 attrStart = _doc->getNextUnknownAttrId();
+    SerialBuf rules( 4096, true );
+    LVCssNameIds names;
+    bool res = compile( str, higher_importance, codeBase, &rules, &names );
+    // names allocated by rules which were skipped still change ids of next ones
+    for ( lUInt16 id = elementStart; id < _doc->getNextUnknownElementId(); id++ )
+        names.addElement( id );
+    for ( lUInt16 id = attrStart; id < _doc->getNextUnknownAttrId(); id++ )
+        names.addAttr( id );
+    SerialBuf buf( rules.pos() + 1024, true );
+    names.serialize( buf, _doc );
+    buf << rules;
+    _styleSheetCache.put( key, buf );
+    return res;
+}
+
 /// extract @import filename from beginning of CSS
 bool LVProcessStyleSheetImport( const char * &str, lString8 & import_file )
 {
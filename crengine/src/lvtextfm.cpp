@@ -65,35 +65,129 @@
 #define FRM_ALLOC_SIZE 16
 #define FLT_ALLOC_SIZE 4
 
-formatted_line_t * lvtextAllocFormattedLine( )
+// Formatted lines, words and floats are carved from a per-buffer bump
+// allocator: they all live until the next Format() or the buffer is freed,
+// so individual calloc/free calls are not needed. Chunks are kept on reset
+// and reused by the next Format() of the same buffer.
+#define ARENA_MIN_CHUNK_SIZE 1024
+#define ARENA_MAX_CHUNK_SIZE 65536
+#define ARENA_ALIGN(sz) (((sz) + 7) & ~((size_t)7))
+
+struct lvtext_arena_chunk_t {
+    lvtext_arena_chunk_t * next;
+    size_t size;
+    size_t used;
+    lUInt8 * data() { return (lUInt8*)this + ARENA_ALIGN(sizeof(lvtext_arena_chunk_t)); }
+};
+
+struct lvtext_arena_t {
+    lvtext_arena_chunk_t * first;
+    lvtext_arena_chunk_t * current;
+};
+
+static void * lvtextArenaAlloc( formatted_text_fragment_t * pbuffer, size_t size )
 {
-    formatted_line_t * pline = (formatted_line_t *)calloc(1, sizeof(*pline));
-    return pline;
+    size = ARENA_ALIGN(size);
+    lvtext_arena_t * arena = pbuffer->arena;
+    if ( !arena )
+        arena = pbuffer->arena = (lvtext_arena_t*)calloc(1, sizeof(lvtext_arena_t));
+    lvtext_arena_chunk_t * chunk = arena->current;
+    while ( chunk && chunk->used + size > chunk->size ) {
+        // move to the next chunk left from a previous Format(), if any
+        chunk = chunk->next;
+        if ( chunk )
+            chunk->used = 0;
+    }
+    if ( !chunk ) {
+        size_t chunkSize = arena->current ? arena->current->size * 2 : ARENA_MIN_CHUNK_SIZE;
+        if ( chunkSize > ARENA_MAX_CHUNK_SIZE )
+            chunkSize = ARENA_MAX_CHUNK_SIZE;
+        if ( chunkSize < size )
+            chunkSize = size;
+        chunk = (lvtext_arena_chunk_t*)malloc( ARENA_ALIGN(sizeof(lvtext_arena_chunk_t)) + chunkSize );
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        if ( arena->current ) {
+            // insert after the current one, before the (too small) remaining ones
+            chunk->next = arena->current->next;
+            arena->current->next = chunk;
+        } else {
+            chunk->next = NULL;
+            arena->first = chunk;
+        }
+    }
+    arena->current = chunk;
+    void * res = chunk->data() + chunk->used;
+    chunk->used += size;
+    return res;
 }
 
-formatted_line_t * lvtextAllocFormattedLineCopy( formatted_word_t * words, int word_count )
+/// grow block allocated by lvtextArenaAlloc: in place when it is the last allocated one
+static void * lvtextArenaGrow( formatted_text_fragment_t * pbuffer, void * ptr, size_t oldSize, size_t newSize )
 {
-    formatted_line_t * pline = (formatted_line_t *)calloc(1, sizeof(*pline));
-    lUInt32 size = (word_count + FRM_ALLOC_SIZE-1) / FRM_ALLOC_SIZE * FRM_ALLOC_SIZE;
-    pline->words = (formatted_word_t*)malloc( sizeof(formatted_word_t)*(size) );
-    memcpy( pline->words, words, word_count * sizeof(formatted_word_t) );
+    if ( ptr ) {
+        lvtext_arena_chunk_t * chunk = pbuffer->arena->current;
+        oldSize = ARENA_ALIGN(oldSize);
+        newSize = ARENA_ALIGN(newSize);
+        if ( (lUInt8*)ptr + oldSize == chunk->data() + chunk->used
+                && chunk->used - oldSize + newSize <= chunk->size ) {
+            chunk->used = chunk->used - oldSize + newSize;
+            return ptr;
+        }
+    }
+    void * res = lvtextArenaAlloc( pbuffer, newSize );
+    if ( ptr )
+        memcpy( res, ptr, oldSize );
+    return res;
+}
+
+/// make all arena memory available again, keeping allocated chunks
+static void lvtextArenaReset( lvtext_arena_t * arena )
+{
+    if ( !arena || !arena->first )
+        return;
+    arena->first->used = 0;
+    arena->current = arena->first;
+}
+
+static void lvtextArenaFree( lvtext_arena_t * arena )
+{
+    if ( !arena )
+        return;
+    lvtext_arena_chunk_t * chunk = arena->first;
+    while ( chunk ) {
+        lvtext_arena_chunk_t * next = chunk->next;
+        free( chunk );
+        chunk = next;
+    }
+    free( arena );
+}
+
+formatted_line_t * lvtextAllocFormattedLine( formatted_text_fragment_t * pbuffer )
+{
+    formatted_line_t * pline = (formatted_line_t *)lvtextArenaAlloc(pbuffer, sizeof(*pline));
+    memset( pline, 0, sizeof(*pline) );
     return pline;
 }
 
-void lvtextFreeFormattedLine( formatted_line_t * pline )
+formatted_line_t * lvtextAllocFormattedLineCopy( formatted_text_fragment_t * pbuffer, formatted_word_t * words, int word_count )
 {
-    if (pline->words)
-        free( pline->words );
-    free(pline);
+    formatted_line_t * pline = lvtextAllocFormattedLine(pbuffer);
+    lUInt32 size = (word_count + FRM_ALLOC_SIZE-1) / FRM_ALLOC_SIZE * FRM_ALLOC_SIZE;
+    pline->words = (formatted_word_t*)lvtextArenaAlloc( pbuffer, sizeof(formatted_word_t)*(size) );
+    memcpy( pline->words, words, word_count * sizeof(formatted_word_t) );
+    pline->word_count = word_count;
+    return pline;
 }
 
-formatted_word_t * lvtextAddFormattedWord( formatted_line_t * pline )
+formatted_word_t * lvtextAddFormattedWord( formatted_text_fragment_t * pbuffer, formatted_line_t * pline )
 {
     int size = (pline->word_count + FRM_ALLOC_SIZE-1) / FRM_ALLOC_SIZE * FRM_ALLOC_SIZE;
     if ( pline->word_count >= size)
     {
-        size += FRM_ALLOC_SIZE;
-        pline->words = cr_realloc( pline->words, size );
+        // words of the line being formatted are usually the last arena block, so this grows in place
+        pline->words = (formatted_word_t*)lvtextArenaGrow( pbuffer, pline->words,
+                sizeof(formatted_word_t)*size, sizeof(formatted_word_t)*(size + FRM_ALLOC_SIZE) );
     }
     return &pline->words[ pline->word_count++ ];
 }
@@ -106,7 +200,7 @@ formatted_line_t * lvtextAddFormattedLine( formatted_text_fragment_t * pbuffer )
         size += FRM_ALLOC_SIZE;
         pbuffer->frmlines = cr_realloc( pbuffer->frmlines, size );
     }
-    return (pbuffer->frmlines[ pbuffer->frmlinecount++ ] = lvtextAllocFormattedLine());
+    return (pbuffer->frmlines[ pbuffer->frmlinecount++ ] = lvtextAllocFormattedLine(pbuffer));
 }
 
 formatted_line_t * lvtextAddFormattedLineCopy( formatted_text_fragment_t * pbuffer, formatted_word_t * words, int words_count )
@@ -117,12 +211,13 @@ formatted_line_t * lvtextAddFormattedLineCopy( formatted_text_fragment_t * pbuff
         size += FRM_ALLOC_SIZE;
         pbuffer->frmlines = cr_realloc( pbuffer->frmlines, size );
     }
-    return (pbuffer->frmlines[ pbuffer->frmlinecount++ ] = lvtextAllocFormattedLineCopy(words, words_count));
+    return (pbuffer->frmlines[ pbuffer->frmlinecount++ ] = lvtextAllocFormattedLineCopy(pbuffer, words, words_count));
 }
 
-embedded_float_t * lvtextAllocEmbeddedFloat( )
+embedded_float_t * lvtextAllocEmbeddedFloat( formatted_text_fragment_t * pbuffer )
 {
-    embedded_float_t * flt = (embedded_float_t *)calloc(1, sizeof(*flt));
+    embedded_float_t * flt = (embedded_float_t *)lvtextArenaAlloc(pbuffer, sizeof(*flt));
+    memset( flt, 0, sizeof(*flt) );
     return flt;
 }
 
@@ -134,10 +229,9 @@ embedded_float_t * lvtextAddEmbeddedFloat( formatted_text_fragment_t * pbuffer )
         size += FLT_ALLOC_SIZE;
         pbuffer->floats = cr_realloc( pbuffer->floats, size );
     }
-    return (pbuffer->floats[ pbuffer->floatcount++ ] = lvtextAllocEmbeddedFloat());
+    return (pbuffer->floats[ pbuffer->floatcount++ ] = lvtextAllocEmbeddedFloat(pbuffer));
 }
 
-
 formatted_text_fragment_t * lvtextAllocFormatter( lUInt16 width )
 {
     formatted_text_fragment_t * pbuffer = (formatted_text_fragment_t*)calloc(1, sizeof(*pbuffer));
@@ -175,13 +269,7 @@ void lvtextFreeFormatter( formatted_text_fragment_t * pbuffer )
         free( pbuffer->srctext );
     }
     if (pbuffer->frmlines)
-    {
-        for (int i=0; i<pbuffer->frmlinecount; i++)
-        {
-            lvtextFreeFormattedLine( pbuffer->frmlines[i] );
-        }
         free( pbuffer->frmlines );
-    }
     if (pbuffer->floats)
     {
         for (int i=0; i<pbuffer->floatcount; i++)
@@ -189,10 +277,10 @@ void lvtextFreeFormatter( formatted_text_fragment_t * pbuffer )
             if (pbuffer->floats[i]->links) {
                 delete pbuffer->floats[i]->links;
             }
-            free(pbuffer->floats[i]);
         }
         free( pbuffer->floats );
     }
+    lvtextArenaFree( pbuffer->arena );
     free(pbuffer);
 }
 
@@ -290,6 +378,8 @@ void lvtextAddSourceObject(
 #ifdef __cplusplus
 
 #define DUMMY_IMAGE_SIZE 16
+// max image height standing for no limit (1000*max height must not overflow)
+#define IMAGE_UNLIMITED_MAX_HEIGHT 1000000
 
 bool gFlgFloatingPunctuationEnabled = true;
 
@@ -372,6 +462,56 @@ void LFormattedText::AddSourceObject(
         flags, interval, valign_dy, margin, object, letter_spacing );
 }
 
+#define STATIC_BUFS_SIZE 8192
+#define MAX_TEXT_CHUNK_SIZE 4096
+#define MAX_LINE_SIZE 4096
+
+/// per-thread scratch buffers, so that formatting can run concurrently from several threads
+struct LVFormatterScratch {
+    // paragraph buffers: used by a single formatter at once (a nested one uses dynamic buffers)
+    bool    parBufsInUse;
+    lChar16 text[STATIC_BUFS_SIZE];
+    lUInt16 flags[STATIC_BUFS_SIZE];
+    src_text_fragment_t * srcs[STATIC_BUFS_SIZE];
+    lUInt16 charindex[STATIC_BUFS_SIZE];
+    int     widths[STATIC_BUFS_SIZE];
+    #if (USE_FRIBIDI==1)
+        FriBidiCharType bidi_ctypes[STATIC_BUFS_SIZE];
+        FriBidiBracketType bidi_btypes[STATIC_BUFS_SIZE];
+        FriBidiLevel bidi_levels[STATIC_BUFS_SIZE];
+    #endif
+    // measureText() buffers
+    lUInt16 measure_widths[MAX_TEXT_CHUNK_SIZE+1];
+    lUInt8  measure_flags[MAX_TEXT_CHUNK_SIZE+1];
+    #if (USE_FRIBIDI==1)
+        // line reordering buffers
+        lChar16 bidi_tmp_text[MAX_LINE_SIZE];
+        lUInt16 bidi_tmp_flags[MAX_LINE_SIZE];
+        src_text_fragment_t * bidi_tmp_srcs[MAX_LINE_SIZE];
+        lUInt16 bidi_tmp_charindex[MAX_LINE_SIZE];
+        int     bidi_tmp_widths[MAX_LINE_SIZE];
+        FriBidiStrIndex bidi_indices_map[MAX_LINE_SIZE];
+    #endif
+
+    /// returns scratch buffers of the calling thread, allocated on first use
+    static LVFormatterScratch * get();
+};
+
+class LVFormatterScratchHolder {
+public:
+    LVFormatterScratch * scratch;
+    LVFormatterScratchHolder() : scratch(NULL) { }
+    ~LVFormatterScratchHolder() { free( scratch ); }
+};
+
+LVFormatterScratch * LVFormatterScratch::get()
+{
+    static thread_local LVFormatterScratchHolder holder;
+    if ( !holder.scratch )
+        holder.scratch = (LVFormatterScratch*)calloc(1, sizeof(LVFormatterScratch));
+    return holder.scratch;
+}
+
 class LVFormatter {
 public:
     //LVArray<lUInt16>  widths_buf;
@@ -380,7 +520,8 @@ public:
     int       m_length;
     int       m_size;
     bool      m_staticBufs;
-    static bool      m_staticBufs_inUse;
+    LVFormatterScratch * m_scratch;
+    LVFormatterScratch * m_parScratch; // scratch paragraph buffers, NULL when already used by an outer formatter
     lChar16 * m_text;
     lUInt16 * m_flags;
     src_text_fragment_t * * m_srcs;
@@ -388,6 +529,7 @@ public:
     int *     m_widths;
     int m_y;
     int m_max_img_height;
+    ldomDocument * m_max_img_doc; // document to note page heights giving the same image sizes
     bool m_has_images;
     bool m_has_float_to_position;
     bool m_has_ongoing_float;
@@ -418,7 +560,13 @@ public:
     LVFormatter(formatted_text_fragment_t * pbuffer)
     : m_pbuffer(pbuffer), m_length(0), m_size(0), m_staticBufs(true), m_y(0)
     {
-        if (m_staticBufs_inUse)
+        m_scratch = LVFormatterScratch::get();
+        m_parScratch = NULL;
+        if ( !m_scratch->parBufsInUse ) {
+            m_parScratch = m_scratch;
+            m_parScratch->parBufsInUse = true;
+        }
+        else
             m_staticBufs = false;
         m_text = NULL;
         m_flags = NULL;
@@ -427,6 +575,7 @@ public:
         m_widths = NULL;
         m_has_images = false,
         m_max_img_height = -1;
+        m_max_img_doc = NULL;
         m_has_float_to_position = false;
         m_has_ongoing_float = false;
         m_no_clear_own_floats = false;
@@ -441,6 +590,9 @@ public:
 
     ~LVFormatter()
     {
+        dealloc();
+        if ( m_parScratch )
+            m_parScratch->parBufsInUse = false;
     }
 
     // Embedded floats positionning helpers.
@@ -800,6 +952,7 @@ public:
                         m_max_img_height -= node->getSurroundingAddedHeight();
                         // remove height taken by the strut baseline
                         m_max_img_height -= (m_pbuffer->strut_height - m_pbuffer->strut_baseline);
+                        m_max_img_doc = node->getDocument();
                         m_has_images = true;
                     }
                 }
@@ -813,7 +966,7 @@ public:
         m_length = pos;
 
         TR("allocate(%d)", m_length);
-        // We start with static buffers, but when m_length reaches STATIC_BUFS_SIZE,
+        // We start with per-thread scratch buffers, but when m_length reaches STATIC_BUFS_SIZE,
         // we switch to dynamic buffers and we keep using them (realloc'ating when
         // needed).
         // The code in this file will fill these buffers with m_length items, so
@@ -828,11 +981,10 @@ public:
         // to zero the additional slot seems enough, as all previous slots seems
         // to be correctly filled.)
 
-#define STATIC_BUFS_SIZE 8192
 #define ITEMS_RESERVED 16
 
         // "m_length+1" to keep room for the additional slot to be zero'ed
-        if ( !m_staticBufs || m_length+1 > STATIC_BUFS_SIZE ) {
+        if ( !m_staticBufs || !m_parScratch || m_length+1 > STATIC_BUFS_SIZE ) {
             // if (!m_staticBufs && m_text == NULL) printf("allocating dynamic buffers\n");
             if ( m_length+1 > m_size ) {
                 // realloc
@@ -853,29 +1005,18 @@ public:
             }
             m_staticBufs = false;
         } else {
-            // static buffer space
-            static lChar16 m_static_text[STATIC_BUFS_SIZE];
-            static lUInt16 m_static_flags[STATIC_BUFS_SIZE];
-            static src_text_fragment_t * m_static_srcs[STATIC_BUFS_SIZE];
-            static lUInt16 m_static_charindex[STATIC_BUFS_SIZE];
-            static int m_static_widths[STATIC_BUFS_SIZE];
-            #if (USE_FRIBIDI==1)
-                static FriBidiCharType m_static_bidi_ctypes[STATIC_BUFS_SIZE];
-                static FriBidiBracketType m_static_bidi_btypes[STATIC_BUFS_SIZE];
-                static FriBidiLevel m_static_bidi_levels[STATIC_BUFS_SIZE];
-            #endif
-            m_text = m_static_text;
-            m_flags = m_static_flags;
-            m_charindex = m_static_charindex;
-            m_srcs = m_static_srcs;
-            m_widths = m_static_widths;
+            // per-thread scratch buffer space
+            m_text = m_parScratch->text;
+            m_flags = m_parScratch->flags;
+            m_charindex = m_parScratch->charindex;
+            m_srcs = m_parScratch->srcs;
+            m_widths = m_parScratch->widths;
             m_staticBufs = true;
-            m_staticBufs_inUse = true;
             // printf("using static buffers\n");
             #if (USE_FRIBIDI==1)
-                m_bidi_ctypes = m_static_bidi_ctypes;
-                m_bidi_btypes = m_static_bidi_btypes;
-                m_bidi_levels = m_static_bidi_levels;
+                m_bidi_ctypes = m_parScratch->bidi_ctypes;
+                m_bidi_btypes = m_parScratch->bidi_btypes;
+                m_bidi_levels = m_parScratch->bidi_levels;
             #endif
         }
         memset( m_flags, 0, sizeof(lUInt16)*m_length ); // start with all flags set to zero
@@ -1192,6 +1333,44 @@ public:
     }
 
     void resizeImage( int & width, int & height, int maxw, int maxh, bool isInline )
+    {
+        int w = width;
+        int h = height;
+        resizeImageToFit( width, height, maxw, maxh, isInline );
+        if ( !m_max_img_doc || maxh != m_max_img_height )
+            return;
+        int pageHeight = m_pbuffer->page_height;
+        if ( w <= 0 || h <= 0 || maxw <= 0 || maxh <= 0 ) {
+            // not resized as usual: don't guess
+            m_max_img_doc->limitRenderPageHeight( pageHeight, pageHeight );
+            return;
+        }
+        // Let document know for which page heights this image gets the same size:
+        // find smallest max height giving the size we get without any height limit
+        int unlimitedWidth = w;
+        int unlimitedHeight = h;
+        resizeImageToFit( unlimitedWidth, unlimitedHeight, maxw, IMAGE_UNLIMITED_MAX_HEIGHT, isInline );
+        if ( width != unlimitedWidth || height != unlimitedHeight ) {
+            // image is limited by page height
+            m_max_img_doc->limitRenderPageHeight( pageHeight, pageHeight );
+            return;
+        }
+        int lo = 1;
+        int hi = maxh;
+        while ( lo < hi ) {
+            int mid = (lo + hi) / 2;
+            int tw = w;
+            int th = h;
+            resizeImageToFit( tw, th, maxw, mid, isInline );
+            if ( tw == unlimitedWidth && th == unlimitedHeight )
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        m_max_img_doc->limitRenderPageHeight( lo + pageHeight - maxh );
+    }
+
+    void resizeImageToFit( int & width, int & height, int maxw, int maxh, bool isInline )
     {
         //CRLog::trace("Resize image (%dx%d) max %dx%d %s", width, height, maxw, maxh, isInline ? "inline" : "block");
         bool arbitraryImageScaling = false;
@@ -1324,10 +1503,10 @@ public:
         src_text_fragment_t * srcline = &m_pbuffer->srctext[word->src_text_index];
         LVFont * srcfont= (LVFont *) srcline->t.font;
         const lChar16 * str = srcline->t.text + word->t.start;
-        // Avoid malloc by using static buffers. Returns false if word too long.
+        // Avoid malloc by using stack buffers. Returns false if word too long.
         #define MAX_MEASURED_WORD_SIZE 127
-        static lUInt16 widths[MAX_MEASURED_WORD_SIZE+1];
-        static lUInt8 flags[MAX_MEASURED_WORD_SIZE+1];
+        lUInt16 widths[MAX_MEASURED_WORD_SIZE+1];
+        lUInt8 flags[MAX_MEASURED_WORD_SIZE+1];
         if (word->t.len > MAX_MEASURED_WORD_SIZE)
             return false;
         lUInt32 hints = WORD_FLAGS_TO_FNT_FLAGS(word->flags);
@@ -1353,9 +1532,8 @@ public:
         lInt16 lastLetterSpacing = 0;
         int start = 0;
         int lastWidth = 0;
-        #define MAX_TEXT_CHUNK_SIZE 4096
-        static lUInt16 widths[MAX_TEXT_CHUNK_SIZE+1];
-        static lUInt8 flags[MAX_TEXT_CHUNK_SIZE+1];
+        lUInt16 * widths = m_scratch->measure_widths;
+        lUInt8 * flags = m_scratch->measure_flags;
         int tabIndex = -1;
         #if (USE_FRIBIDI==1)
             FriBidiLevel lastBidiLevel = 0;
@@ -1874,17 +2052,16 @@ public:
             // make 1000 glyphs, which with a small font of width 4px, would
             // allow them to be displayed on a 4000px screen.
             // Increase that if not enough.)
-            #define MAX_LINE_SIZE 4096
             if ( end-start > MAX_LINE_SIZE ) {
                 // Show a warning and truncate to avoid a segfault.
                 printf("CRE WARNING: bidi processing line overflow (%d > %d)\n", end-start, MAX_LINE_SIZE);
                 end = start + MAX_LINE_SIZE;
             }
-            static lChar16 bidi_tmp_text[MAX_LINE_SIZE];
-            static lUInt16 bidi_tmp_flags[MAX_LINE_SIZE];
-            static src_text_fragment_t * bidi_tmp_srcs[MAX_LINE_SIZE];
-            static lUInt16 bidi_tmp_charindex[MAX_LINE_SIZE];
-            static int     bidi_tmp_widths[MAX_LINE_SIZE];
+            lChar16 * bidi_tmp_text = m_scratch->bidi_tmp_text;
+            lUInt16 * bidi_tmp_flags = m_scratch->bidi_tmp_flags;
+            src_text_fragment_t * * bidi_tmp_srcs = m_scratch->bidi_tmp_srcs;
+            lUInt16 * bidi_tmp_charindex = m_scratch->bidi_tmp_charindex;
+            int *     bidi_tmp_widths = m_scratch->bidi_tmp_widths;
             // Map of string indices which is reordered to reflect where each
             // glyph ends up. Note that fribidi will access it starting
             // from 0 (and not from 'start'): this would need us to allocate
@@ -1894,7 +2071,7 @@ public:
             // if some other part than [start:end] would be accessed, but
             // we know fribid doesn't - by contract as it shouldn't reorder
             // any other part except between start:end).
-            static FriBidiStrIndex bidi_indices_map[MAX_LINE_SIZE];
+            FriBidiStrIndex * bidi_indices_map = m_scratch->bidi_indices_map;
             for (int i=start; i<end; i++) {
                 bidi_indices_map[i-start] = i;
             }
@@ -2266,7 +2443,7 @@ public:
                     }
                 }
 
-                formatted_word_t * word = lvtextAddFormattedWord(frmline);
+                formatted_word_t * word = lvtextAddFormattedWord(m_pbuffer, frmline);
                 src_text_fragment_t * srcline = m_srcs[wstart];
                 // This LTEXT_VALIGN_ flag is now only of use with objects (images)
                 int vertical_align_flag = srcline->flags & LTEXT_VALIGN_MASK;
@@ -3106,7 +3283,7 @@ public:
                     // flags on our upgraded (from lUInt8 to lUInt16) m_flags.
                     lUInt8 * flags = (lUInt8*) (m_flags + start);
                     // Fill static array with cumulative widths relative to word start
-                    static lUInt16 widths[MAX_WORD_SIZE];
+                    lUInt16 widths[MAX_WORD_SIZE];
                     int wordStart_w = start>0 ? m_widths[start-1] : 0;
                     for ( int i=0; i<len; i++ ) {
                         widths[i] = m_widths[start+i] - wordStart_w;
@@ -3312,10 +3489,6 @@ public:
             m_staticBufs = true;
             // printf("freeing dynamic buffers\n");
         }
-        else {
-            m_staticBufs_inUse = false;
-            // printf("releasing static buffers\n");
-        }
     }
 
     /// format source data
@@ -3330,19 +3503,11 @@ public:
     }
 };
 
-bool LVFormatter::m_staticBufs_inUse = false;
-
 static void freeFrmLines( formatted_text_fragment_t * m_pbuffer )
 {
     // clear existing formatted data, if any
     if (m_pbuffer->frmlines)
-    {
-        for (int i=0; i<m_pbuffer->frmlinecount; i++)
-        {
-            lvtextFreeFormattedLine( m_pbuffer->frmlines[i] );
-        }
         free( m_pbuffer->frmlines );
-    }
     m_pbuffer->frmlines = NULL;
     m_pbuffer->frmlinecount = 0;
 
@@ -3354,12 +3519,14 @@ static void freeFrmLines( formatted_text_fragment_t * m_pbuffer )
             if (m_pbuffer->floats[i]->links) {
                 delete m_pbuffer->floats[i]->links;
             }
-            free( m_pbuffer->floats[i] );
         }
         free( m_pbuffer->floats );
     }
     m_pbuffer->floats = NULL;
     m_pbuffer->floatcount = 0;
+
+    // lines, words and floats memory is kept for reuse
+    lvtextArenaReset( m_pbuffer->arena );
 }
 
 // experimental formatter
@@ -3558,7 +3725,7 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
     // We might need to translate "marks" (native highlights) from relative
     // coordinates to absolute coordinates if we have to draw floats or
     // inlineBoxes: we'll do that when dealing with the first of these if any.
-    ldomMarkedRangeList * absmarks = new ldomMarkedRangeList();
+    ldomMarkedRangeList absmarks;
     bool absmarks_update_needed = marks!=NULL && marks->length()>0;
 
     // printf("x/y: %d/%d clip.top/bottom: %d %d\n", x, y, clip.top, clip.bottom);
@@ -3699,10 +3866,10 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                     int dy = m_pbuffer->page_height;
                     int page_height = m_pbuffer->page_height;
                     if ( absmarks_update_needed ) {
-                        getAbsMarksFromMarks(marks, absmarks, node);
+                        getAbsMarksFromMarks(marks, &absmarks, node);
                         absmarks_update_needed = false;
                     }
-                    DrawDocument( *buf, node, x0, y0, dx, dy, doc_x, doc_y, page_height, absmarks, bookmarks );
+                    DrawDocument( *buf, node, x0, y0, dx, dy, doc_x, doc_y, page_height, &absmarks, bookmarks );
                 }
                 else
                 {
@@ -3826,13 +3993,12 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
             int dy = m_pbuffer->page_height;
             int page_height = m_pbuffer->page_height;
             if ( absmarks_update_needed ) {
-                getAbsMarksFromMarks(marks, absmarks, node);
+                getAbsMarksFromMarks(marks, &absmarks, node);
                 absmarks_update_needed = false;
             }
-            DrawDocument( *buf, node, x0, y0, dx, dy, doc_x, doc_y, page_height, absmarks, bookmarks );
+            DrawDocument( *buf, node, x0, y0, dx, dy, doc_x, doc_y, page_height, &absmarks, bookmarks );
         }
     }
-    delete absmarks;
 }
 
 #endif
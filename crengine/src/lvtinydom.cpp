@@ -67,7 +67,9 @@ int gDOMVersionRequested     = DOM_VERSION_CURRENT;
 
 /// change in case of incompatible changes in swap/cache file format to avoid using incompatible swap file
 // increment to force complete reload/reparsing of old file
-#define CACHE_FILE_FORMAT_VERSION "3.12.55"
+#define CACHE_FILE_FORMAT_VERSION "3.12.57"
+
+extern const char * const gCacheFileFormatVersion = CACHE_FILE_FORMAT_VERSION;
 
 /// increment following value to force re-formatting of old book after load
 #define FORMATTING_VERSION_ID 0x001D
@@ -120,6 +122,8 @@ int gDOMVersionRequested     = DOM_VERSION_CURRENT;
 //#define CACHE_FILE_SECTOR_SIZE 4096
 #define CACHE_FILE_SECTOR_SIZE 1024
 #define CACHE_FILE_WRITE_BLOCK_PADDING 1
+/// max size of block data queued for cache file writer thread before writing callers have to wait
+#define CACHE_FILE_MAX_PENDING_SIZE 0x400000 // 4M
 
 /// set t 1 to log storage reads/writes
 #define DEBUG_DOM_STORAGE 0
@@ -201,12 +205,17 @@ enum CacheFileBlockType {
 #endif
 #include "../include/crtest.h"
 #include "../include/crlog.h"
+#include "../include/crconcurrent.h"
 #include <stddef.h>
 #include <math.h>
 #include <zlib.h>
 #include <xxhash.h>
 #include <lvtextfm.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // define to store new text nodes as persistent text, instead of mutable
 #define USE_PERSISTENT_TEXT 1
 
@@ -224,6 +233,18 @@ void setStorageMaxUncompressedSizeFactor(float factor) {
 	_storageMaxUncompressedSizeFactor = factor;
 }
 
+// text and element chunks are scaled with unpacked space, so that with a small
+// space there are still enough chunks in memory, and less data is unpacked per miss
+static int storageChunkSize( int chunkSize )
+{
+    int size = ((int)(chunkSize * _storageMaxUncompressedSizeFactor) + 0xFFF) & ~0xFFF;
+    if ( size < 0x1000 )
+        size = 0x1000;
+    if ( size > 0x10000 )
+        size = 0x10000;
+    return size;
+}
+
 static bool _enableCacheFileContentsValidation = (bool)ENABLE_CACHE_FILE_CONTENTS_VALIDATION;
 void enableCacheFileContentsValidation(bool enable) {
 	_enableCacheFileContentsValidation = enable;
@@ -481,10 +502,33 @@ struct CacheFileHeader : public SimpleCacheFileHeader
     }
 };
 
+/// block data waiting for cache file writer thread
+struct CacheFilePendingBlock
+{
+    lUInt16 type;
+    lUInt16 index;
+    lUInt8 * buf;      // unpacked data
+    int size;
+    lUInt32 hash;      // hash of unpacked data
+    bool compress;
+    bool started;      // writer thread is packing or writing it, replacing data is not allowed
+    bool commit;       // not a block: write index and header when all blocks before it are written
+    CacheFilePendingBlock( lUInt16 dataType, lUInt16 dataIndex )
+        : type(dataType), index(dataIndex), buf(NULL), size(0), hash(0), compress(false), started(false), commit(false) { }
+    ~CacheFilePendingBlock() { if ( buf ) free( buf ); }
+};
+
 /**
  * Cache file implementation.
+ *
+ * Blocks referenced by index saved in file are never overwritten: changed blocks are written
+ * to free or new space, and become visible only after commit writes new index and then file header.
+ * Interrupted writing leaves file with previous committed contents instead of invalid one.
+ *
+ * When concurrencyProvider is set, write() and flush() only queue blocks and commits,
+ * packing and writing is done by writer thread.
  */
-class CacheFile
+class CacheFile : public CRRunnable
 {
     int _sectorSize; // block position and size granularity
     int _size;
@@ -495,27 +539,57 @@ class CacheFile
     LVPtrVector<CacheFileItem, true> _index; // full file block index
     LVPtrVector<CacheFileItem, false> _freeIndex; // free file block index
     LVHashTable<lUInt32, CacheFileItem*> _map; // hash map for fast search
+    LVHashTable<lUInt32, bool> _committedBlocks; // file positions of blocks referenced by saved index
+    LVPtrVector<CacheFileItem, false> _releasedIndex; // blocks freed since last commit, reusable after next one
+    // writer thread
+    CRMonitorRef _monitor;
+    CRThreadRef _thread;
+    LVPtrVector<CacheFilePendingBlock> _pending; // queued blocks and commits, in order of writing
+    int _pendingSize;
+    bool _stopped;
+    bool _writeError;
+    lInt64 _writerTime; // time spent by writer thread on packing and writing
+    lInt64 _waitTime; // time callers were blocked waiting for writer thread
+    int _queuedBlocks;
     // searches for existing block
     CacheFileItem * findBlock( lUInt16 type, lUInt16 index );
     // alocates block at index, reuses existing one, if possible
     CacheFileItem * allocBlock( lUInt16 type, lUInt16 index, int size );
     // mark block as free, for later reusing
     void freeBlock( CacheFileItem * block );
+    // returns true if saved index refers to block, so it cannot be overwritten
+    bool isCommitted( CacheFileItem * block ) { return _committedBlocks.get( (lUInt32)block->_blockFilePos ); }
     // writes file header
     bool updateHeader();
     // writes index block
     bool writeIndex();
+    // writes index and header, so that all written blocks become part of file
+    bool commit();
     // reads index from file
     bool readIndex();
     // reads all blocks of index and checks CRCs
     bool validateContents();
+    /// reads block from file
+    bool readBlock( lUInt16 type, lUInt16 dataIndex, lUInt8 * &buf, int &size );
+    /// packs if needed and writes block to file
+    bool writeBlock( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, bool compress );
+    /// writes already packed data of block to file
+    bool storeBlock( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, lUInt32 hash, lUInt32 uncompressedSize );
+    /// writes dirty flag to header, returns true if value is changed
+    bool updateDirtyFlag( bool dirty );
+    /// starts writer thread if concurrency provider is set
+    void startWriter();
+    /// returns last queued data for block, NULL if there is no one
+    CacheFilePendingBlock * findPending( lUInt16 type, lUInt16 index );
+    /// waits until writer thread queue has no more than maxSize bytes, or is empty for maxSize==0
+    void waitWriter( int maxSize );
 public:
     // return current file size
-    int getSize() { return _size; }
+    int getSize();
     // create uninitialized cache file, call open or create to initialize
     CacheFile();
     // free resources
-    ~CacheFile();
+    virtual ~CacheFile();
     // try open existing cache file
     bool open( lString16 filename );
     // try open existing cache file from stream
@@ -528,6 +602,8 @@ public:
     bool write( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, bool compress );
     /// reads and allocates block in memory
     bool read( lUInt16 type, lUInt16 dataIndex, lUInt8 * &buf, int &size );
+    /// returns size of block data as read() returns it, -1 if block is not present in file
+    int getDataSize( lUInt16 type, lUInt16 dataIndex );
     /// reads and validates block
     bool validate( CacheFileItem * block );
     /// writes content of serial buffer
@@ -551,11 +627,15 @@ public:
     bool setDirtyFlag( bool dirty );
     // flushes index
     bool flush( bool clearDirtyFlag, CRTimerUtil & maxTime );
+    /// writer thread body
+    virtual void run();
     int roundSector( int n )
     {
         return (n + (_sectorSize-1)) & ~(_sectorSize-1);
     }
     void setAutoSyncSize(int sz) {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
         _stream->setAutoSyncSize(sz);
     }
     void setCachePath(const lString16 cachePath) {
@@ -570,21 +650,137 @@ public:
 // create uninitialized cache file, call open or create to initialize
 CacheFile::CacheFile()
 : _sectorSize( CACHE_FILE_SECTOR_SIZE ), _size(0), _indexChanged(false), _dirty(true), _map(1024), _cachePath(lString16::empty_str)
+, _committedBlocks(1024), _pendingSize(0), _stopped(false), _writeError(false), _writerTime(0), _waitTime(0), _queuedBlocks(0)
 {
 }
 
 // free resources
 CacheFile::~CacheFile()
 {
+    if ( !_thread.isNull() ) {
+        // writer finishes queued blocks up to last commit, the rest is not visible in file anyway
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            _stopped = true;
+            _monitor->notifyAll();
+        }
+        _thread->join();
+        CRLog::info("CacheFile: %d blocks queued, writer thread busy %d ms, callers waited %d ms",
+                    _queuedBlocks, (int)_writerTime, (int)_waitTime);
+    }
     if ( !_stream.isNull() ) {
-        // don't flush -- leave file dirty
+        // don't flush -- blocks written after last commit are ignored on next open
         //CRTimerUtil infinite;
         //flush( true, infinite );
+        if ( !_cachePath.empty() )
+            ldomDocCache::updateFileSize( _cachePath, _size );
+    }
+}
+
+// return current file size
+int CacheFile::getSize()
+{
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    return _size;
+}
+
+/// starts writer thread if concurrency provider is set
+void CacheFile::startWriter()
+{
+    if ( !concurrencyProvider || !_thread.isNull() )
+        return;
+    _monitor = concurrencyProvider->createMonitor();
+    _thread = concurrencyProvider->createThread( this );
+    _thread->start();
+}
+
+/// returns last queued data for block, NULL if there is no one
+CacheFilePendingBlock * CacheFile::findPending( lUInt16 type, lUInt16 index )
+{
+    for ( int i=_pending.length()-1; i>=0; i-- ) {
+        CacheFilePendingBlock * item = _pending[i];
+        if ( !item->commit && item->type==type && item->index==index )
+            return item;
+    }
+    return NULL;
+}
+
+/// waits until writer thread queue has no more than maxSize bytes, or is empty for maxSize==0
+void CacheFile::waitWriter( int maxSize )
+{
+    if ( _thread.isNull() )
+        return;
+    CRTimerUtil timer;
+    while ( _pending.length() && (maxSize==0 || _pendingSize>maxSize) )
+        _monitor->wait();
+    _waitTime += timer.elapsed();
+}
+
+/// writer thread body
+void CacheFile::run()
+{
+    for (;;) {
+        CacheFilePendingBlock * item = NULL;
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            while ( !_stopped && !_pending.length() )
+                _monitor->wait();
+            if ( _stopped ) {
+                // drop blocks queued after last commit
+                int last = _pending.length() - 1;
+                while ( last>=0 && !_pending[last]->commit )
+                    last--;
+                while ( _pending.length() > last + 1 ) {
+                    CacheFilePendingBlock * dropped = _pending.remove( _pending.length() - 1 );
+                    _pendingSize -= dropped->size;
+                    delete dropped;
+                }
+            }
+            if ( !_pending.length() )
+                return;
+            item = _pending[0];
+            item->started = true;
+        }
+        // pack outside of lock: caller thread may read blocks meanwhile
+        CRTimerUtil timer;
+        lUInt8 * packed = NULL;
+        lUInt32 packedSize = 0;
+        if ( !item->commit && item->compress && _compressCachedData && !ldomPack( item->buf, item->size, packed, packedSize ) )
+            packed = NULL;
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        bool res;
+        if ( item->commit )
+            res = commit();
+        else if ( packed )
+            res = storeBlock( item->type, item->index, packed, packedSize, item->hash, item->size );
+        else
+            res = storeBlock( item->type, item->index, item->buf, item->size, item->hash, 0 );
+        if ( packed )
+            free( packed );
+        if ( !res )
+            _writeError = true;
+        _writerTime += timer.elapsed();
+        _pendingSize -= item->size;
+        delete _pending.remove( 0 );
+        _monitor->notifyAll();
     }
 }
 
 /// sets dirty flag value, returns true if value is changed
 bool CacheFile::setDirtyFlag( bool dirty )
+{
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    waitWriter( 0 );
+    return updateDirtyFlag( dirty );
+}
+
+/// writes dirty flag to header, returns true if value is changed
+bool CacheFile::updateDirtyFlag( bool dirty )
 {
     if ( _dirty==dirty )
         return false;
@@ -609,11 +805,21 @@ bool CacheFile::setDirtyFlag( bool dirty )
 // flushes index
 bool CacheFile::flush( bool clearDirtyFlag, CRTimerUtil & maxTime )
 {
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    if ( !_thread.isNull() ) {
+        // writer thread commits after writing all blocks queued before, and syncs file itself
+        if ( clearDirtyFlag ) {
+            CacheFilePendingBlock * item = new CacheFilePendingBlock( 0, 0 );
+            item->commit = true;
+            _pending.add( item );
+            _monitor->notifyAll();
+        }
+        return !_writeError;
+    }
     if ( clearDirtyFlag ) {
-        //setDirtyFlag(true);
-        if ( !writeIndex() )
+        if ( !commit() )
             return false;
-        setDirtyFlag(false);
     } else {
         _stream->Flush(false, maxTime);
         //CRLog::trace("CacheFile->flush() took %d ms ", (int)timer.elapsed());
@@ -621,6 +827,33 @@ bool CacheFile::flush( bool clearDirtyFlag, CRTimerUtil & maxTime )
     return true;
 }
 
+// writes index and header, so that all written blocks become part of file
+bool CacheFile::commit()
+{
+    if ( _indexChanged ) {
+        // header written by writeIndex() after index is synced is the commit record: write it clean
+        bool wasDirty = _dirty;
+        _dirty = false;
+        if ( !writeIndex() ) {
+            _dirty = wasDirty;
+            return false;
+        }
+        _stream->Flush(true);
+    } else {
+        updateDirtyFlag(false);
+    }
+    // blocks of new index cannot be overwritten until next commit, blocks freed before can be reused now
+    _committedBlocks.clear();
+    for ( int i=0; i<_index.length(); i++ ) {
+        if ( _index[i]->_dataType )
+            _committedBlocks.set( (lUInt32)_index[i]->_blockFilePos, true );
+    }
+    for ( int i=0; i<_releasedIndex.length(); i++ )
+        _freeIndex.add( _releasedIndex[i] );
+    _releasedIndex.clear();
+    return true;
+}
+
 // reads all blocks of index and checks CRCs
 bool CacheFile::validateContents()
 {
@@ -693,10 +926,12 @@ bool CacheFile::readIndex()
         memcpy(item, &index[i], sizeof(CacheFileItem));
         _index.add( item );
         lUInt32 key = ((lUInt32)item->_dataType)<<16 | item->_dataIndex;
-        if ( key==0 )
+        if ( key==0 ) {
             _freeIndex.add( item );
-        else
+        } else {
             _map.set( key, item );
+            _committedBlocks.set( (lUInt32)item->_blockFilePos, true );
+        }
     }
     delete[] index;
     CacheFileItem * indexitem = findBlock(CBT_INDEX, 0);
@@ -720,7 +955,10 @@ bool CacheFile::writeIndex()
     // create copy of index in memory
     int count = _index.length();
     CacheFileItem * indexItem = findBlock(CBT_INDEX, 0);
-    if (!indexItem) {
+    if (!indexItem || isCommitted(indexItem) || indexItem->_blockSize < (int)sizeof(CacheFileItem) * (count + 1)) {
+        // header still refers to saved index: write new one to other place
+        if (indexItem)
+            freeBlock(indexItem);
         int sz = sizeof(CacheFileItem) * (count * 2 + 100);
         allocBlock(CBT_INDEX, 0, sz);
         indexItem = findBlock(CBT_INDEX, 0);
@@ -736,7 +974,7 @@ bool CacheFile::writeIndex()
             index[i]._dataSize = 0;
         }
     }
-    bool res = write(CBT_INDEX, 0, (const lUInt8*)index, sz, false);
+    bool res = writeBlock(CBT_INDEX, 0, (const lUInt8*)index, sz, false);
     delete[] index;
 
     indexItem = findBlock(CBT_INDEX, 0);
@@ -745,6 +983,8 @@ bool CacheFile::writeIndex()
         return false;
     }
 
+    // blocks and index should reach the disk before header refers to them
+    _stream->Flush(true);
     updateHeader();
     _indexChanged = false;
     return true;
@@ -773,12 +1013,25 @@ void CacheFile::freeBlock( CacheFileItem * block )
     block->_dataIndex = 0;
     block->_dataType = 0;
     block->_dataSize = 0;
-    _freeIndex.add( block );
+    if ( isCommitted(block) )
+        _releasedIndex.add( block ); // saved index still refers to it
+    else
+        _freeIndex.add( block );
 }
 
 /// reads block as a stream
 LVStreamRef CacheFile::readStream(lUInt16 type, lUInt16 index)
 {
+    if ( !_thread.isNull() ) {
+        // writer thread moves file position: return copy of data instead of file fragment
+        lUInt8 * buf = NULL;
+        int size = 0;
+        if ( !read(type, index, buf, size) )
+            return LVStreamRef();
+        LVStreamRef stream = LVCreateMemoryStream(buf, size, true);
+        free(buf);
+        return stream;
+    }
     CacheFileItem * block = findBlock(type, index);
     if (block && block->_dataSize) {
 #if 0
@@ -807,14 +1060,14 @@ CacheFileItem * CacheFile::allocBlock( lUInt16 type, lUInt16 index, int size )
     lUInt32 key = ((lUInt32)type)<<16 | index;
     CacheFileItem * existing = _map.get( key );
     if ( existing ) {
-        if ( existing->_blockSize >= size ) {
+        if ( existing->_blockSize >= size && !isCommitted(existing) ) {
             if ( existing->_dataSize != size ) {
                 existing->_dataSize = size;
                 _indexChanged = true;
             }
             return existing;
         }
-        // old block has not enough space: free it
+        // old block has not enough space or saved index refers to it: free it
         freeBlock( existing );
         existing = NULL;
     }
@@ -884,8 +1137,38 @@ bool CacheFile::validate( CacheFileItem * block )
     return true;
 }
 
+/// returns size of block data as read() returns it, -1 if block is not present in file
+int CacheFile::getDataSize( lUInt16 type, lUInt16 dataIndex )
+{
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    CacheFilePendingBlock * pending = findPending( type, dataIndex );
+    if ( pending )
+        return pending->size;
+    CacheFileItem * block = findBlock( type, dataIndex );
+    if ( !block )
+        return -1;
+    return block->_uncompressedSize ? (int)block->_uncompressedSize : block->_dataSize;
+}
+
 // reads and allocates block in memory
 bool CacheFile::read( lUInt16 type, lUInt16 dataIndex, lUInt8 * &buf, int &size )
+{
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    CacheFilePendingBlock * pending = findPending( type, dataIndex );
+    if ( pending ) {
+        // not written yet: return queued data
+        size = pending->size;
+        buf = (lUInt8 *)malloc(size);
+        memcpy( buf, pending->buf, size );
+        return true;
+    }
+    return readBlock( type, dataIndex, buf, size );
+}
+
+/// reads block from file
+bool CacheFile::readBlock( lUInt16 type, lUInt16 dataIndex, lUInt8 * &buf, int &size )
 {
     buf = NULL;
     size = 0;
@@ -954,49 +1237,85 @@ bool CacheFile::read( lUInt16 type, lUInt16 dataIndex, lUInt8 * &buf, int &size
     return true;
 }
 
+// returns true if block already contains data of this size and hash
+static bool isSameBlockData( CacheFileItem * block, int size, lUInt32 hash )
+{
+    if ( !block )
+        return false;
+    bool sameSize = ((int)block->_uncompressedSize==size) || (block->_uncompressedSize==0 && (int)block->_dataSize==size);
+    return sameSize && block->_dataHash == hash;
+}
+
 // writes block to file
 bool CacheFile::write( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, bool compress )
 {
-    // check whether data is changed
+    if ( _thread.isNull() )
+        return writeBlock( type, dataIndex, buf, size, compress );
     lUInt32 newhash = calcHash( buf, size );
-    CacheFileItem * existingblock = findBlock( type, dataIndex );
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    if ( _writeError )
+        return false;
+    // check whether data is changed
+    CacheFilePendingBlock * pending = findPending( type, dataIndex );
+    if ( pending ? (pending->size==size && pending->hash==newhash) : isSameBlockData( findBlock( type, dataIndex ), size, newhash ) )
+        return true;
+    waitWriter( size < CACHE_FILE_MAX_PENDING_SIZE ? CACHE_FILE_MAX_PENDING_SIZE - size : 1 );
+    // queued data can be replaced until writer thread takes it
+    pending = findPending( type, dataIndex );
+    if ( pending && !pending->started ) {
+        _pendingSize -= pending->size;
+        free( pending->buf );
+    } else {
+        pending = new CacheFilePendingBlock( type, dataIndex );
+        _pending.add( pending );
+    }
+    pending->buf = (lUInt8 *)malloc(size);
+    memcpy( pending->buf, buf, size );
+    pending->size = size;
+    pending->hash = newhash;
+    pending->compress = compress;
+    _pendingSize += size;
+    _queuedBlocks++;
+    _monitor->notifyAll();
+    return true;
+}
 
-    if (existingblock) {
-        bool sameSize = ((int)existingblock->_uncompressedSize==size) || (existingblock->_uncompressedSize==0 && (int)existingblock->_dataSize==size);
-        if (sameSize && existingblock->_dataHash == newhash ) {
-            return true;
-        }
-    }
+/// packs if needed and writes block to file
+bool CacheFile::writeBlock( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, bool compress )
+{
+    // check whether data is changed
+    lUInt32 newhash = calcHash( buf, size );
+    if ( isSameBlockData( findBlock( type, dataIndex ), size, newhash ) )
+        return true;
 
 #if 0
-    if (existingblock)
-        CRLog::trace("*    oldsz=%d oldhash=%08x", (int)existingblock->_uncompressedSize, (int)existingblock->_dataHash);
     CRLog::trace("* wr block t=%d[%d] sz=%d hash=%08x", type, dataIndex, size, newhash);
 #endif
-    setDirtyFlag(true);
 
-    lUInt32 uncompressedSize = 0;
-    lUInt64 newpackedhash = newhash;
     if (!_compressCachedData)
         compress = false;
     if ( compress ) {
         lUInt8 * dstbuf = NULL;
         lUInt32 dstsize = 0;
-        if ( !ldomPack( buf, size, dstbuf, dstsize ) ) {
-            compress = false;
-        } else {
-            uncompressedSize = size;
-            size = dstsize;
-            buf = dstbuf;
-            newpackedhash = calcHash( buf, size );
+        if ( ldomPack( buf, size, dstbuf, dstsize ) ) {
 #if DEBUG_DOM_STORAGE==1
             //CRLog::trace("packed block %d:%d : %d to %d bytes (%d%%)", type, dataIndex, srcsize, dstsize, srcsize>0?(100*dstsize/srcsize):0 );
 #endif
+            bool res = storeBlock( type, dataIndex, dstbuf, dstsize, newhash, size );
+            free( dstbuf );
+            return res;
         }
     }
+    return storeBlock( type, dataIndex, buf, size, newhash, 0 );
+}
 
+/// writes already packed data of block to file
+bool CacheFile::storeBlock( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int size, lUInt32 hash, lUInt32 uncompressedSize )
+{
+    CacheFileItem * existingblock = findBlock( type, dataIndex );
     CacheFileItem * block = NULL;
-    if ( existingblock && existingblock->_dataSize>=size ) {
+    if ( existingblock && existingblock->_dataSize>=size && !isCommitted(existingblock) ) {
         // reuse existing block
         block = existingblock;
     } else {
@@ -1006,37 +1325,16 @@ bool CacheFile::write( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int
         block = allocBlock( type, dataIndex, size );
     }
     if ( !block )
-    {
-#if DOC_DATA_COMPRESSION_LEVEL!=0
-        if ( compress ) {
-            free( (void*)buf );
-        }
-#endif
         return false;
-    }
     if ( (int)_stream->SetPos( block->_blockFilePos )!=block->_blockFilePos )
-    {
-#if DOC_DATA_COMPRESSION_LEVEL!=0
-        if ( compress ) {
-            free( (void*)buf );
-        }
-#endif
         return false;
-    }
     // assert: size == block->_dataSize
     // actual writing of data
     block->_dataSize = size;
     lvsize_t bytesWritten = 0;
     _stream->Write(buf, size, &bytesWritten );
     if ( (int)bytesWritten!=size )
-    {
-#if DOC_DATA_COMPRESSION_LEVEL!=0
-        if ( compress ) {
-            free( (void*)buf );
-        }
-#endif
         return false;
-    }
 #if CACHE_FILE_WRITE_BLOCK_PADDING==1
     int paddingSize = block->_blockSize - size; //roundSector( size ) - size
     if ( paddingSize ) {
@@ -1058,13 +1356,9 @@ bool CacheFile::write( lUInt16 type, lUInt16 dataIndex, const lUInt8 * buf, int
 #endif
     //_stream->Flush(true);
     // update CRC
-    block->_dataHash = newhash;
-    block->_packedHash = newpackedhash;
+    block->_dataHash = hash;
+    block->_packedHash = uncompressedSize ? calcHash( buf, size ) : hash;
     block->_uncompressedSize = uncompressedSize;
-
-    if ( compress ) {
-        free( (void*)buf );
-    }
     _indexChanged = true;
 
     //CRLog::error("CacheFile::write: block %d:%d (pos %ds, size %ds) is written (crc=%08x)", type, dataIndex, (int)block->_blockFilePos/_sectorSize, (int)(size+_sectorSize-1)/_sectorSize, block->_dataCRC);
@@ -1119,6 +1413,7 @@ bool CacheFile::open( LVStreamRef stream )
         CRLog::error("CacheFile::open : file contents validation failed");
         return false;
     }
+    startWriter();
     return true;
 }
 
@@ -1155,6 +1450,7 @@ bool CacheFile::create( LVStreamRef stream )
         _stream.Clear();
         return false;
     }
+    startWriter();
     return true;
 }
 
@@ -1870,6 +2166,10 @@ tinyNodeCollection::tinyNodeCollection()
 , _fonts(FONT_HASH_TABLE_SIZE)
 , _tinyElementCount(0)
 , _itemCount(0)
+, _lazyElemCount(0)
+, _lazyTextCount(0)
+, _lazyNodeStyles(0)
+, _contentChangeCount(0)
 #if BUILD_LITE!=1
 , _renderedBlockCache( 256 )
 , _cacheFile(NULL)
@@ -1885,8 +2185,8 @@ tinyNodeCollection::tinyNodeCollection()
 , _nodeDisplayStyleHashInitial(NODE_DISPLAY_STYLE_HASH_UNITIALIZED)
 , _nodeStylesInvalidIfLoading(false)
 #endif
-, _textStorage(this, 't', (int)(TEXT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), TEXT_CACHE_CHUNK_SIZE ) // persistent text node data storage
-, _elemStorage(this, 'e', (int)(ELEM_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), ELEM_CACHE_CHUNK_SIZE ) // persistent element data storage
+, _textStorage(this, 't', (int)(TEXT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), storageChunkSize(TEXT_CACHE_CHUNK_SIZE) ) // persistent text node data storage
+, _elemStorage(this, 'e', (int)(ELEM_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), storageChunkSize(ELEM_CACHE_CHUNK_SIZE) ) // persistent element data storage
 , _rectStorage(this, 'r', (int)(RECT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), RECT_CACHE_CHUNK_SIZE ) // element render rect storage
 , _styleStorage(this, 's', (int)(STYLE_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), STYLE_CACHE_CHUNK_SIZE ) // element style info storage
 ,_docProps(LVCreatePropsContainer())
@@ -1907,6 +2207,10 @@ tinyNodeCollection::tinyNodeCollection( tinyNodeCollection & v )
 , _fonts(FONT_HASH_TABLE_SIZE)
 , _tinyElementCount(0)
 , _itemCount(0)
+, _lazyElemCount(0)
+, _lazyTextCount(0)
+, _lazyNodeStyles(0)
+, _contentChangeCount(0)
 #if BUILD_LITE!=1
 , _renderedBlockCache( 256 )
 , _cacheFile(NULL)
@@ -1922,8 +2226,8 @@ tinyNodeCollection::tinyNodeCollection( tinyNodeCollection & v )
 , _nodeDisplayStyleHashInitial(NODE_DISPLAY_STYLE_HASH_UNITIALIZED)
 , _nodeStylesInvalidIfLoading(false)
 #endif
-, _textStorage(this, 't', (int)(TEXT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), TEXT_CACHE_CHUNK_SIZE ) // persistent text node data storage
-, _elemStorage(this, 'e', (int)(ELEM_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), ELEM_CACHE_CHUNK_SIZE ) // persistent element data storage
+, _textStorage(this, 't', (int)(TEXT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), storageChunkSize(TEXT_CACHE_CHUNK_SIZE) ) // persistent text node data storage
+, _elemStorage(this, 'e', (int)(ELEM_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), storageChunkSize(ELEM_CACHE_CHUNK_SIZE) ) // persistent element data storage
 , _rectStorage(this, 'r', (int)(RECT_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), RECT_CACHE_CHUNK_SIZE ) // element render rect storage
 , _styleStorage(this, 's', (int)(STYLE_CACHE_UNPACKED_SPACE*_storageMaxUncompressedSizeFactor), STYLE_CACHE_CHUNK_SIZE ) // element style info storage
 ,_docProps(LVCreatePropsContainer())
@@ -2123,37 +2427,6 @@ lUInt16 tinyNodeCollection::getNodeFontIndex( lUInt32 dataIndex )
     return info._fontIndex;
 }
 
-bool tinyNodeCollection::loadNodeData(lUInt16 type, ldomNode ** list, int nodecount)
-{
-    int count = ((nodecount + TNC_PART_LEN - 1) >> TNC_PART_SHIFT);
-    for (lUInt16 i=0; i<count; i++) {
-        int offs = i*TNC_PART_LEN;
-        int sz = TNC_PART_LEN;
-        if (offs + sz > nodecount) {
-            sz = nodecount - offs;
-        }
-
-        lUInt8 * p;
-        int buflen;
-        if (!_cacheFile->read( type, i, p, buflen ))
-            return false;
-        ldomNode * buf = (ldomNode *)p;
-        if (!buf || (unsigned)buflen != sizeof(ldomNode) * sz)
-            return false;
-        list[i] = buf;
-        for (int j=0; j<sz; j++) {
-            buf[j].setDocumentIndex( _docIndex );
-            if ( buf[j].isElement() ) {
-                // will be set by loadStyles/updateStyles
-                //buf[j]._data._pelem._styleIndex = 0;
-                setNodeFontIndex( buf[j]._handle._dataIndex, 0 );
-                //buf[j]._data._pelem._fontIndex = 0;
-            }
-        }
-    }
-    return true;
-}
-
 bool tinyNodeCollection::saveNodeData( lUInt16 type, ldomNode ** list, int nodecount )
 {
     int count = ((nodecount+TNC_PART_LEN-1) >> TNC_PART_SHIFT);
@@ -2186,6 +2459,22 @@ bool tinyNodeCollection::saveNodeData( lUInt16 type, ldomNode ** list, int nodec
     return true;
 }
 
+/// returns true if all parts of node list are present in cache file with expected sizes
+static bool hasNodeParts( CacheFile * cacheFile, lUInt16 type, int nodecount )
+{
+    int count = ((nodecount+TNC_PART_LEN-1) >> TNC_PART_SHIFT);
+    for ( int i=0; i<count; i++ ) {
+        int sz = TNC_PART_LEN;
+        if ( i*TNC_PART_LEN + sz > nodecount )
+            sz = nodecount - i*TNC_PART_LEN;
+        if ( cacheFile->getDataSize( type, (lUInt16)i ) != (int)sizeof(ldomNode) * sz ) {
+            CRLog::error("Node data block %d:%d is missing or has wrong size", type, i);
+            return false;
+        }
+    }
+    return true;
+}
+
 #define NODE_INDEX_MAGIC 0x19283746
 bool tinyNodeCollection::saveNodeData()
 {
@@ -2216,32 +2505,161 @@ bool tinyNodeCollection::loadNodeData()
         return false;
     if ( textcount<=0 )
         return false;
-    ldomNode * elemList[TNC_PART_COUNT] = { 0 };
-    ldomNode * textList[TNC_PART_COUNT] = { 0 };
-    if ( !loadNodeData( CBT_ELEM_NODE, elemList, elemcount+1 ) ) {
-        for ( int i=0; i<TNC_PART_COUNT; i++ )
-            if ( elemList[i] )
-                free( elemList[i] );
+    if ( elemcount >= (TNC_PART_COUNT << TNC_PART_SHIFT) || textcount >= (TNC_PART_COUNT << TNC_PART_SHIFT) )
         return false;
-    }
-    if ( !loadNodeData( CBT_TEXT_NODE, textList, textcount+1 ) ) {
-        for ( int i=0; i<TNC_PART_COUNT; i++ )
-            if ( textList[i] )
-                free( textList[i] );
+    // check that all parts are present, but read them only on first access
+    if ( !hasNodeParts( _cacheFile, CBT_ELEM_NODE, elemcount+1 ) || !hasNodeParts( _cacheFile, CBT_TEXT_NODE, textcount+1 ) )
         return false;
-    }
     for ( int i=0; i<TNC_PART_COUNT; i++ ) {
         if ( _elemList[i] )
             free( _elemList[i] );
         if ( _textList[i] )
             free( _textList[i] );
     }
-    memcpy( _elemList, elemList, sizeof(elemList) );
-    memcpy( _textList, textList, sizeof(textList) );
-    _elemCount = elemcount;
-    _textCount = textcount;
+    memset( _elemList, 0, sizeof(_elemList) );
+    memset( _textList, 0, sizeof(_textList) );
+    _elemCount = _lazyElemCount = elemcount;
+    _textCount = _lazyTextCount = textcount;
+    _lazyNodeStyles = 0;
     return true;
 }
+
+#endif
+
+/// reads node part from cache file on first access, returns NULL if there is no such part
+/// parts are checked by loadNodeData(), if one still cannot be read, its nodes are left empty and cache file is dropped
+ldomNode * tinyNodeCollection::loadNodePart( bool elem, int partIndex )
+{
+#if BUILD_LITE!=1
+    int nodecount = (elem ? _lazyElemCount : _lazyTextCount) + 1;
+    int offs = partIndex * TNC_PART_LEN;
+    if ( !_cacheFile || offs >= nodecount )
+        return NULL;
+    int sz = TNC_PART_LEN;
+    if ( offs + sz > nodecount )
+        sz = nodecount - offs;
+    lUInt8 * p;
+    int buflen;
+    if ( !_cacheFile->read( elem ? CBT_ELEM_NODE : CBT_TEXT_NODE, (lUInt16)partIndex, p, buflen )
+            || !p || (unsigned)buflen != sizeof(ldomNode) * sz ) {
+        CRLog::error("Cannot read node data part %d:%d, cache file will be rebuilt", elem ? CBT_ELEM_NODE : CBT_TEXT_NODE, partIndex);
+        if ( p )
+            free( p );
+        invalidateCacheFile();
+        ldomNode * buf = (ldomNode*)calloc( TNC_PART_LEN, sizeof(ldomNode) );
+        (elem ? _elemList : _textList)[partIndex] = buf;
+        return buf;
+    }
+    // always keep full size part, new nodes may be added to the last one
+    ldomNode * buf = (ldomNode *)realloc( p, sizeof(ldomNode) * TNC_PART_LEN );
+    memset( (void*)(buf + sz), 0, sizeof(ldomNode) * (TNC_PART_LEN - sz) );
+    (elem ? _elemList : _textList)[partIndex] = buf;
+    for ( int j=0; j<sz; j++ )
+        buf[j].setDocumentIndex( _docIndex );
+    if ( elem ) {
+        lUInt32 nodeStyleHash = _nodeStyleHash;
+        if ( _lazyNodeStyles ) {
+            updateLoadedStyles( buf, sz, _lazyNodeStyles == 1 );
+        } else {
+            // will be set by updateLoadedStyles()
+            for ( int j=0; j<sz; j++ )
+                if ( buf[j].isElement() )
+                    setNodeFontIndex( buf[j]._handle._dataIndex, 0 );
+        }
+        // fonts of loaded styles don't change style hash
+        if ( _lazyNodeStyles == 1 )
+            _nodeStyleHash = nodeStyleHash;
+    }
+    return buf;
+#else
+    CR_UNUSED2(elem, partIndex);
+    return NULL;
+#endif
+}
+
+#if BUILD_LITE!=1
+/// returns number of node parts in memory and total number of node parts
+void tinyNodeCollection::getNodePartStats( int & loaded, int & total )
+{
+    loaded = 0;
+    total = 0;
+    for ( int i=0; i<=(_elemCount >> TNC_PART_SHIFT); i++, total++ )
+        if ( _elemList[i] )
+            loaded++;
+    for ( int i=0; i<=(_textCount >> TNC_PART_SHIFT); i++, total++ )
+        if ( _textList[i] )
+            loaded++;
+}
+
+// accesses to all storages of document between redistributions of their space
+#define STORAGE_SPACE_SHARING_INTERVAL 4096
+// a miss costs reading and unpacking of chunk, so it weights more than a hit
+#define STORAGE_SPACE_MISS_WEIGHT 64
+
+/// lends unpacked space not used by some data storages to the ones which miss chunks, by their recent access counts
+void tinyNodeCollection::shareStorageSpace()
+{
+    ldomDataStorageManager * storages[4] = { &_textStorage, &_elemStorage, &_rectStorage, &_styleStorage };
+    lUInt32 accesses = 0;
+    for ( int i=0; i<4; i++ )
+        accesses += storages[i]->_recentAccesses;
+    if ( accesses < STORAGE_SPACE_SHARING_INTERVAL )
+        return;
+    // storages which had no misses recently keep the space they use, with some
+    // room to grow, the rest of their initial space is shared by the ones
+    // which had misses, by weighted access counts
+    int spare = 0;
+    int sizes[4];
+    int wanted[4];
+    lInt64 weights[4];
+    lInt64 weightSum = 0;
+    for ( int i=0; i<4; i++ ) {
+        ldomDataStorageManager * storage = storages[i];
+        int base = storage->_baseUncompressedSize;
+        weights[i] = 0;
+        wanted[i] = 0;
+        if ( storage->_recentMisses ) {
+            sizes[i] = base;
+            wanted[i] = storage->getDataSize() - base;
+            if ( wanted[i] > 0 ) {
+                weights[i] = (lInt64)storage->_recentAccesses + (lInt64)storage->_recentMisses * STORAGE_SPACE_MISS_WEIGHT;
+                weightSum += weights[i];
+            }
+        } else {
+            sizes[i] = storage->_uncompressedSize + base / 8;
+            if ( sizes[i] > base )
+                sizes[i] = base;
+            spare += base - sizes[i];
+        }
+    }
+    // second pass gives space left by storages which got all they want to the others
+    for ( int pass=0; pass<2 && spare > 0 && weightSum > 0; pass++ ) {
+        int left = spare;
+        lInt64 nextWeightSum = 0;
+        for ( int i=0; i<4; i++ ) {
+            if ( !weights[i] )
+                continue;
+            int add = (int)(spare * weights[i] / weightSum);
+            if ( add >= wanted[i] ) {
+                add = wanted[i];
+                weights[i] = 0;
+            } else {
+                nextWeightSum += weights[i];
+            }
+            sizes[i] += add;
+            wanted[i] -= add;
+            left -= add;
+        }
+        spare = left;
+        weightSum = nextWeightSum;
+    }
+    for ( int i=0; i<4; i++ ) {
+        storages[i]->_maxUncompressedSize = sizes[i];
+        // older accesses count less at next redistribution
+        storages[i]->_recentAccesses /= 2;
+        storages[i]->_recentMisses /= 2;
+    }
+}
 #endif
 
 /// get ldomNode instance pointer
@@ -2250,9 +2668,9 @@ ldomNode * tinyNodeCollection::getTinyNode( lUInt32 index )
     if ( !index )
         return NULL;
     if ( index & 1 ) // element
-        return &(_elemList[index>>TNC_PART_INDEX_SHIFT][(index>>4)&TNC_PART_MASK]);
+        return &(getElemPart(index>>TNC_PART_INDEX_SHIFT)[(index>>4)&TNC_PART_MASK]);
     else // text
-        return &(_textList[index>>TNC_PART_INDEX_SHIFT][(index>>4)&TNC_PART_MASK]);
+        return &(getTextPart(index>>TNC_PART_INDEX_SHIFT)[(index>>4)&TNC_PART_MASK]);
 }
 
 /// allocate new tiny node
@@ -2272,7 +2690,7 @@ ldomNode * tinyNodeCollection::allocTinyNode( int type )
             _elemCount++;
             if (_elemCount >= (TNC_PART_COUNT << TNC_PART_SHIFT))
                 crFatalError(1003, "allocTinyNode: can't create any more element nodes (hard limit)");
-            ldomNode * part = _elemList[_elemCount >> TNC_PART_SHIFT];
+            ldomNode * part = getElemPart(_elemCount >> TNC_PART_SHIFT);
             if ( !part ) {
                 part = (ldomNode*)calloc(TNC_PART_LEN, sizeof(*part));
                 _elemList[ _elemCount >> TNC_PART_SHIFT ] = part;
@@ -2295,7 +2713,7 @@ ldomNode * tinyNodeCollection::allocTinyNode( int type )
             _textCount++;
             if (_textCount >= (TNC_PART_COUNT << TNC_PART_SHIFT))
                 crFatalError(1003, "allocTinyNode: can't create any more text nodes (hard limit)");
-            ldomNode * part = _textList[_textCount >> TNC_PART_SHIFT];
+            ldomNode * part = getTextPart(_textCount >> TNC_PART_SHIFT);
             if ( !part ) {
                 part = (ldomNode*)calloc(TNC_PART_LEN, sizeof(*part));
                 _textList[ _textCount >> TNC_PART_SHIFT ] = part;
@@ -2315,7 +2733,7 @@ void tinyNodeCollection::recycleTinyNode( lUInt32 index )
     if ( index & 1 ) {
         // element
         index >>= 4;
-        ldomNode * part = _elemList[index >> TNC_PART_SHIFT];
+        ldomNode * part = getElemPart(index >> TNC_PART_SHIFT);
         ldomNode * p = &part[index & TNC_PART_MASK];
         p->_handle._dataIndex = 0; // indicates NULL node
         p->_data._nextFreeIndex = _elemNextFree;
@@ -2324,7 +2742,7 @@ void tinyNodeCollection::recycleTinyNode( lUInt32 index )
     } else {
         // text
         index >>= 4;
-        ldomNode * part = _textList[index >> TNC_PART_SHIFT];
+        ldomNode * part = getTextPart(index >> TNC_PART_SHIFT);
         ldomNode * p = &part[index & TNC_PART_MASK];
         p->_handle._dataIndex = 0; // indicates NULL node
         p->_data._nextFreeIndex = _textNextFree;
@@ -2501,10 +2919,9 @@ bool ldomDataStorageManager::load()
 #endif
 }
 
-/// get chunk pointer and update usage data
-ldomTextStorageChunk * ldomDataStorageManager::getChunk( lUInt32 address )
+/// moves chunk to head of recently used list
+void ldomDataStorageManager::touchChunk( ldomTextStorageChunk * chunk )
 {
-    ldomTextStorageChunk * chunk = _chunks[address>>16];
     if ( chunk!=_recentChunk ) {
         if ( chunk->_prevRecent )
             chunk->_prevRecent->_nextRecent = chunk->_nextRecent;
@@ -2515,10 +2932,83 @@ ldomTextStorageChunk * ldomDataStorageManager::getChunk( lUInt32 address )
             _recentChunk->_prevRecent = chunk;
         _recentChunk = chunk;
     }
+}
+
+/// reads next chunk from cache file in advance, if it fits without compacting
+bool ldomDataStorageManager::prefetchChunk( int index )
+{
+#if BUILD_LITE!=1
+    if ( index >= _chunks.length() || !_cache )
+        return false;
+    ldomTextStorageChunk * chunk = _chunks[index];
+    if ( chunk->_buf || !chunk->_saved )
+        return false;
+    // never push out chunks in use for reading ahead
+    if ( _uncompressedSize + (int)chunk->_bufpos > _maxUncompressedSize )
+        return false;
+    ldomTextStorageChunk * current = _recentChunk;
+    touchChunk( chunk );
+    bool res = chunk->restoreFromCache();
+    // keep accessed chunk most recent, prefetched one goes right after it
+    if ( current )
+        touchChunk( current );
+    if ( res )
+        _prefetches++;
+    return res;
+#else
+    CR_UNUSED(index);
+    return false;
+#endif
+}
+
+/// get chunk pointer and update usage data
+ldomTextStorageChunk * ldomDataStorageManager::getChunk( lUInt32 address )
+{
+    int index = address>>16;
+    ldomTextStorageChunk * chunk = _chunks[index];
+    touchChunk( chunk );
+    _recentAccesses++;
+    if ( chunk->_buf || !chunk->_saved ) {
+        _hits++;
+        return chunk;
+    }
+    _misses++;
+    _recentMisses++;
+#if BUILD_LITE!=1
+    // other storages of document may lend space they don't use
+    if ( _uncompressedSize + (int)chunk->_bufpos > _maxUncompressedSize )
+        _owner->shareStorageSpace();
+#endif
     chunk->ensureUnpacked();
+    // chunks are missed one after another when reading through document: read next one in advance
+    if ( index == _lastMissChunk + 1 && prefetchChunk( index + 1 ) )
+        index++;
+    _lastMissChunk = index;
     return chunk;
 }
 
+/// returns space needed to keep all chunks unpacked
+int ldomDataStorageManager::getDataSize()
+{
+    int size = 0;
+    for ( int i=0; i<_chunks.length(); i++ ) {
+        ldomTextStorageChunk * chunk = _chunks[i];
+        size += chunk->_bufsize > chunk->_bufpos ? chunk->_bufsize : chunk->_bufpos;
+    }
+    return size;
+}
+
+/// returns chunk access counters, to show in document statistics
+lString16 ldomDataStorageManager::getStatistics()
+{
+    lString16 s;
+    s << fmt::decimal(_chunks.length()) << " chunks, " << fmt::decimal(_uncompressedSize/1024)
+      << " of " << fmt::decimal(_maxUncompressedSize/1024) << " KB unpacked, hits: " << fmt::decimal(_hits)
+      << ", misses: " << fmt::decimal(_misses) << ", unpacks: " << fmt::decimal(_unpacks)
+      << ", prefetched: " << fmt::decimal(_prefetches);
+    return s;
+}
+
 void ldomDataStorageManager::setCache( CacheFile * cache )
 {
     _cache = cache;
@@ -2747,9 +3237,17 @@ ldomDataStorageManager::ldomDataStorageManager( tinyNodeCollection * owner, char
 , _cache(NULL)
 , _uncompressedSize(0)
 , _maxUncompressedSize(maxUnpackedSize)
+, _baseUncompressedSize(maxUnpackedSize)
 , _chunkSize(chunkSize)
 , _type(type)
 , _maxSizeReachedWarned(false)
+, _hits(0)
+, _misses(0)
+, _unpacks(0)
+, _prefetches(0)
+, _recentAccesses(0)
+, _recentMisses(0)
+, _lastMissChunk(-2)
 {
 }
 
@@ -2853,6 +3351,7 @@ bool ldomTextStorageChunk::restoreFromCache()
         return false;
     _bufsize = size;
     _manager->_uncompressedSize += _bufsize;
+    _manager->_unpacks++;
 #if DEBUG_DOM_STORAGE==1
     CRLog::debug("Read %d bytes of chunk %c%d from cache", _bufsize, _type, _index);
 #endif
@@ -3355,6 +3854,22 @@ lUInt16 lxmlDocBase::getElementNameIndex( const lChar16 * name )
     return _nextUnknownElementId++;
 }
 
+lUInt16 lxmlDocBase::findAttrNameIndex( const lChar16 * name )
+{
+    const LDOMNameIdMapItem * item = _attrNameTable.findItem( name );
+    if (item)
+        return item->id;
+    return 0;
+}
+
+lUInt16 lxmlDocBase::findElementNameIndex( const lChar16 * name )
+{
+    const LDOMNameIdMapItem * item = _elementNameTable.findItem( name );
+    if (item)
+        return item->id;
+    return 0;
+}
+
 lUInt16 lxmlDocBase::findElementNameIndex( const lChar8 * name )
 {
     const LDOMNameIdMapItem * item = _elementNameTable.findItem( name );
@@ -3398,6 +3913,11 @@ ldomDocument::ldomDocument()
 , _rendered(false)
 , _just_rendered_from_cache(false)
 , _toc_from_cache_valid(false)
+, _renderedY0(0)
+, _renderedShowCover(false)
+, _renderedOptionsHash(0)
+, _renderMinPageHeight(0)
+, _renderMaxPageHeight(0)
 #endif
 , lists(100)
 {
@@ -3445,6 +3965,11 @@ ldomDocument::ldomDocument( ldomDocument & doc )
 , _last_docflags(doc._last_docflags)
 , _page_height(doc._page_height)
 , _page_width(doc._page_width)
+, _renderedY0(0)
+, _renderedShowCover(false)
+, _renderedOptionsHash(0)
+, _renderMinPageHeight(0)
+, _renderMaxPageHeight(0)
 #endif
 , _container(doc._container)
 , lists(100)
@@ -4178,7 +4703,7 @@ void tinyNodeCollection::dropStyles()
         if ( offs + sz > _elemCount+1 ) {
             sz = _elemCount+1 - offs;
         }
-        ldomNode * buf = _elemList[i];
+        ldomNode * buf = getElemPart(i);
         for ( int j=0; j<sz; j++ ) {
             if ( buf[j].isElement() ) {
                 setNodeStyleIndex( buf[j]._handle._dataIndex, 0 );
@@ -4199,7 +4724,7 @@ int tinyNodeCollection::calcFinalBlocks()
         if ( offs + sz > _elemCount+1 ) {
             sz = _elemCount+1 - offs;
         }
-        ldomNode * buf = _elemList[i];
+        ldomNode * buf = getElemPart(i);
         for ( int j=0; j<sz; j++ ) {
             if ( buf[j].isElement() ) {
                 int rm = buf[j].getRendMethod();
@@ -4277,6 +4802,30 @@ int ldomDocument::render( LVRendPageList * pages, LVDocViewCallback * callback,
 //    }
 
     bool was_just_rendered_from_cache = _just_rendered_from_cache; // cleared by checkRenderContext()
+    if ( canRepaginate( showCover, y0 ) ) {
+        // Only page height is changed, and it did not affect layout: lines
+        // of last render are still valid, only split them into pages again
+        CRLog::info("page height is changed - splitting lines of last render into pages again...");
+        if ( callback ) {
+            callback->OnFormatStart();
+        }
+        setCacheFileStale(true);
+        _toc_from_cache_valid = false;
+        m_toc.invalidatePageNumbers();
+        pages->clear();
+        if ( showCover )
+            pages->add( new LVRendPageInfo( _page_height ) );
+        _renderedLines->split( pages, _page_height );
+        // other render context hashes are checked to be the same
+        _hdr.render_dy = _page_height;
+        _pagesData.reset();
+        pages->serialize( _pagesData );
+        if ( callback ) {
+            callback->OnFormatEnd();
+            callback->OnDocumentReady();
+        }
+        return getFullHeight();
+    }
     if ( !checkRenderContext() ) {
         if ( _nodeDisplayStyleHashInitial == NODE_DISPLAY_STYLE_HASH_UNITIALIZED ) { // happen when just loaded
             // For knowing/debugging cases when node styles set up during loading
@@ -4347,7 +4896,14 @@ int ldomDocument::render( LVRendPageList * pages, LVDocViewCallback * callback,
         pages->clear();
         if ( showCover )
             pages->add( new LVRendPageInfo( _page_height ) );
-        LVRendPageContext context( pages, _page_height );
+        _renderedLines = new LVRendPageContext( pages, _page_height );
+        _renderedY0 = y0;
+        _renderedShowCover = showCover;
+        _renderedOptionsHash = calcRenderOptionsHash();
+        // narrowed by layout code when page height is used
+        _renderMinPageHeight = 0;
+        _renderMaxPageHeight = 0x7FFFFFFF;
+        LVRendPageContext & context = *_renderedLines;
         int numFinalBlocks = calcFinalBlocks();
         CRLog::info("Final block count: %d", numFinalBlocks);
         context.setCallback(callback, numFinalBlocks);
@@ -4362,7 +4918,9 @@ int ldomDocument::render( LVRendPageList * pages, LVDocViewCallback * callback,
     #endif
         gc();
         CRLog::trace("finalizing... fonts.length=%d", _fonts.length());
-        context.Finalize();
+        // lines are kept: pages are split again when only page height is changed
+        context.split( pages, _page_height );
+        CRLog::info("Page height range with the same layout: %d..%d", _renderMinPageHeight, _renderMaxPageHeight);
         updateRenderContext();
         _pagesData.reset();
         pages->serialize( _pagesData );
@@ -5869,6 +6427,145 @@ ldomElementWriter::~ldomElementWriter()
 // ldomDocumentWriter does not do any auto-close of unbalanced tags and
 // expect a fully correct and balanced XHTML.
 
+// base64 decode table
+static const signed char base64_decode_table[] = {
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //0..15
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //16..31   10
+   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63, //32..47   20
+   52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1, //48..63   30
+   -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, //64..79   40
+   15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1, //80..95   50
+   -1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, //INDEX2..111  60
+   41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1  //112..127 70
+};
+
+#if BUILD_LITE!=1
+#if defined(__SSE2__)
+/// decodes 16 base64 digits to 12 bytes; returns false, writing nothing, if there is any other char among them
+static bool decodeBase64Block( const lChar16 * text, lUInt8 * out )
+{
+    // chars above 255 saturate to 0 or 255, which are not digits
+    __m128i v;
+#if __SIZEOF_WCHAR_T__ == 4
+    __m128i lo = _mm_packs_epi32( _mm_loadu_si128( (const __m128i*)text ), _mm_loadu_si128( (const __m128i*)(text + 4) ) );
+    __m128i hi = _mm_packs_epi32( _mm_loadu_si128( (const __m128i*)(text + 8) ), _mm_loadu_si128( (const __m128i*)(text + 12) ) );
+    v = _mm_packus_epi16( lo, hi );
+#elif __SIZEOF_WCHAR_T__ == 2
+    v = _mm_packus_epi16( _mm_loadu_si128( (const __m128i*)text ), _mm_loadu_si128( (const __m128i*)(text + 8) ) );
+#else
+    return false;
+#endif
+    // bytes above 127 are negative in signed comparisons, so they fall out of all ranges
+    __m128i upper = _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( 'A' - 1 ) ), _mm_cmplt_epi8( v, _mm_set1_epi8( 'Z' + 1 ) ) );
+    __m128i lower = _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( 'a' - 1 ) ), _mm_cmplt_epi8( v, _mm_set1_epi8( 'z' + 1 ) ) );
+    __m128i digit = _mm_and_si128( _mm_cmpgt_epi8( v, _mm_set1_epi8( '0' - 1 ) ), _mm_cmplt_epi8( v, _mm_set1_epi8( '9' + 1 ) ) );
+    __m128i plus = _mm_cmpeq_epi8( v, _mm_set1_epi8( '+' ) );
+    __m128i slash = _mm_cmpeq_epi8( v, _mm_set1_epi8( '/' ) );
+    __m128i valid = _mm_or_si128( _mm_or_si128( upper, lower ), _mm_or_si128( digit, _mm_or_si128( plus, slash ) ) );
+    if ( _mm_movemask_epi8( valid ) != 0xFFFF )
+        return false;
+    // same values as base64_decode_table
+    __m128i shift = _mm_or_si128( _mm_and_si128( upper, _mm_set1_epi8( 0 - 'A' ) ),
+                                  _mm_and_si128( lower, _mm_set1_epi8( 26 - 'a' ) ) );
+    shift = _mm_or_si128( shift, _mm_and_si128( digit, _mm_set1_epi8( 52 - '0' ) ) );
+    shift = _mm_or_si128( shift, _mm_and_si128( plus, _mm_set1_epi8( 62 - '+' ) ) );
+    shift = _mm_or_si128( shift, _mm_and_si128( slash, _mm_set1_epi8( 63 - '/' ) ) );
+    v = _mm_add_epi8( v, shift );
+    // each 32 bit lane holds digits k0..k3 in bytes 0..3: combine them to (k0 << 18) | (k1 << 12) | (k2 << 6) | k3
+    const __m128i mask = _mm_set1_epi32( 0x003F003F );
+    __m128i pairs = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( v, mask ), 6 ), _mm_and_si128( _mm_srli_epi32( v, 8 ), mask ) );
+    __m128i values = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( pairs, _mm_set1_epi32( 0xFFFF ) ), 12 ), _mm_srli_epi32( pairs, 16 ) );
+    // bytes of each lane to big endian order: 3 output bytes in lane bytes 0..2
+    values = _mm_or_si128( _mm_or_si128( _mm_slli_epi32( _mm_and_si128( values, _mm_set1_epi32( 0xFF ) ), 16 ),
+                                         _mm_and_si128( values, _mm_set1_epi32( 0xFF00 ) ) ),
+                           _mm_srli_epi32( values, 16 ) );
+    // drop byte 3 of each lane: 6 bytes in each 64 bit half, then 12 bytes together
+    values = _mm_or_si128( _mm_and_si128( values, _mm_set_epi32( 0, 0xFFFFFF, 0, 0xFFFFFF ) ),
+                           _mm_srli_epi64( _mm_andnot_si128( _mm_set_epi32( 0, 0xFFFFFF, 0, 0xFFFFFF ), values ), 8 ) );
+    values = _mm_or_si128( _mm_and_si128( values, _mm_set_epi32( 0, 0, 0xFFFF, (int)0xFFFFFFFF ) ),
+                           _mm_srli_si128( _mm_andnot_si128( _mm_set_epi32( 0, 0, 0xFFFF, (int)0xFFFFFFFF ), values ), 2 ) );
+    _mm_storel_epi64( (__m128i*)out, values );
+    lUInt32 last = (lUInt32)_mm_cvtsi128_si32( _mm_srli_si128( values, 8 ) );
+    memcpy( out + 8, &last, 4 );
+    return true;
+}
+#endif
+
+/// decodes base64 text of FB2 binary, same way as LVBase64NodeStream does
+void ldomDocumentWriter::decodeBinaryText( const lChar16 * text, int len )
+{
+    if ( _binaryEnded )
+        return;
+    int count = _binaryData.length();
+    int maxCount = count + (len + 3) / 4 * 3;
+    if ( maxCount > _binaryData.size() )
+        _binaryData.reserve( maxCount > _binaryData.size() * 2 ? maxCount : _binaryData.size() * 2 );
+    lUInt8 * out = _binaryData.get();
+    const lChar16 * end = text + len;
+    while ( text < end ) {
+#if defined(__SSE2__)
+        // 4 whole groups at once
+        if ( _binaryIteration == 0 && end - text >= 16 && decodeBase64Block( text, out + count ) ) {
+            text += 16;
+            count += 12;
+            continue;
+        }
+#endif
+        // whole group of 4 digits without line breaks
+        if ( _binaryIteration == 0 && end - text >= 4 && (text[0] | text[1] | text[2] | text[3]) < 128 ) {
+            int k0 = base64_decode_table[text[0]];
+            int k1 = base64_decode_table[text[1]];
+            int k2 = base64_decode_table[text[2]];
+            int k3 = base64_decode_table[text[3]];
+            if ( (k0 | k1 | k2 | k3) >= 0 ) {
+                lUInt32 value = (k0 << 18) | (k1 << 12) | (k2 << 6) | k3;
+                out[count++] = (lUInt8)(value >> 16);
+                out[count++] = (lUInt8)(value >> 8);
+                out[count++] = (lUInt8)value;
+                text += 4;
+                continue;
+            }
+        }
+        lChar16 ch = *text++;
+        if ( ch >= 128 )
+            continue;
+        if ( ch == '=' ) {
+            // end of data
+            if ( _binaryIteration == 2 ) {
+                out[count++] = (lUInt8)(_binaryValue >> 4);
+            } else if ( _binaryIteration == 3 ) {
+                out[count++] = (lUInt8)(_binaryValue >> 10);
+                out[count++] = (lUInt8)(_binaryValue >> 2);
+            }
+            _binaryEnded = true;
+            break;
+        }
+        int k = base64_decode_table[ch];
+        if ( k < 0 )
+            continue;
+        _binaryValue = (_binaryValue << 6) | k;
+        if ( ++_binaryIteration == 4 ) {
+            out[count++] = (lUInt8)(_binaryValue >> 16);
+            out[count++] = (lUInt8)(_binaryValue >> 8);
+            out[count++] = (lUInt8)_binaryValue;
+            _binaryIteration = 0;
+            _binaryValue = 0;
+        }
+    }
+    _binaryData.addSpace( count - _binaryData.length() );
+}
+
+/// stores decoded FB2 binary to document blobs; called before binary element is closed
+void ldomDocumentWriter::addBinaryBlob()
+{
+    lString16 id = _currNode->getElement()->getAttributeValue( attr_id );
+    if ( !id.empty() && _binaryData.length() > 0 )
+        _document->addBlob( lString16(FB2_BINARY_NAME_PREFIX) + id, _binaryData.get(), _binaryData.length() );
+    _binaryData.erase( 0, _binaryData.length() );
+    _inBinary = false;
+}
+#endif
+
 // overrides
 void ldomDocumentWriter::OnStart(LVFileFormatParser * parser)
 {
@@ -5983,6 +6680,14 @@ ldomNode * ldomDocumentWriter::OnTagOpen( const lChar16 * nsname, const lChar16
         //CRLog::trace("stop tag found, stopping...");
     //    _parser->Stop();
     //}
+#if BUILD_LITE!=1
+    if ( id == el_binary && !_inBinary && _currNode && _currNode->getElement()->getNodeId() == el_FictionBook ) {
+        _inBinary = true;
+        _binaryEnded = false;
+        _binaryIteration = 0;
+        _binaryValue = 0;
+    }
+#endif
     _currNode = new ldomElementWriter( _document, nsid, id, _currNode );
     _flags = _currNode->getFlags();
     //logfile << " !o!\n";
@@ -6062,6 +6767,10 @@ void ldomDocumentWriter::OnTagClose( const lChar16 *, const lChar16 * tagname )
     lUInt16 id = _document->getElementNameIndex(tagname);
     //lUInt16 nsid = (nsname && nsname[0]) ? _document->getNsNameIndex(nsname) : 0;
     _errFlag |= (id != _currNode->getElement()->getNodeId());
+#if BUILD_LITE!=1
+    if ( _inBinary && id == el_binary && _currNode->getElement()->getNodeId() == el_binary )
+        addBinaryBlob();
+#endif
     _currNode = pop( _currNode, id );
 
     if ( _currNode )
@@ -6110,6 +6819,14 @@ void ldomDocumentWriter::OnText( const lChar16 * text, int len, lUInt32 flags )
         return;
     }
 
+#if BUILD_LITE!=1
+    // Binary data is not needed in DOM: decode it once, instead of on each image access
+    if (_inBinary) {
+        decodeBinaryText( text, len );
+        return;
+    }
+#endif
+
     if (_currNode)
     {
         if ( (_flags & XML_FLAG_NO_SPACE_TEXT)
@@ -6127,6 +6844,9 @@ void ldomDocumentWriter::OnEncoding( const lChar16 *, const lChar16 *)
 
 ldomDocumentWriter::ldomDocumentWriter(ldomDocument * document, bool headerOnly)
     : _document(document), _currNode(NULL), _errFlag(false), _headerOnly(headerOnly), _popStyleOnFinish(false), _flags(0), _inHeadStyle(false)
+#if BUILD_LITE!=1
+    , _inBinary(false), _binaryEnded(false), _binaryIteration(0), _binaryValue(0)
+#endif
 {
     _headStyleText.clear();
     _stylesheetLinks.clear();
@@ -6178,18 +6898,6 @@ bool FindNextNode( ldomNode * & node, ldomNode * root )
     return false;
 }
 
-// base64 decode table
-static const signed char base64_decode_table[] = {
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //0..15
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, //16..31   10
-   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,62,-1,-1,-1,63, //32..47   20
-   52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-1,-1,-1, //48..63   30
-   -1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14, //64..79   40
-   15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1, //80..95   50
-   -1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40, //INDEX2..111  60
-   41,42,43,44,45,46,47,48,49,50,51,-1,-1,-1,-1,-1  //112..127 70
-};
-
 #define BASE64_BUF_SIZE 128
 class LVBase64NodeStream : public LVNamedStream
 {
@@ -6322,7 +7030,8 @@ private:
 public:
     virtual ~LVBase64NodeStream() { }
     LVBase64NodeStream( ldomNode * element )
-        : m_elem(element), m_curr_node(element), m_size(0), m_pos(0)
+        : m_elem(element), m_curr_node(element), m_text_pos(0), m_size(0), m_pos(0)
+        , m_iteration(0), m_value(0), m_bytes_count(0), m_bytes_pos(0)
     {
         // calculate size
         rewind();
@@ -8230,8 +8939,23 @@ ldomXRangeList::ldomXRangeList( ldomXRangeList & srcList, bool splitIntersection
 /// split into subranges using intersection
 void ldomXRangeList::split( ldomXRange * r )
 {
-    int i;
-    for ( i=0; i<length(); i++ ) {
+    if ( r->isNull() )
+        return;
+    // This list is a sorted sequence of adjacent ranges (made by splitting
+    // a single range), so skip the ones ending before r with a binary search,
+    // and stop at the first one starting after r.
+    int i = 0;
+    int last = length();
+    while ( i < last ) {
+        int mid = (i + last) / 2;
+        if ( get(mid)->getEnd().compare( r->getStart() ) < 0 )
+            i = mid + 1;
+        else
+            last = mid;
+    }
+    for ( ; i<length(); i++ ) {
+        if ( get(i)->getStart().compare( r->getEnd() ) > 0 )
+            break;
         if ( r->checkIntersection( *get(i) ) ) {
             ldomXRange * src = remove( i );
             int cmp1 = src->getStart().compare( r->getStart() );
@@ -11228,6 +11952,7 @@ bool lxmlDocBase::DocFileHeader::serialize( SerialBuf & hdrbuf )
     hdrbuf.putMagic( doc_file_magic );
     //CRLog::trace("Serializing render data: %d %d %d %d", render_dx, render_dy, render_docflags, render_style_hash);
     hdrbuf << render_dx << render_dy << render_docflags << render_style_hash << stylesheet_hash << node_displaystyle_hash;
+    hdrbuf << node_style_hash << node_displaystyle_hash_rendered << styles_table_hash;
 
     hdrbuf.putCRC( hdrbuf.pos() - start );
 
@@ -11255,6 +11980,7 @@ bool lxmlDocBase::DocFileHeader::deserialize( SerialBuf & hdrbuf )
         return false;
     }
     hdrbuf >> render_dx >> render_dy >> render_docflags >> render_style_hash >> stylesheet_hash >> node_displaystyle_hash;
+    hdrbuf >> node_style_hash >> node_displaystyle_hash_rendered >> styles_table_hash;
     //CRLog::trace("Deserialized render data: %d %d %d %d", render_dx, render_dy, render_docflags, render_style_hash);
     hdrbuf.checkCRC( hdrbuf.pos() - start );
     if ( hdrbuf.error() ) {
@@ -11293,6 +12019,7 @@ void ldomDocument::clear()
 #if BUILD_LITE!=1
     clearRendBlockCache();
     _rendered = false;
+    _renderedLines.clear();
     _urlImageMap.clear();
     _fontList.clear();
     fontMan->UnregisterDocumentFonts(_docIndex);
@@ -11470,6 +12197,12 @@ bool ldomDocument::loadCacheFileContent(CacheLoadingCallback * formatCallback, L
     if ( loadStylesData() ) {
         CRLog::trace("ldomDocument::loadCacheFileContent() - using loaded styles");
         updateLoadedStyles( true );
+        if ( _hdr.styles_table_hash && _hdr.styles_table_hash == calcStylesTableHash() ) {
+            // node style indexes come from cache file, and styles and their fonts are the same as
+            // when rendering: saved node style hash is still valid, no need to read all nodes for it
+            _nodeStyleHash = _hdr.node_style_hash;
+            _nodeDisplayStyleHash = _hdr.node_displaystyle_hash_rendered;
+        }
 //        lUInt32 styleHash = calcStyleHash();
 //        styleHash = styleHash * 31 + calcGlobalSettingsHash();
 //        CRLog::debug("Loaded style hash: %x", styleHash);
@@ -11832,7 +12565,7 @@ lUInt32 tinyNodeCollection::calcStyleHash()
             if ( offs + sz > _elemCount+1 ) {
                 sz = _elemCount+1 - offs;
             }
-            ldomNode * buf = _elemList[i];
+            ldomNode * buf = getElemPart(i);
             for ( int j=0; j<sz; j++ ) {
                 if ( buf[j].isElement() ) {
                     css_style_ref_t style = buf[j].getStyle();
@@ -11876,6 +12609,23 @@ lUInt32 tinyNodeCollection::calcStyleHash()
     return res;
 }
 
+/// hash of style table and fonts of styles: when unchanged, saved node style hash is still valid
+lUInt32 tinyNodeCollection::calcStylesTableHash()
+{
+    // node style hash depends only on node style indexes and on styles and fonts behind them
+    LVArray<css_style_ref_t> * list = _styles.getIndex();
+    lUInt32 res = 0;
+    for ( int i=1; i<list->length(); i++ ) {
+        css_style_ref_t s = list->get( i );
+        if ( s.isNull() )
+            continue;
+        LVFontRef fnt = getFont( s.get(), getFontContextDocIndex() );
+        res = ((res * 31 + i) * 31 + calcHash( s )) * 31 + calcHash( fnt );
+    }
+    delete list;
+    return res;
+}
+
 static void validateChild( ldomNode * node )
 {
     // DEBUG TEST
@@ -11896,7 +12646,7 @@ bool tinyNodeCollection::validateDocument()
         if ( offs + sz > _elemCount+1 ) {
             sz = _elemCount+1 - offs;
         }
-        ldomNode * buf = _elemList[i];
+        ldomNode * buf = getElemPart(i);
         for ( int j=0; j<sz; j++ ) {
             buf[j].setDocumentIndex( _docIndex );
             if ( buf[j].isElement() ) {
@@ -11930,9 +12680,10 @@ bool tinyNodeCollection::updateLoadedStyles( bool enabled )
 {
     int count = ((_elemCount+TNC_PART_LEN-1) >> TNC_PART_SHIFT);
     bool res = true;
-    LVArray<css_style_ref_t> * list = _styles.getIndex();
 
     _fontMap.clear(); // style index to font index
+    // parts not read from cache file yet will be updated on reading
+    _lazyNodeStyles = enabled ? 1 : 2;
 
     for ( int i=0; i<count; i++ ) {
         int offs = i*TNC_PART_LEN;
@@ -11941,67 +12692,59 @@ bool tinyNodeCollection::updateLoadedStyles( bool enabled )
             sz = _elemCount+1 - offs;
         }
         ldomNode * buf = _elemList[i];
-        for ( int j=0; j<sz; j++ ) {
-            buf[j].setDocumentIndex( _docIndex );
-            if ( buf[j].isElement() ) {
-                lUInt16 style = getNodeStyleIndex( buf[j]._handle._dataIndex );
-                if ( enabled && style!=0 ) {
-                    css_style_ref_t s = list->get( style );
-                    if ( !s.isNull() ) {
-                        lUInt16 fntIndex = _fontMap.get( style );
-                        if ( fntIndex==0 ) {
-                            LVFontRef fnt = getFont(s.get(), getFontContextDocIndex());
-                            fntIndex = (lUInt16)_fonts.cache( fnt );
-                            if ( fnt.isNull() ) {
-                                CRLog::error("font not found for style!");
-                            } else {
-                                _fontMap.set(style, fntIndex);
-                            }
-                        } else {
-                            _fonts.addIndexRef( fntIndex );
-                        }
-                        if ( fntIndex<=0 ) {
-                            CRLog::error("font caching failed for style!");
-                            res = false;
+        if ( buf && !updateLoadedStyles( buf, sz, enabled ) )
+            res = false;
+    }
+    _nodeStyleHash = 0;
+    return res;
+}
+
+/// sets fonts for loaded styles of elements in one node part
+bool tinyNodeCollection::updateLoadedStyles( ldomNode * buf, int sz, bool enabled )
+{
+    bool res = true;
+    for ( int j=0; j<sz; j++ ) {
+        buf[j].setDocumentIndex( _docIndex );
+        if ( buf[j].isElement() ) {
+            lUInt16 style = getNodeStyleIndex( buf[j]._handle._dataIndex );
+            if ( enabled && style!=0 ) {
+                css_style_ref_t s = _styles.get( style );
+                if ( !s.isNull() ) {
+                    lUInt16 fntIndex = _fontMap.get( style );
+                    if ( fntIndex==0 ) {
+                        LVFontRef fnt = getFont(s.get(), getFontContextDocIndex());
+                        fntIndex = (lUInt16)_fonts.cache( fnt );
+                        if ( fnt.isNull() ) {
+                            CRLog::error("font not found for style!");
                         } else {
-                            setNodeFontIndex( buf[j]._handle._dataIndex, fntIndex );
-                            //buf[j]._data._pelem._fontIndex = fntIndex;
+                            _fontMap.set(style, fntIndex);
                         }
                     } else {
-                        CRLog::error("Loaded style index %d not found in style collection", (int)style);
-                        setNodeFontIndex( buf[j]._handle._dataIndex, 0 );
-                        setNodeStyleIndex( buf[j]._handle._dataIndex, 0 );
-//                        buf[j]._data._pelem._styleIndex = 0;
-//                        buf[j]._data._pelem._fontIndex = 0;
+                        _fonts.addIndexRef( fntIndex );
+                    }
+                    if ( fntIndex<=0 ) {
+                        CRLog::error("font caching failed for style!");
                         res = false;
+                    } else {
+                        setNodeFontIndex( buf[j]._handle._dataIndex, fntIndex );
+                        //buf[j]._data._pelem._fontIndex = fntIndex;
                     }
                 } else {
+                    CRLog::error("Loaded style index %d not found in style collection", (int)style);
                     setNodeFontIndex( buf[j]._handle._dataIndex, 0 );
                     setNodeStyleIndex( buf[j]._handle._dataIndex, 0 );
 //                    buf[j]._data._pelem._styleIndex = 0;
 //                    buf[j]._data._pelem._fontIndex = 0;
+                    res = false;
                 }
+            } else {
+                setNodeFontIndex( buf[j]._handle._dataIndex, 0 );
+                setNodeStyleIndex( buf[j]._handle._dataIndex, 0 );
+//                buf[j]._data._pelem._styleIndex = 0;
+//                buf[j]._data._pelem._fontIndex = 0;
             }
         }
     }
-#ifdef TODO_INVESTIGATE
-    if ( enabled && res) {
-        //_styles.setIndex( *list );
-        // correct list reference counters
-
-        for ( int i=0; i<list->length(); i++ ) {
-            if ( !list->get(i).isNull() ) {
-                // decrease reference counter
-                // TODO:
-                //_styles.release( list->get(i) );
-            }
-        }
-    }
-#endif
-    delete list;
-//    getRootNode()->setFont( _def_font );
-//    getRootNode()->setStyle( _def_style );
-    _nodeStyleHash = 0;
     return res;
 }
 
@@ -12069,9 +12812,28 @@ ContinuousOperationResult ldomDocument::updateMap(CRTimerUtil & maxTime, LVDocVi
 
 #endif
 
-static const char * doccache_magic = "CoolReader3 Document Cache Directory Index\nV1.00\n";
+static const char * doccache_magic_v1 = "CoolReader3 Document Cache Directory Index\nV1.00\n";
+static const char * doccache_magic = "CoolReader3 Document Cache Directory Index\nV2.00\n";
+
+class ldomDocCacheImpl;
+
+/// deletes files evicted from document cache, on executor thread
+class ldomDocCacheRemoveTask : public CRRunnable
+{
+    ldomDocCacheImpl * _cache;
+public:
+    ldomDocCacheRemoveTask( ldomDocCacheImpl * cache ) : _cache(cache) { }
+    virtual void run();
+};
 
 /// document cache
+/**
+    Catalog with size, last access time and format version of each cache file is kept in cr3cache.inx,
+    so opening a book needs no directory scan: directory is listed once on init, to delete files
+    missing from catalog, or to rebuild catalog from them when it cannot be read.
+    Least recently used files are evicted when total size exceeds maxSize. Evicted files are
+    listed in catalog until deleted, by executor thread when concurrencyProvider is set.
+*/
 class ldomDocCacheImpl : public ldomDocCache
 {
     lString16 _cacheDir;
@@ -12082,14 +12844,39 @@ class ldomDocCacheImpl : public ldomDocCache
     struct FileItem {
         lString16 filename;
         lUInt32 size;
+        lUInt32 lastAccess; // seconds since epoch
+        lString8 version;   // cache file format version, empty if unknown
     };
     LVPtrVector<FileItem> _files;
+    LVHashTable<lString16, FileItem*> _map; // file name -> catalog item
+    lvsize_t _totalSize;
+    lString16Collection _removed; // evicted files which are not deleted yet
+    bool _accessChanged; // last access times are not saved yet
+    CRMutexRef _mutex; // guards catalog when evicted files are deleted by executor thread
+    CRThreadExecutor * _executor;
+
+    static lUInt32 now()
+    {
+        return (lUInt32)(CRTimerUtil::getSystemTimeMillis() / 1000);
+    }
+
+    static int compareLastAccess( const FileItem ** item1, const FileItem ** item2 )
+    {
+        if ( (*item1)->lastAccess != (*item2)->lastAccess )
+            return (*item1)->lastAccess < (*item2)->lastAccess ? -1 : 1;
+        return 0;
+    }
 public:
     ldomDocCacheImpl( lString16 cacheDir, lvsize_t maxSize )
         : _cacheDir( cacheDir ), _maxSize( maxSize ), _oldStreamSize(0), _oldStreamCRC(0)
+        , _map(1024), _totalSize(0), _accessChanged(false), _executor(NULL)
     {
         LVAppendPathDelimiter( _cacheDir );
         CRLog::trace("ldomDocCacheImpl(%s maxSize=%d)", LCSTR(_cacheDir), (int)maxSize);
+        if ( concurrencyProvider ) {
+            _mutex = concurrencyProvider->createMutex();
+            _executor = new CRThreadExecutor();
+        }
     }
 
     bool writeIndex()
@@ -12098,9 +12885,11 @@ public:
         if (_oldStreamSize == 0)
         {
             LVStreamRef oldStream = LVOpenFileStream(filename.c_str(), LVOM_READ);
-            if (!oldStream.isNull()) {
+            if (!oldStream.isNull() && oldStream->GetSize() > 4) {
                 _oldStreamSize = (lUInt32)oldStream->GetSize();
-                _oldStreamCRC = (lUInt32)oldStream->getcrc32();
+                LVStreamBufferRef sb = oldStream->GetReadBuffer(0, _oldStreamSize - 4);
+                if ( !sb.isNull() )
+                    _oldStreamCRC = lStr_crc32( 0, sb->getReadOnly(), sb->getSize() );
             }
         }
 
@@ -12114,12 +12903,18 @@ public:
             FileItem * item = _files[i];
             buf << item->filename;
             buf << item->size;
-            CRLog::trace("cache item: %s %d", LCSTR(item->filename), (int)item->size);
+            buf << item->lastAccess;
+            buf << item->version;
         }
+        buf << (lUInt32)_removed.length();
+        for ( int i=0; i<_removed.length() && !buf.error(); i++ )
+            buf << _removed[i];
+        // taken before CRC is appended: CRC of data followed by its CRC is the same for any data of same size
+        lUInt32 newCRC = buf.getCRC();
         buf.putCRC( buf.pos() - start );
         if ( buf.error() )
             return false;
-        lUInt32 newCRC = buf.getCRC();
+        _accessChanged = false;
         lUInt32 newSize = buf.pos();
 
         // check to avoid rewritting of identical file
@@ -12137,11 +12932,30 @@ public:
         return true;
     }
 
+    FileItem * addFile( lString16 filename, lUInt32 size, lUInt32 lastAccess, lString8 version )
+    {
+        FileItem * item = new FileItem();
+        item->filename = filename;
+        item->size = size;
+        item->lastAccess = lastAccess;
+        item->version = version;
+        _files.add( item );
+        _map.set( filename, item );
+        _totalSize += size;
+        return item;
+    }
+
+    void removeFile( FileItem * item )
+    {
+        _map.remove( item->filename );
+        _totalSize -= item->size;
+        delete _files.remove( item );
+    }
+
     bool readIndex(  )
     {
         lString16 filename = _cacheDir + "cr3cache.inx";
         // read index
-        lUInt32 totalSize = 0;
         LVStreamRef instream = LVOpenFileStream( filename.c_str(), LVOM_READ );
         if ( !instream.isNull() ) {
             LVStreamBufferRef sb = instream->GetReadBuffer(0, instream->GetSize() );
@@ -12149,20 +12963,52 @@ public:
                 return false;
             SerialBuf buf( sb->getReadOnly(), sb->getSize() );
             if ( !buf.checkMagic( doccache_magic ) ) {
-                CRLog::error("wrong cache index file format");
-                return false;
+                // previous index format: file names and sizes only, most recently used first
+                SerialBuf buf1( sb->getReadOnly(), sb->getSize() );
+                if ( !buf1.checkMagic( doccache_magic_v1 ) ) {
+                    CRLog::error("wrong cache index file format");
+                    return false;
+                }
+                lUInt32 start = buf1.pos();
+                lUInt32 count;
+                buf1 >> count;
+                for (lUInt32 i=0; i < count && !buf1.error(); i++) {
+                    lString16 fn;
+                    lUInt32 size;
+                    buf1 >> fn;
+                    buf1 >> size;
+                    if ( !buf1.error() && !_map.get( fn ) )
+                        addFile( fn, size, count - i, lString8::empty_str );
+                }
+                if ( !buf1.checkCRC( buf1.pos() - start ) || buf1.error() ) {
+                    CRLog::error("CRC32 doesn't match in cache index file");
+                    return false;
+                }
+                CRLog::info( "Document cache index file of previous version read ok, %d files in cache", _files.length() );
+                return true;
             }
 
             lUInt32 start = buf.pos();
             lUInt32 count;
             buf >> count;
             for (lUInt32 i=0; i < count && !buf.error(); i++) {
-                FileItem * item = new FileItem();
-                _files.add( item );
-                buf >> item->filename;
-                buf >> item->size;
-                CRLog::trace("cache %d: %s [%d]", i, UnicodeToUtf8(item->filename).c_str(), (int)item->size );
-                totalSize += item->size;
+                lString16 fn;
+                lUInt32 size;
+                lUInt32 lastAccess;
+                lString8 version;
+                buf >> fn;
+                buf >> size;
+                buf >> lastAccess;
+                buf >> version;
+                if ( !buf.error() && !_map.get( fn ) )
+                    addFile( fn, size, lastAccess, version );
+            }
+            lUInt32 removedCount;
+            buf >> removedCount;
+            for (lUInt32 i=0; i < removedCount && !buf.error(); i++) {
+                lString16 fn;
+                buf >> fn;
+                _removed.add( fn );
             }
             if ( !buf.checkCRC( buf.pos() - start ) ) {
                 CRLog::error("CRC32 doesn't match in cache index file");
@@ -12172,7 +13018,7 @@ public:
             if ( buf.error() )
                 return false;
 
-            CRLog::info( "Document cache index file read ok, %d files in cache, %d bytes", _files.length(), totalSize );
+            CRLog::info( "Document cache index file read ok, %d files in cache, %d bytes", _files.length(), (int)_totalSize );
             return true;
         } else {
             CRLog::error( "Document cache index file cannot be read" );
@@ -12180,8 +13026,9 @@ public:
         }
     }
 
-    /// remove all .cr3 files which are not listed in index
-    bool removeExtraFiles( )
+    /// lists .cr3 files of cache directory which are not in catalog: they are deleted when catalog
+    /// is read, as interrupted saves leave them, otherwise catalog is rebuilt from them
+    bool scanDirectory( bool removeExtraFiles )
     {
         LVContainerRef container;
         container = LVOpenDirectory( _cacheDir.c_str(), L"*.cr3" );
@@ -12200,71 +13047,74 @@ public:
             const LVContainerItemInfo * item = container->GetObjectInfo( i );
             if ( !item->IsContainer() ) {
                 lString16 fn = item->GetName();
-                if ( !fn.endsWith(".cr3") )
+                if ( !fn.endsWith(".cr3") || _map.get( fn ) || _removed.contains( fn ) )
                     continue;
-                if ( findFileIndex(fn)<0 ) {
-                    // delete file
+                if ( removeExtraFiles ) {
                     CRLog::info("Removing cache file not specified in index: %s", UnicodeToUtf8(fn).c_str() );
-                    if ( !LVDeleteFile( _cacheDir + fn ) ) {
-                        CRLog::error("Error while removing cache file not specified in index: %s", UnicodeToUtf8(fn).c_str() );
-                    }
+                    _removed.add( fn );
+                    continue;
                 }
+                // files not listed in catalog are kept, as least recently used ones
+                CRLog::info("Adding cache file not specified in index: %s", UnicodeToUtf8(fn).c_str() );
+                addFile( fn, (lUInt32)item->GetSize(), 0, lString8::empty_str );
             }
         }
         return true;
     }
 
-    // remove all extra files to add new one of specified size
-    bool reserve( lvsize_t allocSize )
+    /// deletes evicted files
+    void removeFiles()
     {
-        bool res = true;
-        // remove extra files specified in list
-        lvsize_t dirsize = allocSize;
-        for ( int i=0; i<_files.length(); ) {
-            if ( LVFileExists( _cacheDir + _files[i]->filename ) ) {
-                if ( (i>0 || allocSize>0) && dirsize+_files[i]->size > _maxSize ) {
-                    if ( LVDeleteFile( _cacheDir + _files[i]->filename ) ) {
-                        _files.erase(i, 1);
-                    } else {
-                        CRLog::error("Cannot delete cache file %s", UnicodeToUtf8(_files[i]->filename).c_str() );
-                        dirsize += _files[i]->size;
-                        res = false;
-                        i++;
-                    }
-                } else {
-                    dirsize += _files[i]->size;
-                    i++;
-                }
-            } else {
-                CRLog::error("File %s is found in cache index, but does not exist", UnicodeToUtf8(_files[i]->filename).c_str() );
-                _files.erase(i, 1);
+        CRGuard guard(_mutex);
+        CR_UNUSED(guard);
+        if ( !_removed.length() )
+            return;
+        lString16Collection failed;
+        for ( int i=0; i<_removed.length(); i++ ) {
+            if ( !LVDeleteFile( _cacheDir + _removed[i] ) && LVFileExists( _cacheDir + _removed[i] ) ) {
+                CRLog::error("Cannot delete cache file %s", UnicodeToUtf8(_removed[i]).c_str() );
+                failed.add( _removed[i] );
             }
         }
-        return res;
+        _removed.clear();
+        _removed.addAll( failed );
+        writeIndex();
     }
 
-    int findFileIndex( lString16 filename )
+    /// evicts file from catalog, it's deleted later by removeFiles()
+    void evict( FileItem * item )
     {
-        for ( int i=0; i<_files.length(); i++ ) {
-            if ( _files[i]->filename == filename )
-                return i;
-        }
-        return -1;
+        CRLog::info("Evicting cache file %s (%d bytes)", UnicodeToUtf8(item->filename).c_str(), (int)item->size );
+        _removed.add( item->filename );
+        removeFile( item );
     }
 
-    bool moveFileToTop( lString16 filename, lUInt32 size )
+    /// deletes evicted files on executor thread, or right now if there is no one
+    void scheduleRemoveFiles()
     {
-        int index = findFileIndex( filename );
-        if ( index<0 ) {
-            FileItem * item = new FileItem();
-            item->filename = filename;
-            item->size = size;
-            _files.insert( 0, item );
+        if ( !_removed.length() )
+            return;
+        if ( _executor ) {
+            _executor->execute( new ldomDocCacheRemoveTask( this ) );
         } else {
-            _files.move( 0, index );
-            _files[0]->size = size;
+            removeFiles();
+        }
+    }
+
+    // evict least recently used files to add new one of specified size, never evicts keep item
+    void reserve( lvsize_t allocSize, FileItem * keep )
+    {
+        if ( _totalSize + allocSize <= _maxSize )
+            return;
+        _files.sort( compareLastAccess );
+        for ( int i=0; i<_files.length() && _totalSize + allocSize > _maxSize; ) {
+            // when nothing is added, most recently used file stays even if it's too big
+            if ( _files[i] == keep || (allocSize == 0 && i == _files.length() - 1) ) {
+                i++;
+                continue;
+            }
+            evict( _files[i] );
         }
-        return writeIndex();
     }
 
     bool init()
@@ -12274,28 +13124,41 @@ public:
         if ( readIndex(  ) ) {
             // read successfully
             // remove files not specified in list
-            removeExtraFiles( );
+            scanDirectory( true );
         } else {
-            if ( !LVCreateDirectory( _cacheDir ) ) {
+            _files.clear();
+            _map.clear();
+            _removed.clear();
+            _totalSize = 0;
+            if ( !scanDirectory( false ) ) {
                 CRLog::error("Document Cache: cannot create cache directory %s, disabling cache", UnicodeToUtf8(_cacheDir).c_str() );
                 return false;
             }
-            _files.clear();
-
         }
-        reserve(0);
+        // files of other cache file format version cannot be opened anymore
+        lString8 version( CACHE_FILE_FORMAT_VERSION );
+        for ( int i=_files.length()-1; i>=0; i-- ) {
+            if ( !_files[i]->version.empty() && _files[i]->version != version )
+                evict( _files[i] );
+        }
+        reserve( 0, NULL );
         if ( !writeIndex() )
             return false; // cannot write index: read only?
+        scheduleRemoveFiles();
         return true;
     }
 
     /// remove all files
     bool clear()
     {
-        for ( int i=0; i<_files.length(); i++ )
-            LVDeleteFile( _files[i]->filename );
-        _files.clear();
-        return writeIndex();
+        {
+            CRGuard guard(_mutex);
+            CR_UNUSED(guard);
+            while ( _files.length() )
+                evict( _files[0] );
+        }
+        removeFiles();
+        return _removed.length() == 0;
     }
 
     // dir/filename.{crc32}.cr3
@@ -12333,6 +13196,8 @@ public:
     /// open existing cache file stream
     LVStreamRef openExisting( lString16 filename, lUInt32 crc, lUInt32 docFlags, lString16 &cachePath )
     {
+        CRGuard guard(_mutex);
+        CR_UNUSED(guard);
         lString16 fn = makeFileName( filename, crc, docFlags );
         CRLog::debug("ldomDocCache::openExisting(%s)", LCSTR(fn));
         // Try filename with ".keep" extension (that a user can manually add
@@ -12352,7 +13217,8 @@ public:
             }
         }
         LVStreamRef res;
-        if ( findFileIndex( fn ) < 0 ) {
+        FileItem * item = _map.get( fn );
+        if ( !item ) {
             CRLog::error( "ldomDocCache::openExisting - File %s is not found in cache index", UnicodeToUtf8(fn).c_str() );
             return res;
         }
@@ -12360,6 +13226,8 @@ public:
         res = LVOpenFileStream( pathname.c_str(), LVOM_APPEND|LVOM_FLAG_SYNC );
         if ( !res ) {
             CRLog::error( "ldomDocCache::openExisting - File %s is listed in cache index, but cannot be opened", UnicodeToUtf8(fn).c_str() );
+            removeFile( item );
+            writeIndex();
             return res;
         }
         cachePath = pathname;
@@ -12378,12 +13246,47 @@ public:
 #endif
 
         lUInt32 fileSize = (lUInt32) res->GetSize();
-        moveFileToTop( fn, fileSize );
+        _totalSize = _totalSize - item->size + fileSize;
+        item->size = fileSize;
+        item->lastAccess = now();
+        // saved with next catalog change or when file is closed
+        _accessChanged = true;
         return res;
     }
 
     /// create new cache file
     LVStreamRef createNew( lString16 filename, lUInt32 crc, lUInt32 docFlags, lUInt32 fileSize, lString16 &cachePath )
+    {
+        LVStreamRef res;
+        {
+            CRGuard guard(_mutex);
+            CR_UNUSED(guard);
+            res = createFile( filename, crc, docFlags, fileSize, cachePath );
+        }
+        scheduleRemoveFiles();
+        return res;
+    }
+
+    /// cache file is closed: update its size, and evict other files if it doesn't fit
+    void updateFileSize( lString16 cachePath, lvsize_t size )
+    {
+        {
+            CRGuard guard(_mutex);
+            CR_UNUSED(guard);
+            if ( !cachePath.startsWith( _cacheDir ) )
+                return;
+            FileItem * item = _map.get( cachePath.substr( _cacheDir.length() ) );
+            if ( !item || (item->size == size && !_accessChanged) )
+                return;
+            _totalSize = _totalSize - item->size + size;
+            item->size = (lUInt32)size;
+            reserve( 0, item );
+            writeIndex();
+        }
+        scheduleRemoveFiles();
+    }
+
+    LVStreamRef createFile( lString16 filename, lUInt32 crc, lUInt32 docFlags, lUInt32 fileSize, lString16 &cachePath )
     {
         lString16 fn = makeFileName( filename, crc, docFlags );
         LVStreamRef res;
@@ -12407,9 +13310,22 @@ public:
                 return stream;
             }
         }
-        if ( findFileIndex( pathname ) >= 0 )
-            LVDeleteFile( pathname );
-        reserve( fileSize/10 );
+        FileItem * item = _map.get( fn );
+        if ( item )
+            removeFile( item );
+        lString16Collection removed;
+        for ( int i=0; i<_removed.length(); i++ ) {
+            if ( _removed[i] != fn ) // deleted right now
+                removed.add( _removed[i] );
+        }
+        _removed.clear();
+        _removed.addAll( removed );
+        // real size is known when file is closed
+        lUInt32 estimatedSize = fileSize/10;
+        reserve( estimatedSize, NULL );
+        // list file in catalog before creating it: interrupted creation leaves no unknown files
+        addFile( fn, estimatedSize, now(), lString8( CACHE_FILE_FORMAT_VERSION ) );
+        writeIndex();
         //res = LVMapFileStream( (_cacheDir+fn).c_str(), LVOM_APPEND, fileSize );
         LVDeleteFile( pathname ); // try to delete, ignore errors
         res = LVOpenFileStream( pathname.c_str(), LVOM_APPEND|LVOM_FLAG_SYNC );
@@ -12429,15 +13345,26 @@ public:
         res = LVCreateCompareTestStream(res, stream2);
 #endif
 #endif
-        moveFileToTop( fn, fileSize );
         return res;
     }
 
     virtual ~ldomDocCacheImpl()
     {
+        if ( _executor ) {
+            _executor->stop();
+            delete _executor;
+        }
+        removeFiles();
+        if ( _accessChanged )
+            writeIndex();
     }
 };
 
+void ldomDocCacheRemoveTask::run()
+{
+    _cache->removeFiles();
+}
+
 static ldomDocCacheImpl * _cacheInstance = NULL;
 
 bool ldomDocCache::init( lString16 cacheDir, lvsize_t maxSize )
@@ -12449,8 +13376,13 @@ bool ldomDocCache::init( lString16 cacheDir, lvsize_t maxSize )
     if ( !_cacheInstance->init() ) {
         delete _cacheInstance;
         _cacheInstance = NULL;
+        LVStyleSheetCache::setCacheDir( lString16::empty_str );
+        LVDocumentFontCache::setCacheDir( lString16::empty_str );
         return false;
     }
+    // compiled stylesheets and decoded embedded fonts are kept next to document cache files
+    LVStyleSheetCache::setCacheDir( cacheDir );
+    LVDocumentFontCache::setCacheDir( cacheDir );
     return true;
 }
 
@@ -12458,6 +13390,8 @@ bool ldomDocCache::close()
 {
     if ( !_cacheInstance )
         return false;
+    LVStyleSheetCache::setCacheDir( lString16::empty_str );
+    LVDocumentFontCache::setCacheDir( lString16::empty_str );
     delete _cacheInstance;
     _cacheInstance = NULL;
     return true;
@@ -12484,9 +13418,20 @@ bool ldomDocCache::clear()
 {
     if ( !_cacheInstance )
         return false;
+    LVStyleSheetCache::clear();
+    LVDocumentFontCache::clear();
     return _cacheInstance->clear();
 }
 
+/// update size of closed cache file, evicting other files if needed
+void ldomDocCache::updateFileSize( lString16 cachePath, lvsize_t size )
+{
+    if ( _cacheInstance )
+        _cacheInstance->updateFileSize( cachePath, size );
+    // document is closed: good time to save stylesheets compiled for it
+    LVStyleSheetCache::save();
+}
+
 /// returns true if cache is enabled (successfully initialized)
 bool ldomDocCache::enabled()
 {
@@ -12533,10 +13478,48 @@ void ldomDocument::updateRenderContext()
     _hdr.render_dy = dy;
     _hdr.render_docflags = _docFlags;
     _hdr.node_displaystyle_hash = _nodeDisplayStyleHashInitial; // we keep using the initial one
+    _hdr.node_style_hash = _nodeStyleHash;
+    _hdr.node_displaystyle_hash_rendered = _nodeDisplayStyleHash;
+    _hdr.styles_table_hash = calcStylesTableHash();
     CRLog::info("Updating render properties: styleHash=%x, stylesheetHash=%x, docflags=%x, width=%x, height=%x, nodeDisplayStyleHash=%x",
                 _hdr.render_style_hash, _hdr.stylesheet_hash, _hdr.render_docflags, _hdr.render_dx, _hdr.render_dy, _hdr.node_displaystyle_hash);
 }
 
+/// returns hash of formatting options which are not part of style hash
+lUInt32 ldomDocument::calcRenderOptionsHash()
+{
+    lUInt32 hash = (lUInt32)_imgScalingOptions.getHash();
+    hash = hash * 31 + _spaceWidthScalePercent;
+    hash = hash * 31 + _minSpaceCondensingPercent;
+    return hash;
+}
+
+/// returns true if only page height is changed since last render, and pages can be split again without reformatting
+bool ldomDocument::canRepaginate( bool showCover, int y0 )
+{
+    if ( !_rendered || _renderedLines.isNull() )
+        return false;
+    int dy = _page_height;
+    if ( dy == (int)_hdr.render_dy || dy < _renderMinPageHeight || dy > _renderMaxPageHeight )
+        return false;
+    // cover page height is added to all positions
+    if ( showCover != _renderedShowCover || y0 != _renderedY0 )
+        return false;
+    if ( calcRenderOptionsHash() != _renderedOptionsHash )
+        return false;
+    ldomNode * node = getRootNode();
+    if ( node == NULL || node->getFont().isNull() )
+        return false;
+    if ( _page_width != (int)_hdr.render_dx || _docFlags != _hdr.render_docflags )
+        return false;
+    lUInt32 stylesheetHash = (((_stylesheet.getHash() * 31) + calcHash(_def_style))*31 + calcHash(_def_font));
+    if ( stylesheetHash != _hdr.stylesheet_hash )
+        return false;
+    if ( calcStyleHash() != _hdr.render_style_hash )
+        return false;
+    return true;
+}
+
 /// check document formatting parameters before render - whether we need to reformat; returns false if render is necessary
 bool ldomDocument::checkRenderContext()
 {
@@ -13231,6 +14214,7 @@ const lString16 & ldomNode::getAttributeName( lUInt32 index ) const
 void ldomNode::setAttributeValue( lUInt16 nsid, lUInt16 id, const lChar16 * value )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if ( !isElement() )
         return;
     lUInt32 valueIndex = getDocument()->getAttrValueIndex(value);
@@ -13363,6 +14347,7 @@ lUInt16 ldomNode::getNodeNsId() const
 void ldomNode::setNodeId( lUInt16 id )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if ( !isElement() )
         return;
 #if BUILD_LITE!=1
@@ -13523,6 +14508,7 @@ lString8 ldomNode::getText8( lChar8 blockDelimiter, int maxSize ) const
 void ldomNode::setText( lString16 str )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     switch ( TNTYPE ) {
     case NT_ELEMENT:
         readOnlyError();
@@ -13554,6 +14540,7 @@ void ldomNode::setText( lString16 str )
 void ldomNode::setText8( lString8 utf8 )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     switch ( TNTYPE ) {
     case NT_ELEMENT:
         readOnlyError();
@@ -14407,6 +15394,7 @@ void ldomNode::removeLastChild()
 void ldomNode::addChild( lInt32 childNodeIndex )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if ( !isElement() )
         return;
     if ( isPersistent() )
@@ -14419,6 +15407,7 @@ void ldomNode::addChild( lInt32 childNodeIndex )
 void ldomNode::moveItemsTo( ldomNode * destination, int startChildIndex, int endChildIndex )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if ( !isElement() )
         return;
     if ( isPersistent() )
@@ -14500,6 +15489,7 @@ ldomNode * ldomNode::findChildElement( lUInt16 idPath[] )
 ldomNode * ldomNode::insertChildElement( lUInt32 index, lUInt16 nsid, lUInt16 id )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14518,6 +15508,7 @@ ldomNode * ldomNode::insertChildElement( lUInt32 index, lUInt16 nsid, lUInt16 id
 ldomNode * ldomNode::insertChildElement( lUInt16 id )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14533,6 +15524,7 @@ ldomNode * ldomNode::insertChildElement( lUInt16 id )
 ldomNode * ldomNode::insertChildText( lUInt32 index, const lString16 & value )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14560,6 +15552,7 @@ ldomNode * ldomNode::insertChildText( lUInt32 index, const lString16 & value )
 ldomNode * ldomNode::insertChildText( const lString16 & value )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14584,6 +15577,7 @@ ldomNode * ldomNode::insertChildText( const lString16 & value )
 ldomNode * ldomNode::insertChildText(const lString8 & s8)
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14606,6 +15600,7 @@ ldomNode * ldomNode::insertChildText(const lString8 & s8)
 ldomNode * ldomNode::removeChild( lUInt32 index )
 {
     ASSERT_NODE_NOT_NULL;
+    getDocument()->contentChanged();
     if  ( isElement() ) {
         if ( isPersistent() )
             modify();
@@ -14857,6 +15852,10 @@ LVStreamRef ldomDocument::getObjectImageStream( lString16 refName )
         }
         return ref;
     }
+    // FB2 binary decoded while parsing; binaries not written by ldomDocumentWriter are read from DOM
+    ref = _blobCache.getBlob( lString16(FB2_BINARY_NAME_PREFIX) + (refName.c_str() + 1) );
+    if ( !ref.isNull() )
+        return ref;
     lUInt32 refValueId = findAttrValueIndex( refName.c_str() + 1 );
     if ( refValueId == (lUInt32)-1 ) {
         return ref;
@@ -15125,6 +16124,10 @@ lString16 tinyNodeCollection::getStatistics()
     s << "Styles: " << fmt::decimal(_styles.length()) << ", " << fmt::decimal(_styleStorage.getUncompressedSize()/1024) << " KB\n";
     s << "Font instances: " << fmt::decimal(_fonts.length()) << "\n";
     s << "Rects: " << fmt::decimal(_rectStorage.getUncompressedSize()/1024) << " KB\n";
+    s << "Text storage: " << _textStorage.getStatistics() << "\n";
+    s << "Element storage: " << _elemStorage.getStatistics() << "\n";
+    s << "Rect storage: " << _rectStorage.getStatistics() << "\n";
+    s << "Style storage: " << _styleStorage.getStatistics() << "\n";
     #if BUILD_LITE!=1
     s << "Cached rendered blocks: " << fmt::decimal(((ldomDocument*)this)->_renderedBlockCache.length()) << "\n";
     #endif
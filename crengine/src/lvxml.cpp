@@ -16,6 +16,10 @@
 #include "../include/fb2def.h"
 #include "../include/lvdocview.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 typedef struct {
    unsigned short indx; /* index into big table */
    unsigned short used; /* bitmask of used entries */
@@ -1048,11 +1052,17 @@ static const lChar16 * heading_chapter[] = {
     NULL
 };
 
+#define MAX_HEADING_PREFIX 16
+
 static bool startsWithOneOf( const lString16 & s, const lChar16 * list[] )
 {
-    lString16 str = s;
-    str.lowercase();
-    const lChar16 * p = str.c_str();
+    // heading words are short: lowercase copy of string start only
+    lChar16 p[MAX_HEADING_PREFIX + 1];
+    int len = 0;
+    for ( const lChar16 * src = s.c_str(); len < MAX_HEADING_PREFIX && src[len]; len++ )
+        p[len] = src[len];
+    p[len] = 0;
+    lStr_lowercase( p, len );
     for ( int i=0; list[i]; i++ ) {
         const lChar16 * q = list[i];
         int j=0;
@@ -1120,6 +1130,35 @@ typedef enum {
     la_width     // justified width
 } lineAlign_t;
 
+/// returns pointer to first char not above bound in [p, end), or end
+static inline const lChar16 * skipCharsAbove( const lChar16 * p, const lChar16 * end, lChar16 bound )
+{
+#if defined(__SSE2__) && (__SIZEOF_WCHAR_T__ == 4 || __SIZEOF_WCHAR_T__ == 2)
+    const int step = 16 / sizeof(lChar16);
+#if __SIZEOF_WCHAR_T__ == 4
+    const __m128i b = _mm_set1_epi32( (int)bound );
+#else
+    const __m128i b = _mm_set1_epi16( (short)bound );
+    const __m128i zero = _mm_setzero_si128();
+#endif
+    for ( ; end - p >= step; p += step ) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)p );
+#if __SIZEOF_WCHAR_T__ == 4
+        __m128i above = _mm_cmpgt_epi32( v, b ); // signed, as lChar16 comparison
+        if ( _mm_movemask_epi8( above ) != 0xFFFF )
+            break;
+#else
+        __m128i notAbove = _mm_cmpeq_epi16( _mm_subs_epu16( v, b ), zero );
+        if ( _mm_movemask_epi8( notAbove ) )
+            break;
+#endif
+    }
+#endif
+    while ( p < end && *p > bound )
+        p++;
+    return p;
+}
+
 class LVTextFileLine
 {
 public:
@@ -1132,14 +1171,32 @@ public:
     lineAlign_t align;
     bool empty() { return rpos==0; }
     bool isHeading() { return (flags & LINE_IS_HEADER)!=0; }
-    LVTextFileLine( LVTextFileBase * file, int maxsize )
+    LVTextFileLine()
     : flags(0), lpos(0), rpos(0), align(la_unknown)
     {
-        text = file->ReadLine( maxsize, flags );
+    }
+    /// reads next line from file, reusing text buffer
+    void read( LVTextFileBase * file, int maxsize )
+    {
+        lpos = rpos = 0;
+        align = la_unknown;
+        file->ReadLine( text, maxsize, flags );
         //CRLog::debug("  line read: %s", UnicodeToUtf8(text).c_str() );
         if ( !text.empty() ) {
             const lChar16 * s = text.c_str();
+            const lChar16 * end = s + text.length();
             for ( int p=0; *s; s++ ) {
+                // run of chars which are neither spaces nor tabs
+                const lChar16 * run = skipCharsAbove( s, end, ' ' );
+                if ( run > s ) {
+                    if ( rpos==0 && p>0 )
+                        lpos = (lUInt16)p;
+                    p += (int)(run - s);
+                    rpos = (lUInt16)p;
+                    s = run;
+                    if ( !*s )
+                        break;
+                }
                 if ( *s == '\t' ) {
                     p = (p + 8)%8;
                 } else {
@@ -1176,11 +1233,85 @@ lChar16 getSingleLineChar( const lString16 & s) {
 #define MAX_PARA_LINES 30
 #define MAX_BUF_LINES  200
 #define MIN_MULTILINE_PARA_WIDTH 45
+#define MAX_PRE_STATS 1000
+
+/// line statistics for text format detection, gathered while sample lines are read
+struct LVTextSampleStats
+{
+    int empty_lines;
+    int pmlTagCount;
+    int min_left;
+    int max_right;
+    int sum_left;
+    int sum_right;
+    int left_stats[MAX_PRE_STATS];
+    int right_stats[MAX_PRE_STATS];
+    void reset()
+    {
+        empty_lines = 0;
+        pmlTagCount = 0;
+        min_left = -1;
+        max_right = -1;
+        sum_left = 0;
+        sum_right = 0;
+        for ( int i=0; i<MAX_PRE_STATS; i++ )
+            left_stats[i] = right_stats[i] = 0;
+    }
+    void add( LVTextFileLine * line )
+    {
+        //CRLog::debug("   LINE: %d .. %d", line->lpos, line->rpos);
+        if ( line->lpos == line->rpos ) {
+            empty_lines++;
+            return;
+        }
+        if ( line->lpos < MAX_PRE_STATS )
+            left_stats[line->lpos]++;
+        if ( line->rpos < MAX_PRE_STATS )
+            right_stats[line->rpos]++;
+        if ( min_left==-1 || line->lpos<min_left )
+            min_left = line->lpos;
+        if ( max_right==-1 || line->rpos>max_right )
+            max_right = line->rpos;
+        sum_left += line->lpos;
+        sum_right += line->rpos;
+        const lChar16 * text = line->text.c_str();
+        for (int j=line->lpos; j<line->rpos-1; j++ ) {
+            if ( text[j]=='\\' ) {
+                switch ( text[j+1] ) {
+                case 'p':
+                case 'x':
+                case 'X':
+                case 'C':
+                case 'c':
+                case 'r':
+                case 'u':
+                case 'o':
+                case 'v':
+                case 't':
+                case 'n':
+                case 's':
+                case 'b':
+                case 'l':
+                case 'a':
+                case 'U':
+                case 'm':
+                case 'q':
+                case 'Q':
+                    pmlTagCount++;
+                    break;
+                }
+            }
+        }
+    }
+};
 
 class LVTextLineQueue : public LVPtrVector<LVTextFileLine>
 {
 private:
     LVTextFileBase * file;
+    LVPtrVector<LVTextFileLine> freeLines; // removed lines, reused with their text buffers
+    LVTextSampleStats * sampleStats; // not NULL while sample for format detection is read
+    lString16 paraText;
     int first_line_index;
     int maxLineSize;
     lString16 bookTitle;
@@ -1215,7 +1346,7 @@ private:
     } formatFlags_t;
 public:
     LVTextLineQueue( LVTextFileBase * f, int maxLineLen )
-    : file(f), first_line_index(0), maxLineSize(maxLineLen), lastParaWasTitle(false), inSubSection(false)
+    : file(f), sampleStats(NULL), first_line_index(0), maxLineSize(maxLineLen), lastParaWasTitle(false), inSubSection(false)
     {
         min_left = -1;
         max_right = -1;
@@ -1240,6 +1371,10 @@ public:
     {
         if ((unsigned)lineCount > (unsigned)length())
             lineCount = length();
+        for ( int i=0; i<lineCount && freeLines.length()<MAX_BUF_LINES; i++ ) {
+            freeLines.add( get(i) );
+            (*this)[i] = NULL;
+        }
         erase(0, lineCount);
         first_line_index += lineCount;
     }
@@ -1252,13 +1387,26 @@ public:
                     return false;
                 break;
             }
-            LVTextFileLine * line = new LVTextFileLine( file, maxLineSize );
+            LVTextFileLine * line = freeLines.length() ? freeLines.remove( freeLines.length()-1 ) : new LVTextFileLine();
+            line->read( file, maxLineSize );
             if ( min_left>=0 )
                 line->align = getFormat( line );
+            if ( sampleStats )
+                sampleStats->add( line );
             add( line );
         }
         return true;
     }
+    /// reads first lines of file, detects text format by statistics gathered while reading
+    void ReadSampleLines( int lineCount )
+    {
+        LVTextSampleStats stats;
+        stats.reset();
+        sampleStats = &stats;
+        ReadLines( lineCount );
+        sampleStats = NULL;
+        detectFormatFlags( stats );
+    }
     inline static int absCompare( int v1, int v2 )
     {
         if ( v1<0 )
@@ -1309,7 +1457,7 @@ public:
         return line->align == la_centered;
     }
     /// checks text format options
-    void detectFormatFlags()
+    void detectFormatFlags( const LVTextSampleStats & stats )
     {
         //CRLog::debug("detectFormatFlags() enter");
         formatFlags = tftParaPerLine | tftEmptyLineDelimHeaders; // default format
@@ -1317,67 +1465,17 @@ public:
             return;
         formatFlags = 0;
         avg_center = 0;
-        int empty_lines = 0;
+        int empty_lines = stats.empty_lines;
         int ident_lines = 0;
         int center_lines = 0;
-        min_left = -1;
-        max_right = -1;
-        avg_left = 0;
-        avg_right = 0;
-        int pmlTagCount = 0;
+        min_left = stats.min_left;
+        max_right = stats.max_right;
+        avg_left = stats.sum_left;
+        avg_right = stats.sum_right;
+        int pmlTagCount = stats.pmlTagCount;
+        const int * left_stats = stats.left_stats;
+        const int * right_stats = stats.right_stats;
         int i;
-#define MAX_PRE_STATS 1000
-        int left_stats[MAX_PRE_STATS];
-        int right_stats[MAX_PRE_STATS];
-        for ( i=0; i<MAX_PRE_STATS; i++ )
-            left_stats[i] = right_stats[i] = 0;
-        for ( i=0; i<length(); i++ ) {
-            LVTextFileLine * line = get(i);
-            //CRLog::debug("   LINE: %d .. %d", line->lpos, line->rpos);
-            if ( line->lpos == line->rpos ) {
-                empty_lines++;
-            } else {
-                if ( line->lpos < MAX_PRE_STATS )
-                    left_stats[line->lpos]++;
-                if ( line->rpos < MAX_PRE_STATS )
-                    right_stats[line->rpos]++;
-                if ( min_left==-1 || line->lpos<min_left )
-                    min_left = line->lpos;
-                if ( max_right==-1 || line->rpos>max_right )
-                    max_right = line->rpos;
-                avg_left += line->lpos;
-                avg_right += line->rpos;
-                for (int j=line->lpos; j<line->rpos-1; j++ ) {
-                    lChar16 ch = line->text[j];
-                    lChar16 ch2 = line->text[j+1];
-                    if ( ch=='\\' ) {
-                        switch ( ch2 ) {
-                        case 'p':
-                        case 'x':
-                        case 'X':
-                        case 'C':
-                        case 'c':
-                        case 'r':
-                        case 'u':
-                        case 'o':
-                        case 'v':
-                        case 't':
-                        case 'n':
-                        case 's':
-                        case 'b':
-                        case 'l':
-                        case 'a':
-                        case 'U':
-                        case 'm':
-                        case 'q':
-                        case 'Q':
-                            pmlTagCount++;
-                            break;
-                        }
-                    }
-                }
-            }
-        }
 
         // pos stats
         int max_left_stats = 0;
@@ -1632,7 +1730,11 @@ public:
     void AddPara( int startline, int endline, LVXMLParserCallback * callback )
     {
         // TODO: remove pos, sz tracking
-        lString16 str;
+        lString16 & str = paraText;
+        int len = 0;
+        for ( int i=startline; i<=endline; i++ )
+            len += get(i)->text.length() + 1;
+        str.reset( len );
         //lvpos_t pos = 0;
         //lvsize_t sz = 0;
         for ( int i=startline; i<=endline; i++ ) {
@@ -1640,7 +1742,7 @@ public:
             //if ( i==startline )
             //    pos = item->fpos;
             //sz = (item->fpos + item->fsize) - pos;
-            str += item->text + "\n";
+            str.append( item->text ).append( 1, '\n' );
         }
         bool singleLineFollowedByEmpty = false;
         bool singleLineFollowedByTwoEmpty = false;
@@ -2359,12 +2461,20 @@ public:
 
 /// reads next text line, tells file position and size of line, sets EOL flag
 lString16 LVTextFileBase::ReadLine( int maxLineSize, lUInt32 & flags )
+{
+    lString16 res;
+    ReadLine( res, maxLineSize, flags );
+    res.pack();
+    return res;
+}
+
+/// reads next text line into res, reusing its buffer, sets EOL flag
+void LVTextFileBase::ReadLine( lString16 & res, int maxLineSize, lUInt32 & flags )
 {
     //fsize = 0;
     flags = 0;
 
-    lString16 res;
-    res.reserve( 80 );
+    res.reset( 80 );
     //FillBuffer( maxLineSize*3 );
 
     lChar16 ch = 0;
@@ -2374,6 +2484,46 @@ lString16 LVTextFileBase::ReadLine( int maxLineSize, lUInt32 & flags )
             flags |= LINE_HAS_EOLN; // EOLN flag
             break;
         }
+        if ( m_read_buffer_pos < m_read_buffer_len ) {
+            // append run of chars from buffer at once: only chars up to space need checks
+            const lChar16 * start = m_read_buffer + m_read_buffer_pos;
+            const lChar16 * end = m_read_buffer + m_read_buffer_len;
+            const lChar16 * p = start;
+            // spaces and tabs before safeEnd cannot make line full, so only control chars need checks there
+            const lChar16 * safeEnd = start;
+            int room = maxLineSize - 1 - res.length();
+            if ( room > 0 )
+                safeEnd = room < (int)(end - start) ? start + room : end;
+            bool lineFull = false;
+            for ( ; p < end; p++ ) {
+                if ( p < safeEnd ) {
+                    p = skipCharsAbove( p, safeEnd, ' ' - 1 );
+                    if ( p == end )
+                        break;
+                }
+                lChar16 c = *p;
+                if ( c > ' ' )
+                    continue;
+                if ( c == ' ' || c == '\t' ) {
+                    if ( res.length() + (int)(p - start) + 1 >= maxLineSize ) {
+                        p++;
+                        lineFull = true;
+                        break;
+                    }
+                } else if ( c == '\r' || c == '\n' || c == 0 ) {
+                    break;
+                }
+            }
+            int count = (int)(p - start);
+            if ( count ) {
+                res.append( start, count );
+                m_read_buffer_pos += count;
+            }
+            if ( lineFull )
+                break;
+            if ( p == end )
+                continue;
+        }
         ch = ReadCharFromBuffer();
         //if ( ch==0xFEFF && fpos==0 && res.empty() ) {
         //} else 
@@ -2428,10 +2578,6 @@ lString16 LVTextFileBase::ReadLine( int maxLineSize, lUInt32 & flags )
             }
         }
     }
-
-
-    res.pack();
-    return res;
 }
 
 //=======================
@@ -2664,9 +2810,10 @@ bool LVTextParser::CheckFormat()
 bool LVTextParser::Parse()
 {
     LVTextLineQueue queue( this, 2000 );
-    queue.ReadLines( 2000 );
-    if ( !m_isPreFormatted )
-        queue.detectFormatFlags();
+    if ( m_isPreFormatted )
+        queue.ReadLines( 2000 );
+    else
+        queue.ReadSampleLines( 2000 );
     // make fb2 document structure
     m_callback->OnTagOpen( NULL, L"?xml" );
     m_callback->OnAttribute( NULL, L"version", L"1.0" );
@@ -4422,3 +4569,278 @@ LVStreamRef GetFB2Coverpage(LVStreamRef stream)
     stream->SetPos(0);
     return res;
 }
+
+void LVDocMetadata::clear()
+{
+    _authorFirstNames.clear();
+    _authorMiddleNames.clear();
+    _authorLastNames.clear();
+    title.clear();
+    language.clear();
+    series.clear();
+    seriesNumber = -1;
+    genres.clear();
+    annotation.clear();
+    coverId.clear();
+    cover.Clear();
+}
+
+void LVDocMetadata::addAuthor( const lString16 & firstName, const lString16 & middleName, const lString16 & lastName )
+{
+    _authorFirstNames.add( firstName );
+    _authorMiddleNames.add( middleName );
+    _authorLastNames.add( lastName );
+}
+
+lString16 LVDocMetadata::getAuthor( int index, bool shortMiddleName ) const
+{
+    // same formatting as extractDocAuthors()
+    lString16 author = _authorFirstNames[index];
+    const lString16 & middleName = _authorMiddleNames[index];
+    const lString16 & lastName = _authorLastNames[index];
+    if ( !author.empty() )
+        author += " ";
+    if ( !middleName.empty() )
+        author += shortMiddleName ? lString16(middleName, 0, 1) + "." : middleName;
+    if ( !lastName.empty() && !author.empty() )
+        author += " ";
+    author += lastName;
+    return author.trim();
+}
+
+lString16 LVDocMetadata::getAuthors( lString16 delimiter, bool shortMiddleName ) const
+{
+    if ( delimiter.empty() )
+        delimiter = ", ";
+    lString16 authors;
+    for ( int i=0; i<getAuthorCount(); i++ ) {
+        if ( !authors.empty() )
+            authors += delimiter;
+        authors += getAuthor( i, shortMiddleName );
+    }
+    return authors;
+}
+
+/// FB2 header-only parser callback: collects <description> fields and, optionally, cover binary
+class FB2MetadataParserCallback : public LVXMLParserCallback
+{
+protected:
+    LVDocMetadata & _metadata;
+    bool _extractCover;
+    bool _insideFictionBook;
+    bool _insideDescription;
+    bool _insideTitleInfo;
+    bool _insideAuthor;
+    bool _insideAnnotation;
+    bool _insideCoverpage;
+    bool _insideCoverBinary;
+    bool _descriptionDone;
+    bool _sequenceDone;
+    bool _collectText;
+    int _tagCounter;
+    lString16 _currTag;
+    lString16 _text;
+    lString16 _firstName;
+    lString16 _middleName;
+    lString16 _lastName;
+    lString8 _coverData;
+public:
+    FB2MetadataParserCallback( LVDocMetadata & metadata, bool extractCover )
+        : _metadata(metadata)
+        , _extractCover(extractCover)
+        , _insideFictionBook(false)
+        , _insideDescription(false)
+        , _insideTitleInfo(false)
+        , _insideAuthor(false)
+        , _insideAnnotation(false)
+        , _insideCoverpage(false)
+        , _insideCoverBinary(false)
+        , _descriptionDone(false)
+        , _sequenceDone(false)
+        , _collectText(false)
+        , _tagCounter(0)
+    {
+    }
+    /// called on parsing start
+    virtual void OnStart(LVFileFormatParser * parser)
+    {
+        _parser = parser;
+    }
+    /// called on parsing end
+    virtual void OnStop()
+    {
+    }
+    /// called on opening tag end
+    virtual void OnTagBody()
+    {
+    }
+    /// add named BLOB data to document
+    virtual bool OnBlob(lString16 /*name*/, const lUInt8 * /*data*/, int /*size*/) { return true; }
+    /// called on opening tag
+    virtual ldomNode * OnTagOpen( const lChar16 * /*nsname*/, const lChar16 * tagname )
+    {
+        _tagCounter++;
+        _currTag = tagname;
+        if ( !_insideFictionBook ) {
+            if ( lStr_cmp(tagname, "FictionBook")==0 )
+                _insideFictionBook = true;
+            else if ( _tagCounter > 5 )
+                _parser->Stop();
+            return NULL;
+        }
+        if ( _descriptionDone ) {
+            // only looking for cover binary here
+            if ( lStr_cmp(tagname, "body")==0 && _metadata.coverId.empty() )
+                _parser->Stop();
+            return NULL;
+        }
+        if ( lStr_cmp(tagname, "description")==0 ) {
+            _insideDescription = true;
+        } else if ( !_insideDescription ) {
+            if ( lStr_cmp(tagname, "body")==0 || lStr_cmp(tagname, "binary")==0 ) {
+                // no <description> in this file
+                _descriptionDone = true;
+                if ( !_extractCover || _metadata.coverId.empty() )
+                    _parser->Stop();
+            }
+        } else if ( lStr_cmp(tagname, "title-info")==0 ) {
+            _insideTitleInfo = true;
+        } else if ( !_insideTitleInfo ) {
+            // publish-info, document-info and custom-info are not collected
+        } else if ( _insideAnnotation ) {
+            if ( lStr_cmp(tagname, "p")==0 && !_text.empty() )
+                _text << "\n";
+        } else if ( lStr_cmp(tagname, "author")==0 ) {
+            _insideAuthor = true;
+            _firstName.clear();
+            _middleName.clear();
+            _lastName.clear();
+        } else if ( lStr_cmp(tagname, "annotation")==0 ) {
+            _insideAnnotation = true;
+            _collectText = true;
+            _text.clear();
+        } else if ( lStr_cmp(tagname, "coverpage")==0 ) {
+            _insideCoverpage = true;
+        } else if ( lStr_cmp(tagname, "book-title")==0 || lStr_cmp(tagname, "lang")==0 || lStr_cmp(tagname, "genre")==0
+                    || (_insideAuthor && (lStr_cmp(tagname, "first-name")==0 || lStr_cmp(tagname, "middle-name")==0
+                                          || lStr_cmp(tagname, "last-name")==0)) ) {
+            _collectText = true;
+            _text.clear();
+        }
+        return NULL;
+    }
+    /// called on closing
+    virtual void OnTagClose( const lChar16 * /*nsname*/, const lChar16 * tagname )
+    {
+        if ( _descriptionDone ) {
+            if ( _insideCoverBinary && lStr_cmp(tagname, "binary")==0 ) {
+                // cover data found: nothing else to read
+                _insideCoverBinary = false;
+                _parser->Stop();
+            }
+            return;
+        }
+        if ( !_insideDescription )
+            return;
+        if ( lStr_cmp(tagname, "description")==0 ) {
+            _insideDescription = false;
+            _descriptionDone = true;
+            if ( !_extractCover || _metadata.coverId.empty() )
+                _parser->Stop();
+        } else if ( lStr_cmp(tagname, "title-info")==0 ) {
+            _insideTitleInfo = false;
+        } else if ( !_insideTitleInfo ) {
+        } else if ( _insideAnnotation ) {
+            if ( lStr_cmp(tagname, "annotation")==0 ) {
+                _insideAnnotation = false;
+                _collectText = false;
+                _metadata.annotation = _text.trim();
+            }
+        } else if ( lStr_cmp(tagname, "author")==0 ) {
+            _insideAuthor = false;
+            if ( !_firstName.empty() || !_middleName.empty() || !_lastName.empty() )
+                _metadata.addAuthor( _firstName, _middleName, _lastName );
+        } else if ( lStr_cmp(tagname, "coverpage")==0 ) {
+            _insideCoverpage = false;
+        } else if ( lStr_cmp(tagname, "sequence")==0 ) {
+            // only first sequence is used
+            _sequenceDone = true;
+        } else if ( _collectText ) {
+            _collectText = false;
+            _text.trim();
+            if ( lStr_cmp(tagname, "book-title")==0 )
+                _metadata.title = _text;
+            else if ( lStr_cmp(tagname, "lang")==0 )
+                _metadata.language = _text;
+            else if ( lStr_cmp(tagname, "genre")==0 ) {
+                if ( !_text.empty() )
+                    _metadata.genres.add( _text );
+            } else if ( lStr_cmp(tagname, "first-name")==0 )
+                _firstName = _text;
+            else if ( lStr_cmp(tagname, "middle-name")==0 )
+                _middleName = _text;
+            else if ( lStr_cmp(tagname, "last-name")==0 )
+                _lastName = _text;
+        }
+    }
+    /// called on element attribute
+    virtual void OnAttribute( const lChar16 * /*nsname*/, const lChar16 * attrname, const lChar16 * attrvalue )
+    {
+        if ( _descriptionDone ) {
+            if ( lStr_cmp(attrname, "id")==0 && _currTag == "binary" && _metadata.coverId == attrvalue )
+                _insideCoverBinary = true;
+            return;
+        }
+        if ( !_insideTitleInfo )
+            return;
+        if ( _insideCoverpage && _currTag == "image" && lStr_cmp(attrname, "href")==0 ) {
+            if ( _metadata.coverId.empty() && attrvalue[0]=='#' )
+                _metadata.coverId = attrvalue + 1;
+        } else if ( _currTag == "sequence" && !_sequenceDone ) {
+            if ( lStr_cmp(attrname, "name")==0 )
+                _metadata.series = lString16(attrvalue).trim();
+            else if ( lStr_cmp(attrname, "number")==0 && !lString16(attrvalue).trim().empty() )
+                _metadata.seriesNumber = lString16(attrvalue).atoi();
+        }
+    }
+    /// called on text
+    virtual void OnText( const lChar16 * text, int len, lUInt32 /*flags*/ )
+    {
+        if ( _insideCoverBinary ) {
+            // base64 is kept encoded here, and is decoded only once cover stream is read
+            _coverData.append( UnicodeToUtf8(text, len) );
+        } else if ( _collectText ) {
+            _text.append( text, len );
+        }
+    }
+    /// returns cover stream, or NULL if cover binary was not found
+    LVStreamRef getCoverStream()
+    {
+        if ( _coverData.empty() )
+            return LVStreamRef();
+        LVStreamRef stream = LVStreamRef(new LVBase64Stream(_coverData));
+        return LVCreateMemoryStream(stream);
+    }
+    /// destructor
+    virtual ~FB2MetadataParserCallback()
+    {
+    }
+};
+
+bool LVParseFB2Metadata( LVStreamRef stream, LVDocMetadata & metadata, bool extractCover )
+{
+    if ( stream.isNull() )
+        return false;
+    metadata.clear();
+    FB2MetadataParserCallback callback( metadata, extractCover );
+    LVXMLParser parser( stream, &callback, false, true );
+    if ( !parser.CheckFormat() ) {
+        stream->SetPos(0);
+        return false;
+    }
+    parser.Parse();
+    if ( extractCover )
+        metadata.cover = callback.getCoverStream();
+    stream->SetPos(0);
+    return true;
+}
@@ -1,5 +1,6 @@
 #include "../include/pdbfmt.h"
 #include "../include/crlog.h"
+#include "../include/crconcurrent.h"
 #include <ctype.h>
 
 // uncomment following line to save PDB content streams to /tmp
@@ -184,7 +185,7 @@ struct MobiPreamble : public PalmDocPreamble
             cnv.rev(&drmSize); //    172	4	DRM Size	Number of bytes in DRM info.
             cnv.rev(&drmFlags); //    176	4	DRM Flags	Some flags concerning the DRM info.
         }
-        if ( compression!=1 && compression!=2 )
+        if ( compression!=1 && compression!=2 && compression!=17480 )
             return false;
         if ( mobiType!=2 && mobiType!=3 && mobiType!=517 && mobiType!=518
                  && mobiType!=257 && mobiType!=258 && mobiType!=259 )
@@ -289,6 +290,413 @@ struct PluckerPreamble {
 /// unpack data from _compbuf to _buf
 bool ldomUnpack( const lUInt8 * compbuf, int compsize, lUInt8 * &dstbuf, lUInt32 & dstsize  );
 
+/// max size of PalmDOC unpacked data: each byte of packed data gives at most 5 bytes
+#define PALMDOC_MAX_UNPACKED_SIZE(srclen) ((srclen) * 5)
+
+/// unpacks PalmDOC LZ77 data to buffer of PALMDOC_MAX_UNPACKED_SIZE(srclen) bytes, returns unpacked size
+static int palmDocUnpack( const lUInt8 * src, int srclen, lUInt8 * dst )
+{
+    const lUInt8 * end = src + srclen;
+    lUInt8 * p = dst;
+    while ( src < end ) {
+        lUInt32 b = *src++;
+        if ( b > 0 && b < 9 ) {
+            // 1..8 bytes follow
+            if ( src + b > end )
+                break;
+            memcpy( p, src, b );
+            p += b;
+            src += b;
+        } else if ( b < 128 ) {
+            // unmodified single byte
+            *p++ = (lUInt8)b;
+        } else if ( b >= 0xc0 ) {
+            *p++ = ' ';
+            *p++ = (lUInt8)(b & 0x7f);
+        } else {
+            if ( src >= end )
+                break;
+            lUInt32 z = ((b & 0x3f) << 8) + *src++;
+            int offset = z >> 3;
+            int size = (z & 7) + 3;
+            if ( offset > 0 && offset <= p - dst ) {
+                // regions overlap when offset is less than size: copy byte by byte
+                const lUInt8 * from = p - offset;
+                for ( int i = 0; i < size; i++ )
+                    p[i] = from[i];
+            } else {
+                // wrong offset
+                memset( p, '?', size );
+            }
+            p += size;
+        }
+    }
+    return (int)(p - dst);
+}
+
+static inline lUInt32 readBE32( const lUInt8 * p )
+{
+    return ((lUInt32)p[0] << 24) | ((lUInt32)p[1] << 16) | ((lUInt32)p[2] << 8) | p[3];
+}
+
+static inline lUInt16 readBE16( const lUInt8 * p )
+{
+    return (lUInt16)((p[0] << 8) | p[1]);
+}
+
+/// appends bytes to array, growing it like LVArray::insert does (append() grows to exact size)
+static inline void appendBytes( LVArray<lUInt8> & dst, const lUInt8 * src, int len )
+{
+    if ( dst.length() + len > dst.size() )
+        dst.reserve( (dst.length() + len) * 3 / 2 + 8 );
+    memcpy( dst.addSpace( len ), src, len );
+}
+
+/// HUFF/CDIC decoder (MOBI compression 17480)
+/**
+    Text is huffman coded sequence of dictionary phrases. HUFF record has lookup table
+    by first 8 bits of code and code ranges for each code length, CDIC records keep phrases,
+    which may be huffman coded themselves: all of them are unpacked when dictionary is loaded,
+    so unpack() may be called from several threads.
+*/
+class HuffCdicDecoder {
+    struct Code {
+        int codelen;
+        bool term; // code length is known from first 8 bits
+        lUInt64 maxcode;
+    };
+    Code _dict1[256];
+    lUInt64 _mincode[33];
+    lUInt64 _maxcode[33];
+    // phrases as stored in CDIC records, while loading
+    LVArray<lUInt8> _raw;
+    LVArray<int> _rawStart;
+    LVArray<int> _rawSize;
+    LVArray<lUInt8> _state; // 0 = packed, 1 = being unpacked, 2 = unpacked
+    // unpacked phrases
+    LVArray<lUInt8> _phrases;
+    LVArray<int> _phraseStart;
+    LVArray<int> _phraseSize;
+
+    static inline lUInt64 load64( const lUInt8 * src, int srclen, int pos )
+    {
+        lUInt64 x = 0;
+        if ( pos + 8 <= srclen ) {
+            x = ((lUInt64)readBE32( src + pos ) << 32) | readBE32( src + pos + 4 );
+        } else {
+            // data is padded with zeros
+            for ( int i=0; i<8; i++ )
+                x = (x << 8) | (pos + i < srclen ? src[pos + i] : 0);
+        }
+        return x;
+    }
+
+    /// unpacks phrase when it's packed, returns false for recursive or broken phrase
+    bool unpackPhrase( int index, int depth )
+    {
+        if ( _state[index] == 2 )
+            return true;
+        if ( _state[index] == 1 || depth > 32 )
+            return false;
+        _state[index] = 1;
+        LVArray<lUInt8> buf;
+        if ( !decode( _raw.get() + _rawStart[index], _rawSize[index], buf, depth + 1 ) )
+            return false;
+        _phraseStart[index] = _phrases.length();
+        _phraseSize[index] = buf.length();
+        appendBytes( _phrases, buf.get(), buf.length() );
+        _state[index] = 2;
+        return true;
+    }
+
+    bool decode( const lUInt8 * src, int srclen, LVArray<lUInt8> & dst, int depth )
+    {
+        int count = _phraseSize.length();
+        lInt64 bitsleft = (lInt64)srclen * 8;
+        int pos = 0;
+        lUInt64 x = load64( src, srclen, 0 );
+        int n = 32;
+        for (;;) {
+            if ( n <= 0 ) {
+                pos += 4;
+                x = load64( src, srclen, pos );
+                n += 32;
+            }
+            lUInt32 code = (lUInt32)(x >> n);
+            const Code & c = _dict1[code >> 24];
+            int codelen = c.codelen;
+            lUInt64 maxcode = c.maxcode;
+            if ( !c.term ) {
+                while ( codelen < 32 && code < _mincode[codelen] )
+                    codelen++;
+                maxcode = _maxcode[codelen];
+            }
+            n -= codelen;
+            bitsleft -= codelen;
+            if ( bitsleft < 0 )
+                break;
+            lUInt64 r = (maxcode - code) >> (32 - codelen);
+            if ( r >= (lUInt64)count )
+                return false;
+            if ( _state[(int)r] != 2 && (depth == 0 || !unpackPhrase( (int)r, depth )) )
+                return false;
+            appendBytes( dst, _phrases.get() + _phraseStart[(int)r], _phraseSize[(int)r] );
+        }
+        return true;
+    }
+public:
+    /// loads HUFF record
+    bool loadHuff( const lUInt8 * p, int size )
+    {
+        if ( size < 24 || memcmp( p, "HUFF\0\0\0\x18", 8 ) )
+            return false;
+        lUInt32 off1 = readBE32( p + 8 );
+        lUInt32 off2 = readBE32( p + 12 );
+        if ( off1 > (lUInt32)size || size - off1 < 256 * 4 || off2 > (lUInt32)size || size - off2 < 64 * 4 )
+            return false;
+        for ( int i=0; i<256; i++ ) {
+            lUInt32 v = readBE32( p + off1 + i * 4 );
+            Code & c = _dict1[i];
+            c.codelen = v & 0x1f;
+            c.term = (v & 0x80) != 0;
+            if ( c.codelen == 0 || (c.codelen <= 8 && !c.term) )
+                return false;
+            c.maxcode = ( ((lUInt64)(v >> 8) + 1) << (32 - c.codelen) ) - 1;
+        }
+        _mincode[0] = 0;
+        _maxcode[0] = ((lUInt64)1 << 32) - 1;
+        for ( int codelen=1; codelen<=32; codelen++ ) {
+            _mincode[codelen] = (lUInt64)readBE32( p + off2 + (codelen - 1) * 8 ) << (32 - codelen);
+            _maxcode[codelen] = ( ((lUInt64)readBE32( p + off2 + (codelen - 1) * 8 + 4 ) + 1) << (32 - codelen) ) - 1;
+        }
+        return true;
+    }
+
+    /// adds phrases from CDIC record
+    bool loadCdic( const lUInt8 * p, int size )
+    {
+        if ( size < 16 || memcmp( p, "CDIC\0\0\0\x10", 8 ) )
+            return false;
+        lUInt32 phrases = readBE32( p + 8 );
+        lUInt32 bits = readBE32( p + 12 );
+        if ( bits > 16 || phrases <= (lUInt32)_rawStart.length() )
+            return false;
+        int n = (int)(phrases - _rawStart.length());
+        if ( n > (1 << bits) )
+            n = 1 << bits;
+        if ( 16 + n * 2 > size )
+            return false;
+        for ( int i=0; i<n; i++ ) {
+            int off = 16 + readBE16( p + 16 + i * 2 );
+            if ( off + 2 > size )
+                return false;
+            int blen = readBE16( p + off );
+            int len = blen & 0x7fff;
+            if ( off + 2 + len > size )
+                return false;
+            _rawStart.add( _raw.length() );
+            _rawSize.add( len );
+            appendBytes( _raw, p + off + 2, len );
+            if ( blen & 0x8000 ) {
+                // phrase is not packed
+                _phraseStart.add( _phrases.length() );
+                _phraseSize.add( len );
+                appendBytes( _phrases, p + off + 2, len );
+                _state.add( 2 );
+            } else {
+                _phraseStart.add( 0 );
+                _phraseSize.add( 0 );
+                _state.add( 0 );
+            }
+        }
+        return true;
+    }
+
+    /// unpacks all packed phrases after all CDIC records are loaded
+    bool unpackDictionary()
+    {
+        for ( int i=0; i<_state.length(); i++ ) {
+            if ( !unpackPhrase( i, 0 ) ) {
+                CRLog::error("HUFF/CDIC: cannot unpack dictionary phrase %d", i);
+                return false;
+            }
+        }
+        _raw.clear();
+        _rawStart.clear();
+        _rawSize.clear();
+        return true;
+    }
+
+    /// unpacks text record
+    bool unpack( const lUInt8 * src, int srclen, LVArray<lUInt8> & dst )
+    {
+        return decode( src, srclen, dst, 0 );
+    }
+};
+
+/// number of threads unpacking text records
+#define PDB_UNPACK_THREADS 2
+/// number of text records unpacked ahead of reader
+#define PDB_UNPACK_AHEAD 8
+
+/// PDB records for PDBUnpackQueue
+class PDBRecordSource {
+public:
+    /// reads record as stored in file, called on reader thread only
+    virtual bool readPackedRecord( int index, LVArray<lUInt8> & buf ) = 0;
+    /// unpacks record, called on worker threads
+    virtual bool unpackRecord( LVArray<lUInt8> & dst, LVArray<lUInt8> & src ) = 0;
+    virtual ~PDBRecordSource() { }
+};
+
+class PDBUnpackTask;
+
+/// unpacks text records on worker threads ahead of sequential reader
+class PDBUnpackQueue {
+    friend class PDBUnpackTask;
+    struct Item {
+        int index;
+        LVArray<lUInt8> src;
+        LVArray<lUInt8> dst;
+        bool started;
+        bool done;
+        bool ok;
+    };
+    PDBRecordSource * _source;
+    int _lastIndex; // last record to unpack
+    int _ahead;
+    bool _stopped;
+    CRMonitorRef _monitor;
+    LVPtrVector<CRThread> _threads;
+    LVPtrVector<PDBUnpackTask> _tasks;
+    LVPtrVector<Item> _items; // records being read ahead, by index
+    /// worker: unpacks records until queue is stopped
+    void unpackRecords();
+    /// drops records read ahead, waiting for ones being unpacked
+    void cancel();
+public:
+    /// queue unpacking up to ahead records after last requested one, till lastIndex
+    PDBUnpackQueue( PDBRecordSource * source, int lastIndex, int threads, int ahead );
+    ~PDBUnpackQueue();
+    /// returns unpacked record, reading ahead next ones
+    bool get( int index, LVArray<lUInt8> & dst );
+};
+
+class PDBUnpackTask : public CRRunnable {
+    PDBUnpackQueue * _queue;
+public:
+    PDBUnpackTask( PDBUnpackQueue * queue ) : _queue(queue) { }
+    virtual void run() { _queue->unpackRecords(); }
+};
+
+PDBUnpackQueue::PDBUnpackQueue( PDBRecordSource * source, int lastIndex, int threads, int ahead )
+    : _source(source), _lastIndex(lastIndex), _ahead(ahead), _stopped(false)
+{
+    _monitor = concurrencyProvider->createMonitor();
+    for ( int i=0; i<threads; i++ ) {
+        PDBUnpackTask * task = new PDBUnpackTask( this );
+        CRThread * thread = concurrencyProvider->createThread( task );
+        _tasks.add( task );
+        _threads.add( thread );
+        thread->start();
+    }
+}
+
+PDBUnpackQueue::~PDBUnpackQueue()
+{
+    {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        _stopped = true;
+        _monitor->notifyAll();
+    }
+    for ( int i=0; i<_threads.length(); i++ )
+        _threads[i]->join();
+}
+
+void PDBUnpackQueue::unpackRecords()
+{
+    for (;;) {
+        Item * item = NULL;
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            for (;;) {
+                if ( _stopped )
+                    return;
+                for ( int i=0; i<_items.length(); i++ ) {
+                    if ( !_items[i]->started ) {
+                        item = _items[i];
+                        item->started = true;
+                        break;
+                    }
+                }
+                if ( item )
+                    break;
+                _monitor->wait();
+            }
+        }
+        bool ok = _source->unpackRecord( item->dst, item->src );
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        item->ok = ok;
+        item->done = true;
+        _monitor->notifyAll();
+    }
+}
+
+void PDBUnpackQueue::cancel()
+{
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    for ( int i=_items.length()-1; i>=0; i-- ) {
+        if ( !_items[i]->started )
+            _items.erase( i, 1 );
+    }
+    for ( int i=0; i<_items.length(); i++ ) {
+        while ( !_items[i]->done )
+            _monitor->wait();
+    }
+    _items.clear();
+}
+
+bool PDBUnpackQueue::get( int index, LVArray<lUInt8> & dst )
+{
+    if ( _items.length() && _items[0]->index != index )
+        cancel(); // not sequential reading
+    // records are read from stream on this thread, then unpacked by workers
+    int next = _items.length() ? _items[_items.length()-1]->index + 1 : index;
+    for ( ; next <= index + _ahead && next <= _lastIndex; next++ ) {
+        Item * item = new Item();
+        item->index = next;
+        item->started = false;
+        item->done = false;
+        item->ok = false;
+        if ( !_source->readPackedRecord( next, item->src ) ) {
+            delete item;
+            break;
+        }
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        _items.add( item );
+        _monitor->notifyAll();
+    }
+    Item * item = NULL;
+    {
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        if ( !_items.length() || _items[0]->index != index )
+            return false;
+        while ( !_items[0]->done )
+            _monitor->wait();
+        item = _items.remove( 0 );
+    }
+    bool ok = item->ok;
+    dst.swap( item->dst );
+    delete item;
+    return ok;
+}
+
 class PDBFile;
 
 class LVPDBContainerItem : public LVContainerItemInfo {
@@ -382,7 +790,7 @@ static bool pattern_cmp( const lUInt8 * buf, const char * pattern ) {
     return true;
 }
 
-class PDBFile : public LVNamedStream {
+class PDBFile : public LVNamedStream, public PDBRecordSource {
 public:
     enum Format {
         UNKNOWN,
@@ -413,50 +821,19 @@ private:
     lvpos_t _pos;
     lUInt16 _mobiExtraDataFlags;
     CRPropRef m_doc_props;
+    HuffCdicDecoder * _huff; // HUFF/CDIC dictionary for compression 17480
+    PDBUnpackQueue * _unpackQueue; // unpacks text records ahead of reader when threads are available
     //LVPDBContainer * _container;
     bool unpack( LVArray<lUInt8> & dst, LVArray<lUInt8> & src ) {
         int srclen = src.length();
         dst.reset();
-        dst.reserve(srclen);
 
         if ( _compression==2 ) {
             // PalmDOC
-            int pos = 0;
-            lInt32 b;
-
-            while (pos<srclen) {
-                b = src[pos];
-                pos++;
-                if (b > 0 && b < 9) {
-                    // 1..8 bytes follow
-                    if (pos + b > srclen)
-                        break;
-                    for (int i=0; i<(int)b; i++)
-                        dst.add(src[pos++]);
-                } else if (b < 128) {
-                    // unmodified single byte
-                    dst.add((lUInt8)b);
-                } else if (b >= 0xc0) {
-                    dst.add(' ');
-                    dst.add(b & 0x7f);
-                } else {
-                    if (pos >= srclen)
-                        break;
-                    lUInt32 z = ((b & 0x3f) << 8) + src[pos];
-                    pos++;
-                    int offset = z >> 3;
-                    int size = (z & 7) + 3;
-                    int srcpos = dst.length() - offset;
-                    for (int i = 0; i < size; i++) {
-                        if (srcpos >= 0) {
-                            dst.add(dst[srcpos++]);
-                        } else {
-                            dst.add('?');
-                            //CRLog::trace("wrong offset");
-                        }
-                    }
-                }
-            }
+            lUInt8 * p = dst.addSpace( PALMDOC_MAX_UNPACKED_SIZE(srclen) );
+            int len = palmDocUnpack( src.get(), srclen, p );
+            if ( len<dst.length() )
+                dst.erase( len, dst.length() - len );
         } else if ( _compression==10 ) {
             // zlib
             /// unpack data from _compbuf to _buf
@@ -467,19 +844,31 @@ private:
             dst.add(dstbuf, dstsize);
             free(dstbuf);
         } else if ( _compression==17480 ) {
-            // zlib
-            // TODO: shouldn't it be HUFFMAN unpacker?
-            /// unpack data from _compbuf to _buf
-            lUInt8 * dstbuf;
-            lUInt32 dstsize;
-            if ( !ldomUnpack( src.get(), src.size(), dstbuf, dstsize ) )
+            // HUFF/CDIC
+            if ( !_huff || !_huff->unpack( src.get(), srclen, dst ) )
                 return false;
-            dst.add(dstbuf, dstsize);
-            free(dstbuf);
         }
         return true;
     }
 
+    /// loads HUFF/CDIC dictionary records
+    bool loadHuffDictionary( int start, int count ) {
+        if ( count<2 || start<=0 || start+count>_records.length() )
+            return false;
+        _huff = new HuffCdicDecoder();
+        LVArray<lUInt8> buf;
+        for ( int i=0; i<count; i++ ) {
+            if ( !readRecordNoUnpack( start+i, &buf ) )
+                return false;
+            bool res = i==0 ? _huff->loadHuff( buf.get(), buf.length() ) : _huff->loadCdic( buf.get(), buf.length() );
+            if ( !res ) {
+                CRLog::error("PDB: invalid %s record %d", i==0 ? "HUFF" : "CDIC", start+i);
+                return false;
+            }
+        }
+        return _huff->unpackDictionary();
+    }
+
     void removeExtraData(int index, LVArray<lUInt8> & buf) {
         if (index >= _records.length() || !_mobiExtraDataFlags)
             return;
@@ -569,12 +958,31 @@ private:
         return unpack(*dstbuf, srcbuf);
     }
 
+    /// reads text record, unpacking next ones on worker threads when available
+    bool readTextRecord( int index, LVArray<lUInt8> * dstbuf ) {
+        if ( _unpackQueue )
+            return _unpackQueue->get( index, *dstbuf );
+        return readRecord( index, dstbuf );
+    }
+
+    virtual bool readPackedRecord( int index, LVArray<lUInt8> & buf ) {
+        if ( !readRecordNoUnpack( index, &buf ) )
+            return false;
+        if ( _mobiExtraDataFlags && index < _recordCount )
+            removeExtraData( index, buf );
+        return true;
+    }
+
+    virtual bool unpackRecord( LVArray<lUInt8> & dst, LVArray<lUInt8> & src ) {
+        return unpack( dst, src );
+    }
+
     bool readBlock( int index ) {
         if ( index<0 || index>=_recordCount )
             return false;
         if ( index==_bufIndex )
             return true; // already read
-        bool res = readRecord( index+1, &_buf );
+        bool res = readTextRecord( index+1, &_buf );
         if ( !res )
             return false;
         _bufIndex = index;
@@ -586,8 +994,19 @@ private:
     int findBlock( lvpos_t pos ) {
         if ( pos==_textSize )
             return _recordCount-1;
-        for ( int i=0; i<_recordCount; i++ ) {
-            if ( pos>=_records[i+1].unpoffset && pos<_records[i+1].unpoffset+_records[i+1].unpsize )
+        if ( _bufIndex>=0 && pos>=_bufOffset && pos<_bufOffset+_bufSize )
+            return _bufIndex;
+        // binary search by unpacked offset
+        int a = 0;
+        int b = _recordCount - 1;
+        while ( a<=b ) {
+            int i = (a + b) / 2;
+            const Record & rec = _records[i+1];
+            if ( pos<rec.unpoffset )
+                b = i - 1;
+            else if ( pos>=rec.unpoffset+rec.unpsize )
+                a = i + 1;
+            else
                 return i;
         }
         return -1;
@@ -762,6 +1181,10 @@ public:
                 _compression = 0;
             _textSize = preamble.textLength;
             _recordCount = preamble.firstNonBookIndex - 1;
+            if ( _compression==17480 && validateContent ) {
+                if ( !loadHuffDictionary( preamble.huffmanRecordOffset, preamble.huffmanRecordCount ) )
+                    return false;
+            }
             lUInt32 coverOffset = (lUInt32)-1;
             lUInt32 thumbOffset = 0;
             if (preamble.mobiFlags & 0x40) {
@@ -900,12 +1323,15 @@ public:
         if ( !validateContent )
             return true; // for simple format check
 
+        if ( _compression && concurrencyProvider && _recordCount>1 )
+            _unpackQueue = new PDBUnpackQueue( this, _recordCount, PDB_UNPACK_THREADS, PDB_UNPACK_AHEAD );
+
         LVArray<lUInt8> buf;
         lUInt32 unpoffset = 0;
         _crc = 0;
         for ( int k=0; k<_recordCount; k++ ) {
 
-            readRecord(k+1, &buf);
+            readTextRecord(k+1, &buf);
             _records[k+1].unpoffset = unpoffset;
             _records[k+1].unpsize = buf.length();
             unpoffset += buf.length();
@@ -1056,8 +1482,7 @@ public:
             int sz = count;
             if ( sz>bytesLeft )
                 sz = bytesLeft;
-            for ( int i=0; i<sz; i++ )
-                dst[i] = _buf[_pos - _bufOffset + i];
+            memcpy( dst, _buf.get() + (_pos - _bufOffset), sz );
             _pos += sz;
             dst += sz;
             count -= sz;
@@ -1095,25 +1520,32 @@ public:
         //_container.AddRef();
         _bufIndex = -1;
         _mobiExtraDataFlags = 0;
+        _huff = NULL;
+        _unpackQueue = NULL;
         m_doc_props = LVCreatePropsContainer();
     }
 
     /// Destructor
-    virtual ~PDBFile() { }
+    virtual ~PDBFile() {
+        if ( _unpackQueue )
+            delete _unpackQueue;
+        if ( _huff )
+            delete _huff;
+    }
 
 };
 
 // open PDB stream from stream
-//LVStreamRef LVOpenPDBStream( LVStreamRef srcstream, int &format )
-//{
-//    PDBFile * stream = PDBFile::create( srcstream, format );
-//    srcstream->SetPos(0);
-//    if ( stream!=NULL )
-//    {
-//        return LVStreamRef( stream );
-//    }
-//    return LVStreamRef();
-//}
+LVStreamRef LVOpenPDBStream( LVStreamRef srcstream, doc_format_t & contentFormat )
+{
+    PDBFile * stream = new PDBFile();
+    if ( !stream->open( srcstream, NULL, true, contentFormat ) ) {
+        delete stream;
+        srcstream->SetPos(0);
+        return LVStreamRef();
+    }
+    return LVStreamRef( stream );
+}
 
 bool DetectPDBFormat( LVStreamRef stream, doc_format_t & contentFormat )
 {
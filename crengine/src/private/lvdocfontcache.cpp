@@ -0,0 +1,259 @@
+/** \file lvdocfontcache.cpp
+    \brief decoded embedded document fonts cache implementation
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#include "lvdocfontcache.h"
+#include "../../include/lvfntman.h"
+#include "../../include/lvptrvec.h"
+#include "../../include/lvstring8collection.h"
+#include "../../include/crlog.h"
+#include <stdio.h>
+#include <string.h>
+
+/// max total size of decoded fonts kept in cache directory
+#define DOC_FONT_CACHE_MAX_SIZE (32*1024*1024)
+/// smallest font file accepted
+#define DOC_FONT_MIN_SIZE 100
+
+/// font data read to memory, when it cannot be mapped from cache directory
+class LVDocumentFontBuffer : public LVStreamBuffer
+{
+    LVArray<lUInt8> _data;
+public:
+    LVDocumentFontBuffer( lvsize_t size ) : _data( (int)size, 0 ) { }
+    virtual const lUInt8 * getReadOnly() { return _data.get(); }
+    virtual lUInt8 * getReadWrite() { return _data.get(); }
+    virtual lvsize_t getSize() { return _data.length(); }
+};
+
+LVDocumentFontCacheImpl::LVDocumentFontCacheImpl()
+    : _fonts(64), hits(0), mapped(0), decoded(0)
+{
+}
+
+LVDocumentFontCacheImpl * LVDocumentFontCacheImpl::instance()
+{
+    static LVDocumentFontCacheImpl _instance;
+    return &_instance;
+}
+
+lString16 LVDocumentFontCacheImpl::makeFileName( const lString8 & key )
+{
+    return _cacheDir + Utf8ToUnicode( key ) + ".font";
+}
+
+LVStreamBufferRef LVDocumentFontCacheImpl::mapFile( const lString16 & pathName, lvsize_t size )
+{
+    LVStreamBufferRef res;
+    if ( !LVFileExists( pathName ) )
+        return res;
+    LVStreamRef stream = LVMapFileStream( pathName.c_str(), LVOM_READ, 0 );
+    if ( stream.isNull() || stream->GetSize() != size )
+        return res;
+    return stream->GetReadBuffer( 0, size );
+}
+
+LVStreamBufferRef LVDocumentFontCacheImpl::writeFile( const lString16 & pathName, LVStreamBufferRef data )
+{
+    LVStreamBufferRef res;
+    LVCreateDirectory( _cacheDir );
+    // written under temporary name: interrupted write leaves no broken font
+    lString16 tmpName = pathName + ".tmp";
+    {
+        LVStreamRef stream = LVOpenFileStream( tmpName.c_str(), LVOM_WRITE );
+        if ( stream.isNull() )
+            return res;
+        lvsize_t bytesWritten = 0;
+        if ( stream->Write( data->getReadOnly(), data->getSize(), &bytesWritten ) != LVERR_OK
+                || bytesWritten != data->getSize() ) {
+            stream.Clear();
+            LVDeleteFile( tmpName );
+            return res;
+        }
+    }
+    if ( !LVRenameFile( tmpName, pathName ) ) {
+        LVDeleteFile( tmpName );
+        return res;
+    }
+    return mapFile( pathName, data->getSize() );
+}
+
+/// compares stream content with data, reading stream by blocks
+bool LVDocumentFontCacheImpl::sameContent( LVStreamRef stream, LVStreamBufferRef data )
+{
+    lvsize_t size = data->getSize();
+    if ( stream->GetSize() != size || stream->SetPos( 0 ) != 0 )
+        return false;
+    const lUInt8 * p = data->getReadOnly();
+    lUInt8 block[16384];
+    for ( lvsize_t pos = 0; pos < size; ) {
+        lvsize_t bytesRead = 0;
+        lvsize_t len = size - pos < sizeof(block) ? size - pos : sizeof(block);
+        if ( stream->Read( block, len, &bytesRead ) != LVERR_OK || bytesRead != len )
+            return false;
+        if ( memcmp( block, p + pos, (size_t)len ) )
+            return false;
+        pos += len;
+    }
+    return true;
+}
+
+LVStreamBufferRef LVDocumentFontCacheImpl::get( LVStreamRef stream )
+{
+    LVStreamBufferRef res;
+    lvsize_t size = stream->GetSize();
+    if ( size < DOC_FONT_MIN_SIZE )
+        return res;
+    // CRC is taken from archive item header: it only selects the candidate,
+    // content of shared font is always compared with stream content
+    lUInt32 crc = 0;
+    if ( stream->getcrc32( crc ) != LVERR_OK )
+        return res;
+    char s[32];
+    sprintf( s, "%08x-%u", (unsigned)crc, (unsigned)size );
+    lString8 key( s );
+    if ( _fonts.get( key, res ) ) {
+        if ( sameContent( stream, res ) ) {
+            hits++;
+            return res;
+        }
+        res.Clear();
+    }
+    lString16 pathName;
+    if ( !_cacheDir.empty() ) {
+        pathName = makeFileName( key );
+        res = mapFile( pathName, size );
+        if ( !res.isNull() ) {
+            if ( sameContent( stream, res ) ) {
+                mapped++;
+                _fonts.set( key, res );
+                return res;
+            }
+            res.Clear();
+        }
+    }
+    LVStreamBufferRef data( new LVDocumentFontBuffer( size ) );
+    lvsize_t bytesRead = 0;
+    if ( stream->SetPos( 0 ) != 0 || stream->Read( data->getReadWrite(), size, &bytesRead ) != LVERR_OK || bytesRead != size )
+        return res;
+    decoded++;
+    if ( lStr_crc32( 0, data->getReadOnly(), (int)size ) != crc ) {
+        // wrong CRC in archive, or another font has this key: used by this document only
+        CRLog::warn("Embedded font CRC mismatch, font is not shared");
+        return data;
+    }
+    if ( !pathName.empty() ) {
+        // mapped copy is shared between processes and not counted in RSS: drop data read to memory
+        removeOldFiles();
+        LVStreamBufferRef fileData = writeFile( pathName, data );
+        if ( !fileData.isNull() )
+            data = fileData;
+    }
+    _fonts.set( key, data );
+    return data;
+}
+
+void LVDocumentFontCacheImpl::release()
+{
+    lString8Collection unused;
+    LVHashTable<lString8, LVStreamBufferRef>::iterator iter = _fonts.forwardIterator();
+    for ( ;; ) {
+        LVHashTable<lString8, LVStreamBufferRef>::pair * item = iter.next();
+        if ( !item )
+            break;
+        // referenced by cache only
+        if ( item->value.getRefCount() == 1 )
+            unused.add( item->key );
+    }
+    for ( int i=0; i<unused.length(); i++ )
+        _fonts.remove( unused[i] );
+}
+
+struct LVDocumentFontFile {
+    lString16 pathName;
+    lUInt64 size;
+    lUInt64 modTime;
+};
+
+static int compareModTime( const LVDocumentFontFile ** file1, const LVDocumentFontFile ** file2 )
+{
+    if ( (*file1)->modTime != (*file2)->modTime )
+        return (*file1)->modTime < (*file2)->modTime ? -1 : 1;
+    return 0;
+}
+
+/// deletes files written first while total size exceeds limit
+void LVDocumentFontCacheImpl::removeOldFiles()
+{
+    LVContainerRef dir = LVOpenDirectory( _cacheDir.c_str(), L"*.font" );
+    if ( dir.isNull() )
+        return;
+    LVPtrVector<LVDocumentFontFile> files;
+    lUInt64 totalSize = 0;
+    for ( int i=0; i<dir->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = dir->GetObjectInfo( i );
+        if ( item->IsContainer() )
+            continue;
+        LVDocumentFontFile * file = new LVDocumentFontFile();
+        file->pathName = _cacheDir + item->GetName();
+        if ( !LVGetFileInfo( UnicodeToUtf8( file->pathName ), file->size, file->modTime ) ) {
+            delete file;
+            continue;
+        }
+        totalSize += file->size;
+        files.add( file );
+    }
+    if ( totalSize <= DOC_FONT_CACHE_MAX_SIZE )
+        return;
+    files.sort( compareModTime );
+    for ( int i=0; i<files.length() && totalSize > DOC_FONT_CACHE_MAX_SIZE; i++ ) {
+        // mapped fonts stay usable after file is deleted
+        if ( LVDeleteFile( files[i]->pathName ) )
+            totalSize -= files[i]->size;
+    }
+}
+
+void LVDocumentFontCacheImpl::setCacheDir( lString16 dir )
+{
+    if ( !dir.empty() ) {
+        LVAppendPathDelimiter( dir );
+        dir = dir + "fonts";
+        LVAppendPathDelimiter( dir );
+    }
+    _cacheDir = dir;
+}
+
+void LVDocumentFontCacheImpl::clear()
+{
+    release();
+    if ( _cacheDir.empty() )
+        return;
+    LVContainerRef dir = LVOpenDirectory( _cacheDir.c_str(), L"*.font" );
+    if ( dir.isNull() )
+        return;
+    for ( int i=0; i<dir->GetObjectCount(); i++ ) {
+        const LVContainerItemInfo * item = dir->GetObjectInfo( i );
+        if ( !item->IsContainer() )
+            LVDeleteFile( _cacheDir + item->GetName() );
+    }
+}
+
+void LVDocumentFontCache::setCacheDir( lString16 dir )
+{
+    LVDocumentFontCacheImpl::instance()->setCacheDir( dir );
+}
+
+void LVDocumentFontCache::clear()
+{
+    LVDocumentFontCacheImpl::instance()->clear();
+}
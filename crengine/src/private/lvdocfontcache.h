@@ -0,0 +1,54 @@
+/** \file lvdocfontcache.h
+    \brief decoded embedded document fonts cache
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#ifndef __LV_DOCFONTCACHE_H_INCLUDED__
+#define __LV_DOCFONTCACHE_H_INCLUDED__
+
+#include "../../include/crsetup.h"
+#include "../../include/lvstring.h"
+#include "../../include/lvstream.h"
+#include "../../include/lvhashtable.h"
+
+/// decoded embedded document fonts, shared between documents
+/**
+    Fonts are looked up by CRC32 and size of decoded content, so the same font
+    embedded into several books, or obfuscated with different keys, is kept once.
+    CRC is taken from archive without decoding, so fonts found are compared with
+    stream content, and a font is shared only when its decoded content has this CRC.
+    When cache directory is set, decoded font is written there and mapped
+    to memory, so reopening a book doesn't keep its own copy of the font.
+*/
+class LVDocumentFontCacheImpl {
+    lString16 _cacheDir;
+    LVHashTable<lString8, LVStreamBufferRef> _fonts; // key -> font data
+    lString16 makeFileName( const lString8 & key );
+    LVStreamBufferRef mapFile( const lString16 & pathName, lvsize_t size );
+    LVStreamBufferRef writeFile( const lString16 & pathName, LVStreamBufferRef data );
+    void removeOldFiles();
+    static bool sameContent( LVStreamRef stream, LVStreamBufferRef data );
+public:
+    int hits;     // font data already loaded
+    int mapped;   // font data mapped from cache directory
+    int decoded;  // font data read from document stream
+    LVDocumentFontCacheImpl();
+    /// returns font data for stream of embedded font, NULL if cannot be read
+    LVStreamBufferRef get( LVStreamRef stream );
+    /// frees data of fonts which are not used anymore
+    void release();
+    void setCacheDir( lString16 dir );
+    void clear();
+    static LVDocumentFontCacheImpl * instance();
+};
+
+#endif  // __LV_DOCFONTCACHE_H_INCLUDED__
@@ -0,0 +1,227 @@
+/** \file lvfontcoverage.cpp
+    \brief Unicode coverage of font face implementation
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#include "lvfontcoverage.h"
+#include "../../include/serialbuf.h"
+#include "../../include/crlog.h"
+
+// fc-lang database
+#include "fc-lang-cat.h"
+
+/// max number of ranges read from cache file
+#define FONT_COVERAGE_MAX_RANGES 0x100000
+
+LVFontCoverage::LVFontCoverage()
+{
+    memset( _pages, 0, sizeof(_pages) );
+}
+
+void LVFontCoverage::addRange( lUInt32 first, lUInt32 last )
+{
+    int n = _ranges.length();
+    if ( n && _ranges[n - 1] + 1 == first ) {
+        _ranges[n - 1] = last;
+        return;
+    }
+    _ranges.add( first );
+    _ranges.add( last );
+}
+
+void LVFontCoverage::buildPages()
+{
+    memset( _pages, 0, sizeof(_pages) );
+    _bits.clear();
+    for ( int i=0; i<_ranges.length(); i += 2 ) {
+        lUInt32 first = _ranges[i];
+        lUInt32 last = _ranges[i + 1];
+        if ( first > 0xFFFF )
+            break;
+        if ( last > 0xFFFF )
+            last = 0xFFFF;
+        for ( lUInt32 code = first; code <= last; ) {
+            int page = code >> 8;
+            lUInt32 pageLast = (code | 0xFF) < last ? (code | 0xFF) : last;
+            if ( (code & 0xFF) == 0 && pageLast == (code | 0xFF) && _pages[page] == 0 ) {
+                _pages[page] = 1; // whole page in single range
+            } else {
+                if ( _pages[page] == 1 )
+                    break; // cannot happen for sorted ranges
+                if ( _pages[page] == 0 ) {
+                    _pages[page] = (lUInt16)(_bits.length() / 8 + 2);
+                    lUInt32 * p = _bits.addSpace( 8 );
+                    memset( p, 0, 8 * sizeof(lUInt32) );
+                }
+                lUInt32 * bits = _bits.get() + (_pages[page] - 2) * 8;
+                for ( lUInt32 c = code; c <= pageLast; c++ )
+                    bits[(c >> 5) & 7] |= (lUInt32)1 << (c & 31);
+            }
+            code = pageLast + 1;
+        }
+    }
+}
+
+bool LVFontCoverage::findRange( lUInt32 code ) const
+{
+    int a = 0;
+    int b = _ranges.length() / 2 - 1;
+    while ( a <= b ) {
+        int i = (a + b) / 2;
+        if ( code < _ranges[i * 2] )
+            b = i - 1;
+        else if ( code > _ranges[i * 2 + 1] )
+            a = i + 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+#if (USE_FREETYPE == 1)
+bool LVFontCoverage::read( FT_Face face )
+{
+    _ranges.clear();
+    if ( FT_Select_Charmap( face, FT_ENCODING_UNICODE ) ) // non-zero means failure
+        return false;
+    FT_UInt glyphIndex = 0;
+    FT_ULong code = FT_Get_First_Char( face, &glyphIndex );
+    lUInt32 first = 0;
+    lUInt32 last = 0;
+    bool started = false;
+    while ( glyphIndex != 0 ) {
+        if ( started && code == last + 1 ) {
+            last = (lUInt32)code;
+        } else {
+            if ( started )
+                addRange( first, last );
+            first = last = (lUInt32)code;
+            started = true;
+        }
+        code = FT_Get_Next_Char( face, code, &glyphIndex );
+    }
+    if ( started )
+        addRange( first, last );
+    buildPages();
+    return true;
+}
+#endif
+
+static bool coverageHasChar( void * context, lUInt32 code )
+{
+    return ((const LVFontCoverage *)context)->hasChar( code );
+}
+
+bool LVFontCoverage::checkLangCompat( const lString8 & langCode ) const
+{
+    return checkLangCompat( langCode, coverageHasChar, (void *)this );
+}
+
+bool LVFontCoverage::checkLangCompat( const lString8 & langCode, LVFontHasCharCallback hasChar, void * context )
+{
+#define FC_LANG_START_INTERVAL_CODE     2
+    bool fullSupport = false;
+    bool partialSupport = false;
+    struct fc_lang_catalog *lang_ptr = fc_lang_cat;
+    unsigned int i;
+    bool found = false;
+    for (i = 0; i < fc_lang_cat_sz; i++) {
+        if (langCode.compare(lang_ptr->lang_code) == 0) {
+            found = true;
+            break;
+        }
+        lang_ptr++;
+    }
+    if (found) {
+        unsigned int codePoint = 0;
+        unsigned int tmp;
+        unsigned int first, second = 0;
+        bool inRange = false;
+        fullSupport = true;
+        for (i = 0;;) {
+            // get next codePoint
+            if (inRange && codePoint < second) {
+                codePoint++;
+            } else {
+                if (i >= lang_ptr->char_set_sz)
+                    break;
+                tmp = lang_ptr->char_set[i];
+                if (FC_LANG_START_INTERVAL_CODE == tmp)        // code of start interval
+                {
+                    if (i + 2 < lang_ptr->char_set_sz) {
+                        i++;
+                        first = lang_ptr->char_set[i];
+                        i++;
+                        second = lang_ptr->char_set[i];
+                        inRange = true;
+                        codePoint = first;
+                        i++;
+                    } else {
+                        // broken language char set
+                        //qDebug() << "broken language char set";
+                        fullSupport = false;
+                        break;
+                    }
+                } else {
+                    codePoint = tmp;
+                    inRange = false;
+                    i++;
+                }
+            }
+            // check codePoint in this font
+            if (!hasChar(context, codePoint)) {
+                fullSupport = false;
+            } else {
+                partialSupport = true;
+            }
+        }
+        if (fullSupport)
+            CRLog::debug("checkFontLangCompat(): Font have full support of language %s",
+                         langCode.c_str());
+        else if (partialSupport)
+            CRLog::debug("checkFontLangCompat(): Font have partial support of language %s",
+                         langCode.c_str());
+        else
+            CRLog::debug("checkFontLangCompat(): Font DON'T have support of language %s",
+                         langCode.c_str());
+    } else
+        CRLog::debug("checkFontLangCompat(): Unsupported language code: %s", langCode.c_str());
+    return fullSupport;
+}
+
+void LVFontCoverage::serialize( SerialBuf & buf ) const
+{
+    buf << (lUInt32)_ranges.length();
+    for ( int i=0; i<_ranges.length(); i++ )
+        buf << _ranges[i];
+}
+
+bool LVFontCoverage::deserialize( SerialBuf & buf )
+{
+    lUInt32 count = 0;
+    buf >> count;
+    if ( buf.error() || (count & 1) || count > FONT_COVERAGE_MAX_RANGES * 2 ) {
+        buf.seterror();
+        return false;
+    }
+    _ranges.clear();
+    _ranges.reserve( count );
+    for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+        lUInt32 code = 0;
+        buf >> code;
+        _ranges.add( code );
+    }
+    if ( buf.error() )
+        return false;
+    buildPages();
+    return true;
+}
@@ -0,0 +1,75 @@
+/** \file lvfontcoverage.h
+    \brief Unicode coverage of font face
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#ifndef __LV_FONTCOVERAGE_H_INCLUDED__
+#define __LV_FONTCOVERAGE_H_INCLUDED__
+
+#include "../../include/crsetup.h"
+#include "../../include/lvstring.h"
+#include "../../include/lvarray.h"
+#include "../../include/lvref.h"
+
+#if (USE_FREETYPE == 1)
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#endif
+
+class SerialBuf;
+
+/// returns true if font has glyph for code point
+typedef bool (*LVFontHasCharCallback)( void * context, lUInt32 code );
+
+/// set of code points present in unicode charmap of font face
+/**
+    Kept as sorted list of ranges of code points, with bitset pages built
+    from it for BMP, so that checking code point needs no charmap lookup.
+    Coverage is not changed once built, so it's shared between font instances.
+*/
+class LVFontCoverage : public LVRefCounter {
+    LVArray<lUInt32> _ranges; // pairs of first and last code points, sorted
+    lUInt16 _pages[256];      // BMP pages of 256 code points: 0 - empty, 1 - full, n - bitset n-2 in _bits
+    LVArray<lUInt32> _bits;   // 8 words for each partially covered page
+    void addRange( lUInt32 first, lUInt32 last );
+    void buildPages();
+    bool findRange( lUInt32 code ) const;
+public:
+    LVFontCoverage();
+#if (USE_FREETYPE == 1)
+    /// reads unicode charmap of face, returns false if face has no unicode charmap
+    bool read( FT_Face face );
+#endif
+    /// returns true if font has glyph for code point
+    inline bool hasChar( lUInt32 code ) const
+    {
+        if ( code < 0x10000 ) {
+            lUInt16 page = _pages[code >> 8];
+            if ( page <= 1 )
+                return page == 1;
+            return ( _bits[(page - 2) * 8 + ((code >> 5) & 7)] >> (code & 31) ) & 1;
+        }
+        return findRange( code );
+    }
+    /// returns number of ranges of code points
+    int rangeCount() const { return _ranges.length() / 2; }
+    /// returns true if font has all characters of language, from fc-lang catalog
+    bool checkLangCompat( const lString8 & langCode ) const;
+    /// checks characters of language from fc-lang catalog with callback, returns true for full support
+    static bool checkLangCompat( const lString8 & langCode, LVFontHasCharCallback hasChar, void * context );
+    void serialize( SerialBuf & buf ) const;
+    bool deserialize( SerialBuf & buf );
+};
+
+typedef LVFastRef<LVFontCoverage> LVFontCoverageRef;
+
+#endif  // __LV_FONTCOVERAGE_H_INCLUDED__
@@ -20,6 +20,8 @@
 #include "../../include/lvstring.h"
 #include "../../include/cssdef.h"
 #include "../../include/lvarray.h"
+#include "../../include/lvstream.h"
+#include "lvfontcoverage.h"
 
 /**
     @brief Font properties definition
@@ -35,12 +37,13 @@ private:
     int _index;
     // for document font: _documentId, _buf, _name
     int _documentId;
-    LVByteArrayRef _buf;
+    LVStreamBufferRef _buf; // font file contents, shared with other documents
     int _bias;
+    LVFontCoverageRef _coverage;
 public:
     LVFontDef(const lString8 &name, int size, int weight, int italic, css_font_family_t family,
               const lString8 &typeface, int index = -1, int documentId = -1,
-              LVByteArrayRef buf = LVByteArrayRef())
+              LVStreamBufferRef buf = LVStreamBufferRef())
             : _size(size), _weight(weight), _italic(italic), _family(family), _typeface(typeface),
               _name(name), _index(index), _documentId(documentId), _buf(buf), _bias(0) {
     }
@@ -48,7 +51,8 @@ public:
     LVFontDef(const LVFontDef &def)
             : _size(def._size), _weight(def._weight), _italic(def._italic), _family(def._family),
               _typeface(def._typeface), _name(def._name), _index(def._index),
-              _documentId(def._documentId), _buf(def._buf), _bias(def._bias) {
+              _documentId(def._documentId), _buf(def._buf), _bias(def._bias),
+              _coverage(def._coverage) {
     }
 
     /// returns true if definitions are equal
@@ -102,9 +106,14 @@ public:
 
     void setDocumentId(int id) { _documentId = id; }
 
-    LVByteArrayRef getBuf() { return _buf; }
+    LVStreamBufferRef getBuf() { return _buf; }
 
-    void setBuf(LVByteArrayRef buf) { _buf = buf; }
+    void setBuf(LVStreamBufferRef buf) { _buf = buf; }
+
+    /// returns unicode coverage of face, if known
+    LVFontCoverageRef getCoverage() const { return _coverage; }
+
+    void setCoverage(LVFontCoverageRef coverage) { _coverage = coverage; }
 
     ~LVFontDef() {}
 
@@ -0,0 +1,185 @@
+/** \file lvfontscancache.cpp
+    \brief font file scan cache implementation
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#include "lvfontscancache.h"
+#include "../../include/lvstream.h"
+#include "../../include/serialbuf.h"
+#include "../../include/crlog.h"
+
+#define FONT_SCAN_CACHE_MAGIC "CR3FNT03"
+
+#define FONT_SCAN_FACE_SCALABLE    1
+#define FONT_SCAN_FACE_CHARSET     2
+#define FONT_SCAN_FACE_FIXED_WIDTH 4
+#define FONT_SCAN_FACE_BOLD        8
+#define FONT_SCAN_FACE_ITALIC      16
+#define FONT_SCAN_FACE_COVERAGE    32
+
+LVFontScanCache::LVFontScanCache()
+    : _index(256), _requiredCharsHash(0), _changed(false), hits(0), misses(0)
+{
+}
+
+void LVFontScanCache::load()
+{
+    LVStreamRef stream = LVOpenFileStream( _fileName.c_str(), LVOM_READ );
+    if ( stream.isNull() )
+        return;
+    LVStreamBufferRef sb = stream->GetReadBuffer( 0, stream->GetSize() );
+    if ( sb.isNull() )
+        return;
+    SerialBuf buf( sb->getReadOnly(), sb->getSize() );
+    if ( !buf.checkMagic( FONT_SCAN_CACHE_MAGIC ) ) {
+        CRLog::error("wrong font scan cache file format");
+        return;
+    }
+    int start = buf.pos();
+    lUInt32 requiredCharsHash = 0;
+    lUInt32 count = 0;
+    buf >> requiredCharsHash >> count;
+    if ( requiredCharsHash != _requiredCharsHash ) {
+        CRLog::info("required font characters are changed, font scan cache is dropped");
+        return;
+    }
+    LVPtrVector<LVFontScanFile> files;
+    for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+        LVFontScanFile * file = new LVFontScanFile();
+        files.add( file );
+        lUInt32 sizeLo = 0, sizeHi = 0, timeLo = 0, timeHi = 0;
+        lUInt16 faceCount = 0;
+        buf >> file->path >> sizeLo >> sizeHi >> timeLo >> timeHi >> faceCount;
+        file->size = ((lUInt64)sizeHi << 32) | sizeLo;
+        file->modTime = ((lUInt64)timeHi << 32) | timeLo;
+        for ( int k=0; k<faceCount && !buf.error(); k++ ) {
+            LVFontScanFace * face = new LVFontScanFace();
+            file->faces.add( face );
+            lUInt8 flags = 0;
+            buf >> face->familyName >> flags;
+            face->scalable = (flags & FONT_SCAN_FACE_SCALABLE) != 0;
+            face->charset = (flags & FONT_SCAN_FACE_CHARSET) != 0;
+            face->fixedWidth = (flags & FONT_SCAN_FACE_FIXED_WIDTH) != 0;
+            face->bold = (flags & FONT_SCAN_FACE_BOLD) != 0;
+            face->italic = (flags & FONT_SCAN_FACE_ITALIC) != 0;
+            if ( flags & FONT_SCAN_FACE_COVERAGE ) {
+                face->coverage = LVFontCoverageRef( new LVFontCoverage() );
+                face->coverage->deserialize( buf );
+            }
+        }
+    }
+    if ( buf.error() || !buf.checkCRC( buf.pos() - start ) ) {
+        CRLog::error("font scan cache file is corrupted");
+        return;
+    }
+    while ( files.length() ) {
+        LVFontScanFile * file = files.remove( 0 );
+        int index = -1;
+        if ( _index.get( file->path, index ) ) {
+            // scanned during this run already
+            delete file;
+            continue;
+        }
+        _index.set( file->path, _files.length() );
+        _files.add( file );
+    }
+    CRLog::info("%d font files read from font scan cache", _files.length());
+}
+
+void LVFontScanCache::setFileName( lString16 fileName, lUInt32 requiredCharsHash )
+{
+    save();
+    // results kept in memory only go to the first file set, so it can be set after fonts are registered
+    if ( !_fileName.empty() ) {
+        _files.clear();
+        _index.clear();
+        _changed = false;
+    }
+    _fileName = fileName;
+    _requiredCharsHash = requiredCharsHash;
+    if ( !_fileName.empty() )
+        load();
+}
+
+LVFontScanFile * LVFontScanCache::get( const lString8 & path, lUInt64 size, lUInt64 modTime )
+{
+    int index = -1;
+    if ( _index.get( path, index ) ) {
+        LVFontScanFile * file = _files[index];
+        if ( file->size == size && file->modTime == modTime ) {
+            file->used = true;
+            hits++;
+            return file;
+        }
+    }
+    misses++;
+    return NULL;
+}
+
+void LVFontScanCache::put( LVFontScanFile * file )
+{
+    file->used = true;
+    int index = -1;
+    if ( _index.get( file->path, index ) ) {
+        _files.set( index, file );
+    } else {
+        _index.set( file->path, _files.length() );
+        _files.add( file );
+    }
+    _changed = true;
+}
+
+void LVFontScanCache::save()
+{
+    if ( _fileName.empty() )
+        return;
+    // files not registered during this run are dropped
+    int used = 0;
+    for ( int i=0; i<_files.length(); i++ )
+        if ( _files[i]->used )
+            used++;
+    if ( !_changed && used == _files.length() )
+        return;
+    SerialBuf buf( 65536, true );
+    buf.putMagic( FONT_SCAN_CACHE_MAGIC );
+    int start = buf.pos();
+    buf << _requiredCharsHash << (lUInt32)used;
+    for ( int i=0; i<_files.length(); i++ ) {
+        LVFontScanFile * file = _files[i];
+        if ( !file->used )
+            continue;
+        buf << file->path << (lUInt32)file->size << (lUInt32)(file->size >> 32)
+            << (lUInt32)file->modTime << (lUInt32)(file->modTime >> 32) << (lUInt16)file->faces.length();
+        for ( int k=0; k<file->faces.length(); k++ ) {
+            LVFontScanFace * face = file->faces[k];
+            lUInt8 flags = (face->scalable ? FONT_SCAN_FACE_SCALABLE : 0)
+                | (face->charset ? FONT_SCAN_FACE_CHARSET : 0)
+                | (face->fixedWidth ? FONT_SCAN_FACE_FIXED_WIDTH : 0)
+                | (face->bold ? FONT_SCAN_FACE_BOLD : 0)
+                | (face->italic ? FONT_SCAN_FACE_ITALIC : 0)
+                | (!face->coverage.isNull() ? FONT_SCAN_FACE_COVERAGE : 0);
+            buf << face->familyName << flags;
+            if ( !face->coverage.isNull() )
+                face->coverage->serialize( buf );
+        }
+    }
+    buf.putCRC( buf.pos() - start );
+    if ( buf.error() )
+        return;
+    LVStreamRef stream = LVOpenFileStream( _fileName.c_str(), LVOM_WRITE );
+    if ( stream.isNull() || stream->Write( buf.buf(), buf.pos(), NULL ) != LVERR_OK ) {
+        CRLog::error("Cannot write font scan cache file");
+        return;
+    }
+    _changed = false;
+    CRLog::debug("%d font files saved to font scan cache (%d hits, %d misses)", used, hits, misses);
+}
@@ -0,0 +1,69 @@
+/** \file lvfontscancache.h
+    \brief font file scan cache
+
+    CoolReader Engine
+
+
+    (c) Vadim Lopatin, 2000-2006
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#ifndef __LV_FONTSCANCACHE_H_INCLUDED__
+#define __LV_FONTSCANCACHE_H_INCLUDED__
+
+#include "../../include/crsetup.h"
+#include "../../include/lvstring.h"
+#include "../../include/lvptrvec.h"
+#include "../../include/lvhashtable.h"
+#include "lvfontcoverage.h"
+
+/// properties of font face needed to register it, read from font file
+struct LVFontScanFace {
+    lString8 familyName;
+    bool scalable;
+    bool charset; // has required characters or symbol charmap
+    bool fixedWidth;
+    bool bold;
+    bool italic;
+    LVFontCoverageRef coverage; // unicode coverage, if face has unicode charmap
+    LVFontScanFace() : scalable(false), charset(false), fixedWidth(false), bold(false), italic(false) { }
+};
+
+/// all faces of font file, including ones which cannot be registered; callers decide which of them to use
+struct LVFontScanFile {
+    lString8 path;
+    lUInt64 size;
+    lUInt64 modTime;
+    bool used; // requested during this run
+    LVPtrVector<LVFontScanFace> faces;
+    LVFontScanFile() : size(0), modTime(0), used(false) { }
+};
+
+/// keeps font file scan results between runs, so that faces of unchanged files are not opened at startup
+class LVFontScanCache {
+    LVPtrVector<LVFontScanFile> _files;
+    LVHashTable<lString8, int> _index; // path to index in _files
+    lString16 _fileName;
+    lUInt32 _requiredCharsHash;
+    bool _changed;
+    void load();
+public:
+    int hits;
+    int misses;
+    LVFontScanCache();
+    /// sets file to keep scan results in, loads it; empty name keeps results in memory only,
+    /// until file is set: they are kept then
+    void setFileName( lString16 fileName, lUInt32 requiredCharsHash );
+    /// returns scan results for font file if it's not changed since scan, NULL otherwise
+    LVFontScanFile * get( const lString8 & path, lUInt64 size, lUInt64 modTime );
+    /// stores scan results, takes ownership
+    void put( LVFontScanFile * file );
+    /// writes scan results of files used during this run, if changed
+    void save();
+};
+
+#endif  // __LV_FONTSCANCACHE_H_INCLUDED__
@@ -26,9 +26,6 @@
 #include "../include/gammatbl.h"
 
 
-// fc-lang database
-#include "fc-lang-cat.h"
-
 #if COLOR_BACKBUFFER == 0
 //#define USE_BITMAP_FONT
 #endif
@@ -301,6 +298,14 @@ inline lUInt32 getHash( const struct LVCharTriplet& triplet )
 
 #endif  // USE_HARFBUZZ==1
 
+LVFontCoverageRef LVFreeTypeFace::readCoverage() {
+    FONT_GUARD
+    LVFontCoverageRef coverage(new LVFontCoverage());
+    if (!_face || !coverage->read(_face))
+        return LVFontCoverageRef();
+    return coverage;
+}
+
 void LVFreeTypeFace::setFallbackFont(LVFontRef font) {
     _fallbackFont = font;
     _fallbackFontIsSet = !font.isNull();
@@ -527,7 +532,7 @@ void LVFreeTypeFace::setEmbolden()
     _embolden_half_strength = embolden_strength / 2;
 }
 
-bool LVFreeTypeFace::loadFromBuffer(LVByteArrayRef buf, int index, int size,
+bool LVFreeTypeFace::loadFromBuffer(LVStreamBufferRef buf, int index, int size,
                                     css_font_family_t fontFamily, bool monochrome, bool italicize) {
     FONT_GUARD
     _hintingMode = fontMan->GetHintingMode();
@@ -535,10 +540,15 @@ bool LVFreeTypeFace::loadFromBuffer(LVByteArrayRef buf, int index, int size,
     _fontFamily = fontFamily;
     if (_face)
         FT_Done_Face(_face);
-    int error = FT_New_Memory_Face(_library, buf->get(), buf->length(), index,
+    // FreeType reads glyphs from buffer until face is done
+    _buf = buf;
+    int error = FT_New_Memory_Face(_library, buf->getReadOnly(), (FT_Long)buf->getSize(), index,
                                    &_face); /* create face object */
-    if (error)
+    if (error) {
+        _face = NULL;
+        _buf.Clear();
         return false;
+    }
     if (_fileName.endsWith(".pfb") || _fileName.endsWith(".pfa")) {
         lString8 kernFile = _fileName.substr(0, _fileName.length() - 4);
         if (LVFileExists(Utf8ToUnicode(kernFile) + ".afm")) {
@@ -739,7 +749,7 @@ LVFreeTypeFace::loadFromFile(const char *fname, int index, int size, css_font_fa
 lChar16 LVFreeTypeFace::filterChar(lChar16 code, lChar16 def_char) {
     if (code == '\t')     // (FreeSerif doesn't have \t, get a space
         code = ' ';       // rather than a '?')
-    FT_UInt ch_glyph_index = FT_Get_Char_Index(_face, code);
+    FT_UInt ch_glyph_index = getCoveredCharIndex(code);
     if (ch_glyph_index != 0) { // found
         return code;
     }
@@ -832,7 +842,7 @@ bool LVFreeTypeFace::hbCalcCharWidth(LVCharPosInfo *posInfo, const LVCharTriplet
 FT_UInt LVFreeTypeFace::getCharIndex(lUInt32 code, lChar16 def_char) {
     if (code == '\t')
         code = ' ';
-    FT_UInt ch_glyph_index = FT_Get_Char_Index(_face, code);
+    FT_UInt ch_glyph_index = getCoveredCharIndex(code);
     if ( ch_glyph_index==0 && code >= 0xF000 && code <= 0xF0FF) {
         // If no glyph found and code is among the private unicode
         // area classically used by symbol fonts (range U+F020-U+F0FF),
@@ -846,9 +856,9 @@ FT_UInt LVFreeTypeFace::getCharIndex(lUInt32 code, lChar16 def_char) {
     if ( ch_glyph_index==0 ) {
         lUInt32 replacement = getReplacementChar( code );
         if ( replacement )
-            ch_glyph_index = FT_Get_Char_Index( _face, replacement );
+            ch_glyph_index = getCoveredCharIndex( replacement );
         if ( ch_glyph_index==0 && def_char )
-            ch_glyph_index = FT_Get_Char_Index( _face, def_char );
+            ch_glyph_index = getCoveredCharIndex( def_char );
     }
     return ch_glyph_index;
 }
@@ -926,77 +936,14 @@ bool LVFreeTypeFace::getGlyphInfo(lUInt32 code, LVFont::glyph_info_t *glyph, lCh
     return true;
 }
 
+static bool faceHasChar(void *context, lUInt32 code) {
+    return FT_Get_Char_Index((FT_Face)context, code) != 0;
+}
+
 bool LVFreeTypeFace::checkFontLangCompat(const lString8 &langCode) {
-#define FC_LANG_START_INTERVAL_CODE     2
-    bool fullSupport = false;
-    bool partialSupport = false;
-    struct fc_lang_catalog *lang_ptr = fc_lang_cat;
-    unsigned int i;
-    bool found = false;
-    for (i = 0; i < fc_lang_cat_sz; i++) {
-        if (langCode.compare(lang_ptr->lang_code) == 0) {
-            found = true;
-            break;
-        }
-        lang_ptr++;
-    }
-    if (found) {
-        unsigned int codePoint = 0;
-        unsigned int tmp;
-        unsigned int first, second = 0;
-        bool inRange = false;
-        FT_UInt glyphIndex;
-        fullSupport = true;
-        for (i = 0;;) {
-            // get next codePoint
-            if (inRange && codePoint < second) {
-                codePoint++;
-            } else {
-                if (i >= lang_ptr->char_set_sz)
-                    break;
-                tmp = lang_ptr->char_set[i];
-                if (FC_LANG_START_INTERVAL_CODE == tmp)        // code of start interval
-                {
-                    if (i + 2 < lang_ptr->char_set_sz) {
-                        i++;
-                        first = lang_ptr->char_set[i];
-                        i++;
-                        second = lang_ptr->char_set[i];
-                        inRange = true;
-                        codePoint = first;
-                        i++;
-                    } else {
-                        // broken language char set
-                        //qDebug() << "broken language char set";
-                        fullSupport = false;
-                        break;
-                    }
-                } else {
-                    codePoint = tmp;
-                    inRange = false;
-                    i++;
-                }
-            }
-            // check codePoint in this font
-            glyphIndex = FT_Get_Char_Index(_face, codePoint);
-            if (0 == glyphIndex) {
-                fullSupport = false;
-            } else {
-                partialSupport = true;
-            }
-        }
-        if (fullSupport)
-            CRLog::debug("checkFontLangCompat(): Font have full support of language %s",
-                         langCode.c_str());
-        else if (partialSupport)
-            CRLog::debug("checkFontLangCompat(): Font have partial support of language %s",
-                         langCode.c_str());
-        else
-            CRLog::debug("checkFontLangCompat(): Font DON'T have support of language %s",
-                         langCode.c_str());
-    } else
-        CRLog::debug("checkFontLangCompat(): Unsupported language code: %s", langCode.c_str());
-    return fullSupport;
+    if (!_coverage.isNull())
+        return _coverage->checkLangCompat(langCode);
+    return LVFontCoverage::checkLangCompat(langCode, faceHasChar, _face);
 }
 
 lUInt16 LVFreeTypeFace::measureText(const lChar16 *text,
@@ -2123,6 +2070,7 @@ void LVFreeTypeFace::Clear() {
         FT_Done_Face(_face);
         _face = NULL;
     }
+    _buf.Clear();
 }
 
 #endif  // (USE_FREETYPE==1)
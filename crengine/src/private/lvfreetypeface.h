@@ -119,6 +119,7 @@ protected:
     css_font_family_t _fontFamily;
     FT_Library _library;
     FT_Face _face;
+    LVStreamBufferRef _buf; // font file contents for face loaded from memory
     FT_GlyphSlot _slot;
     FT_Matrix _matrix;                 /* transformation matrix */
     int _size; // caracter height in pixels
@@ -136,6 +137,7 @@ protected:
     shaping_mode_t _shapingMode;
     bool _fallbackFontIsSet;
     LVFontRef _fallbackFont;
+    LVFontCoverageRef _coverage; // code points of unicode charmap, checked before charmap lookups
     bool           _embolden; // fake/synthetized bold
     bool           _allowKerning;
     FT_Pos         _embolden_half_strength; // for emboldening with Harfbuzz
@@ -163,6 +165,19 @@ public:
     /// get fallback font for this font
     LVFont *getFallbackFont();
 
+    /// set unicode coverage of face, shared by all instances of face
+    void setCoverage(LVFontCoverageRef coverage) { _coverage = coverage; }
+
+    /// reads unicode coverage from charmap, returns empty ref if face has no unicode charmap
+    LVFontCoverageRef readCoverage();
+
+    /// returns glyph index from current charmap, without lookup for code points not in coverage
+    inline FT_UInt getCoveredCharIndex(lUInt32 code) {
+        if (!_coverage.isNull() && !_coverage->hasChar(code))
+            return 0;
+        return FT_Get_Char_Index(_face, code);
+    }
+
     /// returns font weight
     virtual int getWeight() const { return _weight; }
 
@@ -210,7 +225,7 @@ public:
 
     void setEmbolden();
 
-    bool loadFromBuffer(LVByteArrayRef buf, int index, int size, css_font_family_t fontFamily,
+    bool loadFromBuffer(LVStreamBufferRef buf, int index, int size, css_font_family_t fontFamily,
                         bool monochrome, bool italicize);
 
     bool loadFromFile(const char *fname, int index, int size, css_font_family_t fontFamily,
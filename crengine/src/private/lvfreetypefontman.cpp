@@ -15,6 +15,7 @@
 #include "lvfreetypefontman.h"
 #include "lvfreetypeface.h"
 #include "lvfontboldtransform.h"
+#include "lvdocfontcache.h"
 #include "../../include/crlog.h"
 
 #if (USE_FONTCONFIG == 1)
@@ -427,6 +428,7 @@ bool LVFreeTypeFontManager::initSystemFonts() {
 
 LVFreeTypeFontManager::~LVFreeTypeFontManager() {
     FONT_MAN_GUARD
+    _scanCache.save();
     _globalCache.clear();
     _cache.clear();
     if (_library)
@@ -508,23 +510,15 @@ bool LVFreeTypeFontManager::SetAlias(lString8 alias, lString8 facename, int id,
         id
     );
 
-    int index = 0;
-
-    FT_Face face = NULL;
+    LVAutoPtr<LVFontScanFile> holder;
+    LVFontScanFile * file = scanFontFile( item->getDef()->getName(), holder );
 
     // for all faces in file
-    for ( ;; index++ ) {
-        int error = FT_New_Face( _library, item->getDef()->getName().c_str(), index, &face ); /* create face object */
-        if ( error ) {
-            if (index == 0) {
-                CRLog::error("FT_New_Face returned error %d", error);
-            }
-            break;
-        }
-        int num_faces = face->num_faces;
+    for ( int index = 0; index < file->faces.length(); index++ ) {
+        LVFontScanFace * face = file->faces[index];
 
         css_font_family_t fontFamily = css_ff_sans_serif;
-        if ( face->face_flags & FT_FACE_FLAG_FIXED_WIDTH )
+        if ( face->fixedWidth )
             fontFamily = css_ff_monospace;
         //lString8 familyName(!facename.empty() ? facename : ::familyName(face));
         // We don't need this here and in other places below: all fonts (except
@@ -538,8 +532,8 @@ bool LVFreeTypeFontManager::SetAlias(lString8 alias, lString8 facename, int id,
             fontFamily = css_ff_serif;
         */
 
-        bool boldFlag = !facename.empty() ? bold : (face->style_flags & FT_STYLE_FLAG_BOLD) != 0;
-        bool italicFlag = !facename.empty() ? italic : (face->style_flags & FT_STYLE_FLAG_ITALIC) != 0;
+        bool boldFlag = !facename.empty() ? bold : face->bold;
+        bool italicFlag = !facename.empty() ? italic : face->italic;
 
         LVFontDef def2(
                 item->getDef()->getName(),
@@ -551,11 +545,7 @@ bool LVFreeTypeFontManager::SetAlias(lString8 alias, lString8 facename, int id,
                 index,
                 id
         );
-
-        if ( face ) {
-            FT_Done_Face( face );
-            face = NULL;
-        }
+        def2.setCoverage( face->coverage );
 
         if ( _cache.findDuplicate( &def2 ) ) {
             CRLog::trace("font definition is duplicate");
@@ -568,8 +558,6 @@ bool LVFreeTypeFontManager::SetAlias(lString8 alias, lString8 facename, int id,
             if ( !_cache.findDuplicate( &newDef ) )
                 _cache.update( &newDef, LVFontRef(NULL) );
         }
-        if ( index>=num_faces-1 )
-            break;
     }
     item = _cache.find( &def1);
     if (item->getDef()->getTypeFace()==alias ) {
@@ -683,6 +671,14 @@ fprintf(_log, "GetFont(size=%d, weight=%d, italic=%d, family=%d, typeface='%s')\
         //fprintf(_log, "    : loading from file %s : %s %d\n", item->getDef()->getName().c_str(),
         //    item->getDef()->getTypeFace().c_str(), item->getDef()->getSize() );
         LVFontRef ref(font);
+        // unicode coverage is read once for each registered face
+        LVFontCoverageRef coverage = item->getDef()->getCoverage();
+        if (coverage.isNull()) {
+            coverage = font->readCoverage();
+            item->getDef()->setCoverage(coverage);
+            newDef.setCoverage(coverage);
+        }
+        font->setCoverage(coverage);
         font->setKerning( GetKerning() );
         font->setShapingMode( GetShapingMode() );
         font->setFaceName(item->getDef()->getTypeFace());
@@ -734,7 +730,81 @@ bool LVFreeTypeFontManager::checkCharSet(FT_Face face) {
     return true;
 }
 
+LVFontScanFile * LVFreeTypeFontManager::scanFontFile(const lString8 &fname, LVAutoPtr<LVFontScanFile> &holder) {
+    lUInt64 size = 0;
+    lUInt64 modTime = 0;
+    bool cacheable = LVGetFileInfo(fname, size, modTime);
+    if (cacheable) {
+        LVFontScanFile * file = _scanCache.get(fname, size, modTime);
+        if (file)
+            return file;
+    }
+    LVFontScanFile * file = new LVFontScanFile();
+    file->path = fname;
+    file->size = size;
+    file->modTime = modTime;
+    FT_Face face = NULL;
+    // for all faces in file; callers decide which of them to use
+    for (int index = 0;; index++) {
+        int error = FT_New_Face(_library, fname.c_str(), index, &face); /* create face object */
+        if (error) {
+            if (index == 0) {
+                CRLog::error("FT_New_Face returned error %d", error);
+            }
+            break;
+        }
+        LVFontScanFace * item = new LVFontScanFace();
+        file->faces.add(item);
+        item->scalable = FT_IS_SCALABLE(face) != 0;
+        item->charset = checkCharSet(face);
+        if (!item->charset) {
+            if (FT_Select_Charmap(face, FT_ENCODING_UNICODE)) // returns 0 on success
+                // If no unicode charmap found, try symbol charmap
+                if (!FT_Select_Charmap(face, FT_ENCODING_MS_SYMBOL))
+                    // It has a symbol charmap: consider it valid
+                    item->charset = true;
+        }
+        item->fixedWidth = (face->face_flags & FT_FACE_FLAG_FIXED_WIDTH) != 0;
+        item->bold = (face->style_flags & FT_STYLE_FLAG_BOLD) != 0;
+        item->italic = (face->style_flags & FT_STYLE_FLAG_ITALIC) != 0;
+        item->familyName = ::familyName(face);
+        if (item->scalable && item->charset) {
+            LVFontCoverageRef coverage(new LVFontCoverage());
+            if (coverage->read(face))
+                item->coverage = coverage;
+        }
+        int num_faces = face->num_faces;
+        FT_Done_Face(face);
+        face = NULL;
+        if (index >= num_faces - 1)
+            break;
+    }
+    if (cacheable)
+        _scanCache.put(file);
+    else
+        holder = file;
+    return file;
+}
+
+void LVFreeTypeFontManager::SetFontScanCacheFile(lString16 fileName) {
+    FONT_MAN_GUARD
+    _scanCache.setFileName(fileName, _requiredChars.getHash());
+}
+
+void LVFreeTypeFontManager::SaveFontScanCache() {
+    FONT_MAN_GUARD
+    _scanCache.save();
+}
+
 bool LVFreeTypeFontManager::checkFontLangCompat(const lString8 &typeface, const lString8 &langCode) {
+    {
+        FONT_MAN_GUARD
+        // check coverage of face GetFont() would choose, without opening it
+        LVFontDef def(lString8::empty_str, 10, 400, false, css_ff_inherit, typeface, -1, -1);
+        LVFontCacheItem *item = _cache.find(&def);
+        if (item && !item->getDef()->getCoverage().isNull())
+            return item->getDef()->getCoverage()->checkLangCompat(langCode);
+    }
     LVFontRef fntRef = GetFont(10, 400, false, css_ff_inherit, typeface, -1);
     if (!fntRef.isNull())
         return fntRef->checkFontLangCompat(langCode);
@@ -789,12 +859,9 @@ bool LVFreeTypeFontManager::RegisterDocumentFont(int documentId, LVContainerRef
     LVStreamRef stream = container->OpenStream(name.c_str(), LVOM_READ);
     if (stream.isNull())
         return false;
-    lUInt32 size = (lUInt32) stream->GetSize();
-    if (size < 100 || size > 5000000)
-        return false;
-    LVByteArrayRef buf(new LVByteArray(size, 0));
-    lvsize_t bytesRead = 0;
-    if (stream->Read(buf->get(), size, &bytesRead) != LVERR_OK || bytesRead != size)
+    // same font embedded into other documents is decoded once, and mapped from document cache dir
+    LVStreamBufferRef buf = LVDocumentFontCacheImpl::instance()->get(stream);
+    if (buf.isNull())
         return false;
     bool res = false;
 
@@ -804,7 +871,7 @@ bool LVFreeTypeFontManager::RegisterDocumentFont(int documentId, LVContainerRef
 
     // for all faces in file
     for (;; index++) {
-        int error = FT_New_Memory_Face(_library, buf->get(), buf->length(), index,
+        int error = FT_New_Memory_Face(_library, buf->getReadOnly(), (FT_Long)buf->getSize(), index,
                                        &face); /* create face object */
         if (error) {
             if (index == 0) {
@@ -886,7 +953,9 @@ bool LVFreeTypeFontManager::RegisterDocumentFont(int documentId, LVContainerRef
 }
 
 void LVFreeTypeFontManager::UnregisterDocumentFonts(int documentId) {
+    FONT_MAN_GUARD
     _cache.removeDocumentFonts(documentId);
+    LVDocumentFontCacheImpl::instance()->release();
 }
 
 bool LVFreeTypeFontManager::RegisterExternalFont(lString16 name, lString8 family_name, bool bold,
@@ -899,44 +968,24 @@ bool LVFreeTypeFontManager::RegisterExternalFont(lString16 name, lString8 family
 
     bool res = false;
 
-    int index = 0;
-
-    FT_Face face = NULL;
+    LVAutoPtr<LVFontScanFile> holder;
+    LVFontScanFile * file = scanFontFile(fname, holder);
 
     // for all faces in file
-    for (;; index++) {
-        int error = FT_New_Face(_library, fname.c_str(), index, &face); /* create face object */
-        if (error) {
-            if (index == 0) {
-                CRLog::error("FT_New_Face returned error %d", error);
-            }
-            break;
-        }
-        bool scal = FT_IS_SCALABLE(face);
-        bool charset = checkCharSet(face);
-        if (!charset) {
-            if (FT_Select_Charmap(face, FT_ENCODING_UNICODE)) // returns 0 on success
-                // If no unicode charmap found, try symbol charmap
-                if (!FT_Select_Charmap(face, FT_ENCODING_MS_SYMBOL))
-                    // It has a symbol charmap: consider it valid
-                    charset = true;
-        }
-        //bool monospaced = isMonoSpaced( face );
+    for (int index = 0; index < file->faces.length(); index++) {
+        LVFontScanFace * face = file->faces[index];
+        bool scal = face->scalable;
+        bool charset = face->charset;
         if (!scal || !charset) {
             CRLog::debug("    won't register font %s: %s",
                          name.c_str(),
                          !charset ? "no mandatory characters in charset" : "font is not scalable"
             );
-            if (face) {
-                FT_Done_Face(face);
-                face = NULL;
-            }
             break;
         }
-        int num_faces = face->num_faces;
 
         css_font_family_t fontFamily = css_ff_sans_serif;
-        if (face->face_flags & FT_FACE_FLAG_FIXED_WIDTH)
+        if (face->fixedWidth)
             fontFamily = css_ff_monospace;
         //lString8 familyName(::familyName(face));
         /*
@@ -953,6 +1002,7 @@ bool LVFreeTypeFontManager::RegisterExternalFont(lString16 name, lString8 family
                 family_name,
                 index
         );
+        def.setCoverage(face->coverage);
 #if (DEBUG_FONT_MAN == 1)
         if ( _log ) {
             fprintf(_log, "registering font: (file=%s[%d], size=%d, weight=%d, italic=%d, family=%d, typeface=%s)\n",
@@ -972,14 +1022,6 @@ bool LVFreeTypeFontManager::RegisterExternalFont(lString16 name, lString8 family
                 _cache.update(&newDef, LVFontRef(NULL));
         }
         res = true;
-
-        if ( face ) {
-            FT_Done_Face(face);
-            face = NULL;
-        }
-
-        if ( index >= num_faces - 1 )
-            break;
     }
 
     return res;
@@ -1003,46 +1045,26 @@ bool LVFreeTypeFontManager::RegisterFont(lString8 name) {
 #endif
     bool res = false;
 
-    int index = 0;
-
-    FT_Face face = NULL;
+    LVAutoPtr<LVFontScanFile> holder;
+    LVFontScanFile * file = scanFontFile(fname, holder);
 
     // for all faces in file
-    for (;; index++) {
-        int error = FT_New_Face(_library, fname.c_str(), index, &face); /* create face object */
-        if (error) {
-            if (index == 0) {
-                CRLog::error("FT_New_Face returned error %d", error);
-            }
-            break;
-        }
-        bool scal = FT_IS_SCALABLE(face) != 0;
-        bool charset = checkCharSet(face);
-        if (!charset) {
-            if (FT_Select_Charmap(face, FT_ENCODING_UNICODE)) // returns 0 on success
-                // If no unicode charmap found, try symbol charmap
-                if (!FT_Select_Charmap(face, FT_ENCODING_MS_SYMBOL))
-                    // It has a symbol charmap: consider it valid
-                    charset = true;
-        }
-        //bool monospaced = isMonoSpaced( face );
+    for (int index = 0; index < file->faces.length(); index++) {
+        LVFontScanFace * face = file->faces[index];
+        bool scal = face->scalable;
+        bool charset = face->charset;
         if (!scal || !charset) {
             CRLog::debug("    won't register font %s: %s",
                          name.c_str(),
                          !charset ? "no mandatory characters in charset" : "font is not scalable"
             );
-            if (face) {
-                FT_Done_Face(face);
-                face = NULL;
-            }
             break;
         }
-        int num_faces = face->num_faces;
 
         css_font_family_t fontFamily = css_ff_sans_serif;
-        if (face->face_flags & FT_FACE_FLAG_FIXED_WIDTH)
+        if (face->fixedWidth)
             fontFamily = css_ff_monospace;
-        lString8 familyName(::familyName(face));
+        lString8 familyName(face->familyName);
         /*
         if (familyName == "Times" || familyName == "Times New Roman")
             fontFamily = css_ff_serif;
@@ -1051,12 +1073,13 @@ bool LVFreeTypeFontManager::RegisterFont(lString8 name) {
         LVFontDef def(
                 name,
                 -1, // height==-1 for scalable fonts
-                (face->style_flags & FT_STYLE_FLAG_BOLD) ? 700 : 400,
-                (face->style_flags & FT_STYLE_FLAG_ITALIC) ? true : false,
+                face->bold ? 700 : 400,
+                face->italic,
                 fontFamily,
                 familyName,
                 index
         );
+        def.setCoverage(face->coverage);
 #if (DEBUG_FONT_MAN == 1)
         if ( _log ) {
             fprintf(_log, "registering font: (file=%s[%d], size=%d, weight=%d, italic=%d, family=%d, typeface=%s)\n",
@@ -1065,11 +1088,6 @@ bool LVFreeTypeFontManager::RegisterFont(lString8 name) {
         }
 #endif
 
-        if (face) {
-            FT_Done_Face(face);
-            face = NULL;
-        }
-
         if (_cache.findDuplicate(&def)) {
             CRLog::trace("font definition is duplicate");
             return false;
@@ -1088,9 +1106,6 @@ bool LVFreeTypeFontManager::RegisterFont(lString8 name) {
                 _cache.update( &newDef, LVFontRef(NULL) );
         }
         res = true;
-
-        if ( index >= num_faces - 1 )
-            break;
     }
 
     return res;
@@ -20,6 +20,8 @@
 #include "lvfontglyphcache.h"
 #include "lvfontdef.h"
 #include "lvfontcache.h"
+#include "lvfontscancache.h"
+#include "../../include/lvautoptr.h"
 
 #if (DEBUG_FONT_MAN == 1)
 #include <stdio.h>
@@ -35,6 +37,7 @@ private:
     lString8 _path;
     lString8 _fallbackFontFace;
     LVFontCache _cache;
+    LVFontScanCache _scanCache;
     FT_Library _library;
     LVFontGlobalGlyphCache _globalCache;
     lString16 _requiredChars;
@@ -114,6 +117,13 @@ public:
 
     bool checkCharSet(FT_Face face);
 
+    /// returns faces of font file from scan cache, or opens them; result not cached is owned by holder
+    LVFontScanFile * scanFontFile(const lString8 &fname, LVAutoPtr<LVFontScanFile> &holder);
+
+    virtual void SetFontScanCacheFile(lString16 fileName);
+
+    virtual void SaveFontScanCache();
+
     virtual bool checkFontLangCompat(const lString8 &typeface, const lString8 &langCode);
 
     //bool isMonoSpaced( FT_Face face );
@@ -761,7 +761,6 @@ void WOLWriter::addImage(
 )
 {
     int bmp_sz = (width * height * num_bits)>>3;
-    startCatalog();
 #if 0
     lUInt8 * inversed = NULL;
     if (num_bits==1)
@@ -798,25 +797,42 @@ void WOLWriter::addImage(
 */
 
 
-    int compressed_len = bmp_sz * 9/8 + 18;
-    lUInt8 * compressed = new lUInt8 [compressed_len];
+    LVArray<lUInt8> compressed;
+    encodeImage(bitmap, bmp_sz, compressed);
+    addEncodedImage(width, height, num_bits, compressed.get(), compressed.length());
+    //if (inversed)
+    //     delete inversed;
+}
+
+void WOLWriter::encodeImage( const lUInt8 * bitmap, int size, LVArray<lUInt8> & compressed )
+{
+    int compressed_len = size * 9/8 + 18;
+    compressed.clear();
+    compressed.addSpace( compressed_len );
 
     LZSSUtil packer;
-    packer.Encode(bitmap, bmp_sz, compressed, compressed_len);
+    packer.Encode(bitmap, size, compressed.get(), compressed_len);
 
     compressed[ compressed_len++ ] = 0; // extra last dummy char
+    if ( compressed.length() > compressed_len )
+        compressed.erase( compressed_len, compressed.length() - compressed_len );
 
 #if 0 //def _DEBUG_LOG
     LZSSUtil unpacker;
-    lUInt8 * decomp = new lUInt8 [bmp_sz*2];
+    lUInt8 * decomp = new lUInt8 [size*2];
     int decomp_len = 0;
-    unpacker.Decode(compressed, compressed_len-1, decomp, decomp_len);
-    assert(compressed_len==decomp_len);
+    unpacker.Decode(compressed.get(), compressed_len-1, decomp, decomp_len);
+    assert(size==decomp_len);
     for(int i=0; i<decomp_len; i++) {
         assert(bitmap[i]==decomp[i]);
     }
     delete[] decomp;
 #endif
+}
+
+void WOLWriter::addEncodedImage( int width, int height, int num_bits, const lUInt8 * compressed, int compressed_len )
+{
+    startCatalog();
 
     _page_starts.add( (lUInt32)_stream->GetPos() );
 
@@ -838,11 +854,6 @@ void WOLWriter::addImage(
     _stream->Write( compressed, compressed_len, NULL );
     endPage();
     *_stream << cs8("</img>");
-
-    // cleanup
-    delete[] compressed;
-    //if (inversed)
-    //     delete inversed;
 }
 
 void WOLWriter::endPage()
@@ -1020,3 +1031,119 @@ void WOLWriter::addCoverImage( LVGrayDrawBuf & image )
 #endif
 }
 
+class WOLPageEncoderTask : public CRRunnable {
+    WOLPageQueue * _queue;
+public:
+    WOLPageEncoderTask( WOLPageQueue * queue ) : _queue(queue) { }
+    virtual void run() { _queue->encodePages(); }
+};
+
+WOLPageQueue::WOLPageQueue( WOLWriter & writer, int threads, int maxPending )
+    : _writer(writer), _maxPending(maxPending > 0 ? maxPending : 1), _stopped(false), _pageCount(0)
+{
+    if ( !concurrencyProvider || threads < 1 )
+        return;
+    _monitor = concurrencyProvider->createMonitor();
+    for ( int i=0; i<threads; i++ ) {
+        WOLPageEncoderTask * task = new WOLPageEncoderTask( this );
+        CRThread * thread = concurrencyProvider->createThread( task );
+        _tasks.add( task );
+        _threads.add( thread );
+        thread->start();
+    }
+}
+
+WOLPageQueue::~WOLPageQueue()
+{
+    flush();
+    if ( !_monitor.isNull() ) {
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            _stopped = true;
+            _monitor->notifyAll();
+        }
+        for ( int i=0; i<_threads.length(); i++ )
+            _threads[i]->join();
+    }
+}
+
+void WOLPageQueue::encodePages()
+{
+    for (;;) {
+        Page * page = NULL;
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            for (;;) {
+                if ( _stopped )
+                    return;
+                for ( int i=0; i<_pages.length(); i++ ) {
+                    if ( !_pages[i]->started ) {
+                        page = _pages[i];
+                        page->started = true;
+                        break;
+                    }
+                }
+                if ( page )
+                    break;
+                _monitor->wait();
+            }
+        }
+        WOLWriter::encodeImage( page->bitmap.get(), page->bitmap.length(), page->compressed );
+        CRGuard guard(_monitor);
+        CR_UNUSED(guard);
+        page->bitmap.clear();
+        page->done = true;
+        _monitor->notifyAll();
+    }
+}
+
+void WOLPageQueue::writePages( int maxPending )
+{
+    for (;;) {
+        Page * page = NULL;
+        {
+            CRGuard guard(_monitor);
+            CR_UNUSED(guard);
+            while ( _pages.length() > maxPending && !_pages[0]->done )
+                _monitor->wait();
+            if ( _pages.length() == 0 || !_pages[0]->done )
+                return;
+            page = _pages.remove( 0 );
+        }
+        // stream is written on caller thread only, outside of lock
+        _writer.addEncodedImage( page->width, page->height, page->num_bits, page->compressed.get(), page->compressed.length() );
+        delete page;
+    }
+}
+
+void WOLPageQueue::addImage( LVGrayDrawBuf & image )
+{
+    _pageCount++;
+    int bmp_sz = (image.GetWidth() * image.GetHeight() * image.GetBitsPerPixel())>>3;
+    if ( _monitor.isNull() ) {
+        _writer.addImage( image );
+        return;
+    }
+    Page * page = new Page();
+    page->width = image.GetWidth();
+    page->height = image.GetHeight();
+    page->num_bits = image.GetBitsPerPixel();
+    page->bitmap.add( image.GetScanLine(0), bmp_sz );
+    page->started = false;
+    page->done = false;
+    writePages( _maxPending - 1 );
+    CRGuard guard(_monitor);
+    CR_UNUSED(guard);
+    _pages.add( page );
+    _monitor->notify();
+}
+
+void WOLPageQueue::flush()
+{
+    if ( !_monitor.isNull() )
+        writePages( 0 );
+}
+
+
@@ -45,28 +45,6 @@ static lString16 getDateTimeString( time_t t, int langId )
     return Utf8ToUnicode( lString8( str ) );
 }
 
-lString16 extractDocSeriesReverse( ldomDocument * doc )
-{
-    lString16 res;
-    ldomXPointer p = doc->createXPointer(L"/FictionBook/description/title-info/sequence");
-    if ( p.isNull() )
-        return res;
-    ldomNode * series = p.getNode();
-    if ( series ) {
-        lString16 sname = series->getAttributeValue( attr_name );
-        lString16 snumber = series->getAttributeValue( attr_number );
-        if ( !sname.empty() ) {
-            res << "(";
-            if ( !snumber.empty() )
-                res << "#" << snumber << L" ";
-            res << sname;
-            res << ")";
-        }
-    }
-    return res;
-}
-
-
 int GetBookProperties(char *name,  struct BookProperties* pBookProps, int localLanguage)
 {
     CRLog::trace("GetBookProperties( %s )", name);
@@ -137,36 +115,20 @@ int GetBookProperties(char *name,  struct BookProperties* pBookProps, int localL
 
 #endif //USE_ZLIB
 
-    // read document
-#if COMPACT_DOM==1
-    ldomDocument doc(stream, 0);
-#else
-    ldomDocument doc;
-#endif
-    ldomDocumentWriter writer(&doc, true);
-    doc.setNodeTypes( fb2_elem_table );
-    doc.setAttributeTypes( fb2_attr_table );
-    doc.setNameSpaceTypes( fb2_ns_table );
-    LVXMLParser parser( stream, &writer );
-    CRLog::trace( "checking format..." );
-    if ( !parser.CheckFormat() ) {
+    // read <description> only
+    LVDocMetadata metadata;
+    if ( !LVParseFB2Metadata( stream, metadata ) ) {
         return 0;
     }
-    CRLog::trace( "parsing..." );
-    if ( !parser.Parse() ) {
-        return 0;
+    lString16 authors = metadata.getAuthors();
+    lString16 title = metadata.title;
+    lString16 series;
+    if ( !metadata.series.empty() ) {
+        series << "(";
+        if ( metadata.seriesNumber >= 0 )
+            series << "#" << fmt::decimal(metadata.seriesNumber) << " ";
+        series << metadata.series << ")";
     }
-    CRLog::trace( "parsed" );
-    #if 0
-        char ofname[512];
-        sprintf(ofname, "%s.xml", name);
-        CRLog::trace("    writing to file %s", ofname);
-        LVStreamRef out = LVOpenFileStream(ofname, LVOM_WRITE);
-        doc.saveToStream(out, "utf16");
-    #endif
-    lString16 authors = extractDocAuthors( &doc );
-    lString16 title = extractDocTitle( &doc );
-    lString16 series = extractDocSeriesReverse( &doc );
 #if SERIES_IN_AUTHORS==1
     if ( !series.empty() )
         authors << "    " << series;
@@ -1039,6 +1039,9 @@ void chm_close(struct chmFile *h)
  *                 caching scheme is used, wherein the index of the block is
  *                 used as a hash value, and hash collision results in the
  *                 invalidation of the previously cached block.
+ *          CHM_PARAM_MAX_CACHE_SIZE:
+ *                 same as above, but limited by size of decompressed
+ *                 blocks in bytes; never less than CHM_MAX_BLOCKS_CACHED.
  */
 void chm_set_param(struct chmFile *h,
                    int paramType,
@@ -1101,6 +1104,16 @@ void chm_set_param(struct chmFile *h,
             CHM_RELEASE_LOCK(h->cache_mutex);
             break;
 
+        case CHM_PARAM_MAX_CACHE_SIZE:
+            if (h->compression_enabled && h->reset_table.block_len > 0)
+            {
+                int blocks = (int)(paramVal / h->reset_table.block_len);
+                if (blocks < CHM_MAX_BLOCKS_CACHED)
+                    blocks = CHM_MAX_BLOCKS_CACHED;
+                chm_set_param(h, CHM_PARAM_MAX_BLOCKS_CACHED, blocks);
+            }
+            break;
+
         default:
             break;
     }
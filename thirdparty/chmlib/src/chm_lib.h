@@ -113,6 +113,7 @@ void chm_close(struct chmFile *h);
 
 /* methods for ssetting tuning parameters for particular file */
 #define CHM_PARAM_MAX_BLOCKS_CACHED 0
+#define CHM_PARAM_MAX_CACHE_SIZE 1
 void chm_set_param(struct chmFile *h,
                    int paramType,
                    int paramVal);
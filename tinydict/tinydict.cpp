@@ -13,6 +13,16 @@
 #include <stdlib.h>
 #include "tinydict.h"
 
+#ifdef _WIN32
+#define TINYDICT_USE_MMAP 0
+#else
+#define TINYDICT_USE_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 
 /// add word to list
 void TinyDictWordList::add( TinyDictWord * word )
@@ -77,11 +87,118 @@ public:
     }
 };
 
+/*
+    Binary index file format (.tdx), all numbers are little endian 32 bit:
+
+        magic "TDX1"
+        source .index file size, to detect outdated binary index
+        word count
+        string pool size
+        word count * { word offset in string pool, article start, article size }, sorted by word (strcmp)
+        string pool: zero terminated words
+*/
+#define TINYDICT_BIN_INDEX_EXT ".tdx"
+#define TINYDICT_BIN_INDEX_MAGIC "TDX1"
+#define TINYDICT_BIN_INDEX_HEADER_SIZE 16
+#define TINYDICT_BIN_INDEX_ENTRY_SIZE 12
+
+static inline unsigned getU32( const unsigned char * p )
+{
+    return (((((((unsigned)p[3]) << 8) + p[2]) << 8) + p[1]) << 8) + p[0];
+}
+
+static inline void putU32( unsigned char * p, unsigned n )
+{
+    p[0] = (unsigned char)(n & 0xFF);
+    p[1] = (unsigned char)((n >> 8) & 0xFF);
+    p[2] = (unsigned char)((n >> 16) & 0xFF);
+    p[3] = (unsigned char)((n >> 24) & 0xFF);
+}
+
+/// read-only file mapped to memory (read into heap buffer if mmap is not available)
+class TinyDictMappedFile
+{
+    unsigned char * data;
+    size_t size;
+public:
+    TinyDictMappedFile() : data(NULL), size(0) { }
+    ~TinyDictMappedFile() { close(); }
+    const unsigned char * getData() const { return data; }
+    size_t getSize() const { return size; }
+    bool open( const char * filename )
+    {
+        close();
+#if TINYDICT_USE_MMAP==1
+        int fd = ::open( filename, O_RDONLY );
+        if ( fd < 0 )
+            return false;
+        struct stat st;
+        if ( fstat( fd, &st ) || st.st_size <= 0 ) {
+            ::close( fd );
+            return false;
+        }
+        void * p = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        ::close( fd );
+        if ( p == MAP_FAILED )
+            return false;
+        data = (unsigned char *)p;
+        size = (size_t)st.st_size;
+#else
+        FILE * f = fopen( filename, "rb" );
+        if ( !f )
+            return false;
+        if ( fseek( f, 0, SEEK_END ) ) {
+            fclose( f );
+            return false;
+        }
+        long sz = ftell( f );
+        if ( sz <= 0 || fseek( f, 0, SEEK_SET ) ) {
+            fclose( f );
+            return false;
+        }
+        data = (unsigned char *)malloc( sz );
+        size = (size_t)sz;
+        if ( fread( data, 1, size, f ) != size ) {
+            fclose( f );
+            close();
+            return false;
+        }
+        fclose( f );
+#endif
+        return true;
+    }
+    void close()
+    {
+        if ( data ) {
+#if TINYDICT_USE_MMAP==1
+            munmap( data, size );
+#else
+            free( data );
+#endif
+        }
+        data = NULL;
+        size = 0;
+    }
+};
+
 class TinyDictIndexFile : public TinyDictFileBase
 {
     int    factor;
     int    count;
     TinyDictWordList list;
+    /// prebuilt binary index, if available
+    TinyDictMappedFile bin;
+    const unsigned char * binEntries;
+    const char * binPool;
+    unsigned binPoolSize;
+
+    bool openBinary( const char * filename, size_t sourceSize );
+    const char * getBinWord( unsigned n ) const
+    {
+        unsigned offset = getU32( binEntries + n * TINYDICT_BIN_INDEX_ENTRY_SIZE );
+        return offset < binPoolSize ? binPool + offset : "";
+    }
+    bool findBinary( const char * prefix, bool exactMatch, TinyDictWordList & words );
 public:
 
 	void compact()
@@ -91,7 +208,7 @@ public:
 
     bool find( const char * prefix, bool exactMatch, TinyDictWordList & words );
 
-    TinyDictIndexFile() : factor( 16 ), count(0)
+    TinyDictIndexFile() : factor( 16 ), count(0), binEntries(NULL), binPool(NULL), binPoolSize(0)
     {
     }
 
@@ -99,6 +216,15 @@ public:
     {
     }
 
+    virtual void close()
+    {
+        TinyDictFileBase::close();
+        bin.close();
+        binEntries = NULL;
+        binPool = NULL;
+        binPoolSize = 0;
+    }
+
     bool open( const char * filename );
 
 };
@@ -138,6 +264,18 @@ public:
     }
 };
 
+/// number of inflated dictzip chunks kept in memory
+#define TINYDICT_CHUNK_CACHE_SIZE 8
+
+/// inflated dictzip chunk
+struct TinyDictChunk
+{
+    unsigned index;
+    unsigned char * buf;
+    unsigned len;
+    unsigned lastUse;
+};
+
 class TinyDictZStream
 {
     FILE * f;
@@ -162,10 +300,10 @@ class TinyDictZStream
     bool     zInitialized;
     z_stream zStream;
     unsigned packed_size;
-    unsigned char * unp_buffer;
-    unsigned unp_buffer_start;
-    unsigned unp_buffer_len;
-    unsigned unp_buffer_size;
+
+    /// LRU cache of inflated chunks
+    TinyDictChunk cache[ TINYDICT_CHUNK_CACHE_SIZE ];
+    unsigned useCounter;
 
     unsigned int readBytes( unsigned char * buf, unsigned size )
     {
@@ -213,7 +351,9 @@ class TinyDictZStream
 
     bool zclose();
 
-    bool readChunk( unsigned n );
+    bool readChunk( unsigned n, TinyDictChunk * chunk );
+    /// returns inflated chunk from cache, reading it if necessary
+    const TinyDictChunk * getChunk( unsigned n );
 
 public:
 	/// minimize memory consumption
@@ -388,9 +528,34 @@ bool TinyDictWord::match( const char * str, bool exact ) const
     return str[i]==0;
 }
 
+bool TinyDictIndexFile::findBinary( const char * prefix, bool exactMatch, TinyDictWordList & words )
+{
+    // lower bound: first word >= prefix
+    unsigned a = 0;
+    unsigned b = (unsigned)count;
+    while ( a < b ) {
+        unsigned c = (a + b) / 2;
+        if ( strcmp( getBinWord( c ), prefix ) < 0 )
+            a = c + 1;
+        else
+            b = c;
+    }
+    size_t prefixLen = strlen( prefix );
+    for ( unsigned n = a; n < (unsigned)count; n++ ) {
+        const char * word = getBinWord( n );
+        if ( exactMatch ? strcmp( word, prefix ) != 0 : strncmp( word, prefix, prefixLen ) != 0 )
+            break;
+        const unsigned char * entry = binEntries + n * TINYDICT_BIN_INDEX_ENTRY_SIZE;
+        words.add( new TinyDictWord( n, 0, getU32( entry + 4 ), getU32( entry + 8 ), word ) );
+    }
+    return true;
+}
+
 bool TinyDictIndexFile::find( const char * prefix, bool exactMatch, TinyDictWordList & words )
 {
     words.clear();
+    if ( binEntries )
+        return findBinary( prefix, exactMatch, words );
     int n = list.find( prefix );
     if ( n<0 )
         return false;
@@ -414,6 +579,32 @@ bool TinyDictIndexFile::find( const char * prefix, bool exactMatch, TinyDictWord
     return true;
 }
 
+bool TinyDictIndexFile::openBinary( const char * filename, size_t sourceSize )
+{
+    if ( !bin.open( filename ) )
+        return false;
+    const unsigned char * data = bin.getData();
+    size_t sz = bin.getSize();
+    if ( sz < TINYDICT_BIN_INDEX_HEADER_SIZE || memcmp( data, TINYDICT_BIN_INDEX_MAGIC, 4 ) ) {
+        bin.close();
+        return false;
+    }
+    unsigned wordCount = getU32( data + 8 );
+    unsigned poolSize = getU32( data + 12 );
+    if ( (size_t)TINYDICT_BIN_INDEX_HEADER_SIZE + (size_t)wordCount * TINYDICT_BIN_INDEX_ENTRY_SIZE + poolSize != sz
+         || ( sourceSize && getU32( data + 4 ) != (unsigned)sourceSize ) ) {
+        printf("binary index %s is outdated or corrupted\n", filename);
+        bin.close();
+        return false;
+    }
+    count = (int)wordCount;
+    binEntries = data + TINYDICT_BIN_INDEX_HEADER_SIZE;
+    binPool = (const char *)(binEntries + (size_t)wordCount * TINYDICT_BIN_INDEX_ENTRY_SIZE);
+    binPoolSize = poolSize;
+    printf("%d words in binary index %s\n", count, filename);
+    return true;
+}
+
 bool TinyDictIndexFile::open( const char * filename )
 {
     close();
@@ -422,8 +613,10 @@ bool TinyDictIndexFile::open( const char * filename )
     if ( !fname )
         return false;
     f = fopen( fname, "rb" );
-    if ( !f )
-        return false;
+    if ( !f ) {
+        // binary index may be used without text index
+        return openBinary( fname, 0 );
+    }
     if ( fseek( f, 0, SEEK_END ) ) {
         close();
         return false;
@@ -433,6 +626,27 @@ bool TinyDictIndexFile::open( const char * filename )
         close();
         return false;
     }
+    unsigned char magic[4];
+    if ( fread( magic, 1, 4, f ) == 4 && !memcmp( magic, TINYDICT_BIN_INDEX_MAGIC, 4 ) ) {
+        // binary index file passed directly
+        TinyDictFileBase::close();
+        return openBinary( fname, 0 );
+    }
+    // use up to date prebuilt binary index if any
+    size_t len = strlen( fname );
+    char * binname = (char *)malloc( len + sizeof(TINYDICT_BIN_INDEX_EXT) );
+    memcpy( binname, fname, len );
+    memcpy( binname + len, TINYDICT_BIN_INDEX_EXT, sizeof(TINYDICT_BIN_INDEX_EXT) );
+    bool binFound = openBinary( binname, size );
+    free( binname );
+    if ( binFound ) {
+        TinyDictFileBase::close();
+        return true;
+    }
+    if ( fseek( f, 0, SEEK_SET ) ) {
+        close();
+        return false;
+    }
     // test
     TinyDictWord * p;
     count = 0;
@@ -450,6 +664,86 @@ bool TinyDictIndexFile::open( const char * filename )
     return true;
 }
 
+static int compareIndexWords( const void * a, const void * b )
+{
+    const TinyDictWord * w1 = *(const TinyDictWord * const *)a;
+    const TinyDictWord * w2 = *(const TinyDictWord * const *)b;
+    int res = strcmp( w1->getWord(), w2->getWord() );
+    if ( res )
+        return res;
+    // keep original order of duplicates
+    return w1->getIndex() < w2->getIndex() ? -1 : ( w1->getIndex() > w2->getIndex() ? 1 : 0 );
+}
+
+bool TinyDictionary::buildBinaryIndex( const char * indexfile, const char * binindexfile )
+{
+    FILE * f = fopen( indexfile, "rb" );
+    if ( !f )
+        return false;
+    TinyDictWordList words;
+    size_t poolSize = 0;
+    for ( unsigned index=0; ; index++ ) {
+        TinyDictWord * p = TinyDictWord::read( f, index );
+        if ( !p )
+            break;
+        poolSize += strlen( p->getWord() ) + 1;
+        words.add( p );
+    }
+    unsigned sourceSize = (unsigned)ftell( f );
+    if ( !fseek( f, 0, SEEK_END ) )
+        sourceSize = (unsigned)ftell( f );
+    fclose( f );
+    if ( !words.length() )
+        return false;
+    // sort pointers in place: TinyDictWordList has no sort
+    TinyDictWord ** sorted = (TinyDictWord **)malloc( sizeof(TinyDictWord *) * words.length() );
+    for ( int i=0; i<words.length(); i++ )
+        sorted[i] = words.get( i );
+    qsort( sorted, words.length(), sizeof(TinyDictWord *), compareIndexWords );
+
+    size_t len = strlen( indexfile );
+    char * outname = NULL;
+    if ( !binindexfile ) {
+        outname = (char *)malloc( len + sizeof(TINYDICT_BIN_INDEX_EXT) );
+        memcpy( outname, indexfile, len );
+        memcpy( outname + len, TINYDICT_BIN_INDEX_EXT, sizeof(TINYDICT_BIN_INDEX_EXT) );
+        binindexfile = outname;
+    }
+    FILE * out = fopen( binindexfile, "wb" );
+    bool res = out != NULL;
+    if ( out ) {
+        unsigned char buf[TINYDICT_BIN_INDEX_HEADER_SIZE];
+        memcpy( buf, TINYDICT_BIN_INDEX_MAGIC, 4 );
+        putU32( buf + 4, sourceSize );
+        putU32( buf + 8, (unsigned)words.length() );
+        putU32( buf + 12, (unsigned)poolSize );
+        res = fwrite( buf, 1, TINYDICT_BIN_INDEX_HEADER_SIZE, out ) == TINYDICT_BIN_INDEX_HEADER_SIZE;
+        unsigned offset = 0;
+        for ( int i=0; res && i<words.length(); i++ ) {
+            unsigned char entry[TINYDICT_BIN_INDEX_ENTRY_SIZE];
+            putU32( entry, offset );
+            putU32( entry + 4, sorted[i]->getStart() );
+            putU32( entry + 8, sorted[i]->getSize() );
+            res = fwrite( entry, 1, TINYDICT_BIN_INDEX_ENTRY_SIZE, out ) == TINYDICT_BIN_INDEX_ENTRY_SIZE;
+            offset += (unsigned)strlen( sorted[i]->getWord() ) + 1;
+        }
+        for ( int i=0; res && i<words.length(); i++ ) {
+            size_t wlen = strlen( sorted[i]->getWord() ) + 1;
+            res = fwrite( sorted[i]->getWord(), 1, wlen, out ) == wlen;
+        }
+        if ( fclose( out ) )
+            res = false;
+    }
+    if ( res )
+        printf("%d words written to binary index %s\n", words.length(), binindexfile);
+    else
+        printf("cannot write binary index %s\n", binindexfile);
+    free( sorted );
+    if ( outname )
+        free( outname );
+    return res;
+}
+
 enum { 
     DICT_TEXT,
     DICT_GZIP,
@@ -487,22 +781,46 @@ bool TinyDictZStream::zclose()
 
 void TinyDictZStream::compact()
 {
-	if ( unp_buffer ) {
-		free( unp_buffer );
-		unp_buffer_start = unp_buffer_len = unp_buffer_size = 0;
-		unp_buffer = NULL;
-	}
+    for ( int i=0; i<TINYDICT_CHUNK_CACHE_SIZE; i++ ) {
+        if ( cache[i].buf )
+            free( cache[i].buf );
+        cache[i].buf = NULL;
+        cache[i].len = 0;
+        cache[i].lastUse = 0;
+    }
 }
 
-bool TinyDictZStream::readChunk( unsigned n )
+const TinyDictChunk * TinyDictZStream::getChunk( unsigned n )
+{
+    // look up cached chunk, or choose least recently used slot to replace
+    TinyDictChunk * victim = cache;
+    for ( int i=0; i<TINYDICT_CHUNK_CACHE_SIZE; i++ ) {
+        TinyDictChunk * p = cache + i;
+        if ( p->buf && p->lastUse && p->index == n ) {
+            p->lastUse = ++useCounter;
+            return p;
+        }
+        if ( !p->lastUse ) {
+            victim = p;
+            break;
+        }
+        if ( p->lastUse < victim->lastUse )
+            victim = p;
+    }
+    victim->lastUse = 0;
+    if ( !readChunk( n, victim ) )
+        return NULL;
+    victim->index = n;
+    victim->lastUse = ++useCounter;
+    return victim;
+}
+
+bool TinyDictZStream::readChunk( unsigned n, TinyDictChunk * chunk )
 {
     if ( n >= chunkCount )
         return false;
-    if ( !unp_buffer ) {
-        unp_buffer = (unsigned char *)malloc( sizeof(unsigned char)*chunkLength );
-        unp_buffer_size = chunkLength;
-    }
-    unp_buffer_start = n * chunkLength;
+    if ( !chunk->buf )
+        chunk->buf = (unsigned char *)malloc( sizeof(unsigned char)*chunkLength );
 
     if ( fseek( f, offsets[ n ], SEEK_SET ) ) {
         printf( "cannot seek to %d position\n", offsets[n] );
@@ -526,13 +844,11 @@ bool TinyDictZStream::readChunk( unsigned n )
         //return false;
     }
     zclose();
-    if ( !zinit(tmp, packsz, unp_buffer, unp_buffer_size) ) {
+    if ( !zinit(tmp, packsz, chunk->buf, chunkLength) ) {
         printf("cannot init deflater\n");
         return false;
     }
-    printf("unpacking %d bytes\n", packsz);
     int err = inflate( &zStream,  Z_PARTIAL_FLUSH );
-    printf("inflate result: %d\n", err);
     if ( err != Z_OK ) {
         printf("Inflate error %s (%d). avail_in=%d, avail_out=%d \n", zStream.msg, err, (int)zStream.avail_in, (int)zStream.avail_out);
         free( tmp );
@@ -543,15 +859,11 @@ bool TinyDictZStream::readChunk( unsigned n )
         free( tmp );
         return false;
     }
-    unp_buffer_len = unp_buffer_size - zStream.avail_out;
+    chunk->len = chunkLength - zStream.avail_out;
 
-    printf("freeing tmp\n");
     free( tmp );
-    printf("done\n");
-
-
 
-    if ( n < chunkCount-1 && unp_buffer_len!=chunkLength ) {
+    if ( n < chunkCount-1 && chunk->len!=chunkLength ) {
         printf("wrong chunk length\n");
         return false; // too short chunk data
     }
@@ -563,46 +875,42 @@ bool TinyDictZStream::readChunk( unsigned n )
 
 bool TinyDictZStream::read( unsigned char * buf, unsigned start, unsigned len )
 {
-    if ( start >= unp_buffer_start && start < unp_buffer_start + unp_buffer_len ) {
-        unsigned readyBytes = unp_buffer_len - (start-unp_buffer_start);
+    if ( !chunkLength )
+        return false;
+    // article may span several chunks
+    while ( len ) {
+        unsigned n = start / chunkLength;
+        const TinyDictChunk * chunk = getChunk( n );
+        if ( !chunk )
+            return false;
+        unsigned offset = start - n * chunkLength;
+        if ( offset >= chunk->len )
+            return false;
+        unsigned readyBytes = chunk->len - offset;
         if ( readyBytes > len )
             readyBytes = len;
-        memcpy( buf, unp_buffer + (start-unp_buffer_start), readyBytes );
+        memcpy( buf, chunk->buf + offset, readyBytes );
         buf += readyBytes;
         start += readyBytes;
         len -= readyBytes;
-        if ( !len )
-            return true;
     }
-    unsigned n = start / chunkLength;
-    if ( !readChunk( n ) )
-        return false;
-    unsigned readyBytes = unp_buffer_len - (start-unp_buffer_start);
-    if ( readyBytes > len )
-        readyBytes = len;
-    memcpy( buf, unp_buffer + (start-unp_buffer_start), readyBytes );
-    buf += readyBytes;
-    start += readyBytes;
-    len -= readyBytes;
-    if ( !len )
-        return true;
-    return false;
+    return true;
 }
 
 TinyDictZStream::TinyDictZStream()
 : f ( NULL ), size( 0 ), txtpos(0)
 , headerLength(0), error( false )
 , chunks(NULL), offsets(NULL), chunkLength(0), chunkCount(0)
-, zInitialized(false), packed_size(0), unp_buffer(NULL), unp_buffer_start(0), unp_buffer_len(0), unp_buffer_size(0)
+, zInitialized(false), packed_size(0), useCounter(0)
 {
     memset( &zStream, 0, sizeof(zStream) );
+    memset( cache, 0, sizeof(cache) );
 }
 
 TinyDictZStream::~TinyDictZStream()
 {
     zclose();
-    if ( unp_buffer )
-        free( unp_buffer );
+    compact();
     if ( chunks )
         delete [] chunks;
     if ( offsets )
@@ -707,13 +1015,13 @@ bool TinyDictZStream::open( FILE * file )
         return false;
     }
 
-    if ( !readChunk( chunkCount-1 ) ) {
+    const TinyDictChunk * last = chunkCount ? getChunk( chunkCount-1 ) : NULL;
+    if ( !last ) {
         printf("Error reading chunk %d\n", chunkCount-1 );
         return false;
     }
-    size = unp_buffer_start + unp_buffer_len;
+    size = (chunkCount-1) * chunkLength + last->len;
 
-	compact();
     return true;
 }
 
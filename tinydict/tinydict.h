@@ -63,6 +63,7 @@ class TinyDictWord
     unsigned start;
     unsigned size;
     char * word;
+    friend class TinyDictIndexFile;
     TinyDictWord( unsigned _index, unsigned _indexpos, unsigned _start, unsigned _size, const char * _word )
     : index(_index)
     , indexpos(_indexpos)
@@ -146,8 +147,10 @@ public:
 	//TinyDictIndexFile * getIndex() { return index; }
 	/// minimize memory usage
 	void compact();
-	/// open dictonary from files
+	/// open dictonary from files; prebuilt binary index indexfile.tdx is used instead of indexfile when up to date
 	bool open( const char * indexfile, const char * datafile );
+	/// convert text .index file to sorted binary index (indexfile.tdx if binindexfile is NULL)
+	static bool buildBinaryIndex( const char * indexfile, const char * binindexfile = NULL );
 	/// empty dictinary constructor
 	TinyDictionary();
 	/// destructor
@@ -0,0 +1,26 @@
+/** \file tinydictconv.cpp
+    \brief converts .index files of .dict dictionaries to binary .tdx index
+
+    usage: tinydictconv <file.index> [<file.index.tdx>]
+
+    This source code is distributed under the terms of
+    GNU General Public License.
+
+    See LICENSE file for details.
+
+*/
+
+#include "tinydict.h"
+
+int main( int argc, const char * * argv )
+{
+    if ( argc < 2 || argc > 3 ) {
+        printf("usage: tinydictconv <file.index> [<file.index.tdx>]\n");
+        return 1;
+    }
+    if ( !TinyDictionary::buildBinaryIndex( argv[1], argc > 2 ? argv[2] : NULL ) ) {
+        printf("cannot convert index file %s\n", argv[1]);
+        return 2;
+    }
+    return 0;
+}